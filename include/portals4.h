@@ -69,11 +69,27 @@ typedef enum {
     PTL_SR_PERMISSION_VIOLATIONS, /*!< Specifies the status register that
                                     * counts the number of attempted permission
                                     * violations. */
-    PTL_SR_OPERATION_VIOLATIONS   /*!< Specifies the status register that counts
+    PTL_SR_OPERATION_VIOLATIONS,  /*!< Specifies the status register that counts
                                     * the number of attempted operation
                                     * violations. */
+    PTL_SR_MR_CACHE_HITS,         /*!< Specifies the status register that counts
+                                    * the memory registrations found in the
+                                    * registration cache. This is an
+                                    * extension to the Portals 4
+                                    * specification. */
+    PTL_SR_MR_CACHE_MISSES,       /*!< Specifies the status register that counts
+                                    * the memory registrations that had to be
+                                    * created. This is an extension to the
+                                    * Portals 4 specification. */
+    PTL_SR_MR_CACHE_EVICTIONS     /*!< Specifies the status register that counts
+                                    * the unused memory registrations dropped
+                                    * from the registration cache to keep it
+                                    * within its limits, or because the
+                                    * application unmapped their memory. This
+                                    * is an extension to the Portals 4
+                                    * specification. */
 } ptl_sr_index_t;
-#define PTL_SR_LAST (PTL_SR_OPERATION_VIOLATIONS + 1)
+#define PTL_SR_LAST (PTL_SR_MR_CACHE_EVICTIONS + 1)
 typedef int ptl_sr_value_t;             /*!< Signed integral type that defines
                                          * the types of values held in status
                                          * registers. */
@@ -2950,6 +2966,91 @@ int PtlEQPoll(const ptl_handle_eq_t *eq_handles,
               ptl_time_t             timeout,
               ptl_event_t           *event,
               unsigned int          *which);
+/*!
+ * @fn PtlEQGetMany(ptl_handle_eq_t eq_handle,
+ *                  unsigned int    count,
+ *                  ptl_event_t    *events,
+ *                  unsigned int   *num_events)
+ * @brief Get the next events from an event queue.
+ * @details A nonblocking function that behaves like PtlEQGet(), except that
+ *      up to \a count consecutive events are removed from the queue and
+ *      returned at once.
+ * @note This is an extension to the Portals 4 specification.
+ * @param[in] eq_handle     The event queue handle.
+ * @param[in] count         Length of the \a events array.
+ * @param[out] events       On successful return, this array will hold the
+ *                          next events in the event queue, oldest first.
+ * @param[out] num_events   On successful return, this location will hold
+ *                          the number of events stored in \a events.
+ * @retval PTL_OK           Indicates success
+ * @retval PTL_NO_INIT      Indicates that the portals API has not been
+ *                          successfully initialized.
+ * @retval PTL_ARG_INVALID  Indicates that \a eq_handle is not a valid event
+ *                          queue handle or that \a count is 0.
+ * @retval PTL_EQ_EMPTY     Indicates that \a eq_handle is empty.
+ * @retval PTL_EQ_DROPPED   Indicates success (i.e., events are returned) and
+ *                          that at least one event between the first
+ *                          returned event and the last event obtained from
+ *                          this event queue has been dropped due to limited
+ *                          space in the event queue.
+ * @see PtlEQGet(), PtlEQPollMany()
+ */
+int PtlEQGetMany(ptl_handle_eq_t eq_handle,
+                 unsigned int    count,
+                 ptl_event_t    *events,
+                 unsigned int   *num_events);
+/*!
+ * @fn PtlEQPollMany(const ptl_handle_eq_t *eq_handles,
+ *                   unsigned int           size,
+ *                   ptl_time_t             timeout,
+ *                   unsigned int           count,
+ *                   ptl_event_t           *events,
+ *                   unsigned int          *num_events,
+ *                   unsigned int          *which)
+ * @brief Poll for new events on multiple event queues.
+ * @details Behaves like PtlEQPoll(), except that once an event is found in
+ *      one of the event queues, up to \a count consecutive events are
+ *      removed from that queue and returned at once.
+ * @note This is an extension to the Portals 4 specification.
+ * @param[in] eq_handles    An array of event queue handles. All the handles
+ *                          must refer to the same interface.
+ * @param[in] size          Length of the \a eq_handles array.
+ * @param[in] timeout       Time in milliseconds to wait for an event to occur
+ *                          in one of the event queue handles. The constant \c
+ *                          PTL_TIME_FOREVER can be used to indicate an
+ *                          infinite timeout.
+ * @param[in] count         Length of the \a events array.
+ * @param[out] events       On successful return (\c PTL_OK or \c
+ *                          PTL_EQ_DROPPED), this array will hold the next
+ *                          events in the queue, oldest first.
+ * @param[out] num_events   On successful return, this location will hold
+ *                          the number of events stored in \a events.
+ * @param[out] which        On successful return, this location will contain
+ *                          the index into \a eq_handles of the event queue
+ *                          from which the events were taken.
+ * @retval PTL_OK               Indicates success
+ * @retval PTL_NO_INIT          Indicates that the portals API has not been
+ *                              successfully initialized.
+ * @retval PTL_ARG_INVALID      Indicates that an invalid argument was passed.
+ *                              The definition of which arguments are checked
+ *                              is implementation dependent.
+ * @retval PTL_EQ_EMPTY         Indicates that the timeout has been reached and
+ *                              all of the event queues are empty.
+ * @retval PTL_EQ_DROPPED       Indicates success (i.e., events are returned)
+ *                              and that at least one event between the first
+ *                              returned event and the last event obtained
+ *                              from the event queue indicated by \a which has
+ *                              been dropped due to limited space in the event
+ *                              queue.
+ * @see PtlEQPoll(), PtlEQGetMany()
+ */
+int PtlEQPollMany(const ptl_handle_eq_t *eq_handles,
+                  unsigned int           size,
+                  ptl_time_t             timeout,
+                  unsigned int           count,
+                  ptl_event_t           *events,
+                  unsigned int          *num_events,
+                  unsigned int          *which);
 /*! @} */
 
 /************************
@@ -1377,7 +1377,9 @@ static void do_OP_PtlPTEnable(ppebuf_t *buf)
 
 static void do_OP_PtlAtomicSync(ppebuf_t *buf)
 {
-    buf->msg.ret = _PtlAtomicSync();
+    struct client *client = buf->cookie;
+
+    buf->msg.ret = _PtlAtomicSync(&client->gbl);
 }
 
 static void do_OP_PtlCTCancelTriggered(ppebuf_t *buf)
@@ -1458,6 +1460,10 @@ static void *ppe_progress(void *arg)
         ppebuf_t *ppebuf;
         buf_t *mem_buf;
 
+        /* Wake up the clients waiting on EQs and CTs once the
+         * messages received are fully processed. */
+        ptl_wait_defer();
+
 #if WITH_TRANSPORT_IB
         /* Infiniband. Walking the list of active NIs to find work. */
         ni_t *ni;
@@ -1525,6 +1531,8 @@ static void *ppe_progress(void *arg)
             buf_put(mem_buf);
         }
 
+        ptl_wait_flush();
+
         /* TODO: don't spin if we got messages. */
         SPINLOCK_BODY();
     }
@@ -1552,6 +1560,8 @@ int gbl_init(gbl_t *gbl)
     if (err)
         return err;
 
+    atomic_simd_init();
+
     pthread_mutex_init(&gbl->gbl_mutex, NULL);
 
     /* for PtlAbort */
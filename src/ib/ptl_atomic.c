@@ -2040,3 +2040,281 @@ int swap_data_in(ptl_op_t atom_op, ptl_datatype_t atom_type, void *dest,
 
     return PTL_OK;
 }
+
+/*
+ * Single elements of up to 8 bytes are updated with the CPU atomics,
+ * without any lock. Longer operations, and the types the CPU cannot
+ * handle, lock the stripes covering the target buffer instead.
+ *
+ * An element updated by a locked operation must not be updated
+ * natively at the same time. So the native operations announce
+ * themselves in the stripe of their element, and fall back to its
+ * lock while a locked operation holds it.
+ */
+
+/* Number of stripes; a set of stripes fits in a 64 bits mask. */
+#define ATOMIC_STRIPES		(64)
+
+/* Each stripe covers that many bytes (as a shift), repeating. */
+#define ATOMIC_STRIPE_SHIFT	(6)
+
+struct atomic_stripe {
+    pthread_mutex_t lock;
+    atomic_t locked;            /* held by a locked operation */
+    atomic_t native;            /* native operations in progress */
+} __attribute__ ((aligned(64)));
+
+static struct atomic_stripe atomic_stripe[ATOMIC_STRIPES] = {
+    [0 ... ATOMIC_STRIPES - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER},
+};
+
+static inline unsigned int stripe_index(const void *addr)
+{
+    return ((uintptr_t) addr >> ATOMIC_STRIPE_SHIFT) % ATOMIC_STRIPES;
+}
+
+/**
+ * Whether a datatype is an integer.
+ *
+ * @param atom_type the datatype
+ *
+ * @return non-zero for integers
+ */
+static inline int type_is_integer(ptl_datatype_t atom_type)
+{
+    return atom_type < PTL_FLOAT || atom_type == PTL_INT64_T ||
+        atom_type == PTL_UINT64_T;
+}
+
+/*
+ * The native operations load the target, compute the new value with
+ * the regular functions, and compare and swap it until no other
+ * update came in between. Integer sums and bitwise operations, and
+ * plain swaps, map to a single instruction instead.
+ */
+#define NATIVE_OP(bits)							\
+static int native_##bits(ptl_op_t op, ptl_datatype_t atom_type,	\
+                         uint##bits##_t *dst, const void *src,		\
+                         datatype_t *operand, void *fetch)		\
+{									\
+    uint##bits##_t val;							\
+    uint##bits##_t old;							\
+    uint##bits##_t new;							\
+    int err;								\
+									\
+    memcpy(&val, src, sizeof(val));					\
+									\
+    if (op == PTL_SWAP) {						\
+        old = __atomic_exchange_n(dst, val, __ATOMIC_SEQ_CST);		\
+        goto done;							\
+    }									\
+									\
+    if (type_is_integer(atom_type)) {					\
+        switch (op) {							\
+            case PTL_SUM:						\
+                old = __atomic_fetch_add(dst, val, __ATOMIC_SEQ_CST);	\
+                goto done;						\
+            case PTL_BOR:						\
+                old = __atomic_fetch_or(dst, val, __ATOMIC_SEQ_CST);	\
+                goto done;						\
+            case PTL_BAND:						\
+                old = __atomic_fetch_and(dst, val, __ATOMIC_SEQ_CST);	\
+                goto done;						\
+            case PTL_BXOR:						\
+                old = __atomic_fetch_xor(dst, val, __ATOMIC_SEQ_CST);	\
+                goto done;						\
+            default:							\
+                break;							\
+        }								\
+    }									\
+									\
+    old = __atomic_load_n(dst, __ATOMIC_SEQ_CST);			\
+    do {								\
+        new = old;							\
+        if (op_info[op].swap_ok)					\
+            err = swap_data_in(op, atom_type, &new, &val, operand);	\
+        else								\
+            err = atom_op[op][atom_type](&new, &val, sizeof(new));	\
+        if (err)							\
+            return err;							\
+									\
+        /* A failed compare leaves the target as it was. */		\
+        if (new == old)							\
+            break;							\
+    } while (!__atomic_compare_exchange_n(dst, &old, new, 0,		\
+                                          __ATOMIC_SEQ_CST,		\
+                                          __ATOMIC_SEQ_CST));		\
+									\
+  done:									\
+    if (fetch)								\
+        memcpy(fetch, &old, sizeof(old));				\
+									\
+    return PTL_OK;							\
+}
+
+NATIVE_OP(8)
+NATIVE_OP(16)
+NATIVE_OP(32)
+NATIVE_OP(64)
+
+/**
+ * Find whether an atomic operation can run natively.
+ *
+ * @param atom_type the datatype
+ * @param addr the address of the element
+ *
+ * @return non-zero if atomic_native() can update the element
+ */
+int atomic_native_ok(ptl_datatype_t atom_type, const void *addr)
+{
+    int size;
+
+    /* The padding of long doubles is not reliably preserved, so
+     * comparing the whole element would not tell whether it changed. */
+    if (atom_type >= PTL_LONG_DOUBLE)
+        return 0;
+
+    size = atom_type_size[atom_type];
+    if (size > (int)sizeof(uint64_t))
+        return 0;
+
+    return ((uintptr_t) addr & (size - 1)) == 0;
+}
+
+/**
+ * Perform an atomic operation on a single element with the CPU
+ * atomics.
+ *
+ * The caller made sure with atomic_native_ok() that the element
+ * qualifies.
+ *
+ * @param op the operation, atomic or swap
+ * @param atom_type the datatype
+ * @param key the address the stripes are keyed with
+ * @param dst the element
+ * @param src the source value
+ * @param operand the operand of the swap operations
+ * @param fetch where to store the previous value, or NULL
+ *
+ * @return status
+ */
+int atomic_native(ptl_op_t op, ptl_datatype_t atom_type, const void *key,
+                  void *dst, const void *src, datatype_t *operand,
+                  void *fetch)
+{
+    struct atomic_stripe *stripe = &atomic_stripe[stripe_index(key)];
+    int locked = 0;
+    int err;
+
+    atomic_inc(&stripe->native);
+
+    if (unlikely(atomic_read(&stripe->locked))) {
+        /* Wait for the locked operation to be done. */
+        atomic_dec(&stripe->native);
+        pthread_mutex_lock(&stripe->lock);
+        locked = 1;
+    }
+
+    switch (atom_type_size[atom_type]) {
+        case 1:
+            err = native_8(op, atom_type, dst, src, operand, fetch);
+            break;
+        case 2:
+            err = native_16(op, atom_type, dst, src, operand, fetch);
+            break;
+        case 4:
+            err = native_32(op, atom_type, dst, src, operand, fetch);
+            break;
+        case 8:
+            err = native_64(op, atom_type, dst, src, operand, fetch);
+            break;
+        default:
+            err = PTL_ARG_INVALID;
+            break;
+    }
+
+    if (locked)
+        pthread_mutex_unlock(&stripe->lock);
+    else
+        atomic_dec(&stripe->native);
+
+    return err;
+}
+
+/**
+ * Find the stripes covering a buffer.
+ *
+ * @param addr the start of the buffer
+ * @param length the length of the buffer
+ *
+ * @return the set of stripes
+ */
+uint64_t atomic_stripes_find(const void *addr, ptl_size_t length)
+{
+    uintptr_t first;
+    uintptr_t last;
+    uint64_t stripes = 0;
+
+    if (!length)
+        return 0;
+
+    first = (uintptr_t) addr >> ATOMIC_STRIPE_SHIFT;
+    last = ((uintptr_t) addr + length - 1) >> ATOMIC_STRIPE_SHIFT;
+
+    if (last - first >= ATOMIC_STRIPES - 1)
+        return ATOMIC_STRIPES_ALL;
+
+    for (; first <= last; first++)
+        stripes |= 1ULL << (first % ATOMIC_STRIPES);
+
+    return stripes;
+}
+
+/**
+ * Lock a set of stripes for an operation which cannot run natively.
+ *
+ * The stripes are always taken in the same order. The native
+ * operations already running on them are let through first.
+ *
+ * @param stripes the set of stripes
+ */
+void atomic_stripes_lock(uint64_t stripes)
+{
+    struct atomic_stripe *stripe;
+    int i;
+
+    for (i = 0; i < ATOMIC_STRIPES; i++) {
+        if (!(stripes & (1ULL << i)))
+            continue;
+
+        stripe = &atomic_stripe[i];
+
+        pthread_mutex_lock(&stripe->lock);
+        atomic_set(&stripe->locked, 1);
+        __sync_synchronize();
+
+        while (atomic_read(&stripe->native))
+            sched_yield();
+    }
+}
+
+/**
+ * Unlock a set of stripes.
+ *
+ * @param stripes the set of stripes
+ */
+void atomic_stripes_unlock(uint64_t stripes)
+{
+    struct atomic_stripe *stripe;
+    int i;
+
+    for (i = ATOMIC_STRIPES - 1; i >= 0; i--) {
+        if (!(stripes & (1ULL << i)))
+            continue;
+
+        stripe = &atomic_stripe[i];
+
+        atomic_set(&stripe->locked, 0);
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
@@ -51,4 +51,38 @@ extern int atom_type_size[PTL_DATATYPE_LAST];
 int swap_data_in(ptl_op_t atom_op, ptl_datatype_t atom_type, void *dest,
                  void *source, datatype_t *operand);
 
+/** All the stripes, for buffers too scattered to find theirs. */
+#define ATOMIC_STRIPES_ALL	(~0ULL)
+
+int atomic_native_ok(ptl_datatype_t atom_type, const void *addr);
+
+int atomic_native(ptl_op_t op, ptl_datatype_t atom_type, const void *key,
+                  void *dst, const void *src, datatype_t *operand,
+                  void *fetch);
+
+uint64_t atomic_stripes_find(const void *addr, ptl_size_t length);
+
+void atomic_stripes_lock(uint64_t stripes);
+
+void atomic_stripes_unlock(uint64_t stripes);
+
+/**
+ * Instruction sets of the atomic op kernels, narrowest first.
+ */
+enum atomic_isa {
+    ATOMIC_ISA_SCALAR,          /* the loops of ptl_atomic.c */
+    ATOMIC_ISA_GENERIC,         /* vectorized for the baseline CPU */
+    ATOMIC_ISA_AVX2,
+    ATOMIC_ISA_AVX512,
+    ATOMIC_ISA_LAST,
+};
+
+const char *atomic_isa_name(int isa);
+
+int atomic_isa_ok(int isa);
+
+void atomic_isa_use(int isa);
+
+void atomic_simd_init(void);
+
 #endif /* PTL_ATOMIC_H */
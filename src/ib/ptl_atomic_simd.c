@@ -0,0 +1,248 @@
+/**
+ * @file ptl_atomic_simd.c
+ *
+ * Vectorized atomic op kernels.
+ *
+ * These are the loops of ptl_atomic.c for the ops and types which map
+ * onto vector instructions, written so that the compiler vectorizes
+ * them: the arrays are known not to overlap, and the logical ops are
+ * computed without branches. Each loop is built for the baseline
+ * instruction set and, on x86-64, for AVX2 and AVX-512. At
+ * initialization atom_op is pointed at the widest kernels the CPU
+ * supports. Products, complex products and long doubles keep the
+ * scalar kernels.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__)
+/* -O2 does not vectorize loops of unknown length. */
+#pragma GCC optimize ("tree-vectorize")
+#endif
+
+#include "ptl_loc.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_ATOMIC_X86		(1)
+#endif
+
+#define TARGET_generic
+#define TARGET_avx2		__attribute__((target("avx2")))
+#define TARGET_avx512		__attribute__((target("avx512f,avx512bw")))
+
+#define min(a, b)	(((a) < (b)) ? (a) : (b))
+#define max(a, b)	(((a) > (b)) ? (a) : (b))
+#define sum(a, b)	((a) + (b))
+#define lor(a, b)	(((a) != 0) | ((b) != 0))
+#define land(a, b)	(((a) != 0) & ((b) != 0))
+#define bor(a, b)	((a) | (b))
+#define band(a, b)	((a) & (b))
+#define bxor(a, b)	((a) ^ (b))
+
+/*
+ * Define the kernel computing op on two arrays of type, for
+ * instruction set isa. It behaves as the scalar kernel of
+ * ptl_atomic.c.
+ */
+#define KERNEL(isa, op, name, type)					\
+static TARGET_##isa int op##_##name##_##isa(void *dst, void *src,	\
+                                            ptl_size_t length)	\
+{									\
+    type *restrict d = dst;						\
+    const type *restrict s = src;					\
+    const ptl_size_t n = length / sizeof(type);				\
+    ptl_size_t i;							\
+									\
+    for (i = 0; i < n; i++)						\
+        d[i] = op(s[i], d[i]);						\
+									\
+    return PTL_OK;							\
+}
+
+#define INT_KERNELS(isa, op)						\
+    KERNEL(isa, op, sc, int8_t)						\
+    KERNEL(isa, op, uc, uint8_t)					\
+    KERNEL(isa, op, ss, int16_t)					\
+    KERNEL(isa, op, us, uint16_t)					\
+    KERNEL(isa, op, si, int32_t)					\
+    KERNEL(isa, op, ui, uint32_t)					\
+    KERNEL(isa, op, sl, int64_t)					\
+    KERNEL(isa, op, ul, uint64_t)
+
+/* Signedness does not matter to these. */
+#define BIT_KERNELS(isa, op)						\
+    KERNEL(isa, op, c, uint8_t)						\
+    KERNEL(isa, op, s, uint16_t)					\
+    KERNEL(isa, op, i, uint32_t)					\
+    KERNEL(isa, op, l, uint64_t)
+
+#define FLOAT_KERNELS(isa, op)						\
+    KERNEL(isa, op, f, float)						\
+    KERNEL(isa, op, d, double)
+
+#define INT_ENTRIES(isa, op)						\
+    [PTL_INT8_T] = op##_sc_##isa,					\
+    [PTL_UINT8_T] = op##_uc_##isa,					\
+    [PTL_INT16_T] = op##_ss_##isa,					\
+    [PTL_UINT16_T] = op##_us_##isa,					\
+    [PTL_INT32_T] = op##_si_##isa,					\
+    [PTL_UINT32_T] = op##_ui_##isa,					\
+    [PTL_INT64_T] = op##_sl_##isa,					\
+    [PTL_UINT64_T] = op##_ul_##isa
+
+#define BIT_ENTRIES(isa, op)						\
+    [PTL_INT8_T] = op##_c_##isa,					\
+    [PTL_UINT8_T] = op##_c_##isa,					\
+    [PTL_INT16_T] = op##_s_##isa,					\
+    [PTL_UINT16_T] = op##_s_##isa,					\
+    [PTL_INT32_T] = op##_i_##isa,					\
+    [PTL_UINT32_T] = op##_i_##isa,					\
+    [PTL_INT64_T] = op##_l_##isa,					\
+    [PTL_UINT64_T] = op##_l_##isa
+
+#define FLOAT_ENTRIES(isa, op)						\
+    [PTL_FLOAT] = op##_f_##isa,						\
+    [PTL_DOUBLE] = op##_d_##isa
+
+/*
+ * Define all the kernels for instruction set isa, and the table
+ * atom_op_<isa> pointing at them. Complex sums add up the real and
+ * imaginary parts separately, as the scalar kernels do.
+ */
+#define ISA_KERNELS(isa)						\
+    INT_KERNELS(isa, min)						\
+    FLOAT_KERNELS(isa, min)						\
+    INT_KERNELS(isa, max)						\
+    FLOAT_KERNELS(isa, max)						\
+    INT_KERNELS(isa, sum)						\
+    FLOAT_KERNELS(isa, sum)						\
+    BIT_KERNELS(isa, lor)						\
+    BIT_KERNELS(isa, land)						\
+    BIT_KERNELS(isa, bor)						\
+    BIT_KERNELS(isa, band)						\
+    BIT_KERNELS(isa, bxor)						\
+									\
+static const atom_op_t atom_op_##isa[PTL_OP_LAST][PTL_DATATYPE_LAST] = { \
+    [PTL_MIN] = { INT_ENTRIES(isa, min), FLOAT_ENTRIES(isa, min) },	\
+    [PTL_MAX] = { INT_ENTRIES(isa, max), FLOAT_ENTRIES(isa, max) },	\
+    [PTL_SUM] = { INT_ENTRIES(isa, sum), FLOAT_ENTRIES(isa, sum),	\
+                  [PTL_FLOAT_COMPLEX] = sum_f_##isa,		\
+                  [PTL_DOUBLE_COMPLEX] = sum_d_##isa },		\
+    [PTL_LOR] = { BIT_ENTRIES(isa, lor) },				\
+    [PTL_LAND] = { BIT_ENTRIES(isa, land) },				\
+    [PTL_BOR] = { BIT_ENTRIES(isa, bor) },				\
+    [PTL_BAND] = { BIT_ENTRIES(isa, band) },				\
+    [PTL_BXOR] = { BIT_ENTRIES(isa, bxor) },				\
+};
+
+ISA_KERNELS(generic)
+
+#if HAVE_ATOMIC_X86
+ISA_KERNELS(avx2)
+
+ISA_KERNELS(avx512)
+#endif
+
+/**
+ * Kernels and availability of the instruction sets.
+ */
+static const struct {
+    const char *name;
+    const atom_op_t (*ops)[PTL_DATATYPE_LAST];
+} atomic_isa[ATOMIC_ISA_LAST] = {
+    [ATOMIC_ISA_SCALAR] = {"scalar", NULL},
+    [ATOMIC_ISA_GENERIC] = {"generic", atom_op_generic},
+#if HAVE_ATOMIC_X86
+    [ATOMIC_ISA_AVX2] = {"avx2", atom_op_avx2},
+    [ATOMIC_ISA_AVX512] = {"avx512", atom_op_avx512},
+#else
+    [ATOMIC_ISA_AVX2] = {"avx2", NULL},
+    [ATOMIC_ISA_AVX512] = {"avx512", NULL},
+#endif
+};
+
+/* The kernels of ptl_atomic.c, saved before atom_op is changed. */
+static atom_op_t atom_op_scalar[PTL_OP_LAST][PTL_DATATYPE_LAST];
+static int atom_op_saved;
+
+/**
+ * @brief Return the name of an instruction set.
+ *
+ * @param[in] isa the instruction set
+ *
+ * @return its name
+ */
+const char *atomic_isa_name(int isa)
+{
+    return atomic_isa[isa].name;
+}
+
+/**
+ * @brief Find whether the CPU runs the kernels of an instruction set.
+ *
+ * @param[in] isa the instruction set
+ *
+ * @return non-zero if it does
+ */
+int atomic_isa_ok(int isa)
+{
+    switch (isa) {
+        case ATOMIC_ISA_SCALAR:
+        case ATOMIC_ISA_GENERIC:
+            return 1;
+#if HAVE_ATOMIC_X86
+        case ATOMIC_ISA_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case ATOMIC_ISA_AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f") &&
+                __builtin_cpu_supports("avx512bw");
+#endif
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Make atom_op use the kernels of an instruction set.
+ *
+ * The ops and types it has no kernel for keep the scalar one. This
+ * must not be called while atomic operations are in progress.
+ *
+ * @param[in] isa the instruction set, which the CPU must support
+ */
+void atomic_isa_use(int isa)
+{
+    const atom_op_t (*ops)[PTL_DATATYPE_LAST] = atomic_isa[isa].ops;
+    int op;
+    int type;
+
+    if (!atom_op_saved) {
+        memcpy(atom_op_scalar, atom_op, sizeof(atom_op_scalar));
+        atom_op_saved = 1;
+    }
+
+    for (op = 0; op < PTL_OP_LAST; op++) {
+        for (type = 0; type < PTL_DATATYPE_LAST; type++) {
+            if (ops && ops[op][type] && atom_op_scalar[op][type])
+                atom_op[op][type] = ops[op][type];
+            else
+                atom_op[op][type] = atom_op_scalar[op][type];
+        }
+    }
+}
+
+/**
+ * @brief Select the atomic op kernels.
+ *
+ * Use the widest instruction set the CPU supports, up to the one set
+ * by PTL_ATOMIC_ISA.
+ */
+void atomic_simd_init(void)
+{
+    int isa = get_param(PTL_ATOMIC_ISA);
+
+    while (!atomic_isa_ok(isa))
+        isa--;
+
+    atomic_isa_use(isa);
+}
@@ -30,11 +30,17 @@ int buf_setup(void *arg)
     if (buf->obj.obj_pool->type == POOL_BUF) {
         buf->rdma.recv.wr.next = NULL;
         buf->transfer.rdma.num_req_completes = 0;
+        buf->transfer.rdma.compact_length = 0;
     }
 #endif
 
-#if WITH_TRANSPORT_SHMEM &&!USE_KNEM
-    buf->transfer.noknem.data = NULL;
+#if WITH_TRANSPORT_SHMEM
+    buf->transfer.eager.buf = NULL;
+#endif
+
+#if WITH_TRANSPORT_UDP
+    /* The buf may have received a connection message last time. */
+    buf->transfer.udp.conn_msg.msg_type = 0;
 #endif
 
     return PTL_OK;
@@ -57,6 +63,14 @@ void buf_cleanup(void *arg)
 
     buf->num_mr = 0;
 
+#if WITH_TRANSPORT_SHMEM
+    if (buf->transfer.eager.buf) {
+        ll_enqueue_obj(&obj_to_ni(buf)->shmem.eager.free_list,
+                       buf->transfer.eager.buf);
+        buf->transfer.eager.buf = NULL;
+    }
+#endif
+
 #if WITH_TRANSPORT_IB
     /* send/rdma bufs drop their references to
      * the master buf here */
@@ -73,6 +73,9 @@ enum {
     XX_INLINE = (1 << 21),
 
     XI_PUT_SEND_DISABLE_EVENT = (1 << 22),
+
+    XI_BUNDLED = (1 << 23),            /* issued inside a bundle */
+    XI_BUNDLE_SEND = (1 << 24),        /* request waits for the bundle flush */
 };
 
 typedef enum buf_type buf_type_t;
@@ -164,6 +167,7 @@ struct buf {
             struct ct *get_ct;
             ptl_size_t put_offset;
             ptl_size_t get_offset;
+            struct list_head bundle_list;
         };
 
         /* Target side only. */
@@ -194,6 +198,8 @@ struct buf {
 
             int auto_unlink_pending;
             int init_flow_ctrl;
+
+            uint64_t atomic_stripes;    /* locked by an atomic */
         };
 
         /*
@@ -247,6 +253,8 @@ struct buf {
 
     /* Target only. Must survive through buffer reuse. */
     struct list_head unexpected_list;
+    struct list_head unexpected_bits_list;
+    struct list_head unexpected_src_list;
     int unexpected_busy;
     pthread_cond_t cond;
 
@@ -318,6 +326,11 @@ struct buf {
             /* How many previous requests buffer (ie. from initiator)
              * will this one completes. */
             int num_req_completes;
+
+            /* Request header in the compact format, sent in place of
+             * the req_hdr_t when compact_length is not 0. */
+            unsigned int compact_length;
+            uint64_t compact_hdr[16];
         } rdma;
 #endif
 
@@ -330,11 +343,19 @@ struct buf {
         } mem;
 #endif
 
+#if WITH_TRANSPORT_SHMEM
+        struct {
+            /* Eager buffer holding the data of a put. Given back when
+             * the buf is freed, as the target is then done with it. */
+            void *buf;
+        } eager;
+#endif
+
 #if (WITH_TRANSPORT_SHMEM && !USE_KNEM)
         struct {
             /* Invariant during the transfer,
-             * 0=initiator, 2=target */
-            int transfer_state_expected;
+             * 0=initiator, 1=target */
+            int target;
 
             /* Local MD/ME/LE */
             ptl_iovec_t *iovecs;
@@ -346,12 +367,8 @@ struct buf {
              * iovec array. */
             ptl_iovec_t my_iovec;
 
-            /* The associated bounce buffer. Its address, its total
-             * length, and its offset in the comm pad, relative to the
-             * NI's bounce buffers head. */
-            unsigned char *data;
-            ptl_size_t data_length;
-            off_t bounce_offset;
+            /* Local addresses of the bounce buffers. */
+            unsigned char *bufs[NOKNEM_MAX_BUFS];
 
             /* noknem communication pad. For the initiator, this
              * points to the local internal_data, while for the
@@ -360,6 +377,14 @@ struct buf {
              * spaces. */
             struct noknem *noknem;
         } noknem;
+
+        struct {
+            /* Cross memory attach. The initiator and its memory. */
+            pid_t pid;
+            ptl_iovec_t *rem_iovecs;
+            ptl_size_t num_rem_iovecs;
+            ptl_size_t rem_off;
+        } cma;
 #endif
 
 #if WITH_TRANSPORT_UDP
@@ -45,21 +45,13 @@ int conn_init(void *arg, void *parm)
     atomic_set(&conn->rdma.num_req_not_comp, 0);
 
     conn->rdma.max_req_avail = 0;
+    conn->rdma.compact_hdr = 0;
 #endif
 
 #if WITH_TRANSPORT_UDP
     /* Set udp as the transport. */
     conn->transport = transport_udp;
 
-#if WITH_RUDP
-    atomic_set(&conn->udp.send_seq_num, 1);
-    //recv side starts at 1, due to the
-    //need to use atomic inc on the send
-    //seq num before the message is sent
-    atomic_set(&conn->udp.recv_seq_num, 1);
-    INIT_LIST_HEAD(&conn->udp.rel_queued_bufs);
-#endif
-
 #endif
 
 #if WITH_TRANSPORT_IB || WITH_TRANSPORT_UDP
@@ -89,37 +81,266 @@ void conn_fini(void *arg)
     }
 #endif
 
-#if WITH_TRANSPORT_UDP && WITH_RUDP
-    if (conn->transport.type == CONN_TYPE_UDP) {
-        atomic_set(&conn->udp.send_seq_num, 0);
-        atomic_set(&conn->udp.recv_seq_num, 0);
-    }
-#endif
-
     pthread_mutex_destroy(&conn->mutex);
 #if WITH_TRANSPORT_IB || WITH_TRANSPORT_UDP
     pthread_cond_destroy(&conn->move_wait);
 #endif
 }
 
-static int compare_conn_id(const void *a, const void *b)
+/*
+ * Open addressing hash table of the connections of a physical NI,
+ * indexed on their ID. Slots are only ever filled, and a table that
+ * gets too full is replaced by a larger copy, so lookups can probe it
+ * without the lock. The replaced tables are kept until the NI is
+ * destroyed since a reader may still be walking them.
+ */
+struct conn_hash {
+    struct conn_hash *old;      /* table replaced by this one */
+    unsigned int mask;          /* number of slots - 1 */
+    unsigned int count;         /* number of used slots */
+    conn_t *volatile slots[];
+};
+
+#define CONN_HASH_MIN_SIZE (64)
+
+/* Source of the NI serial numbers validating the last_conn caches. */
+static unsigned long conn_hash_serial;
+
+/* Last connection found by this thread on a physical NI. */
+static __thread struct {
+    ni_t *ni;
+    unsigned long serial;
+    conn_t *conn;
+} last_conn;
+
+static inline int same_id(const conn_t *conn, ptl_process_t id)
 {
-    const conn_t *c1 = a;
-    const conn_t *c2 = b;
+    return conn->id.phys.nid == id.phys.nid &&
+        conn->id.phys.pid == id.phys.pid;
+}
+
+static inline unsigned int hash_id(ptl_process_t id)
+{
+    uint32_t h = id.phys.nid * 0x9e3779b1 ^ id.phys.pid * 0x85ebca6b;
+
+    return h ^ (h >> 16);
+}
+
+static conn_t *conn_hash_find(struct conn_hash *hash, ptl_process_t id)
+{
+    unsigned int i;
+    conn_t *conn;
+
+    if (!hash)
+        return NULL;
+
+    for (i = hash_id(id) & hash->mask; (conn = hash->slots[i]);
+         i = (i + 1) & hash->mask) {
+        if (same_id(conn, id))
+            return conn;
+    }
+
+    return NULL;
+}
+
+static void conn_hash_add(struct conn_hash *hash, conn_t *conn)
+{
+    unsigned int i;
+
+    for (i = hash_id(conn->id) & hash->mask; hash->slots[i];
+         i = (i + 1) & hash->mask) ;
+
+    hash->slots[i] = conn;
+    hash->count++;
+}
+
+/**
+ * Insert a new connection in the hash table of a physical NI, growing
+ * the table first if it is half full.
+ *
+ * Must be called with the physical lock held.
+ *
+ * @param[in] ni the physical NI
+ * @param[in] conn the connection, fully initialized
+ *
+ * @return status
+ */
+static int conn_hash_insert(ni_t *ni, conn_t *conn)
+{
+    struct conn_hash *hash = ni->physical.hash;
+
+    if (!hash || 2 * (hash->count + 1) > hash->mask + 1) {
+        unsigned int size = hash ? 2 * (hash->mask + 1) : CONN_HASH_MIN_SIZE;
+        struct conn_hash *new;
+        unsigned int i;
+
+        new = calloc(1, sizeof(*new) + size * sizeof(conn_t *));
+        if (!new)
+            return PTL_NO_SPACE;
+
+        new->mask = size - 1;
+        new->old = hash;
+
+        if (hash) {
+            for (i = 0; i <= hash->mask; i++) {
+                if (hash->slots[i])
+                    conn_hash_add(new, hash->slots[i]);
+            }
+        }
+
+        /* Publish the table only once it is complete. */
+        __sync_synchronize();
+        ni->physical.hash = new;
+        hash = new;
+    }
+
+    /* Likewise for the connection. */
+    __sync_synchronize();
+    conn_hash_add(hash, conn);
+
+    return PTL_OK;
+}
+
+/**
+ * Initialize the connection table of a physical NI.
+ *
+ * @param[in] ni the physical NI
+ */
+void conn_hash_init(ni_t *ni)
+{
+    ni->physical.hash = NULL;
+    ni->physical.serial = __sync_add_and_fetch(&conn_hash_serial, 1);
+    PTL_FASTLOCK_INIT(&ni->physical.lock);
+}
+
+/**
+ * Get the connection to a rank of a logical NI, creating it if this is
+ * the first time the rank is talked to.
+ *
+ * The directory is lock-free. Two threads may create the same leaf or
+ * connection; only the first one to install it wins.
+ *
+ * @param[in] ni the logical NI
+ * @param[in] rank the rank, within the map
+ *
+ * @return the conn_t, without taking a reference
+ */
+static conn_t *get_logical_conn(ni_t *ni, ptl_rank_t rank)
+{
+    conn_t ***leaf_p = &ni->logical.conn_dir[rank >> CONN_DIR_BITS];
+    conn_t **leaf = *leaf_p;
+    conn_t **slot;
+    conn_t *conn;
+    const ptl_process_t *id;
+
+    if (unlikely(!leaf)) {
+        leaf = calloc(CONN_DIR_LEAF_SIZE, sizeof(*leaf));
+        if (!leaf) {
+            WARN();
+            return NULL;
+        }
+
+        if (!__sync_bool_compare_and_swap(leaf_p, NULL, leaf)) {
+            free(leaf);
+            leaf = *leaf_p;
+        }
+    }
+
+    slot = &leaf[rank & (CONN_DIR_LEAF_SIZE - 1)];
+    conn = *slot;
+    if (likely(conn != NULL))
+        return conn;
+
+    if (conn_alloc(ni, &conn)) {
+        WARN();
+        return NULL;
+    }
+
+    /* convert nid/pid to ipv4 address */
+    id = &ni->logical.mapping[rank];
+    conn->sin.sin_family = AF_INET;
+    conn->sin.sin_addr.s_addr = nid_to_addr(id->phys.nid);
+    conn->sin.sin_port = pid_to_port(id->phys.pid);
+#if WITH_TRANSPORT_UDP
+    ptl_info("entry: %i, ADDR: %s PID: %i \n", rank,
+             inet_ntoa(conn->sin.sin_addr), id->phys.pid);
+#endif
+
+    if (!__sync_bool_compare_and_swap(slot, NULL, conn)) {
+        conn_put(conn);
+        conn = *slot;
+    }
+
+    return conn;
+}
+
+/**
+ * Create the connection to a process of a physical NI, unless another
+ * thread just did.
+ *
+ * @param[in] ni the physical NI
+ * @param[in] id the process ID
+ *
+ * @return the conn_t, without taking a reference
+ */
+static conn_t *get_physical_conn(ni_t *ni, ptl_process_t id)
+{
+    conn_t *conn;
 
-    return compare_id(&c1->id, &c2->id);
+    PTL_FASTLOCK_LOCK(&ni->physical.lock);
+
+    conn = conn_hash_find(ni->physical.hash, id);
+    if (conn)
+        goto done;
+
+    if (conn_alloc(ni, &conn)) {
+        WARN();
+        conn = NULL;
+        goto done;
+    }
+#if IS_PPE || WITH_TRANSPORT_SHMEM
+    //need to connect local processes over shared memory
+    if (conn->id.phys.nid == ni->iface->id.phys.nid) {
+        if (get_param(PTL_ENABLE_MEM)) {
+#if IS_PPE
+            conn->transport = transport_mem;
+#elif WITH_TRANSPORT_SHMEM
+            conn->transport = transport_shmem;
+#endif
+            conn->state = CONN_STATE_CONNECTED;
+        }
+    }
+#endif
+
+    conn->id = id;
+
+    /* Get the IP address from the NID. */
+    conn->sin.sin_family = AF_INET;
+    conn->sin.sin_addr.s_addr = nid_to_addr(id.phys.nid);
+    conn->sin.sin_port = pid_to_port(id.phys.pid);
+
+    if (conn_hash_insert(ni, conn)) {
+        WARN();
+        conn_put(conn);
+        conn = NULL;
+    }
+
+  done:
+    PTL_FASTLOCK_UNLOCK(&ni->physical.lock);
+
+    return conn;
 }
 
 /**
  * Get connection info for a given process id.
  *
- * For logical NIs the connection is contained in the rank table.
- * For physical NIs the connection is held in a binary tree using
- * the ID as a sorting value.
+ * For logical NIs the connection is found in the rank directory.
+ * For physical NIs the connection is held in a hash table indexed
+ * on the ID, behind a cache of the last connection found by the
+ * calling thread.
  *
- * For physical NIs if this is the first time we are sending a message
- * to this process create a new conn_t. For logical NIs the conn_t
- * structs are all allocated when the rank table is loaded.
+ * If this is the first time we are sending a message to this process
+ * create a new conn_t.
  *
  * @param[in] ni the NI from which to get the connection
  * @param[in] id the process ID to lookup
@@ -129,7 +350,6 @@ static int compare_conn_id(const void *a, const void *b)
 conn_t *get_conn(ni_t *ni, ptl_process_t id)
 {
     conn_t *conn;
-    void **ret;
 
     if (ni->options & PTL_NI_LOGICAL) {
         if (unlikely(id.rank >= ni->logical.map_size)) {
@@ -138,59 +358,30 @@ conn_t *get_conn(ni_t *ni, ptl_process_t id)
             return NULL;
         }
 
-        conn = ni->logical.rank_table[id.rank].connect;
+        conn = get_logical_conn(ni, id.rank);
+        if (unlikely(!conn))
+            return NULL;
+
         conn_get(conn);
     } else {
-        conn_t conn_search;
-
-        PTL_FASTLOCK_LOCK(&ni->physical.lock);
-
-        /* lookup in binary tree */
-        conn_search.id = id;
-        ret = tfind(&conn_search, &ni->physical.tree, compare_conn_id);
-        if (ret) {
-            conn = *ret;
-            conn_get(conn);
+        if (likely(last_conn.ni == ni &&
+                   last_conn.serial == ni->physical.serial &&
+                   same_id(last_conn.conn, id))) {
+            conn = last_conn.conn;
         } else {
-            /* Not found. Allocate and insert. */
-            if (conn_alloc(ni, &conn)) {
-                PTL_FASTLOCK_UNLOCK(&ni->physical.lock);
-                WARN();
-                return NULL;
+            conn = conn_hash_find(ni->physical.hash, id);
+            if (unlikely(!conn)) {
+                conn = get_physical_conn(ni, id);
+                if (unlikely(!conn))
+                    return NULL;
             }
-#if IS_PPE || WITH_TRANSPORT_SHMEM
-            //need to connect local processes over shared memory
-            if (conn->id.phys.nid == ni->iface->id.phys.nid) {
-                if (get_param(PTL_ENABLE_MEM)) {
-#if IS_PPE
-                    conn->transport = transport_mem;
-#elif WITH_TRANSPORT_SHMEM
-                    conn->transport = transport_shmem;
-#endif
-                    conn->state = CONN_STATE_CONNECTED;
-                }
-            }
-#endif
 
-            conn->id = id;
-
-            /* Get the IP address from the NID. */
-            conn->sin.sin_family = AF_INET;
-            conn->sin.sin_addr.s_addr = nid_to_addr(id.phys.nid);
-            conn->sin.sin_port = pid_to_port(id.phys.pid);
-
-            /* insert new conn into binary tree */
-            ret = tsearch(conn, &ni->physical.tree, compare_conn_id);
-            if (!ret) {
-                WARN();
-                conn_put(conn);
-                conn = NULL;
-            } else {
-                conn_get(conn);
-            }
+            last_conn.ni = ni;
+            last_conn.serial = ni->physical.serial;
+            last_conn.conn = conn;
         }
 
-        PTL_FASTLOCK_UNLOCK(&ni->physical.lock);
+        conn_get(conn);
     }
 
     return conn;
@@ -264,17 +455,6 @@ static void initiate_disconnect_one(conn_t *conn)
     pthread_mutex_unlock(&conn->mutex);
 }
 
-static void initiate_disconnect_one_twalk(const void *data, const VISIT which,
-                                          const int depth)
-{
-    conn_t *conn = *(conn_t **)data;
-
-    if (which != leaf && which != postorder)
-        return;
-
-    initiate_disconnect_one(conn);
-}
-
 /* When an application destroy an NI, it cannot just close its
  * connections because there might be some packets in flight. So it
  * just informs the remote sides that it is ready to shutdown. */
@@ -282,16 +462,30 @@ void initiate_disconnect_all(ni_t *ni)
 {
     if (ni->options & PTL_NI_LOGICAL) {
         int i;
-        const int map_size = ni->logical.map_size;
+        int j;
 
         /* Send a disconnect message. */
-        for (i = 0; i < map_size; i++) {
-            conn_t *conn = ni->logical.rank_table[i].connect;
+        for (i = 0; i < ni->logical.conn_dir_size; i++) {
+            conn_t **leaf = ni->logical.conn_dir[i];
+
+            if (!leaf)
+                continue;
 
-            initiate_disconnect_one(conn);
+            for (j = 0; j < CONN_DIR_LEAF_SIZE; j++) {
+                if (leaf[j])
+                    initiate_disconnect_one(leaf[j]);
+            }
         }
     } else {
-        twalk(ni->physical.tree, initiate_disconnect_one_twalk);
+        struct conn_hash *hash = ni->physical.hash;
+        unsigned int i;
+
+        if (hash) {
+            for (i = 0; i <= hash->mask; i++) {
+                if (hash->slots[i])
+                    initiate_disconnect_one(hash->slots[i]);
+            }
+        }
     }
 }
 
@@ -350,29 +544,81 @@ void destroy_conns(ni_t *ni)
     if (ni->options & PTL_NI_LOGICAL) {
         if (ni->logical.mapping) {
             int i;
-            const int map_size = ni->logical.map_size;
+            int j;
 
             /* Destroy active connections. */
-            for (i = 0; i < map_size; i++) {
-                entry_t *entry = &ni->logical.rank_table[i];
-                destroy_conn(entry->connect);
-                entry->connect = NULL;
+            for (i = 0; i < ni->logical.conn_dir_size; i++) {
+                conn_t **leaf = ni->logical.conn_dir[i];
+
+                if (!leaf)
+                    continue;
+
+                for (j = 0; j < CONN_DIR_LEAF_SIZE; j++) {
+                    if (leaf[j]) {
+                        destroy_conn(leaf[j]);
+                        leaf[j] = NULL;
+                    }
+                }
             }
         }
     } else {
-#ifdef HAVE_TDESTROY
-        tdestroy(ni->physical.tree, destroy_conn);
-#else
-        while (ni->physical.tree != NULL) {
-            destroy_conn(*(void **)ni->physical.tree);
-            tdelete(*(void **)ni->physical.tree, &ni->physical.tree,
-                    compare_conn_id);
+        struct conn_hash *hash = ni->physical.hash;
+        unsigned int i;
+
+        if (hash) {
+            for (i = 0; i <= hash->mask; i++) {
+                if (hash->slots[i])
+                    destroy_conn(hash->slots[i]);
+            }
         }
-#endif
+
+        while (hash) {
+            struct conn_hash *old = hash->old;
+
+            free(hash);
+            hash = old;
+        }
+        ni->physical.hash = NULL;
     }
 }
 
 #if WITH_TRANSPORT_IB
+/**
+ * Get the connection features enabled on this side.
+ *
+ * @param[in] ni
+ *
+ * @return the CONN_FEATURE_* flags
+ */
+static uint32_t local_features(ni_t *ni)
+{
+    uint32_t features = 0;
+
+    /* A compact header is sent from its own SGE. */
+    if (get_param(PTL_COMPACT_HDR) && ni->iface->cap.max_send_sge >= 2)
+        features |= CONN_FEATURE_COMPACT_HDR;
+
+    return features;
+}
+
+/**
+ * Enable on a connection the features both sides have.
+ *
+ * Features are only ever turned on, so a zero filled private data
+ * does not undo what the connection request negotiated.
+ *
+ * @param[in] ni
+ * @param[in] conn
+ * @param[in] remote the CONN_FEATURE_* flags of the remote side
+ */
+static void set_conn_features(ni_t *ni, conn_t *conn, uint32_t remote)
+{
+    uint32_t features = local_features(ni) & remote;
+
+    if (features & CONN_FEATURE_COMPACT_HDR)
+        conn->rdma.compact_hdr = 1;
+}
+
 /**
  * Retrieve some current parameters from the QP. Right now we only
  * need max_inline_data.
@@ -409,6 +655,7 @@ static void get_qp_param(conn_t *conn)
 static int accept_connection_request(ni_t *ni, conn_t *conn,
                                      struct rdma_cm_event *event)
 {
+    const struct cm_priv_request *req = event->param.conn.private_data;
     struct rdma_conn_param conn_param;
     struct ibv_qp_init_attr init_attr;
     struct cm_priv_accept priv;
@@ -446,10 +693,11 @@ static int accept_connection_request(ni_t *ni, conn_t *conn,
     conn_param.retry_count = 7;
     conn_param.rnr_retry_count = 7;
 
-    if (ni->options & PTL_NI_LOGICAL) {
-        conn_param.private_data = &priv;
-        conn_param.private_data_len = sizeof(priv);
-    }
+    priv.features = local_features(ni);
+    conn_param.private_data = &priv;
+    conn_param.private_data_len = sizeof(priv);
+
+    set_conn_features(ni, conn, req->features);
 
     if (rdma_accept(event->id, &conn_param)) {
         rdma_destroy_qp(event->id);
@@ -480,6 +728,7 @@ static int accept_connection_self(ni_t *ni, conn_t *conn,
 {
     struct rdma_conn_param conn_param;
     struct ibv_qp_init_attr init_attr;
+    struct cm_priv_accept priv;
 
     conn->state = CONN_STATE_CONNECTING;
 
@@ -510,6 +759,10 @@ static int accept_connection_self(ni_t *ni, conn_t *conn,
     conn_param.initiator_depth = 1;
     conn_param.rnr_retry_count = 7;
 
+    priv.features = local_features(ni);
+    conn_param.private_data = &priv;
+    conn_param.private_data_len = sizeof(priv);
+
     if (rdma_accept(event->id, &conn_param)) {
         rdma_destroy_qp(event->id);
         conn->state = CONN_STATE_DISCONNECTED;
@@ -754,6 +1007,7 @@ void process_cm_event(EV_P_ ev_io *w, int revents)
 
             priv.src_id = ni->id;
             priv.options = ni->options;
+            priv.features = local_features(ni);
 
             assert(conn->rdma.cm_id == event->id);
 
@@ -798,6 +1052,17 @@ void process_cm_event(EV_P_ ev_io *w, int revents)
 
             get_qp_param(conn);
 
+            /* On the active side, the accept tells what the remote
+             * side enabled. */
+            if (event->param.conn.private_data &&
+                event->param.conn.private_data_len >=
+                sizeof(struct cm_priv_accept)) {
+                const struct cm_priv_accept *acc =
+                    event->param.conn.private_data;
+
+                set_conn_features(ni, conn, acc->features);
+            }
+
             conn->state = CONN_STATE_CONNECTED;
             pthread_cond_broadcast(&conn->move_wait);
 
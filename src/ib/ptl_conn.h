@@ -55,6 +55,11 @@ struct transport {
 
     /* Sends a short or long message. */
     int (*send_message) (struct buf * buf, int from_init);
+
+    /* Sends the requests of a bundle, in order, and returns how many
+     * of the first ones were sent. Optional; when not set each request
+     * goes through send_message. */
+    int (*send_messages) (ni_t *ni, struct buf ** bufs, int num);
     int (*post_tgt_dma) (struct buf * buf);
 
     /* Sets some sent flags, which determine what to do once the
@@ -140,6 +145,9 @@ struct conn {
             int local_disc;
             int remote_disc;
 
+            /* Set if requests can be sent to the remote side with a
+             * compact header. Negotiated during connection setup. */
+            int compact_hdr;
         } rdma;
 #endif
 
@@ -155,11 +163,6 @@ struct conn {
             atomic_t fragment_seq;
             atomic_t is_waiting;    /* set if waiting for connection request response to arrive */
             struct list_head waiting_bufs;  /* list of bufs waiting for connection to be established */
-#if WITH_RUDP
-            atomic_t recv_seq_num;  /*sequence number for reliability */
-            atomic_t send_seq_num;
-            struct list_head rel_queued_bufs;   /*list of queued buffers for in-order delivery */
-#endif
         } udp;
 #endif
     };
@@ -222,10 +225,17 @@ static inline int conn_put(conn_t *conn)
 }
 
 /* RDMA CM private data */
+/* Features a side of a connection has enabled. A feature is used on
+ * the connection only if both sides enabled it. */
+enum {
+    CONN_FEATURE_COMPACT_HDR = 1 << 0,  /* compact request headers */
+};
+
 struct cm_priv_request {
     uint32_t options;           /* NI options (physical/logical, ...) */
     // TODO: make network safe
     ptl_process_t src_id;       /* rank or NID/PID requesting that connection */
+    uint32_t features;          /* CONN_FEATURE_* of the requester */
 };
 
 enum {
@@ -243,6 +253,7 @@ struct cm_priv_reject {
 };
 
 struct cm_priv_accept {
+    uint32_t features;          /* CONN_FEATURE_* of the acceptor */
 };
 
 #if WITH_TRANSPORT_UDP
@@ -295,6 +306,8 @@ static inline int compare_id(const ptl_process_t *id1,
                                                 id2->phys.pid);
 }
 
+void conn_hash_init(struct ni *ni);
+
 conn_t *get_conn(struct ni *ni, ptl_process_t id);
 
 void destroy_conns(struct ni *ni);
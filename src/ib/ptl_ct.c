@@ -65,6 +65,7 @@ int ct_new(void *arg)
     ct->info.interrupt = 0;
     ct->info.event.failure = 0;
     ct->info.event.success = 0;
+    ptl_wait_init(&ct->info.wait);
 
     return PTL_OK;
 }
@@ -504,47 +505,100 @@ int _PtlCTPoll(PPEGBL const ptl_handle_ct_t *ct_handles,
     return err;
 }
 
+/**
+ * @brief Return the threshold a pending triggered operation waits for.
+ *
+ * @param[in] buf the triggered operation
+ *
+ * @return the threshold
+ */
+static inline ptl_size_t trig_threshold(buf_t *buf)
+{
+    return (buf->type == BUF_TRIGGERED) ? buf->threshold : buf->ct_threshold;
+}
+
+/**
+ * @brief Add a triggered operation to the pending list of a ct.
+ *
+ * The list is kept sorted by threshold so that ct_check() only has to
+ * look at its head. Operations with the same threshold stay in posting
+ * order. Schedules usually post increasing thresholds, so the search
+ * starts from the tail.
+ *
+ * @pre caller holds ct->lock
+ *
+ * @param[in] ct the counting event
+ * @param[in] buf the triggered operation
+ */
+void ct_add_trig(ct_t *ct, buf_t *buf)
+{
+    const ptl_size_t threshold = trig_threshold(buf);
+    struct list_head *l;
+
+    list_for_each_prev(l, &ct->trig_list) {
+        if (trig_threshold(list_entry(l, buf_t, list)) <= threshold)
+            break;
+    }
+
+    list_add(&buf->list, l);
+    atomic_inc(&ct->list_size);
+}
+
 /**
  * @brief Check to see if current value of ct event will
  * trigger a further action.
  *
+ * The operations that became ready, or all of them if the ct is being
+ * interrupted, are cut from the pending list in one go under the ct
+ * lock and then run without holding it.
+ *
  * @param[in] ct The counting event to check.
  */
 void ct_check(ct_t *ct)
 {
+    struct list_head batch;
     struct list_head *l;
+    buf_t *buf;
+    buf_t *n;
+    ptl_size_t count;
+    int interrupt;
+    int num = 0;
     int err;
 
+    INIT_LIST_HEAD(&batch);
+
     PTL_FASTLOCK_LOCK(&ct->lock);
 
-    /* check to see if any pending triggered move operations
-     * can now be performed or discarded
-     * TODO this should enqueue the xi to a list and then unwind
-     * all the ct locks before calling process_init */
-    list_for_each_prev_safe(l, ct->trig_list_tmp, &ct->trig_list) {
-        buf_t *buf = list_entry(l, buf_t, list);
+    interrupt = ct->info.interrupt;
+    count = ct->info.event.success + ct->info.event.failure;
+
+    /* find the last pending operation that can now be
+     * performed or discarded */
+    l = &ct->trig_list;
+    while (l->next != &ct->trig_list &&
+           (interrupt ||
+            trig_threshold(list_entry(l->next, buf_t, list)) <= count)) {
+        l = l->next;
+        num++;
+    }
+
+    if (num) {
+        list_cut_position(&batch, &ct->trig_list, l);
+        atomic_sub(&ct->list_size, num);
+    }
 
-        if (buf->type == BUF_INIT) {
-            ptl_info("check for init BUF triggering\n");
-            if (ct->info.interrupt) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
+    PTL_FASTLOCK_UNLOCK(&ct->lock);
 
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
+    list_for_each_entry_safe(buf, n, &batch, list) {
+        list_del(&buf->list);
 
+        if (buf->type == BUF_INIT) {
+            if (interrupt) {
                 buf->init_state = STATE_INIT_CLEANUP;
                 err = process_init(buf);
                 if (unlikely(err))
                     ptl_warn("Error in cleanup on ct interrupt\n");
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            } else if ((ct->info.event.success + ct->info.event.failure) >=
-                       buf->ct_threshold) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-                
+            } else {
                 ptl_info("CT Triggered, initiating operation\n");
 #if WITH_TRANSPORT_UDP
                 buf->udp.i_am_prog_thread = 1;
@@ -552,67 +606,29 @@ void ct_check(ct_t *ct)
                 err = process_init(buf);
                 if (unlikely(err))
                     ptl_warn("Error in processing initiator traffic\n");
-                PTL_FASTLOCK_LOCK(&ct->lock);
             }
 #ifdef WITH_TRIG_ME_OPS
         } else if (buf->type == BUF_TRIGGERED_ME) {
-             ptl_info("check for triggered ME ops\n");
-             if (ct->info.interrupt) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-
+            if (interrupt) {
                 ct_put(buf->ct);
                 buf_put(buf);
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            } else if ((ct->info.event.success + ct->info.event.failure) >=
-                       buf->ct_threshold) {
-                ptl_info("ME operation triggered: %i on ct of: %i and threshold %i\n", 
-                         (int) buf->op, (int)ct->info.event.success, (int)buf->ct_threshold);
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-
-                do_trig_me_op(buf, ct);
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
             } else {
-                ptl_info("ME operation not triggered %i:%i threshold: %i\n",
-                         (int)ct->info.event.success,
-                         (int)ct->info.event.failure, (int)buf->ct_threshold);
+                ptl_info("ME operation triggered: %i on ct of: %i and threshold %i\n",
+                         (int)buf->op, (int)ct->info.event.success,
+                         (int)buf->ct_threshold);
+                do_trig_me_op(buf, ct);
             }
 #endif
         } else {
-            ptl_info("check for BUF triggering\n");
             assert(buf->type == BUF_TRIGGERED);
-            if (ct->info.interrupt) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-
+            if (interrupt) {
                 ct_put(buf->ct);
                 buf_put(buf);
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
-            } else if ((ct->info.event.success + ct->info.event.failure) >=
-                       buf->threshold) {
-                list_del(l);
-                atomic_dec(&ct->list_size);
-
-                PTL_FASTLOCK_UNLOCK(&ct->lock);
-
+            } else {
                 do_trig_ct_op(buf);
-
-                PTL_FASTLOCK_LOCK(&ct->lock);
             }
         }
     }
-
-    PTL_FASTLOCK_UNLOCK(&ct->lock);
 }
 
 /**
@@ -625,6 +641,7 @@ static void ct_set(ct_t *ct, ptl_ct_event_t new_ct)
 {
     /* set new value */
     ct->info.event = new_ct;
+    ptl_wait_wake(&ct->info.wait);
 
     /* check to see if this triggers any further
      * actions */
@@ -700,6 +717,8 @@ static void ct_inc(ct_t *ct, ptl_ct_event_t increment)
              ct, ct->info.event.success, increment.success,
              ct->info.event.failure);
 
+    ptl_wait_wake(&ct->info.wait);
+
     /* check to see if this triggers any further
      * actions */
     if (atomic_read(&ct->list_size) > 0)
@@ -1007,9 +1026,7 @@ void post_ct(buf_t *buf, ct_t *ct)
         if (unlikely(err))
             ptl_warn("error in processing at initiator on post CT \n");
     } else {
-        atomic_inc(&ct->list_size);
-
-        list_add(&buf->list, &ct->trig_list);
+        ct_add_trig(ct, buf);
 
         /* We must check again to avoid a race with make_ct_event/ct_inc_ct_set. */
         if ((ct->info.event.success + ct->info.event.failure) >=
@@ -1043,12 +1060,9 @@ static void post_trig_ct(buf_t *buf, ct_t *trig_ct)
         do_trig_ct_op(buf);
 
     } else {
-        ptl_info("ct value before inc for triggered: %i\n",atomic_read(&trig_ct->list_size));
-        atomic_inc(&trig_ct->list_size);
-
-        ptl_info("triggered condition not met adding to list, list lenght: %i\n",atomic_read(&trig_ct->list_size));
+        ct_add_trig(trig_ct, buf);
 
-        list_add(&buf->list, &trig_ct->trig_list);
+        ptl_info("triggered condition not met adding to list, list length: %i\n",atomic_read(&trig_ct->list_size));
 
         /* We must check again to avoid a race with make_ct_event/ct_inc_ct_set. */
         if ((trig_ct->info.event.success + trig_ct->info.event.failure) >=
@@ -1082,6 +1096,28 @@ void make_ct_event(ct_t *ct, buf_t *buf, enum ct_bytes bytes)
         (void)__sync_add_and_fetch(&ct->info.event.success, buf->rlength);
     }
 
+    ptl_wait_wake(&ct->info.wait);
+
+    if (atomic_read(&ct->list_size))
+        ct_check(ct);
+}
+
+/**
+ * @brief Update a counting event for a PtlLESearch or PtlMESearch.
+ *
+ * @param[in] ct The counting event to update.
+ * @param[in] success The amount to add to the successes.
+ * @param[in] failure The amount to add to the failures.
+ */
+void make_ct_search_event(ct_t *ct, ptl_size_t success, ptl_size_t failure)
+{
+    if (success)
+        (void)__sync_add_and_fetch(&ct->info.event.success, success);
+    if (failure)
+        (void)__sync_add_and_fetch(&ct->info.event.failure, failure);
+
+    ptl_wait_wake(&ct->info.wait);
+
     if (atomic_read(&ct->list_size))
         ct_check(ct);
 }
@@ -16,8 +16,8 @@ struct buf;
 struct ct {
     obj_t obj;                                  /**< object base class */
     struct list_head trig_list;                 /**< list head of pending
-						     triggered operations */
-	struct list_head *trig_list_tmp;            /**< temporary holder for trig_list->prev*/
+						     triggered operations,
+						     sorted by threshold */
     struct list_head list;                      /**< list member of allocated
 						     counting events */
     atomic_t list_size;                         /**< Number of elements in list */
@@ -61,6 +61,10 @@ void post_ct_local(struct buf *buf, ct_t *ct);
 
 void make_ct_event(ct_t *ct, struct buf *buf, enum ct_bytes bytes);
 
+void make_ct_search_event(ct_t *ct, ptl_size_t success, ptl_size_t failure);
+
+void ct_add_trig(ct_t *ct, struct buf *buf);
+
 /**
  * Allocate a new ct object.
  *
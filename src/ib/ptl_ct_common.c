@@ -14,41 +14,44 @@
 #endif
 
 atomic_t keep_polling;
+/**
+ * @brief State of a thread waiting on a counting event.
+ */
+struct ct_wait {
+    const struct ct_info *ct_info;              /**< the counting event */
+    uint64_t threshold;                         /**< success to wait for */
+    ptl_ct_event_t *event_p;                    /**< where the value goes */
+};
+
+/* Ready callback of ptl_wait_until(), checks the threshold. */
+static int ct_wait_ready(void *arg)
+{
+    struct ct_wait *w = arg;
+    const struct ct_info *ct_info = w->ct_info;
+
+    if (ct_info->event.success >= w->threshold || ct_info->event.failure) {
+        *w->event_p = ct_info->event;
+        return 1;
+    }
+
+    return 0;
+}
+
 int PtlCTWait_work(struct ct_info *ct_info, uint64_t threshold,
                    ptl_ct_event_t *event_p)
 {
+    struct ct_wait w;
     int err;
-    atomic_inc(&keep_polling);
 
-    /* wait loop */
-    while (1) {
-        /* check if wait condition satisfied */
-        if (unlikely
-            (ct_info->event.success >= threshold || ct_info->event.failure)) {
-            *event_p = ct_info->event;
-            err = PTL_OK;
-            break;
-        }
+    w.ct_info = ct_info;
+    w.threshold = threshold;
+    w.event_p = event_p;
 
-        /* someone called PtlCTFree or PtlNIFini, leave */
-        //if (unlikely(ct_info->interrupt)) {
-        //    /* PTL_INTERRUPTED is deprecated as of 4.3 */ 
-        //    //err = PTL_INTERRUPTED;
-        //    err = PTL_FAIL;
-        //    break;
-        //}
-        
-        /* has PtlAbort() been called? */
-        err = check_abort_state();
-        if (err == PTL_ABORTED) {
-            atomic_dec(&keep_polling);
-            break;
-        } 
+    atomic_inc(&keep_polling);
+
+    err = ptl_wait_until(&ct_info->wait, ct_wait_ready, &w,
+                         PTL_WAIT_FOREVER, PTL_CT_NONE_REACHED);
 
-        /* memory barrier */
-        sched_yield();
-    }
-    
     atomic_dec(&keep_polling);
 
     return err;
@@ -124,9 +127,27 @@ int PtlCTPoll_work(struct ct_info *cts_info[], const ptl_size_t *thresholds,
 
     timeout_ns = MILLI_TO_TIMER_INTS(timeout);
 
+    /* A single counting event can be slept on until it changes,
+     * several are polled in turn. */
+    if (size == 1) {
+        struct ct_wait w;
+
+        w.ct_info = cts_info[0];
+        w.threshold = thresholds[0];
+        w.event_p = event_p;
+
+        err = ptl_wait_until(&cts_info[0]->wait, ct_wait_ready, &w,
+                             have_timeout ? timeout_ns : PTL_WAIT_FOREVER,
+                             PTL_CT_NONE_REACHED);
+        if (err == PTL_OK)
+            *which_p = 0;
+
+        atomic_dec(&keep_polling);
+        return err;
+    }
+
     /* poll loop */
     while (1) {
-        /* spin PTL_CT_POLL_LOOP_COUNT times */
         /* scan list to see if we can complete one */
         err = ct_poll_loop(size, cts_info, thresholds, event_p, which_p);
         if (err == PTL_ABORTED)
@@ -1,3 +1,5 @@
+#include "ptl_wait.h"
+
 struct ct_info {
     /* When PPE has been selected, the following fields will be shared
      * with the light library. The other fields are only used by the
@@ -6,6 +8,8 @@ struct ct_info {
 
     int interrupt;                              /**< flag indicating ct is
 						     getting shut down */
+
+    struct ptl_wait wait;                       /**< where waiters sleep */
 };
 
 int PtlCTPoll_work(struct ct_info *cts_info[], const ptl_size_t *thresholds,
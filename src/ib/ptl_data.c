@@ -15,7 +15,9 @@
  * an external segment list. These formats are called IMMEDIATE, DMA and
  * INDIRECT. InfiniBand DMA descriptors are based on OFA verbs sge's
  * (scatter gather elements). Shared memory DMA descriptors are based on
- * struct mem_iovec described below.
+ * struct mem_iovec described below. Over shared memory, mid-size puts
+ * use the EAGER format: the data is already in a buffer of the
+ * initiator in the comm pad, and the segment only says where.
  *
  * Three APIs are provided with the data_t struct: data_size returns
  * the actual size of a data segment, append_init_data and append_tgt_data
@@ -52,6 +54,11 @@ int data_size(data_t *data)
             break;
 #endif
 
+#if WITH_TRANSPORT_SHMEM
+        case DATA_FMT_EAGER:
+            break;
+#endif
+
 #if WITH_TRANSPORT_SHMEM && USE_KNEM
         case DATA_FMT_KNEM_DMA:
             size += data->mem.num_mem_iovecs * sizeof(struct mem_iovec);
@@ -32,8 +32,14 @@ enum data_fmt {
     DATA_FMT_KNEM_INDIRECT,
 #endif
 
+#if WITH_TRANSPORT_SHMEM
+    DATA_FMT_EAGER,
+#endif
+
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
     DATA_FMT_NOKNEM,
+    DATA_FMT_CMA,
+    DATA_FMT_CMA_INDIRECT,
 #endif
 
 #if IS_PPE
@@ -44,6 +50,11 @@ enum data_fmt {
 
 typedef enum data_fmt data_fmt_t;
 
+#if WITH_TRANSPORT_SHMEM && !USE_KNEM
+/* Largest number of bounce buffers used by a transfer. */
+#define NOKNEM_MAX_BUFS (8)
+#endif
+
 struct mem_iovec {
 #if WITH_TRANSPORT_SHMEM && USE_KNEM
     uint64_t cookie;
@@ -83,28 +94,53 @@ struct data {
         } mem;
 #endif
 
+#if WITH_TRANSPORT_SHMEM
+        /* Data of a mid-size put, copied by the initiator to one of
+         * its eager buffers, in the comm pad. */
+        struct {
+            uint32_t data_length;
+            uint64_t offset;            /* of the buffer in the comm pad */
+        } eager;
+#endif
+
 #if (WITH_TRANSPORT_SHMEM && !USE_KNEM)
-        /* State memory shared by both sides of the transfer. */
+        /* State memory shared by both sides of the transfer. The
+         * data goes through a ring of bounce buffers, so that the
+         * producer (the initiator of a put, the target of a get)
+         * fills buffer k+1 while the consumer drains buffer k. */
         struct noknem {
-            /* Transfer state.
-             * 0 = initiator to process (set by initiator)
-             * 1 = initiator processing (set by initiator)
-             * 2 = target to process (set by target)
-             * 3 = target processing (set by target)
-             * 4 = transfer done (set by target only.)
-             */
-            int state;
-
-            /* Length being transfered. Only the current owner can modify it. */
-            int length;
+            /* Size of the chunks going through the bounce buffers,
+             * chosen by the initiator. Only the last one may be
+             * shorter. */
+            uint32_t chunk_size;
 
-            /* Bounce buffer. */
-            off_t bounce_offset;
+            /* Number of chunks filled by the producer and drained by
+             * the consumer. Each side only increments its own. */
+            uint32_t produced;
+            uint32_t consumed;
 
-            /* Transfer done. Set by the target only. */
+            /* Transfer done. Each side sets its own. */
             int init_done;
             int target_done;
+
+            /* Length of a get, set by the target before it fills the
+             * first buffer. */
+            uint64_t length;
+
+            /* Bounce buffers, chosen by the initiator. */
+            uint16_t num_bufs;
+            uint16_t buf_index[NOKNEM_MAX_BUFS];
         } noknem;
+
+        /* Memory of the initiator, that the target copies from or to
+         * with cross memory attach. For DATA_FMT_CMA_INDIRECT,
+         * iovec[0] describes the array of iovecs instead. */
+        struct {
+            int32_t pid;
+            uint32_t num_iovecs;
+            uint64_t offset;            /* into the first iovec */
+            ptl_iovec_t iovec[0];
+        } cma;
 #endif
 
 #if WITH_TRANSPORT_UDP
@@ -141,6 +177,26 @@ struct mr;
 
 int data_size(data_t *data);
 
+/**
+ * @brief Find whether the data travels with the message.
+ *
+ * The initiator is then done with its memory once the message is
+ * built, as with immediate data.
+ *
+ * @param[in] data the data descriptor
+ *
+ * @return non-zero if the data was copied to the message
+ */
+static inline int data_is_eager(const data_t *data)
+{
+#if WITH_TRANSPORT_SHMEM
+    if (data->data_fmt == DATA_FMT_EAGER)
+        return 1;
+#endif
+
+    return data->data_fmt == DATA_FMT_IMMEDIATE;
+}
+
 int append_immediate_data(void *start, struct mr **mr_list, int num_iov,
                           data_dir_t dir, ptl_size_t offset,
                           ptl_size_t length, struct buf *buf);
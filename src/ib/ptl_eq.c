@@ -41,13 +41,10 @@ void eq_cleanup(void *arg)
     eq->eqe_list = NULL;
 }
 
-/* After an event is posted, check if there is any waiter. */
+/* After an event is posted, wake up the waiters if any sleeps. */
 static inline void check_waiter(struct eqe_list *eqe_list)
 {
-    if (atomic_read(&eqe_list->waiter) > 0) {
-        SPINLOCK_BODY();
-        sched_yield();
-    }
+    ptl_wait_wake(&eqe_list->wait);
 }
 
 /**
@@ -113,8 +110,9 @@ int _PtlEQAlloc(PPEGBL ptl_handle_ni_t ni_handle, ptl_size_t count,
     count += ni->limits.max_pt_index + 1;
 
     eq->eqe_list_size = sizeof(struct eqe_list) + count * sizeof(eqe_t);
-    eq->eqe_list = calloc(1, eq->eqe_list_size);
-    if (!eq->eqe_list) {
+    if (posix_memalign((void **)&eq->eqe_list, CACHELINE_WIDTH,
+                       eq->eqe_list_size)) {
+        eq->eqe_list = NULL;
         err = PTL_NO_SPACE;
         (void)__sync_fetch_and_sub(&ni->current.max_eqs, 1);
         eq_put(eq);
@@ -122,33 +120,19 @@ int _PtlEQAlloc(PPEGBL ptl_handle_ni_t ni_handle, ptl_size_t count,
     }
 
     eqe_list = eq->eqe_list;
+    memset(eqe_list, 0, eq->eqe_list_size);
 
     eqe_list->producer = 0;
     eqe_list->consumer = 0;
-    eqe_list->used = 0;
-    eqe_list->prod_gen = 0;
-    eqe_list->cons_gen = 0;
+    eqe_list->dropped = 0;
     eqe_list->interrupt = 0;
     eqe_list->count = count;
+    ptl_wait_init(&eqe_list->wait);
 
 #if IS_PPE
-    pthread_mutexattr_t mattr;
-    pthread_condattr_t cattr;
-
     PTL_FASTLOCK_INIT_SHARED(&eqe_list->lock);
-
-    pthread_mutexattr_init(&mattr);
-    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&eqe_list->mutex, &mattr);
-    pthread_mutexattr_destroy(&mattr);
-
-    pthread_condattr_init(&cattr);
-    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
-    pthread_cond_init(&eqe_list->cond, &cattr);
-    pthread_condattr_destroy(&cattr);
 #else
     PTL_FASTLOCK_INIT(&eqe_list->lock);
-
 #endif
 
     *eq_handle_p = eq_to_handle(eq);
@@ -281,6 +265,68 @@ int _PtlEQGet(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p)
     return err;
 }
 
+/**
+ * @brief Get the next events in an event queue.
+ *
+ * Takes up to count consecutive events from the event queue in one
+ * go, which saves a call per event when draining a busy queue.
+ *
+ * @param[in] eq_handle The handle of the event queue from which to get
+ * events.
+ * @param[in] count The size of the events array.
+ * @param[out] events The array of returned events.
+ * @param[out] num_events_p The address of the number of returned events.
+ *
+ * @return PTL_OK Indicates success.
+ * @return PTL_EQ_DROPPED Indicates success (i.e., events are returned)
+ * and that at least one full event between the first returned event and
+ * the last full event obtained from this event queue has been dropped
+ * due to limited space in the event queue.
+ * @return PTL_NO_INIT Indicates that the portals API has not been
+ * successfully initialized.
+ * @return PTL_EQ_EMPTY Indicates that eq_handle is empty.
+ * @return PTL_ARG_INVALID Indicates that eq_handle is not a valid event
+ * queue handle or that count is 0.
+ */
+int _PtlEQGetMany(PPEGBL ptl_handle_eq_t eq_handle, unsigned int count,
+                  ptl_event_t *events, unsigned int *num_events_p)
+{
+    int err;
+    eq_t *eq;
+
+#ifndef NO_ARG_VALIDATION
+    err = gbl_get();
+    if (err)
+        goto err0;
+
+    if (count == 0) {
+        err = PTL_ARG_INVALID;
+        goto err1;
+    }
+
+    err = to_eq(MYGBL_ eq_handle, &eq);
+    if (err)
+        goto err1;
+
+    if (!eq) {
+        err = PTL_ARG_INVALID;
+        goto err1;
+    }
+#else
+    eq = to_obj(MYGBL_ POOL_ANY, eq_handle);
+#endif
+
+    err = PtlEQGetMany_work(eq->eqe_list, count, events, num_events_p);
+
+    eq_put(eq);
+#ifndef NO_ARG_VALIDATION
+  err1:
+    gbl_put();
+  err0:
+#endif
+    return err;
+}
+
 /**
  * @brief Wait for next event in event queue.
  *
@@ -341,19 +387,24 @@ int _PtlEQWait(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p)
 }
 
 /**
- * @brief Poll for an event in an array of event queues.
+ * @brief Poll for events in an array of event queues.
+ *
+ * Once an event is found in one of the event queues, up to count
+ * consecutive events are taken from that queue.
  *
  * @param[in] eq_handles array of event queue handles
  * @param[in] size the size of the array
  * @param[in] timeout how long to poll in msec
- * @param[out] event_p address of returned event
+ * @param[in] count the size of the events array
+ * @param[out] events array of returned events
+ * @param[out] num_events_p address of the number of returned events
  * @param[out] which_p address of returned array index
  *
  * @return PTL_OK Indicates success.
- * @return PTL_EQ_DROPPED Indicates success (i.e., an event is returned)
- * and that at least one full event between this full event and the
- * last full event obtained from the event queue indicated by which has
- * been dropped due to limited space in the event queue.
+ * @return PTL_EQ_DROPPED Indicates success (i.e., events are returned)
+ * and that at least one full event between the first returned event and
+ * the last full event obtained from the event queue indicated by which
+ * has been dropped due to limited space in the event queue.
  * @return PTL_NO_INIT Indicates that the portals API has not been
  * successfully initialized.
  * @return PTL_ARG_INVALID Indicates that an invalid argument was passed.
@@ -361,9 +412,10 @@ int _PtlEQWait(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p)
  * @return PTL_EQ_EMPTY Indicates that the timeout has been reached and all
  * of the event queues are empty.
  */
-int _PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
-               ptl_time_t timeout, ptl_event_t *event_p,
-               unsigned int *which_p)
+int _PtlEQPollMany(PPEGBL const ptl_handle_eq_t * eq_handles,
+                   unsigned int size, ptl_time_t timeout, unsigned int count,
+                   ptl_event_t *events, unsigned int *num_events_p,
+                   unsigned int *which_p)
 {
     int err;
     int ret;
@@ -392,9 +444,9 @@ int _PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
         goto err0;
 #endif
 
-    if (size == 0) {
+    if (size == 0 || count == 0) {
         err = PTL_ARG_INVALID;
-        
+        goto err1;
     }
     
 #ifndef NO_ARG_VALIDATION
@@ -425,7 +477,8 @@ int _PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
     i2 = size - 1;
 #endif
 
-    err = PtlEQPoll_work(PPEGBL eqes_list, size, timeout, event_p, which_p);
+    err = PtlEQPollMany_work(eqes_list, size, timeout, count, events,
+                             num_events_p, which_p);
 
 #ifndef NO_ARG_VALIDATION
   err2:
@@ -443,35 +496,129 @@ int _PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
     return err;
 }
 
-static inline ptl_event_t *reserve_ev(eq_t *restrict eq)
+/**
+ * @brief Poll for an event in an array of event queues.
+ *
+ * @param[in] eq_handles array of event queue handles
+ * @param[in] size the size of the array
+ * @param[in] timeout how long to poll in msec
+ * @param[out] event_p address of returned event
+ * @param[out] which_p address of returned array index
+ *
+ * @return PTL_OK Indicates success.
+ * @return PTL_EQ_DROPPED Indicates success (i.e., an event is returned)
+ * and that at least one full event between this full event and the
+ * last full event obtained from the event queue indicated by which has
+ * been dropped due to limited space in the event queue.
+ * @return PTL_NO_INIT Indicates that the portals API has not been
+ * successfully initialized.
+ * @return PTL_ARG_INVALID Indicates that an invalid argument was passed.
+ * The definition of which arguments are checked is implementation dependent.
+ * @return PTL_EQ_EMPTY Indicates that the timeout has been reached and all
+ * of the event queues are empty.
+ */
+int _PtlEQPoll(PPEGBL const ptl_handle_eq_t * eq_handles, unsigned int size,
+               ptl_time_t timeout, ptl_event_t *event_p,
+               unsigned int *which_p)
 {
-    ptl_event_t *ev;
-    eqe_t *eqe;
-    struct eqe_list *eqe_list;
+    unsigned int num_events;
 
-    eqe_list = eq->eqe_list;
-    eqe = &eqe_list->eqe[eqe_list->producer];
+    return _PtlEQPollMany(MYGBL_ eq_handles, size, timeout, 1, event_p,
+                          &num_events, which_p);
+}
 
-    eqe->generation = eqe_list->prod_gen;
-    ev = &eqe->event;
+/**
+ * @brief Claim the next slot of the event queue.
+ *
+ * The slot is marked as being written until post_ev() is called. If
+ * the queue is full, the oldest event is dropped first. A slot is
+ * only reused once the consumer position has moved past it, so it is
+ * never written by two producers at once, and a consumer still
+ * copying the old event sees the consumer position change and
+ * discards its copy.
+ *
+ * @param[in] eq the event queue
+ * @param[out] pos the position of the slot
+ *
+ * @return the event to fill
+ */
+static inline ptl_event_t *reserve_ev(eq_t *restrict eq, uint64_t *pos)
+{
+    struct eqe_list *eqe_list = eq->eqe_list;
+    uint64_t consumer;
+    eqe_t *eqe;
+
+    while (1) {
+        consumer = eqe_list->consumer;
+        *pos = eqe_list->producer;
+
+        if (*pos - consumer >= eqe_list->count) {
+            /* Full. Drop the oldest event, once its producer has
+             * published it. */
+            eqe = &eqe_list->eqe[consumer % eqe_list->count];
+            if (eqe->seq == consumer + 1 &&
+                __sync_bool_compare_and_swap(&eqe_list->consumer, consumer,
+                                             consumer + 1))
+                eqe_list->dropped = 1;
+            else
+                SPINLOCK_BODY();
+            continue;
+        }
 
-    eqe_list->producer++;
-    if (eqe_list->producer >= eqe_list->count) {
-        eqe_list->producer = 0;
-        eqe_list->prod_gen++;
+        if (__sync_bool_compare_and_swap(&eqe_list->producer, *pos,
+                                         *pos + 1))
+            break;
     }
 
-    eqe_list->used++;
+    eqe = &eqe_list->eqe[*pos % eqe_list->count];
+
+    eqe->seq = 0;
+    __sync_synchronize();
 
     /* If all unreserved entries are used, then the queue is
      * overflowing. It matters only if an attached PT wants flow
      * control. TODO: we should not be counting already inserted
      * reserved entries. */
-    if (eqe_list->used == eq->count_simple && !list_empty(&eq->flowctrl_list)) {
+    if (*pos + 1 - consumer == eq->count_simple &&
+        !list_empty(&eq->flowctrl_list)) {
         eq->overflowing = 1;
     }
 
-    return ev;
+    return &eqe->event;
+}
+
+/* Make an event filled after reserve_ev() visible to consumers. */
+static inline void publish_ev(ptl_event_t *ev, uint64_t pos)
+{
+    eqe_t *eqe = container_of(ev, eqe_t, event);
+
+    __sync_synchronize();
+    eqe->seq = pos + 1;
+}
+
+static void process_overflowing(eq_t *restrict eq);
+
+/**
+ * @brief Publish an event filled after reserve_ev().
+ *
+ * @param[in] eq the event queue
+ * @param[in] ev the event
+ * @param[in] pos the position returned by reserve_ev()
+ */
+static inline void post_ev(eq_t *restrict eq, ptl_event_t *ev, uint64_t pos)
+{
+    publish_ev(ev, pos);
+
+    /* If the EQ is overflowing, warn every PT not already stopped by
+     * using one of the reserved EQ entries. */
+    if (unlikely(eq->overflowing)) {
+        PTL_FASTLOCK_LOCK(&eq->eqe_list->lock);
+        if (eq->overflowing)
+            process_overflowing(eq);
+        PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
+    }
+
+    check_waiter(eq->eqe_list);
 }
 
 /* Overflow situation. The EQ lock must be taken. */
@@ -482,9 +629,12 @@ static void process_overflowing(eq_t *restrict eq)
     struct list_head *l;
     pt_t *pt;
     ptl_event_t *ev;
+    uint64_t pos;
 
     assert(eq->overflowing);
 
+    eq->overflowing = 0;
+
     list_for_each(l, &eq->flowctrl_list) {
         pt = list_entry(l, pt_t, flowctrl_list);
 
@@ -493,15 +643,15 @@ static void process_overflowing(eq_t *restrict eq)
 
             /* Note/TODO: this will take a reserved entry but it
              * will be counted as a regular entry later. */
-            ev = reserve_ev(eq);
+            ev = reserve_ev(eq, &pos);
 
             ev->type = PTL_EVENT_PT_DISABLED;
             ev->pt_index = pt->index;
             ev->ni_fail_type = PTL_NI_PT_DISABLED;
+
+            publish_ev(ev, pos);
         }
     }
-
-    eq->overflowing = 0;
 }
 
 /**
@@ -522,10 +672,9 @@ void make_init_event(buf_t *restrict buf, eq_t *restrict eq,
     }
 
     ptl_event_t *ev;
+    uint64_t pos;
 
-    PTL_FASTLOCK_LOCK(&eq->eqe_list->lock);
-
-    ev = reserve_ev(eq);
+    ev = reserve_ev(eq, &pos);
     ev->type = type;
     ev->user_ptr = buf->user_ptr;
 
@@ -544,14 +693,7 @@ void make_init_event(buf_t *restrict buf, eq_t *restrict eq,
         ev->ptl_list = buf->matching_list;
     }
 
-    /* If the EQ is overflowing, warn every PT not already stopped by
-     * using one of the reserved EQ entries. */
-    if (eq->overflowing)
-        process_overflowing(eq);
-
-    PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
-
-    check_waiter(eq->eqe_list);
+    post_ev(eq, ev, pos);
 }
 
 /**
@@ -595,16 +737,13 @@ void fill_target_event(buf_t *restrict buf, ptl_event_kind_t type,
  */
 void send_target_event(eq_t *restrict eq, ptl_event_t *restrict ev)
 {
-    PTL_FASTLOCK_LOCK(&eq->eqe_list->lock);
-
-    *(reserve_ev(eq)) = *ev;
+    ptl_event_t *slot;
+    uint64_t pos;
 
-    if (eq->overflowing)
-        process_overflowing(eq);
+    slot = reserve_ev(eq, &pos);
+    *slot = *ev;
 
-    PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
-
-    check_waiter(eq->eqe_list);
+    post_ev(eq, slot, pos);
 }
 
 /**
@@ -620,19 +759,13 @@ void make_target_event(buf_t *restrict buf, eq_t *restrict eq,
                        ptl_event_kind_t type, void *user_ptr, void *start)
 {
     ptl_event_t *ev;
+    uint64_t pos;
 
-    PTL_FASTLOCK_LOCK(&eq->eqe_list->lock);
-
-    ev = reserve_ev(eq);
+    ev = reserve_ev(eq, &pos);
 
     fill_target_event(buf, type, user_ptr, start, ev);
 
-    if (eq->overflowing)
-        process_overflowing(eq);
-
-    PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
-
-    check_waiter(eq->eqe_list);
+    post_ev(eq, ev, pos);
 }
 
 /**
@@ -647,19 +780,13 @@ void make_le_event(le_t *restrict le, eq_t *restrict eq,
                    ptl_event_kind_t type, ptl_ni_fail_t fail_type)
 {
     ptl_event_t *ev;
+    uint64_t pos;
 
-    PTL_FASTLOCK_LOCK(&eq->eqe_list->lock);
-
-    ev = reserve_ev(eq);
+    ev = reserve_ev(eq, &pos);
     ev->type = type;
     ev->pt_index = le->pt_index;
     ev->user_ptr = le->user_ptr;
     ev->ni_fail_type = fail_type;
 
-    if (eq->overflowing)
-        process_overflowing(eq);
-
-    PTL_FASTLOCK_UNLOCK(&eq->eqe_list->lock);
-
-    check_waiter(eq->eqe_list);
+    post_ev(eq, ev, pos);
 }
@@ -26,65 +26,113 @@ extern atomic_t keep_polling;
  *
  * @param[in] eq the event queue
  *
- * @return non-zero if the queue is empty. The result is not
- * guaranteed unless the eq->lock is taken. However it is sufficient
- * to give an idea whether get_event() can be called. This avoids
- * taking a lock.
+ * @return non-zero if the queue is empty. The result is only a hint,
+ * an event may have been claimed but not written yet. It is
+ * sufficient to give an idea whether get_event() can be called.
  */
 static int inline is_queue_empty(struct eqe_list *eqe_list)
 {
-    return ((eqe_list->producer == eqe_list->consumer) &&
-            (eqe_list->prod_gen == eqe_list->cons_gen));
+    return eqe_list->producer == eqe_list->consumer;
 }
 
 /**
- * @brief Find next event in event queue.
+ * @brief Find the next events in event queue.
+ *
+ * Several threads may call it at once. Consecutive events are copied
+ * out of their slots, then the consumer position is moved past them
+ * if no other consumer took them and no producer overwrote them
+ * meanwhile.
  *
  * @param[in] eq the event queue
- * @param[out] event_p the address of the returned event
+ * @param[out] events the array of returned events
+ * @param[in] count the size of the array
+ * @param[out] num_p the number of returned events
  *
- * @return PTL_EQ_EMPTY if there are no events in the queue
- * @return PTL_EQ_DROPPED if there was an event but there was a
- * gap since the last event returned
- * @return PTL_EQ_OK if there was an event and no gap
+ * @return PTL_OK if events were returned
+ * @return PTL_EQ_DROPPED if events were returned but events preceding
+ * them have been dropped
+ * @return PTL_EQ_EMPTY if the queue was empty
  */
-static int get_event(struct eqe_list *restrict eqe_list,
-                     ptl_event_t *restrict event_p)
+static int get_events(struct eqe_list *restrict eqe_list,
+                      ptl_event_t *restrict events, unsigned int count,
+                      unsigned int *num_p)
 {
-    int dropped = 0;
+    uint64_t pos;
+    uint64_t seq = 0;           /* stays 0 if count is 0 */
+    uint64_t producer;
+    unsigned int n;
+    unsigned int i;
+    eqe_t *eqe;
 
-    PTL_FASTLOCK_LOCK(&eqe_list->lock);
+    while (1) {
+        pos = eqe_list->consumer;
 
-    /* check to see if the queue is empty */
-    if (is_queue_empty(eqe_list)) {
-        PTL_FASTLOCK_UNLOCK(&eqe_list->lock);
-        return PTL_EQ_EMPTY;
-    }
+        for (n = 0; n < count; n++) {
+            eqe = &eqe_list->eqe[(pos + n) % eqe_list->count];
 
-    /* if we have been lapped by the producer advance the
-     * consumer pointer until we catch up */
-    while (eqe_list->cons_gen < eqe_list->eqe[eqe_list->consumer].generation) {
-        eqe_list->consumer++;
-        if (eqe_list->consumer == eqe_list->count) {
-            eqe_list->consumer = 0;
-            eqe_list->cons_gen++;
+            seq = eqe->seq;
+            __sync_synchronize();
+
+            if (seq != pos + n + 1)
+                break;
+
+            events[n] = eqe->event;
         }
-        dropped = 1;
-        eqe_list->used--;
-    }
 
-    /* return the next valid event and update the consumer pointer */
-    *event_p = eqe_list->eqe[eqe_list->consumer++].event;
-    if (eqe_list->consumer >= eqe_list->count) {
-        eqe_list->consumer = 0;
-        eqe_list->cons_gen++;
-    }
+        if (n) {
+            __sync_synchronize();
 
-    eqe_list->used--;
+            /* keep only the events not overwritten while copying */
+            for (i = 0; i < n; i++) {
+                if (eqe_list->eqe[(pos + i) % eqe_list->count].seq !=
+                    pos + i + 1)
+                    break;
+            }
+            if (i == 0)
+                continue;
+
+            if (!__sync_bool_compare_and_swap(&eqe_list->consumer, pos,
+                                              pos + i))
+                continue;
 
-    PTL_FASTLOCK_UNLOCK(&eqe_list->lock);
+            *num_p = i;
+
+            return __sync_lock_test_and_set(&eqe_list->dropped, 0) ?
+                PTL_EQ_DROPPED : PTL_OK;
+        }
 
-    return dropped ? PTL_EQ_DROPPED : PTL_OK;
+        /* The slot holds an older event, or is being written. Unless
+         * the producers lapped the consumer, the event is not there
+         * yet. */
+        producer = eqe_list->producer;
+        if (seq < pos + 1 && pos + eqe_list->count >= producer)
+            return PTL_EQ_EMPTY;
+
+        /* We have been lapped by the producer, skip to the oldest
+         * event still in the queue. */
+        if (__sync_bool_compare_and_swap(&eqe_list->consumer, pos,
+                                         producer - eqe_list->count))
+            eqe_list->dropped = 1;
+    }
+}
+
+/**
+ * @brief Find next event in event queue.
+ *
+ * @param[in] eq the event queue
+ * @param[out] event_p the address of the returned event
+ *
+ * @return PTL_OK if an event was returned
+ * @return PTL_EQ_DROPPED if an event was returned but events preceding
+ * it have been dropped
+ * @return PTL_EQ_EMPTY if the queue was empty
+ */
+static inline int get_event(struct eqe_list *restrict eqe_list,
+                            ptl_event_t *restrict event_p)
+{
+    unsigned int num;
+
+    return get_events(eqe_list, event_p, 1, &num);
 }
 
 /**
@@ -99,69 +147,78 @@ int PtlEQGet_work(struct eqe_list *eqe_list, ptl_event_t *event_p)
     return err;
 }
 
-static inline int check_eq(struct eqe_list *eqe_list, ptl_event_t *event_p)
+/**
+ * Do the work for PtlEQGetMany
+ */
+int PtlEQGetMany_work(struct eqe_list *eqe_list, unsigned int count,
+                      ptl_event_t *events, unsigned int *num_events_p)
 {
     int err;
 
-    if (!is_queue_empty(eqe_list)) {
-        err = get_event(eqe_list, event_p);
-        if (err != PTL_EQ_EMPTY)
-            return err;
-    }
+    *num_events_p = 0;
 
-    //if (eqe_list->interrupt) {
-    //    /* PTL_INTERRUPTED is deprecated as of 4.3 */
-    //    /* return PTL_INTERRUPTED; */
-    //    return PTL_FAIL;
-    //}
+    err = get_events(eqe_list, events, count, num_events_p);
 
-    return PTL_EQ_EMPTY;
+    return err;
 }
 
 /**
- * Do the work for PtlEQWait
+ * @brief State of a thread waiting on an event queue.
  */
-int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p)
+struct eq_wait {
+    struct eqe_list *eqe_list;                  /**< the event queue */
+    ptl_event_t *events;                        /**< where events go */
+    unsigned int count;                         /**< size of events */
+    unsigned int *num_p;                        /**< events returned */
+    int err;                                    /**< get_events() result */
+};
+
+/* Ready callback of ptl_wait_until(), tries to get the events. */
+static int eq_wait_ready(void *arg)
 {
-    int err;
-    atomic_inc(&keep_polling);
-    atomic_inc(&eqe_list->waiter);
+    struct eq_wait *w = arg;
 
-    while (1) {
+    if (is_queue_empty(w->eqe_list))
+        return 0;
 
-        /*
-         * has PtlAbort been called?
-         * if so, leave immediately
-         */
-        err = check_abort_state();
-        if (err == PTL_ABORTED)
-            break;
+    w->err = get_events(w->eqe_list, w->events, w->count, w->num_p);
 
+    return w->err != PTL_EQ_EMPTY;
+}
 
-        err = check_eq(eqe_list, event_p);
-        if (err != PTL_EQ_EMPTY)
-            break;
+/**
+ * Do the work for PtlEQWait
+ */
+int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p)
+{
+    struct eq_wait w;
+    unsigned int num;
+    int err;
 
-        sched_yield();
+    w.eqe_list = eqe_list;
+    w.events = event_p;
+    w.count = 1;
+    w.num_p = &num;
 
+    atomic_inc(&keep_polling);
 
-    }
+    err = ptl_wait_until(&eqe_list->wait, eq_wait_ready, &w,
+                         PTL_WAIT_FOREVER, PTL_EQ_EMPTY);
+    if (err == PTL_OK)
+        err = w.err;
 
-    atomic_dec(&eqe_list->waiter);
     atomic_dec(&keep_polling);
 
     return err;
-
-  err0:
-    return err;
 }
 
 /**
- * Do the work for PtlEQPoll.
+ * Do the work for PtlEQPollMany.
  */
-int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
-                   ptl_time_t timeout, ptl_event_t *event_p,
-                   unsigned int *which_p)
+int PtlEQPollMany_work(struct eqe_list *eqe_list_in[], unsigned int size,
+                       ptl_time_t timeout, unsigned int count,
+                       ptl_event_t *events, unsigned int *num_events_p,
+                       unsigned int *which_p)
 {
     int err;
     int ret;
@@ -178,12 +235,34 @@ int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
     timeout_ns = MILLI_TO_TIMER_INTS(timeout);
     atomic_inc(&keep_polling);
 
+    *num_events_p = 0;
+
+    /* A single queue can be slept on until a producer wakes it up,
+     * several queues are polled in turn. */
+    if (size == 1) {
+        struct eq_wait w;
+
+        w.eqe_list = eqe_list_in[0];
+        w.events = events;
+        w.count = count;
+        w.num_p = num_events_p;
+
+        err = ptl_wait_until(&w.eqe_list->wait, eq_wait_ready, &w,
+                             forever ? PTL_WAIT_FOREVER : timeout_ns,
+                             PTL_EQ_EMPTY);
+        if (err == PTL_OK) {
+            err = w.err;
+            *which_p = 0;
+        }
+        goto out;
+    }
+
     while (1) {
         for (i = 0; i < size; i++) {
             struct eqe_list *eqe_list = eqe_list_in[i];
 
             if (!is_queue_empty(eqe_list)) {
-                err = get_event(eqe_list, event_p);
+                err = get_events(eqe_list, events, count, num_events_p);
 
                 if (err != PTL_EQ_EMPTY) {
                     *which_p = i;
@@ -223,3 +302,16 @@ int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
     atomic_dec(&keep_polling);
     return err;
 }
+
+/**
+ * Do the work for PtlEQPoll.
+ */
+int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
+                   ptl_time_t timeout, ptl_event_t *event_p,
+                   unsigned int *which_p)
+{
+    unsigned int num;
+
+    return PtlEQPollMany_work(eqe_list_in, size, timeout, 1, event_p, &num,
+                              which_p);
+}
@@ -9,35 +9,50 @@
 #define PTL_EQ_COMMON_H
 
 #include "ptl_locks.h"
+#include "ptl_queue.h"
+#include "ptl_wait.h"
 
 /**
  * Event queue entry.
  */
 typedef struct {
-    unsigned int generation;                    /**< increments each time the producer
-									   pointer wraps */
+    uint64_t seq;                               /**< position of the event
+									   in the queue plus one, 0 while
+									   it is being written */
     ptl_event_t event;                          /**< portals event */
 } eqe_t;
 
-// todo: reorder fields for better performance. use align.
+/**
+ * Event queue ring.
+ *
+ * Producers and consumers claim positions with atomic operations, a
+ * slot is valid for position pos when its seq is pos + 1, so the
+ * generation of a slot is (seq - 1) / count. When the queue overflows
+ * the producers overwrite the oldest events, and the consumer skips
+ * them and reports PTL_EQ_DROPPED.
+ *
+ * The ring is shared with the light library clients through xpmem, so
+ * it holds no pointers.
+ */
 struct eqe_list {
-    unsigned int producer;                      /**< producer index */
-    unsigned int consumer;                      /**< consumer index */
-    unsigned int prod_gen;                      /**< producer generation */
-    unsigned int cons_gen;                      /**< consumer generation */
-    int interrupt;                                              /**< if set eq is being
-									   freed or destroyed */
-    unsigned int used;                          /**< number of slots used */
-    unsigned int count;                         /**< size of event queue */
+    /* Producers cacheline. */
+    uint64_t producer __attribute__ ((aligned(CACHELINE_WIDTH)));   /**< next position to write */
 
-    PTL_FASTLOCK_TYPE lock;             /**< lock for adding */
+    /* Consumers cacheline. */
+    uint64_t consumer __attribute__ ((aligned(CACHELINE_WIDTH)));   /**< next position to read */
+    int dropped;                                /**< set if events were
+									   overwritten before being read */
+    struct ptl_wait wait;                       /**< where consumers
+									   sleep */
 
-    pthread_mutex_t mutex;     /**< mutex for eq condition */
-    pthread_cond_t cond;
+    /* Read mostly. */
+    unsigned int count __attribute__ ((aligned(CACHELINE_WIDTH)));  /**< size of event queue */
+    int interrupt;                                              /**< if set eq is being
+									   freed or destroyed */
 
-    atomic_t waiter;
+    PTL_FASTLOCK_TYPE lock;             /**< lock for flow control */
 
-    eqe_t eqe[0];
+    eqe_t eqe[0] __attribute__ ((aligned(CACHELINE_WIDTH)));
 };
 
 int PtlEQGet_work(struct eqe_list *eqe_list, ptl_event_t *event_p);
@@ -45,5 +60,11 @@ int PtlEQWait_work(struct eqe_list *eqe_list, ptl_event_t *event_p);
 int PtlEQPoll_work(struct eqe_list *eqe_list_in[], unsigned int size,
                    ptl_time_t timeout, ptl_event_t *event_p,
                    unsigned int *which_p);
+int PtlEQGetMany_work(struct eqe_list *eqe_list, unsigned int count,
+                      ptl_event_t *events, unsigned int *num_events_p);
+int PtlEQPollMany_work(struct eqe_list *eqe_list_in[], unsigned int size,
+                       ptl_time_t timeout, unsigned int count,
+                       ptl_event_t *events, unsigned int *num_events_p,
+                       unsigned int *which_p);
 
 #endif /* PTL_EQ_COMMON_H */
@@ -195,15 +195,24 @@ static void dump_everything(int unused)
             if (ni->options & PTL_NI_LOGICAL) {
                 printf("  Connections on logical NI:\n");
 
-                if (ni->logical.rank_table) {
+                if (ni->logical.conn_dir) {
                     for (k = 0; k < ni->logical.map_size; k++) {
-                        struct rank_entry *entry = &ni->logical.rank_table[k];
-                        printf("    rank            = %d\n", entry->rank);
+                        conn_t **leaf =
+                            ni->logical.conn_dir[k >> CONN_DIR_BITS];
+                        conn_t *conn;
+
+                        if (!leaf)
+                            continue;
+
+                        conn = leaf[k & (CONN_DIR_LEAF_SIZE - 1)];
+                        if (!conn)
+                            continue;
+
+                        printf("    rank            = %d\n", k);
                         printf("    max pending wr  = %d\n",
-                               entry->connect->rdma.max_req_avail);
+                               conn->rdma.max_req_avail);
                         printf("    pending send wr = %d\n",
-                               atomic_read(&entry->connect->
-                                           rdma.num_req_posted));
+                               atomic_read(&conn->rdma.num_req_posted));
                     }
                 }
             }
@@ -247,6 +256,8 @@ int gbl_init(gbl_t *gbl)
     if (err)
         return err;
 
+    atomic_simd_init();
+
     pthread_mutex_init(&gbl->gbl_mutex, NULL);
     /* for PtlAbort */
     pthread_mutex_init(&abort_state.abort_state_mutex, NULL);
@@ -284,6 +295,11 @@ void PtlAbort(void)
     _PtlAbort(&per_proc_gbl);
 }
 
+int PtlAtomicSync(void)
+{
+    return _PtlAtomicSync(&per_proc_gbl);
+}
+
 void PtlFini(void)
 {
     _PtlFini(&per_proc_gbl);
@@ -83,6 +83,9 @@ typedef struct gbl {
 
     atomic_t next_index;
     void **index_map;
+    pthread_mutex_t index_mutex;
+    unsigned int *index_free;   /* indexes of freed objects */
+    unsigned int num_index_free;
 
     /* PPE specific. */
 
@@ -138,6 +141,9 @@ typedef struct gbl {
 
     atomic_t next_index;
     void **index_map;
+    pthread_mutex_t index_mutex;
+    unsigned int *index_free;   /* indexes of freed objects */
+    unsigned int num_index_free;
 } gbl_t;
 
 extern gbl_t per_proc_gbl;
@@ -0,0 +1,178 @@
+/**
+ * @file ptl_hdr.c
+ *
+ * @brief Compact request header encoding.
+ */
+
+#include "ptl_loc.h"
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t val)
+{
+    while (val >= 0x80) {
+        *p++ = val | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+
+    return p;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end,
+                                        uint64_t *val)
+{
+    uint64_t v = 0;
+    int shift;
+
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *val = v;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Encode a request header in the compact format.
+ *
+ * @param[in] hdr the request header
+ * @param[out] out where to write the compact header, at least
+ * REQ_HDR_COMPACT_MAX bytes, aligned like a req_hdr_t
+ *
+ * @return the length of the compact header, or 0 if it would not be
+ * shorter than the request header
+ */
+unsigned int req_hdr_pack(const req_hdr_t *hdr, void *out)
+{
+    req_hdr_t *chdr = out;      /* only the fixed part is valid */
+    uint8_t *p = out;
+    uint32_t pt_index = le32_to_cpu(hdr->pt_index);
+    uint64_t roffset = le64_to_cpu(hdr->roffset);
+    uint64_t match_bits = le64_to_cpu(hdr->match_bits);
+    uint64_t hdr_data = le64_to_cpu(hdr->hdr_data);
+    uint32_t uid = le32_to_cpu(hdr->uid);
+    unsigned int fields = 0;
+    unsigned int length;
+
+    if (pt_index > 0xffff)
+        return 0;
+
+    memcpy(out, hdr, REQ_HDR_FIXED_SIZE);
+    p += REQ_HDR_FIXED_SIZE;
+
+    *p++ = pt_index;
+    *p++ = pt_index >> 8;
+
+    p = put_varint(p, le64_to_cpu(hdr->rlength));
+
+    if (roffset) {
+        fields |= HDR_FIELD_ROFFSET;
+        p = put_varint(p, roffset);
+    }
+
+    if (match_bits) {
+        fields |= HDR_FIELD_MATCH_BITS;
+        p = put_varint(p, match_bits);
+    }
+
+    if (hdr_data) {
+        fields |= HDR_FIELD_HDR_DATA;
+        p = put_varint(p, hdr_data);
+    }
+
+    if (uid) {
+        fields |= HDR_FIELD_UID;
+        p = put_varint(p, uid);
+    }
+
+    length = p - (uint8_t *)out;
+    if (length >= sizeof(req_hdr_t))
+        return 0;
+
+    chdr->h1.compact = 1;
+    chdr->fields = fields;
+
+    return length;
+}
+
+/**
+ * @brief Turn a received compact request header back into a
+ * req_hdr_t, in place.
+ *
+ * The data segments following the header are moved accordingly, and
+ * the buf length adjusted.
+ *
+ * @param[in] buf the received buf
+ *
+ * @return status
+ */
+int req_hdr_unpack(buf_t *buf)
+{
+    const uint8_t *p = buf->data;
+    const uint8_t *end = p + buf->length;
+    req_hdr_t hdr;
+    unsigned int fields;
+    unsigned int rest;
+    uint64_t val;
+
+    if (buf->length < REQ_HDR_FIXED_SIZE + 2)
+        return PTL_FAIL;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(&hdr, p, REQ_HDR_FIXED_SIZE);
+    p += REQ_HDR_FIXED_SIZE;
+
+    fields = hdr.fields;
+    hdr.fields = 0;
+    hdr.h1.compact = 0;
+
+    hdr.pt_index = cpu_to_le32(p[0] | (p[1] << 8));
+    p += 2;
+
+    p = get_varint(p, end, &val);
+    if (!p)
+        return PTL_FAIL;
+    hdr.rlength = cpu_to_le64(val);
+
+    if (fields & HDR_FIELD_ROFFSET) {
+        p = get_varint(p, end, &val);
+        if (!p)
+            return PTL_FAIL;
+        hdr.roffset = cpu_to_le64(val);
+    }
+
+    if (fields & HDR_FIELD_MATCH_BITS) {
+        p = get_varint(p, end, &val);
+        if (!p)
+            return PTL_FAIL;
+        hdr.match_bits = cpu_to_le64(val);
+    }
+
+    if (fields & HDR_FIELD_HDR_DATA) {
+        p = get_varint(p, end, &val);
+        if (!p)
+            return PTL_FAIL;
+        hdr.hdr_data = cpu_to_le64(val);
+    }
+
+    if (fields & HDR_FIELD_UID) {
+        p = get_varint(p, end, &val);
+        if (!p)
+            return PTL_FAIL;
+        hdr.uid = cpu_to_le32(val);
+    }
+
+    rest = end - p;
+    if (sizeof(hdr) + rest > BUF_DATA_SIZE)
+        return PTL_FAIL;
+
+    memmove(buf->data + sizeof(hdr), p, rest);
+    memcpy(buf->data, &hdr, sizeof(hdr));
+    buf->length = sizeof(hdr) + rest;
+
+    return PTL_OK;
+}
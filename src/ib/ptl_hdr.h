@@ -55,7 +55,8 @@ struct hdr_common {
     unsigned int data_out:1;
     unsigned int matching_list:2;   /* response only */
     unsigned int operand:1;
-    unsigned int pad:6;
+    unsigned int compact:1;     /* request in the compact format */
+    unsigned int pad:5;
     unsigned int physical:1;    /* PPE */
     unsigned int ni_type:4;     /* request only */
     unsigned int pkt_fmt:4;     /* request only */
@@ -88,7 +89,8 @@ typedef struct req_hdr {
     unsigned int ack_req:4;
     unsigned int atom_type:4;
     unsigned int atom_op:5;
-    unsigned int reserved_19:19;
+    unsigned int fields:4;      /* compact format only */
+    unsigned int reserved_15:15;
     __le64 rlength;
     __le64 roffset;
     __le64 match_bits;
@@ -101,6 +103,28 @@ typedef struct req_hdr {
 #endif
 } req_hdr_t;
 
+/*
+ * Compact request header. It starts with the same hdr_common and
+ * flags word as req_hdr_t, with h1.compact set, followed by:
+ *   - the portal table index, on 16 bits,
+ *   - rlength, as a varint,
+ *   - roffset, match_bits, hdr_data and uid, as varints, only when
+ *     their bit is set in fields, ie. when they are not 0.
+ * The data segments of the request come right after it. The target
+ * turns it back into a req_hdr_t before processing the request.
+ */
+enum hdr_fields {
+    HDR_FIELD_ROFFSET = 1 << 0,
+    HDR_FIELD_MATCH_BITS = 1 << 1,
+    HDR_FIELD_HDR_DATA = 1 << 2,
+    HDR_FIELD_UID = 1 << 3,
+};
+
+#define REQ_HDR_FIXED_SIZE (sizeof(struct hdr_common) + sizeof(uint32_t))
+
+/* A varint takes up to 10 bytes for 64 bits, and 5 for 32 bits. */
+#define REQ_HDR_COMPACT_MAX (REQ_HDR_FIXED_SIZE + 2 + 4 * 10 + 5)
+
 /* Header for an ack or a reply. */
 typedef struct ack_hdr {
     struct hdr_common h1;
@@ -108,4 +132,10 @@ typedef struct ack_hdr {
     __le64 moffset;
 } ack_hdr_t;
 
+struct buf;
+
+unsigned int req_hdr_pack(const req_hdr_t *hdr, void *out);
+
+int req_hdr_unpack(struct buf *buf);
+
 #endif /* PTL_HDR_H */
@@ -43,6 +43,9 @@ void cleanup_iface(iface_t *iface)
 #if WITH_TRANSPORT_UDP
     //close the socket
     close(iface->udp.connect_s);
+#if !IS_PPE
+    udp_recv_fini(iface);
+#endif
 #endif
 
     iface->ifname[0] = 0;
@@ -62,6 +65,9 @@ void iface_fini(gbl_t *gbl)
     for (i = 0; i < gbl->num_iface; i++) {
         iface_t *iface = &gbl->iface[i];
         cleanup_iface(iface);
+#if WITH_TRANSPORT_UDP
+        pthread_mutex_destroy(&iface->udp.recv.lock);
+#endif
     }
 
     free(gbl->iface);
@@ -160,6 +166,7 @@ int init_iface_table(gbl_t *gbl)
 
 
         gbl->iface[i].udp.connect_s = -1;
+        pthread_mutex_init(&gbl->iface[i].udp.recv.lock, NULL);
 #endif
 
     }
@@ -70,6 +70,17 @@ struct iface {
         /* Used to determine when to close the shared */
         /* connection socket */
         int ni_count;
+
+        /* Datagrams drained from connect_s in one recvmmsg(), waiting
+         * to be claimed by the NI they are addressed to. */
+        struct {
+            pthread_mutex_t lock;
+            struct udp_recv_slot *slots;
+            struct mmsghdr *msgs;
+            unsigned int num_slots;
+            unsigned int pending;   /* received but not claimed yet */
+            size_t data_size;       /* payload area of each slot */
+        } recv;
     } udp;
 #endif
 };
@@ -339,17 +339,17 @@ static int prepare_req(buf_t *buf)
      * operation for the Put. Until the response is received, we
      * cannot free the MR nor post the send events. Note we
      * have already set event_mask. */
-    if ((buf->data_out && (buf->data_out->data_fmt != DATA_FMT_IMMEDIATE) &&
+    if ((buf->data_out && !data_is_eager(buf->data_out) &&
          (buf->event_mask & (XI_SEND_EVENT | XI_CT_SEND_EVENT))) ||
         buf->num_mr) {
         hdr->ack_req = PTL_ACK_REQ;
         buf->event_mask |= XI_RECEIVE_EXPECTED;
     }
 
-    /* For immediate data we can cause an early send event provided
-     * we request a send completion event */
+    /* For immediate or eager data we can cause an early send event
+     * provided we request a send completion event */
     if (buf->event_mask & (XI_SEND_EVENT | XI_CT_SEND_EVENT) &&
-        (buf->data_out && buf->data_out->data_fmt == DATA_FMT_IMMEDIATE))
+        (buf->data_out && data_is_eager(buf->data_out)))
         buf->event_mask |= XI_EARLY_SEND;
 
     /* Inline the data if it fits. That may save waiting for a
@@ -484,11 +484,7 @@ static int send_req(buf_t *buf)
     if ((buf->data_in && buf->data_in->data_fmt == DATA_FMT_NOKNEM) ||
         (buf->data_out && buf->data_out->data_fmt == DATA_FMT_NOKNEM)) {
         ptl_info("add to noknem list \n");
-        ni_t *ni = obj_to_ni(buf);
-
-        PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
-        list_add_tail(&buf->list, &ni->shmem.noknem_list);
-        PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
+        noknem_start(obj_to_ni(buf), buf);
 
         if (buf->data_in && buf->data_in->data_fmt == DATA_FMT_NOKNEM)
             state = STATE_INIT_COPY_IN;
@@ -505,6 +501,13 @@ static int send_req(buf_t *buf)
     else
         state = STATE_INIT_CLEANUP;
 
+    if (buf->event_mask & XI_BUNDLED) {
+        /* end_bundle() sends it along with the rest of the bundle,
+         * then resumes the state machine in the next state. */
+        buf->event_mask |= XI_BUNDLE_SEND;
+        return state;
+    }
+
     err = buf->conn->transport.send_message(buf, 1);
     if (err)
         return STATE_INIT_SEND_ERROR;
@@ -541,73 +544,98 @@ static int send_error(buf_t *buf)
 }
 
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
+/* Get: drain the bounce buffers the target has filled. */
 static int init_copy_in(buf_t *buf)
 {
     struct noknem *noknem = buf->transfer.noknem.noknem;
+    unsigned int slot;
     ptl_size_t to_copy;
+    int target_done;
     int ret;
 
-    /* Copy the data from the bounce buffer. */
-    to_copy = noknem->length;
+    for (;;) {
+        /* The target is done once it has produced its last chunk, so
+         * if it was done, all its chunks are visible now. */
+        target_done = noknem->target_done;
+        __sync_synchronize();
 
-    /* Target should never send more than requested. */
-    assert(to_copy <= buf->transfer.noknem.length_left);
+        if (noknem->consumed == noknem->produced)
+            break;
 
-    ret =
-        iov_copy_in(buf->transfer.noknem.data, buf->transfer.noknem.iovecs,
-                    NULL, buf->transfer.noknem.num_iovecs,
-                    buf->transfer.noknem.offset, to_copy);
-    if (ret == PTL_FAIL) {
-        WARN();
-        return STATE_INIT_ERROR;
-    }
+        /* Copy the data from the bounce buffer. */
+        slot = noknem->consumed % noknem->num_bufs;
+        to_copy = noknem->length -
+            (ptl_size_t)noknem->consumed * noknem->chunk_size;
+        if (to_copy > noknem->chunk_size)
+            to_copy = noknem->chunk_size;
+
+        /* Target should never send more than requested. */
+        assert(to_copy <= buf->transfer.noknem.length_left);
+
+        ret =
+            iov_copy_in(buf->transfer.noknem.bufs[slot],
+                        buf->transfer.noknem.iovecs, NULL,
+                        buf->transfer.noknem.num_iovecs,
+                        buf->transfer.noknem.offset, to_copy);
+        if (ret == PTL_FAIL) {
+            WARN();
+            return STATE_INIT_ERROR;
+        }
 
-    if (noknem->target_done)
-        return STATE_INIT_COPY_DONE;
+        buf->transfer.noknem.length_left -= to_copy;
+        buf->transfer.noknem.offset += to_copy;
 
-    buf->transfer.noknem.length_left -= to_copy;
-    buf->transfer.noknem.offset += to_copy;
+        /* Give the buffer back to the target. */
+        __sync_synchronize();
+        noknem->consumed++;
+    }
 
-    /* Tell the target the data is ready. */
-    __sync_synchronize();
-    noknem->state = 2;
+    if (target_done)
+        return STATE_INIT_COPY_DONE;
 
     return STATE_INIT_COPY_IN;
 }
 
+/* Put: fill the bounce buffers the target has drained. */
 static int init_copy_out(buf_t *buf)
 {
     struct noknem *noknem = buf->transfer.noknem.noknem;
+    unsigned int slot;
     ptl_size_t to_copy;
     int ret;
 
-    if (noknem->target_done)
-        return STATE_INIT_COPY_DONE;
-
-    noknem->state = 1;
+    while (!noknem->target_done && buf->transfer.noknem.length_left &&
+           noknem->produced - noknem->consumed < noknem->num_bufs) {
+        __sync_synchronize();
+
+        /* Copy the data to the bounce buffer. */
+        slot = noknem->produced % noknem->num_bufs;
+        to_copy = noknem->chunk_size;
+        if (to_copy > buf->transfer.noknem.length_left)
+            to_copy = buf->transfer.noknem.length_left;
+
+        ret =
+            iov_copy_out(buf->transfer.noknem.bufs[slot],
+                         buf->transfer.noknem.iovecs, NULL,
+                         buf->transfer.noknem.num_iovecs,
+                         buf->transfer.noknem.offset, to_copy);
+        if (ret == PTL_FAIL) {
+            WARN();
+            return STATE_INIT_ERROR;
+        }
 
-    /* Copy the data to the bounce buffer. */
-    to_copy = buf->transfer.noknem.data_length;
-    if (to_copy > buf->transfer.noknem.length_left)
-        to_copy = buf->transfer.noknem.length_left;
+        buf->transfer.noknem.length_left -= to_copy;
+        buf->transfer.noknem.offset += to_copy;
 
-    ret =
-        iov_copy_out(buf->transfer.noknem.data, buf->transfer.noknem.iovecs,
-                     NULL, buf->transfer.noknem.num_iovecs,
-                     buf->transfer.noknem.offset, to_copy);
-    if (ret == PTL_FAIL) {
-        WARN();
-        return STATE_INIT_ERROR;
+        /* Tell the target the data is ready. */
+        __sync_synchronize();
+        noknem->produced++;
     }
 
-    buf->transfer.noknem.length_left -= to_copy;
-    buf->transfer.noknem.offset += to_copy;
-
-    noknem->length = to_copy;
-
-    /* Tell the target the data is ready. */
-    __sync_synchronize();
-    noknem->state = 2;
+    /* The target may not need all the data, so it decides when the
+     * transfer is over. */
+    if (noknem->target_done)
+        return STATE_INIT_COPY_DONE;
 
     return STATE_INIT_COPY_OUT;
 }
@@ -616,21 +644,22 @@ static int init_copy_done(buf_t *buf)
 {
     ni_t *ni = obj_to_ni(buf);
     struct noknem *noknem = buf->transfer.noknem.noknem;
+    unsigned int i;
 
-    /* Ack. */
-    noknem->init_done = 1;
-    __sync_synchronize();
-    noknem->state = 2;
-
-    /* Free the bounce buffer allocated in init_append_data. */
-    if (buf->transfer.noknem.data)
+    /* Free the bounce buffers allocated in init_prepare_transfer. */
+    for (i = 0; i < noknem->num_bufs; i++)
         ll_enqueue_obj_alien(&ni->shmem.bounce_buf.head->free_list,
-                             buf->transfer.noknem.data,
+                             buf->transfer.noknem.bufs[i],
                              ni->shmem.bounce_buf.head,
                              ni->shmem.bounce_buf.head->head_index0);
 
-    /* Only called from the progress thread, so ni->shmem.noknem_lock is
-     * already locked. */
+    /* Ack. The target must not release the communication pad
+     * before the initiator is done with it. */
+    __sync_synchronize();
+    noknem->init_done = 1;
+
+    /* Only called from the progress thread, which owns
+     * ni->shmem.noknem_list. */
     list_del(&buf->list);
 
     if (buf->event_mask & XI_EARLY_SEND)
@@ -1114,22 +1143,6 @@ static void error(buf_t *buf)
  */
 static void cleanup(buf_t *buf)
 {
-
-#if WITH_TRANSPORT_IB && !IS_PPE
-    /* In the case where ummunotify is not installed */
-    ni_t *ni = obj_to_ni(buf);
-    if (ni->umn_fd == -1) {
-        if (buf->conn->transport.type == CONN_TYPE_RDMA) {
-            if (buf->get_md)
-                if (buf->get_md->mr_list)
-                    mr_put(buf->get_md->mr_list[0]);
-            if (buf->put_md)
-                if (buf->put_md->mr_list)
-                    mr_put(buf->put_md->mr_list[0]);
-        } 
-    }
-#endif
-
     if (buf->get_md) {
         md_put(buf->get_md);
         buf->get_md = NULL;
@@ -1207,6 +1220,8 @@ int process_init(buf_t *buf)
                 break;
             case STATE_INIT_SEND_REQ:
                 state = send_req(buf);
+                if (buf->event_mask & XI_BUNDLE_SEND)
+                    goto exit;
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
                 if (state == STATE_INIT_COPY_IN ||
                     state == STATE_INIT_COPY_OUT)
@@ -1262,6 +1277,10 @@ int process_init(buf_t *buf)
             case STATE_INIT_CLEANUP:
 #if WITH_TRANSPORT_UDP
                 if (buf->conn->transport.type == CONN_TYPE_UDP) {
+                    /* The response may have been seen here before
+                     * the progress thread hands it over to the state
+                     * machine. It must then find nothing to do. */
+                    buf->init_state = STATE_INIT_DONE;
                     pthread_mutex_unlock(&buf->mutex);
                     ni_t *ni;
                     ni = obj_to_ni(buf);
@@ -1301,3 +1320,247 @@ int process_init(buf_t *buf)
     pthread_mutex_unlock(&buf->mutex);
     return err;
 }
+
+/* A bundle opened by a thread on an ni. */
+struct bundle {
+    struct list_head list;      /* on ni->bundle.list */
+    pthread_t thread;
+    int depth;
+    struct list_head bufs;      /* requests waiting to be sent */
+};
+
+/**
+ * @brief Find the bundle the calling thread has open on an ni.
+ *
+ * The ni bundle lock must be held.
+ *
+ * @param[in] ni the ni.
+ *
+ * @return the bundle, or NULL if there is none
+ */
+static struct bundle *find_bundle(ni_t *ni)
+{
+    struct bundle *bundle;
+    pthread_t self = pthread_self();
+
+    list_for_each_entry(bundle, &ni->bundle.list, list) {
+        if (pthread_equal(bundle->thread, self))
+            return bundle;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Enter a bundle.
+ *
+ * Bundles belong to the calling thread; operations issued by other
+ * threads on the same ni are not held back.
+ *
+ * @param[in] ni the ni.
+ *
+ * @return status
+ */
+int start_bundle(ni_t *ni)
+{
+    struct bundle *bundle;
+
+    PTL_FASTLOCK_LOCK(&ni->bundle.lock);
+
+    bundle = find_bundle(ni);
+    if (!bundle) {
+        bundle = malloc(sizeof(*bundle));
+        if (unlikely(!bundle)) {
+            PTL_FASTLOCK_UNLOCK(&ni->bundle.lock);
+            return PTL_NO_SPACE;
+        }
+
+        bundle->thread = pthread_self();
+        bundle->depth = 0;
+        INIT_LIST_HEAD(&bundle->bufs);
+        list_add_tail(&bundle->list, &ni->bundle.list);
+        ni->bundle.num++;
+    }
+
+    bundle->depth++;
+
+    PTL_FASTLOCK_UNLOCK(&ni->bundle.lock);
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Start an initiator operation.
+ *
+ * Inside a bundle the operation runs as usual up to the point where
+ * its request would be sent. The request is then held until
+ * end_bundle(), so errors found while preparing it are still returned
+ * here.
+ *
+ * @param[in] ni the ni the operation is issued on.
+ * @param[in] buf the request buf, in the start state.
+ *
+ * @return status
+ */
+int start_init(ni_t *ni, buf_t *buf)
+{
+    struct bundle *bundle = NULL;
+    int held;
+    int err;
+
+    if (unlikely(ni->bundle.num)) {
+        PTL_FASTLOCK_LOCK(&ni->bundle.lock);
+        bundle = find_bundle(ni);
+        PTL_FASTLOCK_UNLOCK(&ni->bundle.lock);
+    }
+
+    if (likely(!bundle))
+        return process_init(buf);
+
+    buf->event_mask |= XI_BUNDLED;
+
+    buf_get(buf);
+
+    err = process_init(buf);
+
+    /* A request still waiting for its connection is sent directly
+     * once connected. */
+    pthread_mutex_lock(&buf->mutex);
+    buf->event_mask &= ~XI_BUNDLED;
+    held = buf->event_mask & XI_BUNDLE_SEND;
+    pthread_mutex_unlock(&buf->mutex);
+
+    if (held) {
+        /* The state machine keeps its reference until resumed. */
+        PTL_FASTLOCK_LOCK(&ni->bundle.lock);
+        list_add_tail(&buf->bundle_list, &bundle->bufs);
+        PTL_FASTLOCK_UNLOCK(&ni->bundle.lock);
+    }
+
+    buf_put(buf);
+
+    return err;
+}
+
+/**
+ * @brief Send the requests of a bundle.
+ *
+ * Consecutive requests going over the same transport are handed to it
+ * together so that it can post them at once. The state machine of
+ * each request is then resumed, in the send error state if it could
+ * not be sent.
+ *
+ * @param[in] ni the ni.
+ * @param[in] bufs the request bufs, in issue order.
+ * @param[in] num the number of bufs.
+ */
+static void send_bundle(ni_t *ni, buf_t **bufs, int num)
+{
+    struct transport *transport;
+    char failed[num];
+    int sent;
+    int i;
+    int j;
+    int k;
+
+    /* A response may reach the state machine as soon as the request
+     * is sent, so it must not be freed before it is resumed here. */
+    for (i = 0; i < num; i++) {
+        buf_get(bufs[i]);
+
+        pthread_mutex_lock(&bufs[i]->mutex);
+        bufs[i]->event_mask &= ~XI_BUNDLE_SEND;
+        pthread_mutex_unlock(&bufs[i]->mutex);
+    }
+
+    for (i = 0; i < num; i = j) {
+        transport = &bufs[i]->conn->transport;
+
+        for (j = i + 1; j < num; j++) {
+            if (bufs[j]->conn->transport.type != transport->type)
+                break;
+        }
+
+        if (transport->send_messages) {
+            sent = transport->send_messages(ni, &bufs[i], j - i);
+            for (k = i; k < j; k++)
+                failed[k] = (k - i >= sent);
+        } else {
+            for (k = i; k < j; k++)
+                failed[k] = !!transport->send_message(bufs[k], 1);
+        }
+    }
+
+    for (i = 0; i < num; i++) {
+        if (unlikely(failed[i])) {
+            pthread_mutex_lock(&bufs[i]->mutex);
+            bufs[i]->init_state = STATE_INIT_SEND_ERROR;
+            pthread_mutex_unlock(&bufs[i]->mutex);
+        }
+
+        process_init(bufs[i]);
+        buf_put(bufs[i]);
+    }
+}
+
+/**
+ * @brief Send the requests held by a bundle and free it.
+ *
+ * @param[in] ni the ni.
+ * @param[in] bundle the bundle, no longer on the ni.
+ */
+static void flush_bundle(ni_t *ni, struct bundle *bundle)
+{
+    buf_t *buf;
+    int num = 0;
+
+    list_for_each_entry(buf, &bundle->bufs, bundle_list)
+        num++;
+
+    if (num) {
+        buf_t *bufs[num];
+
+        num = 0;
+        list_for_each_entry(buf, &bundle->bufs, bundle_list)
+            bufs[num++] = buf;
+
+        send_bundle(ni, bufs, num);
+    }
+
+    free(bundle);
+}
+
+/**
+ * @brief Leave a bundle.
+ *
+ * When the outermost bundle of the calling thread ends, the requests
+ * it held are sent as one batch.
+ *
+ * @param[in] ni the ni.
+ * @param[in] force end the bundles of all threads at once.
+ */
+void end_bundle(ni_t *ni, int force)
+{
+    struct list_head list;
+    struct bundle *bundle;
+    struct bundle *n;
+
+    INIT_LIST_HEAD(&list);
+
+    PTL_FASTLOCK_LOCK(&ni->bundle.lock);
+    if (force) {
+        list_splice_init(&ni->bundle.list, &list);
+        ni->bundle.num = 0;
+    } else {
+        bundle = find_bundle(ni);
+        if (bundle && --bundle->depth == 0) {
+            list_del(&bundle->list);
+            list_add(&bundle->list, &list);
+            ni->bundle.num--;
+        }
+    }
+    PTL_FASTLOCK_UNLOCK(&ni->bundle.lock);
+
+    list_for_each_entry_safe(bundle, n, &list, list)
+        flush_bundle(ni, bundle);
+}
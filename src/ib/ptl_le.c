@@ -101,6 +101,9 @@ void le_unlink(le_t *le, int auto_event)
                 pt->overflow_size--;
             list_del_init(&le->list);
 
+            if (le->type == TYPE_ME)
+                pt_match_index_del((me_t *)le);
+
             if (auto_event)
                 le_post_unlink_event(le);
 
@@ -261,6 +264,9 @@ int le_append_pt(ni_t *ni, le_t *le)
         list_add_tail(&le->list, &pt->overflow_list);
     }
 
+    if (le->type == TYPE_ME)
+        pt_match_index_add(pt, (me_t *)le);
+
     if (le->eq && !(le->options & PTL_LE_EVENT_LINK_DISABLE))
         make_le_event(le, le->eq, PTL_EVENT_LINK, PTL_NI_OK);
 
@@ -268,6 +274,34 @@ int le_append_pt(ni_t *ni, le_t *le)
 }
 
 
+/**
+ * @brief Return the unexpected message a list link belongs to.
+ *
+ * @param[in] l The list link.
+ * @param[in] link Which of the buf links l is.
+ *
+ * @return The message.
+ */
+static inline buf_t *unexpected_entry(struct list_head *l,
+                                      enum unexpected_link link)
+{
+    switch (link) {
+        case UNEXPECTED_LINK_BITS:
+            return list_entry(l, buf_t, unexpected_bits_list);
+        case UNEXPECTED_LINK_SRC:
+            return list_entry(l, buf_t, unexpected_src_list);
+        default:
+            return list_entry(l, buf_t, unexpected_list);
+    }
+}
+
+/* Walk the unexpected messages of a list returned by
+ * pt_unexpected_lookup(). The current message can be removed. */
+#define list_for_each_unexpected_safe(buf, l, n, head, link)		\
+	for (l = (head)->next, n = l->next;				\
+	     l != (head) && ((buf = unexpected_entry(l, link)), 1);	\
+	     l = n, n = l->next)
+
 /**
  * @brief Compares an ME/LE with the unexpected list
  * and returns a list of messages that match.
@@ -284,7 +318,10 @@ static void __match_le_unexpected(le_t *le,
     //ptl_handle_ni_t* ni_h = ni_to_handle(hi_h);
     pt_t *pt = &ni->pt[le->pt_index];
     buf_t *buf;
-    buf_t *n;
+    struct list_head *head;
+    struct list_head *l;
+    struct list_head *n;
+    enum unexpected_link link;
 
     // Used if LE is actually an ME (le->type == TYPE_ME)
     // The buf->data is a request header, and that is where info about the PUT is hiding
@@ -303,7 +340,8 @@ static void __match_le_unexpected(le_t *le,
 
 
     INIT_LIST_HEAD(buf_list);
-    list_for_each_entry_safe(buf, n, &pt->unexpected_list, unexpected_list) {
+    head = pt_unexpected_lookup(pt, le, &link);
+    list_for_each_unexpected_safe(buf, l, n, head, link) {
 
         if ((le->type == TYPE_LE || check_match(buf, (me_t *)le))) {
 
@@ -313,6 +351,7 @@ static void __match_le_unexpected(le_t *le,
                 && (le->options & PTL_ME_LOCAL_INC_UH_RLENGTH)) {
 
                 list_del(&buf->unexpected_list);
+                pt_unexpected_index_del(buf);
                 list_add_tail(&buf->unexpected_list, buf_list);
 
                 hdr       = (req_hdr_t *) buf->data;
@@ -347,6 +386,7 @@ static void __match_le_unexpected(le_t *le,
             }
 
             list_del(&buf->unexpected_list);
+            pt_unexpected_index_del(buf);
             list_add_tail(&buf->unexpected_list, buf_list);
 
             if (le->options & PTL_LE_USE_ONCE)
@@ -453,14 +493,20 @@ int check_overflow_search_only(le_t *le)
     ni_t *ni = obj_to_ni(le);
     pt_t *pt = &ni->pt[le->pt_index];
     buf_t *buf;
-    buf_t *n;
+    struct list_head *head;
+    struct list_head *l;
+    struct list_head *n;
+    enum unexpected_link link;
     int found = 0;
+    ptl_size_t ct_success = 0;
+    ptl_size_t ct_failure = 0;
     PTL_FASTLOCK_LOCK(&pt->lock);
     ptl_event_t event[atomic_read(&pt->unexpected_size)];
 
     ct_t *ct = le->ct; // 4.3
 
-    list_for_each_entry_safe(buf, n, &pt->unexpected_list, unexpected_list) {
+    head = pt_unexpected_lookup(pt, le, &link);
+    list_for_each_unexpected_safe(buf, l, n, head, link) {
 
         if ((le->type == TYPE_LE || check_match(buf, (me_t *)le))) {
             if (le->eq && !(le->options & PTL_LE_EVENT_COMM_DISABLE)) {
@@ -476,10 +522,9 @@ int check_overflow_search_only(le_t *le)
                 // 4.3 The following code is based on code in ptl_tgt.c and from make_ct_event in ptl_ct.c
                 int bytes = (le->options & PTL_LE_EVENT_CT_BYTES) ? CT_MBYTES : CT_EVENTS;
                 if (bytes == CT_EVENTS)
-                    (void)__sync_add_and_fetch(&ct->info.event.success, 1);
+                    ct_success++;
                 else
-                    (void)__sync_add_and_fetch(&ct->info.event.success, buf->mlength);
-                ct_check(ct); /* Check if counter update triggers anything */
+                    ct_success += buf->mlength;
             }
             // end of 4.3
 
@@ -492,13 +537,10 @@ int check_overflow_search_only(le_t *le)
     // 4.3 : Semantics for use once are different than not use once
     if (ct && (le->options & PTL_LE_EVENT_CT_OVERFLOW)) {
         if (le->options & PTL_LE_USE_ONCE) {
-            if (found == 0) {
-                (void)__sync_add_and_fetch(&ct->info.event.failure, 1);
-                //(le->ct->info.event.failure)++;
-            }
+            if (found == 0)
+                ct_failure = 1;
         } else {
-            (void)__sync_add_and_fetch(&ct->info.event.failure, 1);
-            //(le->ct->info.event.failure)++;
+            ct_failure = 1;
         }
     }
     // end of new 4.3
@@ -506,6 +548,11 @@ int check_overflow_search_only(le_t *le)
 
     PTL_FASTLOCK_UNLOCK(&pt->lock);
 
+    /* Update the counter outside the lock, as it may trigger
+     * operations on that portal table entry. */
+    if (ct_success || ct_failure)
+        make_ct_search_event(ct, ct_success, ct_failure);
+
     /* note there is a race where the buf can get removed before
      * the event is delivered to the target so we save the contents
      * of the event in a local struct inside the lock and cause
@@ -558,10 +605,8 @@ int check_overflow_search_delete(le_t *le)
         // 4.3 whether it is USE_ONCE or not USE_ONCE. This occurs only if
         // 4.3 PTL_LE_EVENT_CT_OVERFLOW is enabled
         //if (!(le->ct == NULL) && ((le->options & PTL_LE_EVENT_CT_OVERFLOW) || (le->options & PTL_ME_EVENT_CT_OVERFLOW))) {
-        if (ct && (le->options & PTL_LE_EVENT_CT_OVERFLOW)) {
-            (void)__sync_add_and_fetch(&ct->info.event.failure, 1);
-            //(le->ct->info.event.failure)++;
-        }
+        if (ct && (le->options & PTL_LE_EVENT_CT_OVERFLOW))
+            make_ct_search_event(ct, 0, 1);
         // end of new 4.3
     } else {
         // 4.3 This call will eventually result in counter success being incremented by at least 1
@@ -569,10 +614,8 @@ int check_overflow_search_delete(le_t *le)
         flush_from_unexpected_list(le, &buf_list, 1);
         // 4.3 If USE_ONCE and a match is found, then failure is not incremented
         // 4.3 If not USE_ONCE, failure++ in both cases.
-        if (ct && !((le->options & PTL_LE_USE_ONCE) || (le->options & PTL_ME_USE_ONCE)) && (le->options & PTL_LE_EVENT_CT_OVERFLOW)) {
-            (void)__sync_add_and_fetch(&ct->info.event.failure, 1);
-            //(le->ct->info.event.failure)++;
-        }
+        if (ct && !((le->options & PTL_LE_USE_ONCE) || (le->options & PTL_ME_USE_ONCE)) && (le->options & PTL_LE_EVENT_CT_OVERFLOW))
+            make_ct_search_event(ct, 0, 1);
         // end of new 4.3
     }
 
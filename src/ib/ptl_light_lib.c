@@ -1602,6 +1602,27 @@ int PtlEQGet(ptl_handle_eq_t eq_handle, ptl_event_t *event)
     return err;
 }
 
+int PtlEQGetMany(ptl_handle_eq_t eq_handle, unsigned int count,
+                 ptl_event_t *events, unsigned int *num_events)
+{
+    const struct light_eq *eq;
+    int err;
+
+#ifndef NO_ARG_VALIDATION
+    if (!ppe.ppe_comm_pad)
+        return PTL_NO_INIT;
+#endif
+
+    eq = get_light_eq(eq_handle);
+    if (eq && count) {
+        err = PtlEQGetMany_work(eq->eqe_list, count, events, num_events);
+    } else {
+        err = PTL_ARG_INVALID;
+    }
+
+    return err;
+}
+
 int PtlEQWait(ptl_handle_eq_t eq_handle, ptl_event_t *event)
 {
     const struct light_eq *eq;
@@ -1621,8 +1642,9 @@ int PtlEQWait(ptl_handle_eq_t eq_handle, ptl_event_t *event)
     return err;
 }
 
-int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
-              ptl_time_t timeout, ptl_event_t *event, unsigned int *which)
+int PtlEQPollMany(const ptl_handle_eq_t * eq_handles, unsigned int size,
+                  ptl_time_t timeout, unsigned int count, ptl_event_t *events,
+                  unsigned int *num_events, unsigned int *which)
 {
     int err;
     int i;
@@ -1633,7 +1655,7 @@ int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
         return PTL_NO_INIT;
 #endif
 
-    if (size == 0) {
+    if (size == 0 || count == 0) {
         err = PTL_ARG_INVALID;
         goto done;
     }
@@ -1653,7 +1675,8 @@ int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
         eqes_list[i] = eq->eqe_list;
     }
 
-    err = PtlEQPoll_work(eqes_list, size, timeout, event, which);
+    err = PtlEQPollMany_work(eqes_list, size, timeout, count, events,
+                             num_events, which);
 
   done:
     if (eqes_list)
@@ -1662,6 +1685,15 @@ int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
     return err;
 }
 
+int PtlEQPoll(const ptl_handle_eq_t * eq_handles, unsigned int size,
+              ptl_time_t timeout, ptl_event_t *event, unsigned int *which)
+{
+    unsigned int num_events;
+
+    return PtlEQPollMany(eq_handles, size, timeout, 1, event, &num_events,
+                         which);
+}
+
 int PtlTriggeredPut(ptl_handle_md_t md_handle, ptl_size_t local_offset,
                     ptl_size_t length, ptl_ack_req_t ack_req,
                     ptl_process_t target_id, ptl_pt_index_t pt_index,
@@ -173,6 +173,10 @@ static inline ptl_pid_t port_to_pid(__be16 port)
 /* round up x to multiple of y. y MUST be a power of 2. */
 #define ROUND_UP(x,y) ((x) + (y) - 1) & ~((y)-1);
 
+#ifndef BITS_PER_LONG
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+#endif
+
 /* Transport operations, use to setup and shutdown the interfaces. */
 struct transport_ops {
     /* Initializes an interface. */
@@ -228,6 +232,12 @@ int process_rdma_desc(buf_t *buf);
 
 int process_init(buf_t *buf);
 
+int start_init(ni_t *ni, buf_t *buf);
+
+int start_bundle(ni_t *ni);
+
+void end_bundle(ni_t *ni, int force);
+
 int process_tgt(buf_t *buf);
 
 int check_match(buf_t *buf, const me_t *me);
@@ -242,10 +252,11 @@ void initiate_disconnect_all(ni_t *ni);
 
 #if WITH_TRANSPORT_IB
 void disconnect_conn_locked(conn_t *conn);
-void progress_thread_rdma(ni_t *ni);
+int progress_thread_rdma(ni_t *ni);
 #else
-static inline void progress_thread_rdma(ni_t *ni)
+static inline int progress_thread_rdma(ni_t *ni)
 {
+    return 0;
 }
 #endif
 
@@ -253,7 +264,13 @@ static inline void progress_thread_rdma(ni_t *ni)
 int PtlSetMap_mem(ni_t *ni, ptl_size_t map_size,
                   const ptl_process_t *mapping);
 void shmem_enqueue(ni_t *ni, buf_t *buf, ptl_pid_t dest);
+
+void shmem_enqueue_list(ni_t *ni, buf_t **bufs, int num, ptl_pid_t dest);
 buf_t *shmem_dequeue(ni_t *ni);
+int shmem_busy(ni_t *ni);
+#if WITH_TRANSPORT_SHMEM && !USE_KNEM
+void noknem_start(ni_t *ni, buf_t *buf);
+#endif
 void process_recv_mem(ni_t *ni, buf_t *buf);
 int mem_do_transfer(buf_t *buf);
 
@@ -274,11 +291,18 @@ void PtlSetMap_udp(ni_t *ni, ptl_size_t map_size,
 void disconnect_conn_locked(conn_t *conn);
 void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest);
 buf_t *udp_receive(ni_t *ni);
+void udp_recv_fini(iface_t *iface);
 void process_recv_udp(ni_t *ni, buf_t *buf);
-void progress_thread_udp(ni_t *ni);
+int progress_thread_udp(ni_t *ni);
+#if WITH_RUDP
+int rudp_init(ni_t *ni);
+void rudp_fini(ni_t *ni);
+void rudp_progress(ni_t *ni);
+#endif
 #else
-static inline void progress_thread_udp(ni_t *ni)
+static inline int progress_thread_udp(ni_t *ni)
 {
+    return 0;
 }
 #endif
 
@@ -302,6 +326,10 @@ static inline void stop_progress_thread(ni_t *ni)
 {
 }
 
+static inline void progress_wake(ni_t *ni)
+{
+}
+
 #else
 
 #define addr_to_ppe(addr,dontcare) (addr)
@@ -309,10 +337,12 @@ static inline void stop_progress_thread(ni_t *ni)
 /* There is a progress thread per NI when the PPE is not used. */
 int start_progress_thread(ni_t *ni);
 void stop_progress_thread(ni_t *ni);
+void progress_wake(ni_t *ni);
 #endif
 
 int _PtlInit(gbl_t *gbl);
 int _PtlAbort(gbl_t *gbl);
+int _PtlAtomicSync(gbl_t *gbl);
 void _PtlFini(gbl_t *gbl);
 int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
                ptl_pid_t pid, const ptl_ni_limits_t *desired,
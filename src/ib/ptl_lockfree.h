@@ -122,6 +122,77 @@ static inline void ll_enqueue_obj_alien(union counted_ptr *free_list,
     } while (tmpv.c16 != oldv.c16);
 }
 
+/**
+ * Remove up to max objects at once from the head of a freelist.
+ *
+ * The objects stay chained by their next field. The list must not be
+ * alien, and the memory of its objects must not be freed while this
+ * runs, as the chain is walked before the head is swapped.
+ *
+ * @param free_list the freelist
+ * @param max the most objects to remove
+ * @param num_p returns the number of objects removed
+ *
+ * @return the first object, or NULL if the list is empty
+ */
+static inline void *ll_dequeue_obj_list(union counted_ptr *free_list,
+                                        unsigned int max,
+                                        unsigned int *num_p)
+{
+    union counted_ptr oldv, newv, retv;
+    void *last;
+    unsigned int num;
+
+    retv.c16 = free_list->c16;
+
+    do {
+        oldv = retv;
+        num = 0;
+        newv.head = NULL;
+        if (retv.head != NULL) {
+            /* The walk may read a stale chain, in which case the
+             * counter has moved on and the swap fails. */
+            last = retv.head;
+            num = 1;
+            while (num < max && *(void **)last) {
+                last = *(void **)last;
+                num++;
+            }
+            newv.head = *(void **)last;
+        }
+        newv.counter = oldv.counter + 1;
+
+        retv.c16 = PtlInternalAtomicCas128(&free_list->c16, oldv, newv);
+    } while (retv.c16 != oldv.c16);
+
+    *num_p = num;
+
+    return retv.head;
+}
+
+/**
+ * Add a chain of objects at once to a freelist.
+ *
+ * @param free_list the freelist
+ * @param first the first object of the chain
+ * @param last the last object of the chain
+ */
+static inline void ll_enqueue_obj_list(union counted_ptr *free_list,
+                                       void *first, void *last)
+{
+    union counted_ptr oldv, newv, tmpv;
+
+    tmpv.c16 = free_list->c16;
+
+    do {
+        oldv = tmpv;
+        *(void **)last = tmpv.head;
+        newv.head = first;
+        newv.counter = oldv.counter + 1;
+        tmpv.c16 = PtlInternalAtomicCas128(&free_list->c16, oldv, newv);
+    } while (tmpv.c16 != oldv.c16);
+}
+
 static inline void ll_init(union counted_ptr *free_list)
 {
     free_list->head = NULL;
@@ -172,6 +243,43 @@ static inline void ll_enqueue_obj_alien(union counted_ptr *free_list,
     PTL_FASTLOCK_UNLOCK(&free_list->lock);
 }
 
+static inline void *ll_dequeue_obj_list(union counted_ptr *free_list,
+                                        unsigned int max,
+                                        unsigned int *num_p)
+{
+    void *ret;
+    void *last;
+    unsigned int num = 0;
+
+    PTL_FASTLOCK_LOCK(&free_list->lock);
+    ret = free_list->head;
+    if (ret) {
+        last = ret;
+        num = 1;
+        while (num < max && *(void **)last) {
+            last = *(void **)last;
+            num++;
+        }
+        free_list->head = *(void **)last;
+    }
+    PTL_FASTLOCK_UNLOCK(&free_list->lock);
+
+    *num_p = num;
+
+    return ret;
+}
+
+static inline void ll_enqueue_obj_list(union counted_ptr *free_list,
+                                       void *first, void *last)
+{
+    PTL_FASTLOCK_LOCK(&free_list->lock);
+
+    *(void **)last = free_list->head;
+    free_list->head = first;
+
+    PTL_FASTLOCK_UNLOCK(&free_list->lock);
+}
+
 static inline void ll_init(union counted_ptr *free_list)
 {
     free_list->head = NULL;
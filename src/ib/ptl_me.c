@@ -110,6 +110,7 @@ static int me_append_or_search(PPEGBL ptl_handle_ni_t ni_handle,
     pt = &ni->pt[pt_index];
 
     INIT_LIST_HEAD(&me->list);
+    INIT_LIST_HEAD(&me->match_list);
     me->pt_index = pt_index;
     me->eq = pt->eq;
     me->uid = me_init->uid;
@@ -642,9 +643,7 @@ static void post_trig_me(buf_t *buf, ct_t *me_ct)
         do_trig_me_op(buf,me_ct);
 
     } else {
-        atomic_inc(&me_ct->list_size);
-
-        list_add(&buf->list, &me_ct->trig_list);
+        ct_add_trig(me_ct, buf);
 
         /* We must check again to avoid a race with make_ct_event/ct_inc_ct_set. */
         if ((me_ct->info.event.success + me_ct->info.event.failure) >=
@@ -142,7 +142,7 @@ int _PtlPut(PPEGBL ptl_handle_md_t md_handle, ptl_size_t local_offset,
     buf->init_state = STATE_INIT_START;
     buf->recv_buf = NULL;
 
-    err = process_init(buf);; 
+    err = start_init(ni, buf);
     if (unlikely(err))
         goto err1;
 
@@ -326,7 +326,7 @@ int _PtlGet(PPEGBL ptl_handle_md_t md_handle, ptl_size_t local_offset,
     buf->get_offset = local_offset;
     buf->init_state = STATE_INIT_START;
 
-    err = process_init(buf); 
+    err = start_init(ni, buf);
     if (unlikely(err)) 
         goto err1;
 
@@ -570,7 +570,7 @@ int _PtlAtomic(PPEGBL ptl_handle_md_t md_handle, ptl_size_t local_offset,
     buf->init_state = STATE_INIT_START;
     buf->recv_buf = NULL;
 
-    err = process_init(buf); 
+    err = start_init(ni, buf);
     if (unlikely(err)) 
         goto err1;
 
@@ -773,7 +773,7 @@ int _PtlFetchAtomic(PPEGBL ptl_handle_md_t get_md_handle,
     buf->get_offset = local_get_offset;
     buf->init_state = STATE_INIT_START;
 
-    err = process_init(buf); 
+    err = start_init(ni, buf);
     if (unlikely(err)) 
         goto err1;
 
@@ -920,17 +920,44 @@ int _PtlTriggeredFetchAtomic(PPEGBL ptl_handle_md_t get_md_handle,
 /**
  * @brief Perform an atomic sync.
  *
+ * Wait for the atomic operations in progress on the memory of this
+ * process to be over, then make their results visible to the host.
+ * When none is in progress, which is usually the case, that is just a
+ * memory barrier.
+ *
+ * @param[in] gbl the process global state
+ *
  * @return status
  */
-int _PtlAtomicSync(void)
+int _PtlAtomicSync(gbl_t *gbl)
 {
     int err;
+    int i;
+    int j;
 
     err = gbl_get();
     if (unlikely(err))
         goto err0;
 
-    /* TODO */
+    /* Keeps the NIs from going away. */
+    pthread_mutex_lock(&gbl->gbl_mutex);
+
+    for (i = 0; i < gbl->num_iface; i++) {
+        for (j = 0; j < MAX_NI_TYPES; j++) {
+            ni_t *ni = gbl->iface[i].ni[j];
+
+            if (!ni)
+                continue;
+
+            while (atomic_read(&ni->atomic_pending))
+                sched_yield();
+        }
+    }
+
+    pthread_mutex_unlock(&gbl->gbl_mutex);
+
+    __sync_synchronize();
+
     err = PTL_OK;
 
     gbl_put();
@@ -1080,7 +1107,7 @@ int _PtlSwap(PPEGBL ptl_handle_md_t get_md_handle,
         memcpy(operand_msg, operand, atom_type_size[atom_type]);
     }
 
-    err = process_init(buf); 
+    err = start_init(ni, buf);
     if (unlikely(err)) 
         goto err1;
 
@@ -1233,6 +1260,10 @@ int _PtlTriggeredSwap(PPEGBL ptl_handle_md_t get_md_handle,
 /**
  * @brief Start a bundle.
  *
+ * Until the matching PtlEndBundle, the requests of the puts, gets and
+ * atomics the calling thread issues on the ni are held back. Bundles
+ * can be nested.
+ *
  * @return status
  */
 int _PtlStartBundle(PPEGBL ptl_handle_ni_t ni_handle)
@@ -1253,12 +1284,15 @@ int _PtlStartBundle(PPEGBL ptl_handle_ni_t ni_handle)
         goto err1;
     }
 
-    /* TODO implement start bundle */
+    err = start_bundle(ni);
+    if (unlikely(err))
+        goto err2;
 
     ni_put(ni);
     gbl_put();
     return PTL_OK;
 
+  err2:
     ni_put(ni);
   err1:
     gbl_put();
@@ -1269,6 +1303,9 @@ int _PtlStartBundle(PPEGBL ptl_handle_ni_t ni_handle)
 /**
  * @brief End a bundle.
  *
+ * Ending the outermost bundle starts the operations it held and sends
+ * their requests as a batch.
+ *
  * @return status
  */
 int _PtlEndBundle(PPEGBL ptl_handle_ni_t ni_handle)
@@ -1289,7 +1326,7 @@ int _PtlEndBundle(PPEGBL ptl_handle_ni_t ni_handle)
         goto err1;
     }
 
-    /* TODO implement end bundle */
+    end_bundle(ni, 0);
 
     ni_put(ni);
     gbl_put();
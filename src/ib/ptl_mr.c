@@ -9,14 +9,34 @@
 
 #include "ummunotify.h"
 #include <unistd.h>
+#if !IS_PPE
+#include <stdarg.h>
+#include <malloc.h>
+#include <sys/syscall.h>
+#endif
+
+/* Whether the registrations pin the pages. Only then can a stale
+ * cached registration point to the wrong memory. */
+#define MR_PINS_PAGES (WITH_TRANSPORT_IB || (WITH_TRANSPORT_SHMEM && USE_KNEM))
 
 #if !IS_PPE
 int global_umn_init=0;
 int global_umn_fd;
 uint64_t *global_umn_counter;
 ev_io global_umn_watcher;
+
+/* The NIs caching their registrations. */
 ni_t *global_nis[8];
 int global_ni_count;
+static pthread_mutex_t global_nis_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set when ummunotify is not there, for the memory hooks to
+ * invalidate the caches. */
+static int mr_hooks_active;
+
+/* Set while this thread is in the cache, so that unmapping memory
+ * from there, for instance when deregistering, doesn't reenter it. */
+static __thread int in_mr_cache;
 #endif
 
 /**
@@ -149,6 +169,119 @@ static void umn_register(ni_t *ni, mr_t *mr, void *start, size_t size)
  */
 RB_GENERATE_STATIC(the_root, mr, entry, mr_compare);
 
+/**
+ * Initialize an mr cache.
+ *
+ * @param[in] tree to initialize
+ */
+void mr_tree_init(struct ni_mr_tree *tree)
+{
+    RB_INIT(&tree->tree);
+    PTL_FASTLOCK_INIT(&tree->tree_lock);
+    INIT_LIST_HEAD(&tree->lru);
+    tree->num_entries = 0;
+    tree->num_bytes = 0;
+    tree->hits = 0;
+    tree->misses = 0;
+    tree->evictions = 0;
+}
+
+/**
+ * Remove an mr from the cache, and drop the reference the cache
+ * had on it.
+ *
+ * The tree lock must be held.
+ *
+ * @param[in] tree the mr belongs to
+ * @param[in] mr to remove
+ */
+static void mr_tree_remove(struct ni_mr_tree *tree, mr_t *mr)
+{
+    RB_REMOVE(the_root, &tree->tree, mr);
+    list_del(&mr->lru);
+    tree->num_entries--;
+    tree->num_bytes -= mr->length;
+
+    mr_put(mr);
+}
+
+/**
+ * Evict the least recently used mrs until the cache is back within
+ * its limits. Only the mrs referenced by nobody but the cache can go.
+ *
+ * The tree lock must be held.
+ *
+ * @param[in] tree to shrink
+ */
+static void mr_tree_evict(struct ni_mr_tree *tree)
+{
+    unsigned long max_entries = get_param(PTL_MR_CACHE_ENTRIES);
+    unsigned long max_bytes = get_param(PTL_MR_CACHE_SIZE);
+    mr_t *mr;
+    mr_t *next;
+
+    list_for_each_entry_safe(mr, next, &tree->lru, lru) {
+        if ((!max_entries || tree->num_entries <= max_entries) &&
+            (!max_bytes || tree->num_bytes <= max_bytes))
+            break;
+
+        /* New references are only taken under the tree lock. */
+        if (atomic_read(&mr->obj.obj_ref.ref_cnt) == 1) {
+            mr_tree_remove(tree, mr);
+            tree->evictions++;
+        }
+    }
+}
+
+#if !IS_PPE
+/**
+ * Drop the cached mrs overlapping an address range, whose memory is
+ * going away.
+ *
+ * @param[in] tree to search
+ * @param[in] start starting address of the range
+ * @param[in] length length of the range
+ */
+static void mr_tree_invalidate(struct ni_mr_tree *tree, void *start,
+                               size_t length)
+{
+    void *end = start + length;
+    mr_t *link;
+    mr_t *mr = NULL;
+    mr_t *next;
+
+    PTL_FASTLOCK_LOCK(&tree->tree_lock);
+
+    /* Find the last mr starting at or before the range. The mrs don't
+     * overlap each other. */
+    link = RB_ROOT(&tree->tree);
+    while (link) {
+        if (start < link->addr) {
+            link = RB_LEFT(link, entry);
+        } else {
+            mr = link;
+            link = RB_RIGHT(link, entry);
+        }
+    }
+
+    if (!mr)
+        mr = RB_MIN(the_root, &tree->tree);
+    else if (mr->addr + mr->length <= start)
+        mr = RB_NEXT(the_root, &tree->tree, mr);
+
+    while (mr && mr->addr < end) {
+        next = RB_NEXT(the_root, &tree->tree, mr);
+
+        mr_tree_remove(tree, mr);
+        tree->evictions++;
+
+        mr = next;
+    }
+
+    PTL_FASTLOCK_UNLOCK(&tree->tree_lock);
+}
+#endif
+
 /**
  * Allocate and register a new memory region.
  *
@@ -295,6 +428,10 @@ static int mr_create(ni_t *ni, void *start, ptl_size_t length, mr_t **mr_p)
  * be allocated, or an existing one can be used. It is also possible that
  * one or more existing mrs will be merged into one.
  *
+ * The mrs are only cached if the NI can learn about the application
+ * releasing their memory. Otherwise each lookup creates a new mr,
+ * freed once its last user drops it.
+ *
  * @param[in] ni in which to lookup range
  * @param[in] start starting address of memory range in application space
  * @param[in] length length of range
@@ -313,107 +450,112 @@ int mr_lookup(ni_t *ni, struct ni_mr_tree *tree, void *start,
     struct mr *link;
     struct mr *rb;
     struct mr *mr;
+    struct mr *next;
     struct mr *left_node;
+    void *req_start = start;
+    ptl_size_t req_length = length;
+    void *res;
     int ret;
     struct list_head mr_list;
 
+    if (!ni->mr_cache || length == 0) {
+        ret = mr_create(ni, start, length, mr_p);
+        if (ret) {
+            *mr_p = NULL;
+            return PTL_FAIL;
+        }
+        return PTL_OK;
+    }
+
 #if !IS_PPE
     if (global_umn_init == 1){
         while (generation_counter != *ni->umn_counter){
             SPINLOCK_BODY();
         }
     }
-#endif
 
-#if !IS_PPE
   again:
+    in_mr_cache = 1;
 #endif
     PTL_FASTLOCK_LOCK(&tree->tree_lock);
 
     link = RB_ROOT(&tree->tree);
     left_node = NULL;
 
-    mr = NULL;
-
-#if !IS_PPE
-    if (global_umn_init == 1){
-
-        while (link) {
-            mr = link;
-
-            if (start < mr->addr)
-                link = RB_LEFT(mr, entry);
-            else {
-                if (mr->addr + mr->length >= start + length) {
-                    /* Requested mr fits in an existing region. */
-                    mr_get(mr);
-                    if (atomic_read(&mr->obj.obj_ref.ref_cnt) >= 1){
-                        ret = 0;
-                        *mr_p = mr;
-                        goto done;
-                    }    
-                }
-                left_node = mr;
-                link = RB_RIGHT(mr, entry);
+    while (link) {
+        mr = link;
+
+        if (start < mr->addr)
+            link = RB_LEFT(mr, entry);
+        else {
+            if (mr->addr + mr->length >= start + length) {
+                /* Requested mr fits in an existing region. */
+                mr_get(mr);
+                list_del(&mr->lru);
+                list_add_tail(&mr->lru, &tree->lru);
+                tree->hits++;
+
+                *mr_p = mr;
+                ret = PTL_OK;
+                goto done;
             }
+            left_node = mr;
+            link = RB_RIGHT(mr, entry);
         }
+    }
 
-        /* Not found. */
-        INIT_LIST_HEAD(&mr_list);
+    /* Not found. */
+    tree->misses++;
 
-        mr = NULL;
+    INIT_LIST_HEAD(&mr_list);
 
-        /* Extend region to the left. */
-        if (left_node && (start <= (left_node->addr + left_node->length))) {
-            length += start - left_node->addr;
-            start = left_node->addr;
+    mr = NULL;
 
-            /* First merge node. Will be replaced later. */
-            mr = left_node;
-        }
+    /* Extend region to the left. */
+    if (left_node && (start <= (left_node->addr + left_node->length))) {
+        length += start - left_node->addr;
+        start = left_node->addr;
 
-        /* Extend the region to the right. */
-        if (left_node)
-            rb = RB_NEXT(the_root, &tree->tree, left_node);
-        else
-            rb = RB_MIN(the_root, &tree->tree);
-        while (rb) {
-            struct mr *next_rb = RB_NEXT(the_root, &tree->tree, rb);
-
-            /* Check whether new region can be merged with this node. */
-            if (start + length >= rb->addr) {
-                /* Is it completely part of the new region ? */
-                size_t new_length = rb->addr + rb->length - start;
-                if (new_length > length)
-                    length = new_length;
-
-                if (mr) {
-                    /* Mark the node for removal since it will be included
-                     * in the new mr. */
-                    list_add_tail(&rb->list, &mr_list);
-                } else {
-                    /* First merge node. Will be replaced later. */
-                    mr = rb;
-                }
+        /* First merge node. Will be replaced later. */
+        mr = left_node;
+    }
+
+    /* Extend the region to the right. */
+    if (left_node)
+        rb = RB_NEXT(the_root, &tree->tree, left_node);
+    else
+        rb = RB_MIN(the_root, &tree->tree);
+    while (rb) {
+        struct mr *next_rb = RB_NEXT(the_root, &tree->tree, rb);
+
+        /* Check whether new region can be merged with this node. */
+        if (start + length >= rb->addr) {
+            /* Is it completely part of the new region ? */
+            size_t new_length = rb->addr + rb->length - start;
+            if (new_length > length)
+                length = new_length;
+
+            if (mr) {
+                /* Mark the node for removal since it will be included
+                 * in the new mr. */
+                list_add_tail(&rb->list, &mr_list);
             } else {
-                break;
+                /* First merge node. Will be replaced later. */
+                mr = rb;
             }
-
-            rb = next_rb;
+        } else {
+            break;
         }
 
-        if (mr) {
-            /* Mark for removal the included mr on the right. */
-            list_add_tail(&mr->list, &mr_list);
-            mr = NULL;
-        }
+        rb = next_rb;
     }
-    else
-#endif
-    /* No memory registration cache enabled */
-    {
-        INIT_LIST_HEAD(&mr_list);
+
+    if (mr) {
+        /* Mark for removal the included mr on the right. */
+        list_add_tail(&mr->list, &mr_list);
+        mr = NULL;
     }
+
     /* Insert the new node */
     ret = mr_create(ni, start, length, mr_p);
     if (ret) {
@@ -428,54 +570,64 @@ int mr_lookup(ni_t *ni, struct ni_mr_tree *tree, void *start,
              * This case should rarely happen as it is there only to
              * close that small race. */
             PTL_FASTLOCK_UNLOCK(&tree->tree_lock);
+            in_mr_cache = 0;
             while (generation_counter != *ni->umn_counter) {
                 SPINLOCK_BODY();
             }
             goto again;
         }
-        if (ret == EFAULT && ni->umn_fd == -1){
-            PTL_FASTLOCK_UNLOCK(&tree->tree_lock); 
-            goto again;
-        }
 #endif
 
+        /* The merged region may not be valid anymore. Fall back to
+         * the requested range, and don't cache it. */
+        if (!list_empty(&mr_list) &&
+            mr_create(ni, req_start, req_length, mr_p) == 0) {
+            ret = PTL_OK;
+            goto done;
+        }
+
         *mr_p = NULL;
         ret = PTL_FAIL;
-    } else {
-        void *res;
-
-        /* Remove all the MRs that are included in the new MR. We must
-         * create the new MR first before eliminating these. */
-        list_for_each_entry(mr, &mr_list, list) {
-            RB_REMOVE(the_root, &tree->tree, mr);
-            mr_put(mr);
-        }
+        goto done;
+    }
 
-        /* Finally we can insert the new MR in the tree. */
-        mr = *mr_p;
-        mr_get(mr);
-        res = RB_INSERT(the_root, &tree->tree, mr);
-//this can happen if using Qlogic
-#if !WITH_ZERO_MRS
-        /* should never happen */
-        if (res == NULL) {
-            ptl_fatal("NULL result from RB_INSERT, try rebuilding with --enable-zero-mrs");
-        }
-#endif
+    /* Remove all the MRs that are included in the new MR. We must
+     * create the new MR first before eliminating these. */
+    list_for_each_entry_safe(mr, next, &mr_list, list) {
+        mr_tree_remove(tree, mr);
     }
 
+    /* Finally we can insert the new MR in the tree. The cache keeps a
+     * reference. */
+    mr = *mr_p;
+    mr_get(mr);
+    res = RB_INSERT(the_root, &tree->tree, mr);
+    assert(res == NULL);
+    (void)res;
+
+    list_add_tail(&mr->lru, &tree->lru);
+    tree->num_entries++;
+    tree->num_bytes += mr->length;
+
+    mr_tree_evict(tree);
+
   done:
     PTL_FASTLOCK_UNLOCK(&tree->tree_lock);
+#if !IS_PPE
+    in_mr_cache = 0;
+#endif
 
     return ret;
 }
 
 #if !IS_PPE
 
+#if !WITH_TRANSPORT_UDP
 static void process_ummunotify(EV_P_ ev_io *w, int revents)
 {
     struct ummunotify_event ev;
     int len;
+    int i;
 
     while (1) {
 
@@ -485,79 +637,206 @@ static void process_ummunotify(EV_P_ ev_io *w, int revents)
             WARN();
             return;
         }
-        int i;
-        for(i=0; i<global_ni_count; i++)
-          {
+
+        if (ev.type == UMMUNOTIFY_EVENT_TYPE_LAST) {
+            generation_counter = ev.user_cookie_counter;
+            return;
+        }
+
+        if (ev.type != UMMUNOTIFY_EVENT_TYPE_INVAL)
+            continue;
+
+        in_mr_cache = 1;
+        pthread_mutex_lock(&global_nis_lock);
+
+        for (i = 0; i < global_ni_count; i++) {
             ni_t *ni = global_nis[i];
 
-        switch (ev.type) {
-            case UMMUNOTIFY_EVENT_TYPE_INVAL:{
-                /* Search the app tree for the MR with that cookie and
-                 * remove it. We don't care for the self tree. */
-                struct mr *mr;
+            /* Search the app tree for the MR with that cookie and
+             * remove it. We don't care for the self tree. */
+            struct mr *mr;
 
-                PTL_FASTLOCK_LOCK(&ni->mr_app.tree_lock);
+            PTL_FASTLOCK_LOCK(&ni->mr_app.tree_lock);
 
-                RB_FOREACH(mr, the_root, &ni->mr_app.tree) {
-                    if (mr->umn_cookie == ev.user_cookie_counter) {
-                        /* All or part of that region is now invalid. We must not reuse it. Remove it from the tree. */
-                        RB_REMOVE(the_root, &ni->mr_app.tree, mr);
-                        mr_put(mr);
+            RB_FOREACH(mr, the_root, &ni->mr_app.tree) {
+                if (mr->umn_cookie == ev.user_cookie_counter) {
+                    /* All or part of that region is now invalid. We must not reuse it. Remove it from the tree. */
+                    mr_tree_remove(&ni->mr_app, mr);
+                    ni->mr_app.evictions++;
 
-                        break;
-                    }
+                    break;
                 }
-
-                PTL_FASTLOCK_UNLOCK(&ni->mr_app.tree_lock);
             }
-                break;
 
-            case UMMUNOTIFY_EVENT_TYPE_LAST:
-                generation_counter = ev.user_cookie_counter;
-                return;
+            PTL_FASTLOCK_UNLOCK(&ni->mr_app.tree_lock);
         }
+
+        pthread_mutex_unlock(&global_nis_lock);
+        in_mr_cache = 0;
+    }
+}
+#endif
+
+/**
+ * Drop the cached mrs of all the NIs overlapping a range the
+ * application is releasing.
+ *
+ * @param[in] start starting address of the range
+ * @param[in] length length of the range
+ */
+static void mr_hooks_invalidate(void *start, size_t length)
+{
+    int i;
+
+    if (!mr_hooks_active || in_mr_cache || length == 0)
+        return;
+
+    in_mr_cache = 1;
+    pthread_mutex_lock(&global_nis_lock);
+
+    for (i = 0; i < global_ni_count; i++)
+        mr_tree_invalidate(&global_nis[i]->mr_app, start, length);
+
+    pthread_mutex_unlock(&global_nis_lock);
+    in_mr_cache = 0;
+}
+
+/*
+ * Memory hooks, used when ummunotify is not available and
+ * PTL_MR_HOOKS is set. They override the C library calls releasing
+ * memory, so that the cached mrs are dropped before their pages go
+ * away. Otherwise they only make the system call.
+ */
+int munmap(void *addr, size_t length)
+{
+    mr_hooks_invalidate(addr, length);
+
+    return syscall(SYS_munmap, addr, length);
+}
+
+void *mremap(void *old_address, size_t old_size, size_t new_size,
+             int flags, ...)
+{
+    void *new_address = NULL;
+    va_list ap;
+
+    if (flags & MREMAP_FIXED) {
+        va_start(ap, flags);
+        new_address = va_arg(ap, void *);
+        va_end(ap);
+
+        mr_hooks_invalidate(new_address, new_size);
+    }
+
+    mr_hooks_invalidate(old_address, old_size);
+
+    return (void *)syscall(SYS_mremap, old_address, old_size, new_size,
+                           flags, new_address);
+}
+
+int madvise(void *addr, size_t length, int advice)
+{
+    if (advice == MADV_DONTNEED
+#ifdef MADV_FREE
+        || advice == MADV_FREE
+#endif
+        || advice == MADV_REMOVE)
+        mr_hooks_invalidate(addr, length);
+
+    return syscall(SYS_madvise, addr, length, advice);
+}
+
+/**
+ * Start the memory hooks.
+ */
+static void mr_hooks_init(void)
+{
+    if (mr_hooks_active)
+        return;
+
+#if MR_PINS_PAGES && defined(M_MMAP_MAX)
+    /* malloc() would otherwise give memory back to the system from
+     * inside the C library, where the hooks can't see it. */
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_TRIM_THRESHOLD, -1);
+#endif
+
+    mr_hooks_active = 1;
+}
+
+/**
+ * Start watching the invalidations from the ummunotify driver.
+ *
+ * @param[in] ni to watch for
+ *
+ * @return status
+ */
+static int mr_umn_init(ni_t *ni)
+{
+#if WITH_TRANSPORT_UDP
+    return PTL_FAIL;
+#else
+    if (!global_umn_init) {
+        global_umn_fd = open("/dev/ummunotify", O_RDONLY | O_NONBLOCK);
+        if (global_umn_fd == -1)
+            return PTL_FAIL;
+
+        global_umn_counter =
+            mmap(NULL, sizeof *(global_umn_counter), PROT_READ, MAP_SHARED,
+                 global_umn_fd, 0);
+        if (global_umn_counter == MAP_FAILED) {
+            close(global_umn_fd);
+            global_umn_fd = -1;
+            return PTL_FAIL;
         }
+
+        global_umn_watcher.data = NULL;
+        ev_io_init(&global_umn_watcher, process_ummunotify, global_umn_fd, EV_READ);
+        EVL_WATCH(ev_io_start(evl.loop, &global_umn_watcher));
+        global_umn_init = 1;
     }
+    ni->umn_counter = global_umn_counter;
+    ni->umn_watcher = global_umn_watcher;
+    ni->umn_fd = global_umn_fd;
+
+    return PTL_OK;
+#endif
 }
 
 /**
- * Try to use the ummunotify driver if present
+ * Setup the mr cache of an NI. Its invalidations come from the
+ * ummunotify driver if present, else from the memory hooks when
+ * PTL_MR_HOOKS is set. Without either, registrations are only cached
+ * when they don't pin the pages.
  */
 void mr_init(ni_t *ni)
 {
-    if (get_param(PTL_DISABLE_MEM_REG_CACHE) != 1) {
-        global_nis[global_ni_count++] = ni;
-        if (!global_umn_init) {
-            global_umn_init = 1;
-            global_umn_fd = open("/dev/ummunotify", O_RDONLY | O_NONBLOCK);
-            if (global_umn_fd == -1) {
-                fprintf(stderr,
-                        "WARNING: Ummunotify not found: Not using ummunotify can result in incorrect results download and install ummunotify from:\n  https://github.com/Portals4/ummunotify/ummunotify-v2.tar.gz \n");
-                global_umn_init = 0;
-                return;
-            }   
-
-            global_umn_counter =
-                mmap(NULL, sizeof *(global_umn_counter), PROT_READ, MAP_SHARED,
-                     global_umn_fd, 0);
-            if (global_umn_counter == MAP_FAILED) {
-                close(global_umn_fd);
-                global_umn_fd = -1;
-                return;
-            }
+    if (get_param(PTL_DISABLE_MEM_REG_CACHE) == 1) {
+        fprintf(stderr, "NOTE: Ummunotify and IB registered mem cache disabled, set PTL_DISABLE_MEM_REG_CACHE=0 to re-enable.\n"); 
+        return;
+    }
 
-            global_umn_watcher.data = NULL;
-            ev_io_init(&global_umn_watcher, process_ummunotify, global_umn_fd, EV_READ);
-            EVL_WATCH(ev_io_start(evl.loop, &global_umn_watcher));
+    if (mr_umn_init(ni)) {
+        if (get_param(PTL_MR_HOOKS)) {
+            ptl_info("ummunotify not found, using memory hooks\n");
+            mr_hooks_init();
+        } else {
+#if MR_PINS_PAGES
+            /* A pinned registration could outlive the memory the
+             * application gives back, and later point to other pages
+             * at the same address. */
+            ptl_info("ummunotify not found, registration cache disabled\n");
+            return;
+#endif
         }
-        ni->umn_counter = global_umn_counter;
-        ni->umn_watcher = global_umn_watcher;
-        ni->umn_fd = global_umn_fd;
     }
-    else {
-        global_umn_fd = -1;
-        fprintf(stderr, "NOTE: Ummunotify and IB registered mem cache disabled, set PTL_DISABLE_MEM_REG_CACHE=0 to re-enable.\n"); 
+
+    pthread_mutex_lock(&global_nis_lock);
+    if (global_ni_count < sizeof(global_nis) / sizeof(global_nis[0])) {
+        global_nis[global_ni_count++] = ni;
+        ni->mr_cache = 1;
     }
+    pthread_mutex_unlock(&global_nis_lock);
 }
 #endif
 
@@ -575,10 +854,7 @@ static void cleanup_mr_tree(struct ni_mr_tree *tree)
 
     for (mr = RB_MIN(the_root, &tree->tree); mr != NULL; mr = next_mr) {
         next_mr = RB_NEXT(the_root, &tree->tree, mr);
-        RB_REMOVE(the_root, &tree->tree, mr);
-        //account for the case where no active mrs are on the list
-        if (atomic_read(&mr->obj.obj_ref.ref_cnt) > 1)
-            mr_put(mr);
+        mr_tree_remove(tree, mr);
     }
 
     PTL_FASTLOCK_UNLOCK(&tree->tree_lock);
@@ -592,11 +868,51 @@ static void cleanup_mr_tree(struct ni_mr_tree *tree)
 void cleanup_mr_trees(ni_t *ni)
 {
 #if !IS_PPE
+    int i;
+
     if (ni->umn_fd != -1) {
         EVL_WATCH(ev_io_stop(evl.loop, &ni->umn_watcher));
     }
+
+    /* Stop the invalidations for that NI. */
+    pthread_mutex_lock(&global_nis_lock);
+    for (i = 0; i < global_ni_count; i++) {
+        if (global_nis[i] == ni) {
+            global_nis[i] = global_nis[--global_ni_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&global_nis_lock);
+
+    in_mr_cache = 1;
 #endif
 
     cleanup_mr_tree(&ni->mr_self);
     cleanup_mr_tree(&ni->mr_app);
+
+#if !IS_PPE
+    in_mr_cache = 0;
+#endif
+}
+
+/**
+ * Read one of the mr cache status registers.
+ *
+ * @param[in] ni owning the caches
+ * @param[in] index of the status register
+ *
+ * @return the value of the register
+ */
+ptl_sr_value_t mr_cache_status(ni_t *ni, ptl_sr_index_t index)
+{
+    switch (index) {
+    case PTL_SR_MR_CACHE_HITS:
+        return ni->mr_app.hits + ni->mr_self.hits;
+    case PTL_SR_MR_CACHE_MISSES:
+        return ni->mr_app.misses + ni->mr_self.misses;
+    case PTL_SR_MR_CACHE_EVICTIONS:
+        return ni->mr_app.evictions + ni->mr_self.evictions;
+    default:
+        return 0;
+    }
 }
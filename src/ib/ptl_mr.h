@@ -16,6 +16,7 @@ typedef struct mr {
     obj_t obj;
 
     struct list_head list;      /* internal management */
+    struct list_head lru;       /* in the cache of the NI */
 
     /* Boundaries of the region. */
     void *addr;                 /* in application space */
@@ -68,8 +69,12 @@ static inline int mr_lookup_self(ni_t *ni, void *start, ptl_size_t length,
     return mr_lookup(ni, &ni->mr_self, start, length, mr);
 }
 
+void mr_tree_init(struct ni_mr_tree *tree);
+
 void cleanup_mr_trees(ni_t *ni);
 
+ptl_sr_value_t mr_cache_status(ni_t *ni, ptl_sr_index_t index);
+
 #if IS_PPE
 static inline void mr_init(ni_t *ni)
 {
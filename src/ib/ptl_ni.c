@@ -172,46 +172,22 @@ static int init_pools(ni_t *ni)
 
 /*
  * create_tables
- *	initialize private rank table in NI
- *	we are not yet connected to remote QPs
+ *	initialize private rank directory in NI
+ *	the connections are created on first use
  */
 static int create_tables(ni_t *ni)
 {
-    int i;
-    conn_t *conn;
     const ptl_size_t map_size = ni->logical.map_size;
-    ptl_process_t *mapping = ni->logical.mapping;
 
-    ni->logical.rank_table = calloc(map_size, sizeof(entry_t));
-    if (!ni->logical.rank_table) {
+    ni->logical.conn_dir_size =
+        (map_size + CONN_DIR_LEAF_SIZE - 1) >> CONN_DIR_BITS;
+    ni->logical.conn_dir =
+        calloc(ni->logical.conn_dir_size, sizeof(*ni->logical.conn_dir));
+    if (!ni->logical.conn_dir) {
         WARN();
         return PTL_NO_SPACE;
     }
 
-    ptl_info("mapping table: \n");
-
-    for (i = 0; i < map_size; i++) {
-        entry_t *entry = &ni->logical.rank_table[i];
-
-        entry->rank = i;
-        entry->nid = mapping[i].phys.nid;
-        entry->pid = mapping[i].phys.pid;
-
-        if (conn_alloc(ni, &entry->connect))
-            return PTL_FAIL;
-
-        /* convert nid/pid to ipv4 address */
-        conn = entry->connect;
-        conn->sin.sin_family = AF_INET;
-        conn->sin.sin_addr.s_addr = nid_to_addr(entry->nid);
-        conn->sin.sin_port = pid_to_port(entry->pid);
-#if WITH_TRANSPORT_UDP
-//              conn->sin.sin_port = entry->pid;
-        ptl_info("entry: %i, ADDR: %s PID: %i \n", i,
-                 inet_ntoa(conn->sin.sin_addr), (entry->pid));
-#endif
-    }
-
     return PTL_OK;
 }
 
@@ -317,38 +293,45 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
     ni->cleanup_state = NI_INIT_CLEANUP;
     INIT_LIST_HEAD(&ni->md_list);
     INIT_LIST_HEAD(&ni->ct_list);
+    INIT_LIST_HEAD(&ni->bundle.list);
 #if WITH_TRANSPORT_UDP
     PTL_FASTLOCK_INIT(&ni->udp_lock);
     INIT_LIST_HEAD(&ni->udp_list);
+#if WITH_RUDP
+    err = rudp_init(ni);
+    if (unlikely(err)) {
+        WARN();
+        goto err3;
+    }
 #endif
-    RB_INIT(&ni->mr_self.tree);
-    PTL_FASTLOCK_INIT(&ni->mr_self.tree_lock);
-    RB_INIT(&ni->mr_app.tree);
-    PTL_FASTLOCK_INIT(&ni->mr_app.tree_lock);
+#endif
+    mr_tree_init(&ni->mr_self);
+    mr_tree_init(&ni->mr_app);
+    ni->mr_cache = 0;
 #if !IS_PPE
     ni->umn_fd = -1;
 #endif
     PTL_FASTLOCK_INIT(&ni->md_list_lock);
     PTL_FASTLOCK_INIT(&ni->ct_list_lock);
-    pthread_mutex_init(&ni->atomic_mutex, NULL);
+    PTL_FASTLOCK_INIT(&ni->bundle.lock);
     pthread_mutex_init(&ni->pt_mutex, NULL);
+    atomic_set(&ni->atomic_pending, 0);
 
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
     PTL_FASTLOCK_INIT(&ni->shmem.noknem_lock);
+    INIT_LIST_HEAD(&ni->shmem.noknem_new);
     INIT_LIST_HEAD(&ni->shmem.noknem_list);
 #endif
 
     if (options & PTL_NI_PHYSICAL) {
-        PTL_FASTLOCK_INIT(&ni->physical.lock);
+        conn_hash_init(ni);
     }
 
-#if !WITH_TRANSPORT_UDP
     mr_init(ni);
-#endif
 
     err = init_pools(ni);
     if (unlikely(err))
-        goto err3;
+        goto err4;
 
     /* Initialize the remote transport first, because the local
      * transport might depend on it. */
@@ -356,7 +339,7 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
         err = transports.remote.NIInit(gbl, ni);
         if (unlikely(err)) {
             WARN();
-            goto err3;
+            goto err4;
         }
     }
 #if WITH_TRANSPORT_UDP
@@ -369,7 +352,7 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
         err = transports.local.NIInit(gbl, ni);
         if (unlikely(err)) {
             WARN();
-            goto err3;
+            goto err4;
         }
     }
 
@@ -381,7 +364,7 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
     if (unlikely(!ni->pt)) {
         WARN();
         err = PTL_NO_SPACE;
-        goto err3;
+        goto err4;
     }
 
 
@@ -390,7 +373,7 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
     if (err) {
         WARN();
         err = PTL_ARG_INVALID;
-        goto err3;
+        goto err4;
     }
 
     assert(iface->ni[ni_type] == NULL);
@@ -407,6 +390,10 @@ int _PtlNIInit(gbl_t *gbl, ptl_interface_t iface_id, unsigned int options,
     gbl_put();
     return PTL_OK;
 
+  err4:
+#if WITH_RUDP
+    rudp_fini(ni);
+#endif
   err3:
     ni_put(ni);
   err2:
@@ -630,6 +617,10 @@ static void ni_cleanup(ni_t *ni)
     if (transports.remote.NIFini)
         transports.remote.NIFini(ni);
 
+#if WITH_RUDP
+    rudp_fini(ni);
+#endif
+
     ni->iface->ni[ni->ni_type] = NULL;
     ni->iface = NULL;
 
@@ -638,9 +629,13 @@ static void ni_cleanup(ni_t *ni)
             free(ni->logical.mapping);
             ni->logical.mapping = NULL;
         }
-        if (ni->logical.rank_table) {
-            free(ni->logical.rank_table);
-            ni->logical.rank_table = NULL;
+        if (ni->logical.conn_dir) {
+            int i;
+
+            for (i = 0; i < ni->logical.conn_dir_size; i++)
+                free(ni->logical.conn_dir[i]);
+            free(ni->logical.conn_dir);
+            ni->logical.conn_dir = NULL;
         }
     }
 
@@ -655,14 +650,22 @@ static void ni_cleanup(ni_t *ni)
     pool_fini(&ni->mr_pool);
 
     if (ni->pt) {
+        int i;
+
+        /* Release the match indexes of PTs the user did not free. */
+        for (i = 0; i <= ni->limits.max_pt_index; i++) {
+            if (ni->pt[i].in_use)
+                pt_match_index_fini(&ni->pt[i]);
+        }
+
         free(ni->pt);
         ni->pt = NULL;
     }
 
-    pthread_mutex_destroy(&ni->atomic_mutex);
     pthread_mutex_destroy(&ni->pt_mutex);
     PTL_FASTLOCK_DESTROY(&ni->md_list_lock);
     PTL_FASTLOCK_DESTROY(&ni->ct_list_lock);
+    PTL_FASTLOCK_DESTROY(&ni->bundle.lock);
     PTL_FASTLOCK_DESTROY(&ni->mr_self.tree_lock);
     PTL_FASTLOCK_DESTROY(&ni->mr_app.tree_lock);
 #if WITH_TRANSPORT_UDP
@@ -686,8 +689,12 @@ int _PtlNIFini(gbl_t *gbl, ptl_handle_ni_t ni_handle)
 
 #if !IS_PPE
     ni->catcher_nosleep = 1;
+    progress_wake(ni);
 #endif
 
+    /* Start whatever an unterminated bundle still holds. */
+    end_bundle(ni, 1);
+
     pthread_mutex_lock(&gbl->gbl_mutex);
 
     assert(atomic_read(&ni->ref_cnt) >= 1);
@@ -749,7 +756,10 @@ int _PtlNIStatus(PPEGBL ptl_handle_ni_t ni_handle, ptl_sr_index_t index,
         goto err1;
     }
 
-    *status = ni->status[index];
+    if (index >= PTL_SR_MR_CACHE_HITS)
+        *status = mr_cache_status(ni, index);
+    else
+        *status = ni->status[index];
 
     ni_put(ni);
     gbl_put();
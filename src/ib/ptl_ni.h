@@ -11,17 +11,12 @@ struct queue;
 struct conn;
 
 /*
- * rank_entry_t
- *	per private rank table entry info
- *	only used for logical NIs
+ * The connections of a logical NI are only created when a rank is
+ * first talked to. They are found through a two-level directory
+ * indexed by rank, whose leaves are also allocated on demand.
  */
-typedef struct rank_entry {
-    ptl_rank_t rank;            /* world rank */
-    ptl_rank_t main_rank;       /* main rank on NID */
-    ptl_nid_t nid;
-    ptl_pid_t pid;
-    struct conn *connect;
-} entry_t;
+#define CONN_DIR_BITS		(10)
+#define CONN_DIR_LEAF_SIZE	(1 << CONN_DIR_BITS)
 
 /* Used by SHMEM to communicate the PIDs between the local ranks for a
  * physical NI. */
@@ -30,6 +25,24 @@ struct shmem_pid_table {
 
     /* Set to 1 when id is valid. */
     int valid;
+
+    /* For cross memory attach. The process, an address in it to try
+     * a copy from, and whether that rank can copy from and to all the
+     * local ranks: 1 if not, 2 if it can. */
+    pid_t os_pid;
+    void *cma_probe;
+    int cma;
+};
+
+/* Receiving side of a local rank, in the comm pad. It is followed by
+ * one ring per local rank, each with a single sender, then by the
+ * sbufs of the rank. */
+struct shmem_mailbox {
+    /* Written by the receiver. */
+    int sleeping __attribute__ ((aligned(CACHELINE_WIDTH)));   /* the receiver may sleep, ring it */
+
+    /* Written by the senders. One bit per ring which may hold bufs. */
+    unsigned long ready[0] __attribute__ ((aligned(CACHELINE_WIDTH)));
 };
 
 struct shmem_bounce_head {
@@ -44,11 +57,36 @@ struct udp_bounce_head {
                                  * 0. Invariant. */
 };
 
+/* How the progress thread waits for work, see PTL_PROGRESS_MODE. */
+enum progress_mode {
+    PROGRESS_POLL,              /* always polls */
+    PROGRESS_BLOCK,             /* sleeps as soon as there is no work */
+    PROGRESS_HYBRID,            /* polls for a while, then sleeps */
+};
+
+/* Sources of work polled by the progress thread. */
+enum progress_src {
+    PROGRESS_SRC_RDMA,
+    PROGRESS_SRC_UDP,
+    PROGRESS_SRC_SHMEM,
+    PROGRESS_SRC_LAST,          /* keep me last */
+};
+
 /* Memory regions tree attached to an NI. The PPE must have 2, the
  * other transports need one. */
 struct ni_mr_tree {
     RB_HEAD(the_root, mr) tree;
     PTL_FASTLOCK_TYPE tree_lock;
+
+    /* Cached regions, least recently looked up first. */
+    struct list_head lru;
+    size_t num_entries;
+    size_t num_bytes;
+
+    /* Reported by PtlNIStatus(). */
+    ptl_sr_value_t hits;
+    ptl_sr_value_t misses;
+    ptl_sr_value_t evictions;
 };
 
 /*
@@ -77,8 +115,8 @@ typedef struct ni {
 
     int shutting_down;
 
-    /* Serialize atomic operations on this NI. */
-    pthread_mutex_t atomic_mutex;
+    /* Target atomics in progress, waited for by PtlAtomicSync(). */
+    atomic_t atomic_pending;
 
     pt_t *pt;
     pthread_mutex_t pt_mutex;
@@ -90,12 +128,23 @@ typedef struct ni {
     struct list_head ct_list;
     PTL_FASTLOCK_TYPE ct_list_lock;
 
+    /* Bundles opened by PtlStartBundle, one per thread. */
+    struct {
+        int num;
+        struct list_head list;
+        PTL_FASTLOCK_TYPE lock;
+    } bundle;
+
     /* The PPE must have a tree indexed on the application addresses,
      * and one tree for its own addresses. The other implementations
      * don't need that distinction. */
     struct ni_mr_tree mr_self;  /* the PPE */
     struct ni_mr_tree mr_app;   /* the client */
 
+    /* Whether the mr trees keep the regions once they are no longer
+     * used. Only when their invalidation can be caught. */
+    int mr_cache;
+
 #if !IS_PPE
     int umn_fd;
     ev_io umn_watcher;
@@ -112,6 +161,19 @@ typedef struct ni {
     int has_catcher;
     int catcher_stop;
     int catcher_nosleep;
+
+    /* Progress engine, see ptl_recv.c */
+    struct {
+        int mode;               /* enum progress_mode */
+        int epfd;               /* sources which can wake the thread up */
+        int wake_fd;            /* eventfd, for wakeups from this process */
+        int watched;            /* mask of the sources in epfd */
+        int cq_armed;           /* CQ notification requested */
+        int sleeping;           /* the thread is about to sleep */
+        uint64_t polls[PROGRESS_SRC_LAST];      /* polls of each source */
+        uint64_t hits[PROGRESS_SRC_LAST];       /* polls which found work */
+        uint64_t sleeps;
+    } progress;
 #endif
 
     int cleanup_state;
@@ -151,9 +213,32 @@ typedef struct ni {
         size_t per_proc_comm_buf_size;
         int per_proc_comm_buf_numbers;
         int knem_fd;
-        struct queue *queue;    /* own queue, in the comm pad */
-        void *first_queue;      /* addr of rank 0 queue, in the comm pad */
+        struct shmem_mailbox *mailbox;  /* own mailbox, in the comm pad */
+        void *first_mailbox;    /* addr of rank 0 mailbox, in the comm pad */
+        size_t mailbox_size;    /* mailbox with its ready bitmap */
+        size_t ring_size;
+        unsigned long ring_slots;
+        int ready_words;        /* number of words of the ready bitmap */
+        int next_ring;          /* where the receiver looks first */
+
+        /* Serialize the senders of this NI, one lock per destination. */
+        PTL_FASTLOCK_TYPE *ring_locks;
         char *comm_pad_shm_name;
+        char *comm_pad_path;    /* file on hugetlbfs, if used */
+
+        /* Doorbell, to wake up the progress thread of a local rank. */
+        int bell_fd;
+        char *bell_name;
+
+        /* Eager buffers of this rank, after its sbufs. Mid-size puts
+         * are copied there and read by the target. Only this rank
+         * takes them and gives them back, once its sbuf returns. */
+        struct {
+            union counted_ptr free_list;
+            void *bufs;
+            size_t buf_size;
+            unsigned int num_bufs;
+        } eager;
 
 #if !USE_KNEM
         /* Bounce buffers used when KNEM is not available. They are
@@ -166,8 +251,17 @@ typedef struct ni {
             unsigned int num_bufs;
         } bounce_buf;
 
+        /* Transfers going through the bounce buffers. New ones are
+         * queued on noknem_new, under noknem_lock; the progress thread
+         * moves them to noknem_list, which only it accesses. */
         PTL_FASTLOCK_TYPE noknem_lock;
+        struct list_head noknem_new;
         struct list_head noknem_list;
+
+        /* Large transfers use cross memory attach instead of the
+         * bounce buffers. */
+        int cma;
+        pid_t pid;
 #endif
     } shmem;
 #endif
@@ -219,6 +313,19 @@ typedef struct ni {
             size_t buf_size;
             unsigned int num_bufs;
         } udp_buf;
+
+#if WITH_RUDP
+        /* Reliability windows, see ptl_rudp.c */
+        struct {
+            pthread_mutex_t lock;
+            struct rudp_peer **peers;
+            struct rudp_spoke *wheel;
+            uint64_t tick;      /* last one processed */
+            struct list_head ready;     /* bufs delivered in order */
+            struct rudp_peer *acks;     /* peers owed a delayed ACK */
+            unsigned int num_pending;   /* datagrams waiting for a window */
+        } rudp;
+#endif
 #if IS_PPE
         /* Link the active NIs together so that the PPE can poll them. */
         struct list_head ppe_ni_list;
@@ -254,15 +361,19 @@ typedef struct ni {
              * XI/XT will not be queued on the non-main ranks, but on
              * the main rank. */
 
-            /* Rank table. This is used to connection TO remote ranks */
+            /* Rank directory. This is used to connection TO remote
+             * ranks */
             int map_size;
-            struct rank_entry *rank_table;
+            struct conn ***conn_dir;
+            int conn_dir_size;  /* number of leaves */
             ptl_process_t *mapping;
         } logical;
 
         struct {
-            /* Physical NI. */
-            void *tree;
+            /* Physical NI. Connections are in a hash table indexed on
+             * their ID. The lock serializes insertions only. */
+            struct conn_hash *hash;
+            unsigned long serial;   /* unique to this NI instance */
             PTL_FASTLOCK_TYPE lock;
         } physical;
     };
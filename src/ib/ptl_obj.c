@@ -15,7 +15,15 @@ int index_init(gbl_t *gbl)
     if (!gbl->index_map)
         return PTL_NO_SPACE;
 
+    gbl->index_free = calloc(MAX_INDEX, sizeof(unsigned int));
+    if (!gbl->index_free) {
+        free(gbl->index_map);
+        return PTL_NO_SPACE;
+    }
+
     atomic_set(&gbl->next_index, 0);
+    gbl->num_index_free = 0;
+    pthread_mutex_init(&gbl->index_mutex, NULL);
 
     return PTL_OK;
 }
@@ -25,35 +33,70 @@ int index_init(gbl_t *gbl)
  */
 void index_fini(gbl_t *gbl)
 {
+    pthread_mutex_destroy(&gbl->index_mutex);
+    free(gbl->index_free);
     free(gbl->index_map);
 }
 
 /**
  * Get index for object and save address.
  *
+ * Indexes released by index_put are reused first, with the generation
+ * following the one they were released with.
+ *
  * @param obj
- * @param index_p
+ * @param index_p returns the index and generation, as in a handle
  *
  * @output status
  */
 static inline int index_get(gbl_t *gbl, obj_t *obj, unsigned int *index_p)
 {
-    unsigned int index;
+    unsigned int index = 0;
+    int reused = 0;
+
+    /* reuse the index of a freed object first */
+    if (gbl->num_index_free) {
+        pthread_mutex_lock(&gbl->index_mutex);
+        if (gbl->num_index_free) {
+            index = gbl->index_free[--gbl->num_index_free];
+            reused = 1;
+        }
+        pthread_mutex_unlock(&gbl->index_mutex);
+    }
 
-    index = atomic_inc(&gbl->next_index);
+    if (reused) {
+        index = obj_handle_next_gen(index);
+    } else {
+        index = atomic_inc(&gbl->next_index);
 
-    if (index >= MAX_INDEX) {
-        ptl_warn("Index > MAX Index, index was: %i \n", index);
-        return PTL_FAIL;
+        if (index >= MAX_INDEX) {
+            ptl_warn("Index > MAX Index, index was: %i \n", index);
+            return PTL_FAIL;
+        }
     }
 
-    gbl->index_map[index] = obj;
+    gbl->index_map[obj_handle_to_index(index)] = obj;
 
     *index_p = index;
 
     return PTL_OK;
 }
 
+/**
+ * Release the index of an object whose memory is freed.
+ *
+ * @param handle the handle of the object
+ */
+static void index_put(gbl_t *gbl, ptl_handle_any_t handle)
+{
+    gbl->index_map[obj_handle_to_index(handle)] = NULL;
+
+    pthread_mutex_lock(&gbl->index_mutex);
+    gbl->index_free[gbl->num_index_free++] =
+        handle & (HANDLE_GEN_MASK | HANDLE_INDEX_MASK);
+    pthread_mutex_unlock(&gbl->index_mutex);
+}
+
 /**
  * Convert index to object.
  *
@@ -80,11 +123,11 @@ static inline int index_lookup(gbl_t *gbl, unsigned int index, obj_t **obj_p)
  * Return a new zero filled slab.
  *
  * The slab will be used by caller to hold a new
- * batch of objects. Normal behavior is to allocate
- * page aligned memory. In the special case that
- * we are creating objects in shared memory the pool
- * has a pre allocated chunk of shared memory that is
- * used instead.
+ * batch of objects. Normal behavior is to reuse a slab
+ * parked by pool_shrink, else to allocate page aligned
+ * memory. In the special case that we are creating
+ * objects in shared memory the pool has a pre allocated
+ * chunk of shared memory that is used instead.
  *
  * @param pool the pool for which slab is created.
  *
@@ -98,6 +141,8 @@ static void *pool_get_slab(pool_t *pool)
     if (pool->use_pre_alloc_buffer) {
         slab = pool->pre_alloc_buffer;
         pool->pre_alloc_buffer = NULL;
+    } else if (pool->num_parked_slabs) {
+        slab = pool->parked_slabs[--pool->num_parked_slabs];
     } else {
         err = posix_memalign(&slab, pagesize, pool->slab_size);
         if (unlikely(err))
@@ -112,8 +157,8 @@ static void *pool_get_slab(pool_t *pool)
 
 /**
  * get chunk hold new slab.
- * note that we currently never free objects so there are
- * never any holes in chunk->slab_list
+ * pool_shrink keeps the slabs of each chunk packed so there
+ * are never any holes in chunk->slab_list
  *
  * @pre caller should hold pool->mutex
  *
@@ -127,9 +172,8 @@ static int pool_get_chunk(pool_t *pool, chunk_t **chunk_p)
     int err;
     chunk_t *chunk;
 
-    /* see if there is a chunk with room at head of list */
-    if (likely(!list_empty(&pool->chunk_list))) {
-        chunk = list_first_entry(&pool->chunk_list, chunk_t, list);
+    /* see if there is a chunk with room */
+    list_for_each_entry(chunk, &pool->chunk_list, list) {
         if (chunk->num_slabs < chunk->max_slabs) {
             *chunk_p = chunk;
             return PTL_OK;
@@ -232,10 +276,475 @@ static int pool_alloc_slab(pool_t *pool)
     }
 
     chunk->num_slabs++;
+    pool->num_objs += pool->obj_per_slab;
+
+    return PTL_OK;
+}
+
+/**
+ * Destroy the objects of a slab.
+ *
+ * The objects must all be free and off the freelist and the
+ * thread caches.
+ *
+ * @pre caller should hold pool->mutex
+ *
+ * @param pool the pool owning the slab
+ * @param slab the slab
+ */
+static void pool_clear_slab(pool_t *pool, slab_info_t *slab)
+{
+    uint8_t *p = slab->addr;
+    obj_t *obj;
+    int i;
+
+    for (i = 0; i < pool->obj_per_slab; i++) {
+        obj = (obj_t *)p;
+
+        if (pool->fini)
+            pool->fini(obj);
+
+        index_put(pool->gbl, obj->obj_handle);
+        p += pool->round_size;
+    }
+
+#if WITH_TRANSPORT_IB
+    if (slab->mr)
+        ibv_dereg_mr(slab->mr);
+#endif
+
+    pool->num_objs -= pool->obj_per_slab;
+}
+
+/**
+ * Free a slab of objects.
+ *
+ * @pre caller should hold pool->mutex
+ *
+ * @param pool the pool owning the slab
+ * @param slab the slab
+ */
+static void pool_free_slab(pool_t *pool, slab_info_t *slab)
+{
+    pool_clear_slab(pool, slab);
+
+    if (!pool->use_pre_alloc_buffer)
+        free(slab->addr);
+
+    slab->addr = NULL;
+}
+
+/**
+ * Give the memory of a slab of objects back to the system, keeping
+ * the slab mapped for the next pool_get_slab.
+ *
+ * to_obj() may still read an object of the slab through a stale
+ * handle looked up just before. The object then reads as zeros,
+ * which no valid handle matches.
+ *
+ * @pre caller should hold pool->mutex
+ *
+ * @param pool the pool owning the slab
+ * @param slab the slab
+ */
+static void pool_park_slab(pool_t *pool, slab_info_t *slab)
+{
+    void **parked;
+
+    pool_clear_slab(pool, slab);
+
+    parked = realloc(pool->parked_slabs,
+                     (pool->num_parked_slabs + 1) * sizeof(*parked));
+    if (parked) {
+        pool->parked_slabs = parked;
+        pool->parked_slabs[pool->num_parked_slabs++] = slab->addr;
+    }
+
+    /* Without room to park it, the slab is leaked rather than
+     * unmapped. */
+    madvise(slab->addr, pool->slab_size & ~(pagesize - 1), MADV_DONTNEED);
+
+    slab->addr = NULL;
+}
+
+/* Thread slots, which index the caches of each pool. */
+static pthread_mutex_t pool_slot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pool_slot_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_slot_key;
+static int pool_slot_used[POOL_MAX_THREADS];
+
+/* Slot of the current thread plus one, 0 until it gets one, or
+ * POOL_MAX_THREADS + 1 if they were all taken. */
+static __thread int pool_slot;
+
+/**
+ * Release the slot of an exiting thread.
+ *
+ * The objects in its caches go to the next thread taking the slot.
+ *
+ * @param arg the slot plus one
+ */
+static void pool_slot_release(void *arg)
+{
+    int slot = (uintptr_t) arg - 1;
+
+    pthread_mutex_lock(&pool_slot_mutex);
+    pool_slot_used[slot] = 0;
+    pthread_mutex_unlock(&pool_slot_mutex);
+}
+
+static void pool_slot_key_create(void)
+{
+    pthread_key_create(&pool_slot_key, pool_slot_release);
+}
+
+/**
+ * Assign a slot to the current thread.
+ *
+ * @return the slot plus one, or POOL_MAX_THREADS + 1 if none is left
+ */
+static int pool_slot_get(void)
+{
+    int slot;
+
+    pthread_once(&pool_slot_once, pool_slot_key_create);
+
+    pthread_mutex_lock(&pool_slot_mutex);
+    for (slot = 0; slot < POOL_MAX_THREADS; slot++) {
+        if (!pool_slot_used[slot]) {
+            pool_slot_used[slot] = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool_slot_mutex);
+
+    pool_slot = slot + 1;
+
+    if (slot < POOL_MAX_THREADS)
+        pthread_setspecific(pool_slot_key, (void *)(uintptr_t) pool_slot);
+
+    return pool_slot;
+}
+
+/**
+ * Return the cache of the current thread for a pool.
+ *
+ * @param pool the pool
+ *
+ * @return the cache, or NULL if the thread has none
+ */
+static inline struct pool_cache *pool_get_cache(pool_t *pool)
+{
+    struct pool_cache *cache;
+    int slot;
+
+    if (!pool->cache_size)
+        return NULL;
+
+    slot = pool_slot;
+    if (unlikely(!slot))
+        slot = pool_slot_get();
+
+    if (unlikely(slot > POOL_MAX_THREADS))
+        return NULL;
+
+    cache = pool->caches[slot - 1];
+    if (unlikely(!cache)) {
+        if (posix_memalign((void **)&cache, linesize, sizeof(*cache)))
+            return NULL;
+
+        cache->num = 0;
+        pool->caches[slot - 1] = cache;
+    }
+
+    return cache;
+}
+
+/**
+ * Enter a section walking the freelist of a pool.
+ *
+ * pool_shrink waits for the threads in such sections to leave before
+ * giving back any slab, and holds off those trying to enter.
+ *
+ * @param pool the pool
+ */
+static inline void pool_enter(pool_t *pool)
+{
+    for (;;) {
+        atomic_inc(&pool->dequeuers);
+        if (likely(!atomic_read(&pool->shrinking)))
+            return;
+
+        /* wait for pool_shrink, which holds the pool mutex */
+        atomic_dec(&pool->dequeuers);
+        pthread_mutex_lock(&pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/**
+ * Leave a section walking the freelist of a pool.
+ *
+ * @param pool the pool
+ */
+static inline void pool_leave(pool_t *pool)
+{
+    atomic_dec(&pool->dequeuers);
+}
+
+/**
+ * Return an object from the freelist of a pool.
+ *
+ * @param pool the pool
+ *
+ * @return the object, or NULL if the freelist is empty
+ */
+static inline obj_t *pool_dequeue(pool_t *pool)
+{
+    obj_t *obj;
+
+    /* preallocated slabs are never freed */
+    if (pool->use_pre_alloc_buffer)
+        return ll_dequeue_obj(&pool->free_list);
+
+    pool_enter(pool);
+    obj = ll_dequeue_obj(&pool->free_list);
+    pool_leave(pool);
+
+    return obj;
+}
+
+/**
+ * Refill an empty thread cache with a batch of objects from the
+ * freelist of a pool, growing the pool if the freelist is empty.
+ *
+ * @param pool the pool
+ * @param cache the cache
+ *
+ * @return status
+ */
+static int pool_refill(pool_t *pool, struct pool_cache *cache)
+{
+    obj_t *obj;
+    unsigned int num;
+    int err;
+
+    for (;;) {
+        pool_enter(pool);
+        obj = ll_dequeue_obj_list(&pool->free_list,
+                                  (pool->cache_size + 1) / 2, &num);
+        pool_leave(pool);
+
+        if (obj)
+            break;
+
+        pthread_mutex_lock(&pool->mutex);
+        err = pool_alloc_slab(pool);
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (unlikely(err))
+            return err;
+    }
+
+    atomic_add(&pool->count, num);
+
+    while (num--) {
+        cache->objs[cache->num++] = obj;
+        obj = obj->next;
+    }
 
     return PTL_OK;
 }
 
+/**
+ * Return the oldest objects of a thread cache to the freelist of a
+ * pool in one batch.
+ *
+ * @param pool the pool
+ * @param cache the cache
+ * @param num the number of objects to return, at least one
+ */
+static void pool_flush(pool_t *pool, struct pool_cache *cache, int num)
+{
+    int i;
+
+    for (i = 0; i < num - 1; i++)
+        cache->objs[i]->next = cache->objs[i + 1];
+
+    ll_enqueue_obj_list(&pool->free_list, cache->objs[0],
+                        cache->objs[num - 1]);
+
+    cache->num -= num;
+    memmove(cache->objs, cache->objs + num,
+            cache->num * sizeof(cache->objs[0]));
+
+    atomic_sub(&pool->count, num);
+}
+
+static int slab_cmp(const void *a, const void *b)
+{
+    const slab_info_t *slab_a = *(slab_info_t * const *)a;
+    const slab_info_t *slab_b = *(slab_info_t * const *)b;
+
+    return (slab_a->addr > slab_b->addr) - (slab_a->addr < slab_b->addr);
+}
+
+/**
+ * Find the slab holding an object.
+ *
+ * @param slabs the slabs of the pool, sorted by address
+ * @param num_slabs the number of slabs
+ * @param obj the object
+ *
+ * @return the slab
+ */
+static slab_info_t *slab_find(slab_info_t **slabs, int num_slabs,
+                              obj_t *obj)
+{
+    int lo = 0;
+    int hi = num_slabs - 1;
+    int mid;
+
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (slabs[mid]->addr <= (void *)obj)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return slabs[lo];
+}
+
+/* Slabs picked by pool_shrink to be freed. */
+#define SLAB_FREED	(UINT_MAX)
+
+/**
+ * Give back the slabs of a pool whose objects are all on the
+ * freelist, keeping at least a slab worth of free objects.
+ *
+ * Nothing is done if another thread holds the pool mutex.
+ *
+ * @param pool the pool
+ */
+static void pool_shrink(pool_t *pool)
+{
+    chunk_t *chunk;
+    chunk_t *tmp;
+    slab_info_t **slabs;
+    slab_info_t *slab;
+    obj_t *list;
+    obj_t *obj;
+    obj_t *next;
+    obj_t *first = NULL;
+    obj_t *last = NULL;
+    unsigned int num;
+    unsigned int num_left;
+    unsigned int i;
+    int num_slabs = 0;
+    int j;
+
+    if (pthread_mutex_trylock(&pool->mutex))
+        return;
+
+    list_for_each_entry(chunk, &pool->chunk_list, list)
+        num_slabs += chunk->num_slabs;
+
+    slabs = malloc(num_slabs * sizeof(*slabs));
+    if (!slabs) {
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+
+    i = 0;
+    list_for_each_entry(chunk, &pool->chunk_list, list) {
+        for (j = 0; j < chunk->num_slabs; j++) {
+            chunk->slab_list[j].num_free = 0;
+            slabs[i++] = &chunk->slab_list[j];
+        }
+    }
+
+    qsort(slabs, num_slabs, sizeof(*slabs), slab_cmp);
+
+    /* hold off the threads walking the freelist, then take it all */
+    atomic_set(&pool->shrinking, 1);
+    __sync_synchronize();
+    while (atomic_read(&pool->dequeuers))
+        SPINLOCK_BODY();
+
+    list = ll_dequeue_obj_list(&pool->free_list, UINT_MAX, &num);
+
+    for (obj = list, i = 0; i < num; obj = obj->next, i++)
+        slab_find(slabs, num_slabs, obj)->num_free++;
+
+    num_left = num;
+    for (j = 0; j < num_slabs; j++) {
+        if (slabs[j]->num_free == pool->obj_per_slab &&
+            num_left >= 2 * pool->obj_per_slab) {
+            slabs[j]->num_free = SLAB_FREED;
+            num_left -= pool->obj_per_slab;
+        }
+    }
+
+    /* put back the objects of the other slabs */
+    for (obj = list, i = 0; i < num; obj = next, i++) {
+        next = obj->next;
+
+        if (slab_find(slabs, num_slabs, obj)->num_free != SLAB_FREED) {
+            obj->next = first;
+            first = obj;
+            if (!last)
+                last = obj;
+        }
+    }
+
+    if (first)
+        ll_enqueue_obj_list(&pool->free_list, first, last);
+
+    atomic_set(&pool->shrinking, 0);
+
+    /* park the picked slabs, keeping those of each chunk packed */
+    list_for_each_entry_safe(chunk, tmp, &pool->chunk_list, list) {
+        j = 0;
+        while (j < chunk->num_slabs) {
+            slab = &chunk->slab_list[j];
+            if (slab->num_free == SLAB_FREED) {
+                pool_park_slab(pool, slab);
+                *slab = chunk->slab_list[--chunk->num_slabs];
+            } else {
+                j++;
+            }
+        }
+
+        if (!chunk->num_slabs) {
+            list_del(&chunk->list);
+            free(chunk);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(slabs);
+}
+
+/* Consider shrinking a pool every that many batches returned to it. */
+#define POOL_SHRINK_PERIOD	(16)
+
+/**
+ * Shrink a pool if it is mostly idle.
+ *
+ * @param pool the pool
+ */
+static inline void pool_maybe_shrink(pool_t *pool)
+{
+    int used = atomic_read(&pool->count);
+    int free = pool->num_objs - used;
+
+    if (free >= 2 * pool->obj_per_slab && free > 2 * used &&
+        atomic_inc(&pool->returns) % POOL_SHRINK_PERIOD == 0)
+        pool_shrink(pool);
+}
+
 /**
  * Cleanup an object pool.
  *
@@ -246,7 +755,7 @@ static int pool_alloc_slab(pool_t *pool)
 int pool_fini(pool_t *pool)
 {
     struct list_head *l, *t;
-    obj_t *obj;
+    struct pool_cache *cache;
     chunk_t *chunk;
     int i;
     int err = PTL_OK;
@@ -255,14 +764,20 @@ int pool_fini(pool_t *pool)
     if (!pool->name)
         return err;
 
-    /*
-     * if pool has a fini routine call it on
-     * each free object
-     */
-    if (pool->fini) {
-        while ((obj = ll_dequeue_obj(&pool->free_list))) {
-            pool->fini(obj);
+    /* get back the objects held in thread caches */
+    if (pool->caches) {
+        for (i = 0; i < POOL_MAX_THREADS; i++) {
+            cache = pool->caches[i];
+            if (cache) {
+                if (cache->num)
+                    pool_flush(pool, cache, cache->num);
+                free(cache);
+            }
         }
+
+        free(pool->caches);
+        pool->caches = NULL;
+        pool->cache_size = 0;
     }
 
     if (atomic_read(&pool->count)) {
@@ -276,26 +791,25 @@ int pool_fini(pool_t *pool)
     pthread_mutex_destroy(&pool->mutex);
 
     /*
-     * free slabs and chunks
+     * free slabs and chunks, calling the fini routine of the
+     * pool on each object
      */
     list_for_each_safe(l, t, &pool->chunk_list) {
         list_del(l);
         chunk = list_entry(l, chunk_t, list);
 
-        for (i = 0; i < chunk->num_slabs; i++) {
-#if WITH_TRANSPORT_IB
-            struct ibv_mr *mr = chunk->slab_list[i].mr;
-            if (mr)
-                ibv_dereg_mr(mr);
-#endif
-
-            if (!pool->use_pre_alloc_buffer)
-                free(chunk->slab_list[i].addr);
-        }
+        for (i = 0; i < chunk->num_slabs; i++)
+            pool_free_slab(pool, &chunk->slab_list[i]);
 
         free(chunk);
     }
 
+    for (i = 0; i < pool->num_parked_slabs; i++)
+        free(pool->parked_slabs[i]);
+    free(pool->parked_slabs);
+    pool->parked_slabs = NULL;
+    pool->num_parked_slabs = 0;
+
     return err;
 }
 
@@ -339,10 +853,26 @@ int pool_init(gbl_t *gbl, pool_t *pool, char *name, int size,
     }
 
     atomic_set(&pool->count, 0);
+    atomic_set(&pool->dequeuers, 0);
+    atomic_set(&pool->shrinking, 0);
+    atomic_set(&pool->returns, 0);
+    pool->num_objs = 0;
+    pool->parked_slabs = NULL;
+    pool->num_parked_slabs = 0;
     ll_init(&pool->free_list);
     INIT_LIST_HEAD(&pool->chunk_list);
     pthread_mutex_init(&pool->mutex, NULL);
 
+    /* Objects of preallocated slabs may be freed by other processes,
+     * so they do not go through thread caches. */
+    pool->caches = NULL;
+    pool->cache_size = 0;
+    if (!pool->use_pre_alloc_buffer && get_param(PTL_POOL_CACHE)) {
+        pool->caches = calloc(POOL_MAX_THREADS, sizeof(*pool->caches));
+        if (pool->caches)
+            pool->cache_size = get_param(PTL_POOL_CACHE);
+    }
+
     if (pool->use_pre_alloc_buffer) {
         /* This pool cannot expand. Allocate its slab now. */
         assert(pool->pre_alloc_buffer);
@@ -364,6 +894,7 @@ void obj_release(ref_t *ref)
 {
     obj_t *obj = container_of(ref, obj_t, obj_ref);
     pool_t *pool = obj->obj_pool;
+    struct pool_cache *cache;
 
     if (pool->cleanup)
         pool->cleanup(obj);
@@ -372,19 +903,34 @@ void obj_release(ref_t *ref)
         obj_put(obj->obj_parent);
 
     assert(obj->obj_free == 0);
+    obj->obj_handle = obj_handle_next_gen(obj->obj_handle);
     obj->obj_free = 1;
 
-    __sync_synchronize();
+    cache = pool_get_cache(pool);
+    if (likely(cache != NULL)) {
+        if (unlikely(cache->num == pool->cache_size)) {
+            pool_flush(pool, cache, (pool->cache_size + 1) / 2);
+            pool_maybe_shrink(pool);
+        }
+
+        cache->objs[cache->num++] = obj;
+    } else {
+        __sync_synchronize();
+
+        ll_enqueue_obj(&pool->free_list, obj);
+        atomic_dec(&pool->count);
 
-    ll_enqueue_obj(&pool->free_list, obj);
-    atomic_dec(&pool->count);
+        if (!pool->use_pre_alloc_buffer)
+            pool_maybe_shrink(pool);
+    }
 }
 
 /**
  * Allocate a new object.
  *
- * If the free list is empty allocate a new
- * slab of objects first.
+ * Take it from the cache of the current thread, or from the free
+ * list. If the free list is empty allocate a new slab of objects
+ * first.
  *
  * @param pool pool to get object from
  * @param obj_p pointer to returned object
@@ -395,31 +941,45 @@ int obj_alloc(pool_t *pool, obj_t **obj_p)
 {
     int err;
     obj_t *obj;
+    struct pool_cache *cache;
 
-    /* reserve an object */
-    atomic_inc(&pool->count);
+    cache = pool_get_cache(pool);
+    if (likely(cache != NULL)) {
+        if (unlikely(!cache->num)) {
+            err = pool_refill(pool, cache);
+            if (unlikely(err)) {
+                WARN();
+                return err;
+            }
+        }
 
-    obj = ll_dequeue_obj(&pool->free_list);
-    if (unlikely(!obj)) {
-        if (pool->use_pre_alloc_buffer) {
-            /* The pool cannot expand, for instance in the case of the
-             * SBUF pool, so we must busy wait until a new buffer appears
-             * on the list. */
-            do {
-                SPINLOCK_BODY();
-            } while ((obj = ll_dequeue_obj(&pool->free_list)) == NULL);
-        } else {
-            do {
-                pthread_mutex_lock(&pool->mutex);
-                err = pool_alloc_slab(pool);
-                pthread_mutex_unlock(&pool->mutex);
-
-                if (unlikely(err)) {
-                    atomic_dec(&pool->count);
-                    WARN();
-                    return err;
-                }
-            } while ((obj = ll_dequeue_obj(&pool->free_list)) == NULL);
+        obj = cache->objs[--cache->num];
+    } else {
+        /* reserve an object */
+        atomic_inc(&pool->count);
+
+        obj = pool_dequeue(pool);
+        if (unlikely(!obj)) {
+            if (pool->use_pre_alloc_buffer) {
+                /* The pool cannot expand, for instance in the case of
+                 * the SBUF pool, so we must busy wait until a new buffer
+                 * appears on the list. */
+                do {
+                    SPINLOCK_BODY();
+                } while ((obj = pool_dequeue(pool)) == NULL);
+            } else {
+                do {
+                    pthread_mutex_lock(&pool->mutex);
+                    err = pool_alloc_slab(pool);
+                    pthread_mutex_unlock(&pool->mutex);
+
+                    if (unlikely(err)) {
+                        atomic_dec(&pool->count);
+                        WARN();
+                        return err;
+                    }
+                } while ((obj = pool_dequeue(pool)) == NULL);
+            }
         }
     }
 
@@ -488,7 +1048,8 @@ void *to_obj(PPEGBL enum obj_type type, ptl_handle_any_t handle)
         goto err1;
     }
 
-    if (obj_handle_to_index(obj->obj_handle) != index) {
+    /* a stale handle has another generation */
+    if (obj->obj_handle != handle) {
         WARN();
         goto err1;
     }
@@ -109,13 +109,18 @@ static inline int obj_put(obj_t *obj)
     return ref_put(&obj->obj_ref, obj_release);
 }
 
-/* Handle format, 32-bits: [Type/8, Index/24] */
+/* Handle format, 32-bits: [Type/8, Generation/6, Index/18]
+ *
+ * The generation of an object changes each time it is freed, so that
+ * handles kept past that no longer match it. */
 #define HANDLE_TYPE_SIZE 8
-#define HANDLE_INDEX_MASK (0x00ffffff)
+#define HANDLE_GEN_SHIFT 18
+#define HANDLE_GEN_MASK (0x00fc0000)
+#define HANDLE_INDEX_MASK (0x0003ffff)
 #define HANDLE_SHIFT ((sizeof(ptl_handle_any_t)*8)-HANDLE_TYPE_SIZE)
 
-/* Maximum number of stored objects ever. */
-#define MAX_INDEX (256*1024)
+/* Maximum number of stored objects at once. */
+#define MAX_INDEX (HANDLE_INDEX_MASK + 1)
 
 
 /**
@@ -130,6 +135,19 @@ static inline unsigned int obj_handle_to_index(ptl_handle_any_t handle)
     return handle & HANDLE_INDEX_MASK;
 }
 
+/**
+ * Return a handle with the next generation.
+ *
+ * @param handle the handle
+ *
+ * @return the new handle
+ */
+static inline ptl_handle_any_t obj_handle_next_gen(ptl_handle_any_t handle)
+{
+    return (handle & ~HANDLE_GEN_MASK) |
+        ((handle + (1 << HANDLE_GEN_SHIFT)) & HANDLE_GEN_MASK);
+}
+
 #ifdef NO_ARG_VALIDATION
 /**
  * Faster version of to_obj without checking.
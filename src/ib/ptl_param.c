@@ -213,36 +213,84 @@ param_t param[] = {
                       .max = LONG_MAX,
                       .val = 10,
                       },
-    [PTL_EQ_WAIT_LOOP_COUNT] = {
-                                .name = "PTL_EQ_WAIT_LOOP_COUNT",
-                                .min = 0,
-                                .max = LONG_MAX,
-                                .val = 1000000,
-                                },
-    [PTL_EQ_POLL_LOOP_COUNT] = {
-                                .name = "PTL_EQ_POLL_LOOP_COUNT",
-                                .min = 0,
-                                .max = LONG_MAX,
-                                .val = 1000000,
-                                },
-    [PTL_CT_WAIT_LOOP_COUNT] = {
-                                .name = "PTL_CT_WAIT_LOOP_COUNT",
-                                .min = 0,
-                                .max = LONG_MAX,
-                                .val = 1000000,
-                                },
-    [PTL_CT_POLL_LOOP_COUNT] = {
-                                .name = "PTL_CT_POLL_LOOP_COUNT",
-                                .min = 0,
-                                .max = LONG_MAX,
-                                .val = 1000000,
-                                },
+    [PTL_WAIT_SPIN_MIN] = {
+                           .name = "PTL_WAIT_SPIN_MIN",
+                           .min = 0,
+                           .max = LONG_MAX,
+                           .val = 1000,
+                           },
+    [PTL_WAIT_SPIN_MAX] = {
+                           .name = "PTL_WAIT_SPIN_MAX",
+                           .min = 0,
+                           .max = LONG_MAX,
+                           .val = 100000,
+                           },
     [PTL_NUM_SBUF] = {
                       .name = "PTL_NUM_SBUF",
                       .min = 0,
                       .max = LONG_MAX,
                       .val = 500,
                       },
+    [PTL_MATCH_HASH_SIZE] = {
+                             .name = "PTL_MATCH_HASH_SIZE",
+                             .min = 1,
+                             .max = 1 * MiB,
+                             .val = KiB,
+                             },
+    [PTL_UDP_RECV_BATCH] = {
+                            .name = "PTL_UDP_RECV_BATCH",
+                            .min = 1,
+                            .max = 1024,
+                            .val = 16,
+                            },
+    [PTL_RUDP_WINDOW] = {
+                         .name = "PTL_RUDP_WINDOW",
+                         .min = 1,
+                         .max = 1 << 20,
+                         .val = 64,
+                         },
+    [PTL_RUDP_TIMEOUT] = {
+                          .name = "PTL_RUDP_TIMEOUT",
+                          .min = 8,
+                          .max = 10000000,
+                          .val = 10000,
+                          },
+    [PTL_RUDP_LOSS] = {
+                       .name = "PTL_RUDP_LOSS",
+                       .min = 0,
+                       .max = 1000,
+                       .val = 0,
+                       },
+    [PTL_PROGRESS_MODE] = {
+                           .name = "PTL_PROGRESS_MODE",
+                           .min = PROGRESS_POLL,
+                           .max = PROGRESS_HYBRID,
+                           .val = PROGRESS_POLL,
+                           },
+    [PTL_PROGRESS_SPIN] = {
+                           .name = "PTL_PROGRESS_SPIN",
+                           .min = 0,
+                           .max = LONG_MAX,
+                           .val = 50000,
+                           },
+    [PTL_PROGRESS_SLEEP] = {
+                            .name = "PTL_PROGRESS_SLEEP",
+                            .min = 1,
+                            .max = 1000,
+                            .val = 1,
+                            },
+    [PTL_ATOMIC_ISA] = {
+                        .name = "PTL_ATOMIC_ISA",
+                        .min = ATOMIC_ISA_SCALAR,
+                        .max = ATOMIC_ISA_LAST - 1,
+                        .val = ATOMIC_ISA_LAST - 1,
+                        },
+    [PTL_POOL_CACHE] = {
+                        .name = "PTL_POOL_CACHE",
+                        .min = 0,
+                        .max = POOL_CACHE_MAX,
+                        .val = 32,
+                        },
     [PTL_LOG_LEVEL] = {
                        .name = "PTL_LOG_LEVEL",
                        .min = 0,
@@ -273,12 +321,72 @@ param_t param[] = {
                              .max = 10000000,
                              .val = 8 * 4096,
                              },
+    [PTL_BOUNCE_PIPELINE] = {
+                             .name = "PTL_BOUNCE_PIPELINE",
+                             .min = 1,
+                             .max = 8,  /* NOKNEM_MAX_BUFS */
+                             .val = 4,
+                             },
+    [PTL_SHMEM_CMA] = {
+                       .name = "PTL_SHMEM_CMA",
+                       .min = 0,
+                       .max = 1,
+                       .val = 1,
+                       },
+    /* The pid table and each rank's part of the comm pad are rounded
+     * to a huge page, so an NI takes at least node_size + 2 huge pages
+     * (2MB each on x86-64). Set to 0 on nodes short of huge pages. */
+    [PTL_SHMEM_HUGEPAGES] = {
+                             .name = "PTL_SHMEM_HUGEPAGES",
+                             .min = 0,
+                             .max = 1,
+                             .val = 1,
+                             },
     [PTL_DISABLE_MEM_REG_CACHE] = {
                                    .name = "PTL_DISABLE_MEM_REG_CACHE",
                                    .min = 0,
                                    .max = 1,
                                    .val = 0,
                                   },
+    [PTL_MR_CACHE_ENTRIES] = {
+                              .name = "PTL_MR_CACHE_ENTRIES",
+                              .min = 0,  /* no limit */
+                              .max = LONG_MAX,
+                              .val = 1024,
+                              },
+    [PTL_MR_CACHE_SIZE] = {
+                           .name = "PTL_MR_CACHE_SIZE",
+                           .min = 0,     /* no limit */
+                           .max = LONG_MAX,
+                           .val = 1024 * MiB,
+                           },
+    /* Without ummunotify, pinned registrations are only cached with
+     * the memory hooks. They also keep malloc from returning memory to
+     * the system. */
+    [PTL_MR_HOOKS] = {
+                      .name = "PTL_MR_HOOKS",
+                      .min = 0,
+                      .max = 1,
+                      .val = 0,
+                      },
+    [PTL_COMPACT_HDR] = {
+                         .name = "PTL_COMPACT_HDR",
+                         .min = 0,
+                         .max = 1,
+                         .val = 1,
+                         },
+    [PTL_EAGER_LIMIT] = {
+                         .name = "PTL_EAGER_LIMIT",
+                         .min = 0,
+                         .max = 1 * MiB,
+                         .val = 16 * KiB,
+                         },
+    [PTL_EAGER_NUM_BUFS] = {
+                            .name = "PTL_EAGER_NUM_BUFS",
+                            .min = 0,
+                            .max = 10000,
+                            .val = 64,
+                            },
 };
 
 /**
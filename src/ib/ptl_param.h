@@ -42,18 +42,35 @@ enum {
     PTL_MAX_RDMA_WR_OUT,
     PTL_RDMA_TIMEOUT,
     PTL_WC_COUNT,
-    PTL_CT_WAIT_LOOP_COUNT,
-    PTL_CT_POLL_LOOP_COUNT,
-    PTL_EQ_WAIT_LOOP_COUNT,
-    PTL_EQ_POLL_LOOP_COUNT,
+    PTL_WAIT_SPIN_MIN,
+    PTL_WAIT_SPIN_MAX,
     PTL_NUM_SBUF,
+    PTL_MATCH_HASH_SIZE,
+    PTL_UDP_RECV_BATCH,
+    PTL_RUDP_WINDOW,
+    PTL_RUDP_TIMEOUT,
+    PTL_RUDP_LOSS,
+    PTL_PROGRESS_MODE,
+    PTL_PROGRESS_SPIN,
+    PTL_PROGRESS_SLEEP,
+    PTL_ATOMIC_ISA,
+    PTL_POOL_CACHE,
 
     PTL_LOG_LEVEL,
     PTL_DEBUG,
     PTL_ENABLE_MEM,
     PTL_BOUNCE_NUM_BUFS,
     PTL_BOUNCE_BUF_SIZE,
+    PTL_BOUNCE_PIPELINE,
+    PTL_SHMEM_CMA,
+    PTL_SHMEM_HUGEPAGES,
     PTL_DISABLE_MEM_REG_CACHE,
+    PTL_MR_CACHE_ENTRIES,
+    PTL_MR_CACHE_SIZE,
+    PTL_MR_HOOKS,
+    PTL_COMPACT_HDR,
+    PTL_EAGER_LIMIT,
+    PTL_EAGER_NUM_BUFS,
     PTL_PARAM_LAST,             /* keep me last */
 };
 
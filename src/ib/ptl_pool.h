@@ -11,11 +11,14 @@
  * Slabs are maintained in 'chunks' which are page sized arrays of
  * slab_info structs.
  *
- * And chunks are maintained in circular lists within pools. The
- * current design is very simple and only allows the object resources
- * in a pool to grow. Additional work would allow this design to
- * dynamically grow and shrink the amount of memory used in a given
- * pool.
+ * And chunks are maintained in circular lists within pools. Pools
+ * grow a slab at a time, and give back the slabs whose objects are
+ * all free once they are mostly idle.
+ *
+ * Each thread keeps a small cache of free objects in front of the
+ * shared freelist of a pool, which it refills from and returns to in
+ * batches, so that threads allocating and freeing objects do not all
+ * contend on the freelist head.
  *
  * Pools are designed to allow an object to 'own' pools of other objects
  * in a heirarchy. All objects eventually belong to an NI which is the
@@ -57,6 +60,9 @@ struct slab_info {
         /** address of slab */
     void *addr;
 
+        /** number of free objects, counted by pool_shrink */
+    unsigned int num_free;
+
         /** slab private data */
 #if WITH_TRANSPORT_IB
     struct ibv_mr *mr;
@@ -86,6 +92,24 @@ struct chunk {
 
 typedef struct chunk chunk_t;
 
+/** most objects a per-thread cache can hold */
+#define POOL_CACHE_MAX		(256)
+
+/** most threads having a cache in front of each pool */
+#define POOL_MAX_THREADS	(64)
+
+/**
+ * A pool_cache struct holds free objects of a pool for one thread,
+ * which is the only one to access it.
+ */
+struct pool_cache {
+        /** number of objects in objs */
+    int num;
+
+        /** the objects, the most recently freed last */
+    struct obj *objs[POOL_CACHE_MAX];
+};
+
 /**
  * A pool struct holds information about a type of object
  * that it manages.
@@ -123,9 +147,33 @@ struct pool {
         /** pool type */
     enum obj_type type;
 
-        /** number of objects currently allocated */
+        /** number of objects allocated or held in thread caches */
     atomic_t count;
 
+        /** number of objects in the slabs of the pool */
+    int num_objs;
+
+        /** per-thread caches, indexed by thread slot, or NULL */
+    struct pool_cache **caches;
+
+        /** number of objects a thread cache holds, 0 for none */
+    int cache_size;
+
+        /** number of threads walking free_list */
+    atomic_t dequeuers;
+
+        /** set while pool_shrink frees slabs */
+    atomic_t shrinking;
+
+        /** number of batches returned to free_list */
+    atomic_t returns;
+
+        /** slabs given back by pool_shrink, still mapped */
+    void **parked_slabs;
+
+        /** number of parked slabs */
+    int num_parked_slabs;
+
         /** object size */
     int size;
 
@@ -498,6 +498,12 @@ int _PtlEQWait(PPEGBL ptl_handle_eq_t eq_handle, ptl_event_t *event_p);
 int _PtlEQPoll(PPEGBL const ptl_handle_eq_t * eq_handles, unsigned int size,
                ptl_time_t timeout, ptl_event_t *event_p,
                unsigned int *which_p);
+int _PtlEQGetMany(PPEGBL ptl_handle_eq_t eq_handle, unsigned int count,
+                  ptl_event_t *events, unsigned int *num_events_p);
+int _PtlEQPollMany(PPEGBL const ptl_handle_eq_t * eq_handles,
+                   unsigned int size, ptl_time_t timeout, unsigned int count,
+                   ptl_event_t *events, unsigned int *num_events_p,
+                   unsigned int *which_p);
 int _PtlGetUid(PPEGBL ptl_handle_ni_t ni_handle, ptl_uid_t *uid_p);
 int _PtlGetId(PPEGBL ptl_handle_ni_t ni_handle, ptl_process_t *id_p);
 int _PtlGetPhysId(PPEGBL ptl_handle_ni_t ni_handle, ptl_process_t *id_p);
@@ -573,7 +579,6 @@ int _PtlTriggeredFetchAtomic(PPEGBL ptl_handle_md_t get_md_handle,
                              ptl_datatype_t atom_type,
                              ptl_handle_ct_t trig_ct_handle,
                              ptl_size_t threshold);
-int _PtlAtomicSync(void);
 int _PtlSwap(PPEGBL ptl_handle_md_t get_md_handle,
              ptl_size_t local_get_offset, ptl_handle_md_t put_md_handle,
              ptl_size_t local_put_offset, ptl_size_t length,
@@ -624,7 +629,6 @@ int _PtlPTEnable(PPEGBL ptl_handle_ni_t ni_handle, ptl_pt_index_t pt_index);
 #else /* WITH_PPE */
 
 #define _PtlAtomic PtlAtomic
-#define _PtlAtomicSync PtlAtomicSync
 #define _PtlCTAlloc PtlCTAlloc
 #define _PtlCTCancelTriggered PtlCTCancelTriggered
 #define _PtlCTFree PtlCTFree
@@ -636,7 +640,9 @@ int _PtlPTEnable(PPEGBL ptl_handle_ni_t ni_handle, ptl_pt_index_t pt_index);
 #define _PtlEQAlloc PtlEQAlloc
 #define _PtlEQFree PtlEQFree
 #define _PtlEQGet PtlEQGet
+#define _PtlEQGetMany PtlEQGetMany
 #define _PtlEQPoll PtlEQPoll
+#define _PtlEQPollMany PtlEQPollMany
 #define _PtlEQWait PtlEQWait
 #define _PtlEndBundle PtlEndBundle
 #define _PtlFetchAtomic PtlFetchAtomic
@@ -59,6 +59,311 @@ static int get_pt_index(ni_t *ni, ptl_pt_index_t req, ptl_pt_index_t *index_p)
     return PTL_OK;
 }
 
+/**
+ * Hash a match bits value into a bucket index.
+ *
+ * @param[in] bits the match bits
+ * @param[in] num_buckets the number of buckets, a power of 2
+ *
+ * @return the bucket index
+ */
+static inline unsigned int match_bits_hash(uint64_t bits,
+                                           unsigned int num_buckets)
+{
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+
+    return bits & (num_buckets - 1);
+}
+
+/**
+ * Hash the source of a message or an ME with match bits.
+ *
+ * @param[in] ni the ni the pt belongs to
+ * @param[in] id the source process
+ * @param[in] bits the match bits
+ * @param[in] num_buckets the number of buckets, a power of 2
+ *
+ * @return the bucket index
+ */
+static inline unsigned int match_src_hash(const ni_t *ni, ptl_process_t id,
+                                          uint64_t bits,
+                                          unsigned int num_buckets)
+{
+    uint64_t src;
+
+    if (ni->options & PTL_NI_LOGICAL)
+        src = id.rank;
+    else
+        src = ((uint64_t)id.phys.nid << 32) | id.phys.pid;
+
+    return match_bits_hash(bits ^ (src * 0x9e3779b97f4a7c15ULL),
+                           num_buckets);
+}
+
+/**
+ * Allocate an array of empty hash buckets.
+ *
+ * @param[out] num_buckets_p the number of buckets, a power of 2
+ *
+ * @return the buckets or NULL if out of memory
+ */
+static struct list_head *alloc_buckets(unsigned int *num_buckets_p)
+{
+    unsigned int num_buckets = 1;
+    struct list_head *buckets;
+    unsigned int i;
+
+    while (num_buckets < get_param(PTL_MATCH_HASH_SIZE))
+        num_buckets <<= 1;
+
+    buckets = malloc(num_buckets * sizeof(struct list_head));
+    if (!buckets)
+        return NULL;
+
+    for (i = 0; i < num_buckets; i++)
+        INIT_LIST_HEAD(&buckets[i]);
+
+    *num_buckets_p = num_buckets;
+
+    return buckets;
+}
+
+/**
+ * Initialize the match indexes of a pt entry.
+ *
+ * This covers the priority and overflow list indexes as well as
+ * the unexpected list index.
+ *
+ * @param[in] pt the pt entry
+ *
+ * @return PTL_OK		on success
+ * @return PTL_NO_SPACE		if the buckets could not be allocated
+ */
+int pt_match_index_init(pt_t *pt)
+{
+    struct pt_unexpected_index *unexpected = &pt->unexpected_index;
+
+    pt->match_seq = 0;
+
+    INIT_LIST_HEAD(&pt->priority_index.wildcard_list);
+    INIT_LIST_HEAD(&pt->overflow_index.wildcard_list);
+
+    pt->priority_index.buckets =
+        alloc_buckets(&pt->priority_index.num_buckets);
+    pt->overflow_index.buckets =
+        alloc_buckets(&pt->overflow_index.num_buckets);
+    unexpected->bits_buckets = alloc_buckets(&unexpected->num_buckets);
+    unexpected->src_buckets = alloc_buckets(&unexpected->num_buckets);
+
+    if (!pt->priority_index.buckets || !pt->overflow_index.buckets ||
+        !unexpected->bits_buckets || !unexpected->src_buckets) {
+        pt_match_index_fini(pt);
+        return PTL_NO_SPACE;
+    }
+
+    return PTL_OK;
+}
+
+/**
+ * Free the match indexes of a pt entry.
+ *
+ * @param[in] pt the pt entry
+ */
+void pt_match_index_fini(pt_t *pt)
+{
+    free(pt->priority_index.buckets);
+    pt->priority_index.buckets = NULL;
+
+    free(pt->overflow_index.buckets);
+    pt->overflow_index.buckets = NULL;
+
+    free(pt->unexpected_index.bits_buckets);
+    pt->unexpected_index.bits_buckets = NULL;
+
+    free(pt->unexpected_index.src_buckets);
+    pt->unexpected_index.src_buckets = NULL;
+}
+
+/**
+ * Add an ME to the match index of the list it was appended to.
+ *
+ * @pre caller should hold the pt spinlock and the ME must have
+ * been added to the tail of its list.
+ *
+ * @param[in] pt the pt entry
+ * @param[in] me the ME to add
+ */
+void pt_match_index_add(pt_t *pt, me_t *me)
+{
+    struct pt_match_index *index;
+
+    if (me->ptl_list == PTL_PRIORITY_LIST)
+        index = &pt->priority_index;
+    else
+        index = &pt->overflow_index;
+
+    if (!index->buckets)
+        return;
+
+    me->match_seq = pt->match_seq++;
+
+    if (me->ignore_bits)
+        list_add_tail(&me->match_list, &index->wildcard_list);
+    else
+        list_add_tail(&me->match_list,
+                      &index->buckets[match_bits_hash(me->match_bits,
+                                                      index->num_buckets)]);
+}
+
+/**
+ * Remove an ME from its match index.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] me the ME to remove
+ */
+void pt_match_index_del(me_t *me)
+{
+    list_del_init(&me->match_list);
+}
+
+/**
+ * Find the first ME of a list that matches a message.
+ *
+ * Only the bucket of the message match bits and the wildcard list are
+ * searched. The wildcard walk stops as soon as it reaches an ME that
+ * was appended after the bucket candidate.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] index the match index of the list to search
+ * @param[in] buf the message buf received by the target
+ *
+ * @return the first matching ME or NULL if there is none
+ */
+me_t *pt_match_index_lookup(struct pt_match_index *index, buf_t *buf)
+{
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    uint64_t match_bits = le64_to_cpu(hdr->match_bits);
+    struct list_head *bucket;
+    me_t *found = NULL;
+    me_t *me;
+
+    bucket = &index->buckets[match_bits_hash(match_bits,
+                                             index->num_buckets)];
+
+    list_for_each_entry(me, bucket, match_list) {
+        if (me->match_bits == match_bits && check_match(buf, me)) {
+            found = me;
+            break;
+        }
+    }
+
+    list_for_each_entry(me, &index->wildcard_list, match_list) {
+        if (found && me->match_seq > found->match_seq)
+            break;
+
+        if (check_match(buf, me)) {
+            found = me;
+            break;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Add a message to the unexpected list index.
+ *
+ * @pre caller should hold the pt spinlock and the message must have
+ * been added to the tail of the unexpected list.
+ *
+ * @param[in] pt the pt entry
+ * @param[in] buf the unexpected message
+ */
+void pt_unexpected_index_add(pt_t *pt, buf_t *buf)
+{
+    struct pt_unexpected_index *index = &pt->unexpected_index;
+    const ni_t *ni = obj_to_ni(buf);
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    uint64_t match_bits = le64_to_cpu(hdr->match_bits);
+    ptl_process_t src;
+
+    if (!index->bits_buckets)
+        return;
+
+    if (ni->options & PTL_NI_LOGICAL) {
+        src.rank = le32_to_cpu(hdr->h1.src_rank);
+    } else {
+        src.phys.nid = le32_to_cpu(hdr->h1.src_nid);
+        src.phys.pid = le32_to_cpu(hdr->h1.src_pid);
+    }
+
+    list_add_tail(&buf->unexpected_bits_list,
+                  &index->bits_buckets[match_bits_hash(match_bits,
+                                                       index->num_buckets)]);
+    list_add_tail(&buf->unexpected_src_list,
+                  &index->src_buckets[match_src_hash(ni, src,
+                                                     match_bits,
+                                                     index->num_buckets)]);
+}
+
+/**
+ * Remove a message from the unexpected list index.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] buf the unexpected message
+ */
+void pt_unexpected_index_del(buf_t *buf)
+{
+    list_del_init(&buf->unexpected_bits_list);
+    list_del_init(&buf->unexpected_src_list);
+}
+
+/**
+ * Return the shortest list of unexpected messages holding every
+ * message an LE/ME can match.
+ *
+ * An ME with exact match bits only needs the messages hashed with the
+ * same bits, and the same source if it does not accept any source.
+ * Anything else has to walk the whole unexpected list. All of these
+ * lists are in arrival order.
+ *
+ * @pre caller should hold the pt spinlock.
+ *
+ * @param[in] pt the pt entry
+ * @param[in] le the LE/ME searching the unexpected list
+ * @param[out] link_p the buf link the returned list is made of
+ *
+ * @return the list head to walk
+ */
+struct list_head *pt_unexpected_lookup(pt_t *pt, const le_t *le,
+                                       enum unexpected_link *link_p)
+{
+    struct pt_unexpected_index *index = &pt->unexpected_index;
+    const ni_t *ni = obj_to_ni(le);
+    const me_t *me = (me_t *)le;
+
+    if (le->type != TYPE_ME || !index->bits_buckets || me->ignore_bits) {
+        *link_p = UNEXPECTED_LINK_ALL;
+        return &pt->unexpected_list;
+    }
+
+    if ((ni->options & PTL_NI_LOGICAL) ? me->id.rank == PTL_RANK_ANY :
+        (me->id.phys.nid == PTL_NID_ANY || me->id.phys.pid == PTL_PID_ANY)) {
+        *link_p = UNEXPECTED_LINK_BITS;
+        return &index->bits_buckets[match_bits_hash(me->match_bits,
+                                                    index->num_buckets)];
+    }
+
+    *link_p = UNEXPECTED_LINK_SRC;
+    return &index->src_buckets[match_src_hash(ni, me->id, me->match_bits,
+                                              index->num_buckets)];
+}
+
 /**
  * Allocate pt entry.
  *
@@ -137,6 +442,17 @@ int _PtlPTAlloc(PPEGBL ptl_handle_ni_t ni_handle, unsigned int options,
     INIT_LIST_HEAD(&pt->unexpected_list);
     INIT_LIST_HEAD(&pt->flowctrl_list);
 
+    if (ni->options & PTL_NI_MATCHING) {
+        err = pt_match_index_init(pt);
+        if (unlikely(err)) {
+            PTL_FASTLOCK_DESTROY(&pt->lock);
+            pthread_mutex_lock(&ni->pt_mutex);
+            pt->in_use = 0;
+            pthread_mutex_unlock(&ni->pt_mutex);
+            goto err3;
+        }
+    }
+
     if (options & PTL_PT_FLOWCTRL) {
         PTL_FASTLOCK_LOCK(&eq->eqe_list->lock);
         list_add_tail(&pt->flowctrl_list, &eq->flowctrl_list);
@@ -227,6 +543,8 @@ int _PtlPTFree(PPEGBL ptl_handle_ni_t ni_handle, ptl_pt_index_t pt_index)
     }
 #endif
 
+    pt_match_index_fini(pt);
+
     PTL_FASTLOCK_DESTROY(&pt->lock);
 
     pt->in_use = 0;
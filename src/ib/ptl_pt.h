@@ -17,6 +17,8 @@
 
 struct eq;
 struct me;
+struct le;
+struct buf;
 
 /**
  * pt state variables.
@@ -40,6 +42,54 @@ struct pt_me_hash {
 typedef struct pt_me_hash pt_me_hash_t;
 #endif
 
+/**
+ * Ordered match index for a priority or overflow list.
+ *
+ * MEs with no ignore bits are hashed on their match bits, the others
+ * are kept on the wildcard list. Both keep the append order, and the
+ * sequence number stored in each ME tells which of two candidates
+ * was appended first, so a lookup returns the same ME as a walk of
+ * the list would.
+ */
+struct pt_match_index {
+        /** number of hash buckets, a power of 2 */
+    unsigned int num_buckets;
+
+        /** buckets of MEs matching on exact bits */
+    struct list_head *buckets;
+
+        /** MEs with some ignore bits set */
+    struct list_head wildcard_list;
+};
+
+/**
+ * Index of the unexpected list.
+ *
+ * Every unexpected message is hashed on its match bits, and on its
+ * source plus match bits. Both bucket chains keep the arrival order,
+ * so the first message of a chain that matches an ME is also the
+ * oldest matching message of the whole unexpected list.
+ */
+struct pt_unexpected_index {
+        /** number of hash buckets, a power of 2 */
+    unsigned int num_buckets;
+
+        /** messages hashed on their match bits */
+    struct list_head *bits_buckets;
+
+        /** messages hashed on their source and match bits */
+    struct list_head *src_buckets;
+};
+
+/**
+ * Which link of an unexpected message a list is made of.
+ */
+enum unexpected_link {
+    UNEXPECTED_LINK_ALL,
+    UNEXPECTED_LINK_BITS,
+    UNEXPECTED_LINK_SRC,
+};
+
 /**
  * pt class into.
  */
@@ -68,18 +118,30 @@ struct pt {
         /** list of priority me/le's */
     struct list_head priority_list;
 
+        /** match index of the priority list */
+    struct pt_match_index priority_index;
+
         /** size of overflow list */
     unsigned int overflow_size;
 
         /** list of overflow me/le's */
     struct list_head overflow_list;
 
+        /** match index of the overflow list */
+    struct pt_match_index overflow_index;
+
+        /** sequence number given to the next appended me */
+    uint64_t match_seq;
+
         /** size of unexpected list */
     atomic_t unexpected_size;
 
         /** list of unexpected xt's */
     struct list_head unexpected_list;
 
+        /** index of the unexpected list */
+    struct pt_unexpected_index unexpected_index;
+
         /** to attach on the EQ flow control list if this PT does it. **/
     struct list_head flowctrl_list;
 
@@ -94,4 +156,22 @@ struct pt {
 
 typedef struct pt pt_t;
 
+int pt_match_index_init(pt_t *pt);
+
+void pt_match_index_fini(pt_t *pt);
+
+void pt_match_index_add(pt_t *pt, struct me *me);
+
+void pt_match_index_del(struct me *me);
+
+struct me *pt_match_index_lookup(struct pt_match_index *index,
+                                 struct buf *buf);
+
+void pt_unexpected_index_add(pt_t *pt, struct buf *buf);
+
+void pt_unexpected_index_del(struct buf *buf);
+
+struct list_head *pt_unexpected_lookup(pt_t *pt, const struct le *le,
+                                       enum unexpected_link *link_p);
+
 #endif /* PTL_PT_H */
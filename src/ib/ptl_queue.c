@@ -90,3 +90,83 @@ void queue_init(queue_t *queue)
     queue->tail = 0;
     queue->shadow_head = 0;
 }
+
+/**
+ * @brief Initialize a ring.
+ *
+ * @param[in] ring the ring to initialize
+ * @param[in] num_slots the number of slots, a power of 2
+ */
+void ring_init(ring_t *ring, unsigned long num_slots)
+{
+    ring->tail = 0;
+    ring->head_cache = 0;
+    ring->prod_mask = num_slots - 1;
+    ring->head = 0;
+    ring->tail_cache = 0;
+    ring->cons_mask = num_slots - 1;
+}
+
+/**
+ * @brief Append several bufs to a ring at once.
+ *
+ * Only the producer may call it. The tail is only published once,
+ * after all the slots are filled.
+ *
+ * @param[in] ring the ring.
+ * @param[in] objs the objects to append, in order.
+ * @param[in] num the number of objects.
+ *
+ * @return 1 if the objects were appended, 0 if there is not enough room
+ * for all of them.
+ */
+int ring_push_list(const void *comm_pad, ring_t *ring, obj_t **objs,
+                   int num)
+{
+    unsigned long tail = ring->tail;
+    unsigned long num_slots = ring->prod_mask + 1;
+    int i;
+
+    if (tail + num - ring->head_cache > num_slots) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (tail + num - ring->head_cache > num_slots)
+            return 0;
+    }
+
+    for (i = 0; i < num; i++)
+        ring->slots[(tail + i) & ring->prod_mask] =
+            PTR2OFF(comm_pad, objs[i]);
+
+    /* The slots must be visible before the new tail. */
+    __atomic_store_n(&ring->tail, tail + num, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+/**
+ * @brief Take the first buf off a ring.
+ *
+ * Only the consumer may call it.
+ *
+ * @param[in] ring the ring.
+ *
+ * @return an object, or NULL if the ring is empty.
+ */
+obj_t *ring_pop(const void *comm_pad, ring_t *ring)
+{
+    unsigned long head = ring->head;
+    obj_t *obj;
+
+    if (head == ring->tail_cache) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head == ring->tail_cache)
+            return NULL;
+    }
+
+    obj = OFF2PTR(comm_pad, ring->slots[head & ring->cons_mask]);
+
+    /* The slot is free again once the head moves past it. */
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return obj;
+}
@@ -27,5 +27,47 @@ void queue_init(queue_t *queue);
 void enqueue(const void *comm_pad, queue_t *restrict queue, struct obj *obj);
 struct obj *dequeue(const void *comm_pad, queue_t *queue);
 
+/**
+ * @brief shared memory buffer ring, with a single producer and a
+ * single consumer
+ *
+ * The producer and the consumer each write their own cacheline
+ * only. The indexes are free running.
+ */
+struct ring {
+    /* Producer side */
+    volatile unsigned long tail __attribute__ ((aligned(CACHELINE_WIDTH)));   /**< next slot to fill */
+    unsigned long head_cache;   /**< head, as last read by the producer */
+    unsigned long prod_mask;    /**< number of slots - 1 */
+
+    /* Consumer side */
+    volatile unsigned long head __attribute__ ((aligned(CACHELINE_WIDTH)));   /**< next slot to empty */
+    unsigned long tail_cache;   /**< tail, as last read by the consumer */
+    unsigned long cons_mask;    /**< number of slots - 1 */
+
+    /* Offsets of the objects in the comm pad */
+    unsigned long slots[0] __attribute__ ((aligned(CACHELINE_WIDTH)));
+};
+
+typedef struct ring ring_t;
+
+void ring_init(ring_t *ring, unsigned long num_slots);
+int ring_push_list(const void *comm_pad, ring_t *ring, struct obj **objs,
+                   int num);
+struct obj *ring_pop(const void *comm_pad, ring_t *ring);
+
+/**
+ * @brief Compute the size of a ring.
+ *
+ * @param[in] num_slots the number of slots, a power of 2.
+ *
+ * @return the size of the ring in bytes, a multiple of the cacheline.
+ */
+static inline size_t ring_size(unsigned long num_slots)
+{
+    return sizeof(ring_t) + ((num_slots * sizeof(unsigned long) +
+                              CACHELINE_WIDTH - 1) & ~(CACHELINE_WIDTH - 1));
+}
+
 
 #endif /* PTL_QUEUE_H */
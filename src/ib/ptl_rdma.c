@@ -63,25 +63,26 @@ static int rdma_init_connect(ni_t *ni, conn_t *conn)
 }
 
 /**
- * @brief Build and post an send work request to transfer
+ * @brief Build a send work request for a buf.
  *
  * @param[in] buf A buf holding state for the send operation.
+ * @param[in] from_init whether the buf is an initiator request.
+ * @param[out] wr the work request to fill.
+ * @param[out] sg_list the two scatter/gather entries the request
+ * points to.
  *
- * @return status
+ * @return true if the initiator must wait for the send queue to drain.
  */
-static int rdma_send_message(buf_t *buf, int from_init)
+static int rdma_build_send(buf_t *buf, int from_init, struct ibv_send_wr *wr,
+                           struct ibv_sge *sg_list)
 {
-    int err;
-    struct ibv_send_wr *bad_wr;
-    struct ibv_send_wr wr;
-    struct ibv_sge sg_list;
     conn_t *conn = buf->conn;
 
-    wr.wr_id = (uintptr_t) buf;
-    wr.next = NULL;
-    wr.sg_list = &sg_list;
-    wr.num_sge = 1;
-    wr.opcode = IBV_WR_SEND;
+    wr->wr_id = (uintptr_t) buf;
+    wr->next = NULL;
+    wr->sg_list = sg_list;
+    wr->num_sge = 1;
+    wr->opcode = IBV_WR_SEND;
 
     if ((buf->event_mask & XX_SIGNALED) ||
         (atomic_inc(&buf->conn->rdma.send_comp_threshold) ==
@@ -92,61 +93,102 @@ static int rdma_send_message(buf_t *buf, int from_init)
                                                      get_param
                                                      (PTL_MAX_SEND_COMP_THRESHOLD)))
     {
-        wr.send_flags = IBV_SEND_SIGNALED;
+        wr->send_flags = IBV_SEND_SIGNALED;
         atomic_set(&buf->conn->rdma.send_comp_threshold, 0);
 
         /* Keep the buffer from being freed until we get the
          * completion. */
         buf_get(buf);
     } else {
-        wr.send_flags = 0;
+        wr->send_flags = 0;
     }
 
     if (buf->event_mask & XX_INLINE) {
-        wr.send_flags |= IBV_SEND_INLINE;
+        wr->send_flags |= IBV_SEND_INLINE;
 
-        if (wr.send_flags == IBV_SEND_INLINE) {
+        if (wr->send_flags == IBV_SEND_INLINE) {
             /* Inline and no completion required: fire and forget. If
              * there is an error, we will get a completion anyway, so
              * we must ignore it. */
-            wr.wr_id = 0;
+            wr->wr_id = 0;
         }
     }
 
-    sg_list.addr = (uintptr_t) buf->internal_data;
-    sg_list.lkey = buf->rdma.lkey;
-    sg_list.length = buf->length;
+    if (buf->transfer.rdma.compact_length) {
+        /* Send the compact header instead of the req_hdr_t. */
+        sg_list[0].addr = (uintptr_t) buf->transfer.rdma.compact_hdr;
+        sg_list[0].lkey = buf->rdma.lkey;
+        sg_list[0].length = buf->transfer.rdma.compact_length;
+
+        sg_list[1].addr = (uintptr_t) buf->internal_data + sizeof(req_hdr_t);
+        sg_list[1].lkey = buf->rdma.lkey;
+        sg_list[1].length = buf->length - sizeof(req_hdr_t);
+
+        if (sg_list[1].length)
+            wr->num_sge = 2;
+    } else {
+        sg_list->addr = (uintptr_t) buf->internal_data;
+        sg_list->lkey = buf->rdma.lkey;
+        sg_list->length = buf->length;
+    }
 
     buf->type = BUF_SEND;
 
-    /* Rate limit the initiator. If the IB/RDMA send queue gets full, there
-     * wouldn't be any space left to send the ACKs/replies, and we
-     * would get a deadlock. */
-    if (from_init) {
-        int limit = buf->conn->rdma.max_req_avail;
-
-        atomic_inc(&conn->rdma.num_req_posted);
-        atomic_inc(&conn->rdma.num_req_not_comp);
-
-        /* If the high water mark is reached, wait until we go back to
-         * the low watermark (=1/2 high WM). */
-        if (atomic_read(&buf->conn->rdma.num_req_posted) >= limit) {
-            limit /= 2;
-            while (atomic_read(&buf->conn->rdma.num_req_posted) >= limit) {
-                pthread_yield();
-                SPINLOCK_BODY();
-            }
-        }
+    if (!from_init)
+        return 0;
 
-        if (wr.send_flags & IBV_SEND_SIGNALED) {
-            /* Atomically set buf->init_req_completes to the current value of
-             * conn->rdma.num_req_posted and set
-             * conn->rdma.num_req_posted to 0. */
-            buf->transfer.rdma.num_req_completes =
-                atomic_swap(&conn->rdma.num_req_not_comp, 0);
-        }
+    atomic_inc(&conn->rdma.num_req_posted);
+    atomic_inc(&conn->rdma.num_req_not_comp);
+
+    if (wr->send_flags & IBV_SEND_SIGNALED) {
+        /* Atomically set buf->init_req_completes to the current value of
+         * conn->rdma.num_req_posted and set
+         * conn->rdma.num_req_posted to 0. */
+        buf->transfer.rdma.num_req_completes =
+            atomic_swap(&conn->rdma.num_req_not_comp, 0);
     }
 
+    return atomic_read(&conn->rdma.num_req_posted) >=
+        conn->rdma.max_req_avail;
+}
+
+/**
+ * @brief Rate limit the initiator.
+ *
+ * If the IB/RDMA send queue gets full, there wouldn't be any space
+ * left to send the ACKs/replies, and we would get a deadlock. Once the
+ * high water mark is reached, wait until we go back to the low
+ * watermark (=1/2 high WM).
+ *
+ * @param[in] conn the connection.
+ */
+static void rdma_throttle(conn_t *conn)
+{
+    int limit = conn->rdma.max_req_avail / 2;
+
+    while (atomic_read(&conn->rdma.num_req_posted) >= limit) {
+        pthread_yield();
+        SPINLOCK_BODY();
+    }
+}
+
+/**
+ * @brief Build and post an send work request to transfer
+ *
+ * @param[in] buf A buf holding state for the send operation.
+ *
+ * @return status
+ */
+static int rdma_send_message(buf_t *buf, int from_init)
+{
+    int err;
+    struct ibv_send_wr *bad_wr;
+    struct ibv_send_wr wr;
+    struct ibv_sge sg_list[2];
+
+    if (rdma_build_send(buf, from_init, &wr, sg_list))
+        rdma_throttle(buf->conn);
+
     err = ibv_post_send(buf->dest.rdma.qp, &wr, &bad_wr);
     if (err) {
         WARN();
@@ -157,13 +199,78 @@ static int rdma_send_message(buf_t *buf, int from_init)
     return PTL_OK;
 }
 
+/**
+ * @brief Send the requests of a bundle.
+ *
+ * Consecutive requests for the same QP are chained and posted with a
+ * single ibv_post_send. A chain is posted early if the initiator has
+ * to be throttled, since only posted requests can complete.
+ *
+ * @param[in] ni
+ * @param[in] bufs
+ * @param[in] num
+ *
+ * @return the number of requests posted
+ */
+static int rdma_send_messages(ni_t *ni, buf_t **bufs, int num)
+{
+    struct ibv_send_wr wr[num];
+    struct ibv_sge sg_list[num][2];
+    struct ibv_send_wr *bad_wr;
+    int first = 0;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        int throttle = rdma_build_send(bufs[i], 1, &wr[i], sg_list[i]);
+
+        if (i > first && (throttle ||
+                          bufs[i]->dest.rdma.qp != bufs[first]->dest.rdma.qp)) {
+            /* Post what was chained so far. */
+            if (ibv_post_send(bufs[first]->dest.rdma.qp, &wr[first], &bad_wr)) {
+                WARN();
+                return bad_wr - wr;
+            }
+            first = i;
+        }
+
+        if (throttle)
+            rdma_throttle(bufs[i]->conn);
+
+        if (i > first)
+            wr[i - 1].next = &wr[i];
+    }
+
+    if (ibv_post_send(bufs[first]->dest.rdma.qp, &wr[first], &bad_wr)) {
+        WARN();
+        return bad_wr - wr;
+    }
+
+    return num;
+}
+
 static void rdma_set_send_flags(buf_t *buf, int can_signal)
 {
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    unsigned int length = buf->length;
+
+    /* The request header is final by now. If the remote side takes
+     * it, encode it in the compact format. */
+    buf->transfer.rdma.compact_length = 0;
+    if (buf->conn->rdma.compact_hdr && hdr->h1.operation <= OP_SWAP) {
+        assert(REQ_HDR_COMPACT_MAX <=
+               sizeof(buf->transfer.rdma.compact_hdr));
+
+        buf->transfer.rdma.compact_length =
+            req_hdr_pack(hdr, buf->transfer.rdma.compact_hdr);
+        if (buf->transfer.rdma.compact_length)
+            length += buf->transfer.rdma.compact_length - sizeof(req_hdr_t);
+    }
+
     /* If the buffer fits in the work request inline data, then we can
      * inline, in which case the data will be copied during
      * ibv_post_send, else we can't and must wait for the data to be
      * sent before disposing of the buffer. */
-    if (buf->length <= buf->conn->rdma.max_inline_data) {
+    if (length <= buf->conn->rdma.max_inline_data) {
         buf->event_mask |= XX_INLINE;
     } else {
         if (can_signal)
@@ -675,6 +782,7 @@ struct transport transport_rdma = {
     .buf_alloc = buf_alloc,
     .init_connect = rdma_init_connect,
     .send_message = rdma_send_message,
+    .send_messages = rdma_send_messages,
     .set_send_flags = rdma_set_send_flags,
     .init_prepare_transfer = rdma_init_prepare_transfer,
     .post_tgt_dma = rdma_do_transfer,
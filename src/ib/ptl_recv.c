@@ -4,8 +4,13 @@
  * Completion queue processing.
  */
 #include "ptl_loc.h"
-#include <sys/time.h>
-#include <sys/resource.h>
+#include "ptl_timer.h"
+
+#include <fcntl.h>
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 /**
  * Receive state name for debug output.
@@ -42,47 +47,18 @@ extern atomic_t keep_polling;
 static int comp_poll(ni_t *ni, int num_wc, struct ibv_wc wc_list[],
                      buf_t *buf_list[])
 {
-    int ret = 0;
+    int ret;
     int i;
     buf_t *buf;
-    int rep_poll = 0;
-
-#if WITH_TRANSPORT_IB && !WITH_TRANSPORT_SHMEM && !IS_PPE
-    while (ni->catcher_stop == 0 && ret == 0) {
-        ret = ibv_poll_cq(ni->rdma.cq, num_wc, wc_list);
-        if (ret <= 0) {
-            rep_poll++;
-            pthread_yield();
-
-            if (rep_poll >= 1000) {
-                if (rep_poll == 1000)
-                    ibv_req_notify_cq(ni->rdma.cq, 0);
-                else {
-                    if (atomic_read(&keep_polling) == 0 &&
-                        ni->catcher_nosleep == 0) {
-                        ret =
-                            ibv_get_cq_event(ni->rdma.ch, &ni->rdma.cq,
-                                             (void **)&ni->
-                                             iface->ibv_context);
-                        ibv_ack_cq_events(ni->rdma.cq, 1);
-                        rep_poll = 0;
-                    }
-                }
-            }
-        }
-    }
-    if (ret == 0)
-        return 0;
-    rep_poll = 0;
-#else
-    /* if there is some other interface the thread
-     * should continue polling others */
+
+    /* Outside of the PPE, the progress thread sleeps on the
+     * completion channel once it finds no work anywhere. See
+     * progress_sleep(). */
     ret = ibv_poll_cq(ni->rdma.cq, num_wc, wc_list);
     if (ret <= 0) {
         pthread_yield();
         return 0;
     }
-#endif
 
     /* convert from wc to buf and set initial state */
     for (i = 0; i < ret; i++) {
@@ -275,6 +251,9 @@ static int recv_packet(buf_t *buf)
 
     /* compute next state */
     if (hdr->operation <= OP_SWAP) {
+        if (hdr->compact && req_hdr_unpack(buf))
+            return STATE_RECV_DROP_BUF;
+
         if (buf->length < sizeof(req_hdr_t))
             return STATE_RECV_DROP_BUF;
         else
@@ -552,7 +531,14 @@ static void process_recv_rdma(ni_t *ni, buf_t *buf)
     return;
 }
 
-void progress_thread_rdma(ni_t *ni)
+/**
+ * Process the completions of an NI.
+ *
+ * @param ni the ni.
+ *
+ * @return the number of completions processed.
+ */
+int progress_thread_rdma(ni_t *ni)
 {
     const int num_wc = get_param(PTL_WC_COUNT);
     buf_t *buf_list[num_wc];
@@ -566,20 +552,42 @@ void progress_thread_rdma(ni_t *ni)
         if (buf_list[i])
             process_recv_rdma(ni, buf_list[i]);
     }
+
+    return num_buf;
 }
 #endif
 
 #if WITH_TRANSPORT_UDP
-void progress_thread_udp(ni_t *ni)
+/**
+ * Process a UDP message for an NI.
+ *
+ * @param ni the ni.
+ *
+ * @return 1 if a message was processed, 0 otherwise.
+ */
+int progress_thread_udp(ni_t *ni)
 {
+    buf_t *udp_buf = NULL;
+
     /* Socket connection. */
 
     if (ni->udp.dest_addr && ni->udp.map_done != 0) {
 
         int err;
-        buf_t *udp_buf;
+        int self;
 
-        udp_buf = udp_receive(ni);
+#if WITH_RUDP
+        rudp_progress(ni);
+#endif
+
+        //a send to ourselves hands over the sender's buf
+        self = atomic_read(&ni->udp.self_recv) >= 1;
+        if (self) {
+            ptl_info("got a message from self %p \n", ni->udp.self_recv_addr);
+            udp_buf = ni->udp.self_recv_addr;
+        } else {
+            udp_buf = udp_receive(ni);
+        }
 
         if (udp_buf != NULL) {
             ptl_info("UDP progress thread, received data: %p type:%i\n",
@@ -638,8 +646,14 @@ void progress_thread_udp(ni_t *ni)
                     if (udp_buf->put_ct != NULL) {
                         ptl_info("putct is : %p \n", udp_buf->put_ct);
                     }
-                    pthread_mutex_init(&udp_buf->mutex, NULL);
-                    udp_buf->obj.obj_ni = ni;
+                    if (self) {
+                        pthread_mutex_init(&udp_buf->mutex, NULL);
+                        udp_buf->obj.obj_ni = ni;
+                    } else {
+                        /* The state machine drops a reference. Keep
+                         * the one from udp_receive() until done. */
+                        buf_get(udp_buf);
+                    }
                     udp_buf->conn = get_conn(ni, ni->id);
                     udp_buf->conn->state = CONN_STATE_CONNECTED;
                     process_recv_udp(ni, udp_buf);
@@ -710,19 +724,19 @@ void progress_thread_udp(ni_t *ni)
                     /* Should not happen. */
                     abort();
             }
-            //if a buffer was allocated for the recv, free it
-            if (atomic_read(&ni->udp.self_recv) == 0) {
+            //if a buffer was allocated for the recv, release it
+            if (!self) {
                 if (udp_buf->completed) {
                     ptl_info("free recv buf %p\n", &udp_buf);
                     if (udp_buf->recv_buf)
                         buf_put(udp_buf->recv_buf);
                     if (udp_buf->conn)
                         conn_put(udp_buf->conn);
-                    free(udp_buf);
                 }
+                buf_put(udp_buf);
             }
             //if we sent something to ourselves, flag it as processed
-            else if ((int)atomic_read(&ni->udp.self_recv) > 0) {
+            else {
                 atomic_dec(&ni->udp.self_recv);
                 ptl_info(" self recv: %i \n",
                          atomic_read(&ni->udp.self_recv));
@@ -779,6 +793,8 @@ void progress_thread_udp(ni_t *ni)
 
 	PTL_FASTLOCK_UNLOCK(&ni->udp_lock);
 //#endif*/
+
+    return udp_buf != NULL;
 }
 #endif
 
@@ -889,158 +905,488 @@ void process_recv_udp(ni_t *ni, buf_t *buf)
 #endif
 
 #if !IS_PPE
+#if WITH_TRANSPORT_SHMEM
 /**
- * Progress thread. Waits for ib, udp, and/or shared memory messages.
+ * Process a shared memory message for an NI.
  *
- * @param arg opaque pointer to ni.
+ * @param ni the ni.
+ *
+ * @return 1 if a message was processed, 0 otherwise.
  */
+static int progress_shmem(ni_t *ni)
+{
+    buf_t *shmem_buf;
+    int err;
 
-static void *progress_thread(void *arg)
+    shmem_buf = shmem_dequeue(ni);
+    if (!shmem_buf)
+        return 0;
+
+    switch (shmem_buf->type) {
+        case BUF_SHMEM_SEND:{
+            buf_t *buf;
+
+            /* Mark it for return now. The target state machine might
+             * change its type to BUF_SHMEM_SEND. */
+            shmem_buf->type = BUF_SHMEM_RETURN;
+
+            err = buf_alloc(ni, &buf);
+            if (err) {
+                WARN();
+            } else {
+                buf->data = shmem_buf->internal_data;
+                buf->length = shmem_buf->length;
+                buf->mem_buf = shmem_buf;
+                INIT_LIST_HEAD(&buf->list);
+                process_recv_mem(ni, buf);
+            }
+
+#if WITH_TRANSPORT_SHMEM && !USE_KNEM
+            /* Don't send back if it's on the noknem list. Other
+             * threads may queue transfers behind it, but can't
+             * remove it. */
+            if (!list_empty(&buf->list))
+                break;
+#endif
+#if WITH_TRANSPORT_IB
+            if (buf_ref_cnt(buf) == 1 && 
+                !(buf->event_mask & XI_RECEIVE_EXPECTED) && 
+                (buf->type == BUF_TGT)) {
+                ptl_warn("freeing a shared mem buf of type: %i with mask %X \n",buf->type, buf->event_mask);
+			    buf->type = BUF_FREE;
+			    buf_put(buf);
+			}
+#endif
+            if (shmem_buf->type == BUF_SHMEM_SEND ||
+                shmem_buf->shmem.index_owner != ni->mem.index) {
+                /* Requested to send the buffer back, or not the
+                 * owner. Send the buffer back in both cases. */
+                shmem_enqueue(ni, shmem_buf,
+                              shmem_buf->shmem.index_owner);
+            } else {
+                /* It was returned to us with a message from a remote
+                 * rank. From send_message_shmem(). */
+                buf_put(shmem_buf);
+            }
+        }
+            break;
+
+        case BUF_SHMEM_RETURN:
+            /* Buffer returned to us by remote node. */
+            assert(shmem_buf->shmem.index_owner == ni->mem.index);
+
+            /* From send_message_shmem(). */
+            buf_put(shmem_buf);
+            break;
+
+        default:
+            /* Should not happen. */
+            abort();
+    }
+
+    return 1;
+}
+#endif
+
+#if WITH_TRANSPORT_SHMEM && !USE_KNEM
+/**
+ * Advance the shared memory transfers going through bounce buffers.
+ *
+ * @param ni the ni.
+ *
+ * @return non-zero while transfers are in progress. Their peers
+ * don't ring the doorbell, so they must be polled.
+ */
+static int progress_noknem(ni_t *ni)
 {
-    ni_t *ni = arg;
-#if WITH_TRANSPORT_SHMEM
-    int err = 0;
+    struct list_head *l, *t;
+    int err;
+    int busy;
+
+    /* Take the new transfers. From then on, only the progress
+     * thread accesses them, so no lock is needed to advance them. */
+    if (!list_empty(&ni->shmem.noknem_new)) {
+        PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
+        list_splice_tail(&ni->shmem.noknem_new, &ni->shmem.noknem_list);
+        INIT_LIST_HEAD(&ni->shmem.noknem_new);
+        PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
+    }
+
+    list_for_each_safe(l, t, &ni->shmem.noknem_list) {
+        buf_t *buf = list_entry(l, buf_t, list);
+        struct noknem *noknem = buf->transfer.noknem.noknem;
+
+        if (!buf->transfer.noknem.target) {
+            /* The initiator leaves the list in init_copy_done(). */
+            err = process_init(buf);
+            if (unlikely(err))
+                ptl_warn("Error in non-knem shared memory initiator processing\n");
+        } else if (noknem->init_done) {
+            buf_t *shmem_buf = buf->mem_buf;
+
+            /* The transfer is now done. Remove from
+             * noknem_list, which lets tgt_rdma() complete. */
+            list_del_init(&buf->list);
+
+            err = process_tgt(buf);
+            if (unlikely(err))
+                ptl_warn("Error in non-knem shared memory target processing");
+
+            if (shmem_buf->type == BUF_SHMEM_SEND ||
+                shmem_buf->shmem.index_owner != ni->mem.index) {
+                /* Requested to send the buffer back, or not the
+                 * owner. Send the buffer back in both cases. */
+                shmem_enqueue(ni, shmem_buf, shmem_buf->shmem.index_owner);
+            } else {
+                /* It was returned to us with a message from a remote
+                 * rank. From send_message_shmem(). */
+                buf_put(shmem_buf);
+            }
+        } else {
+            err = process_tgt(buf);
+            if (unlikely(err))
+                ptl_warn("Error in non-knem shared memory target processing");
+        }
+    }
+
+    busy = !list_empty(&ni->shmem.noknem_list) ||
+        !list_empty(&ni->shmem.noknem_new);
+
+    return busy;
+}
+#endif
+
+/**
+ * Account for a poll of a source of work.
+ *
+ * @param ni the ni.
+ * @param src the source.
+ * @param found the amount of work found.
+ *
+ * @return non-zero if work was found.
+ */
+static inline int progress_count(ni_t *ni, enum progress_src src, int found)
+{
+    ni->progress.polls[src]++;
+
+    if (found <= 0)
+        return 0;
+
+    ni->progress.hits[src]++;
+
+    return 1;
+}
+
+/**
+ * Bind the progress thread to the cores given by PTL_PROGRESS_BIND.
+ *
+ * The value is either a core ("3" or "core:3"), or a NUMA node
+ * ("node:1") in which case the thread may run on any core of the node.
+ */
+static void progress_bind(void)
+{
+    const char *str = getenv("PTL_PROGRESS_BIND");
+    cpu_set_t set;
+    char list[1024];
+    char *p;
+    FILE *f;
+
+    if (!str || !str[0])
+        return;
+
+    CPU_ZERO(&set);
+
+    if (!strncmp(str, "node:", 5)) {
+        snprintf(list, sizeof(list), "/sys/devices/system/node/node%d/cpulist",
+                 atoi(str + 5));
+        f = fopen(list, "r");
+        if (!f || !fgets(list, sizeof(list), f))
+            list[0] = 0;
+        if (f)
+            fclose(f);
+
+        /* A list of ranges, such as "0-3,8-11". */
+        p = list;
+        while (*p >= '0' && *p <= '9') {
+            long first = strtol(p, &p, 10);
+            long last = first;
+
+            if (*p == '-')
+                last = strtol(p + 1, &p, 10);
+
+            for (; first <= last && first < CPU_SETSIZE; first++)
+                CPU_SET(first, &set);
+
+            if (*p == ',')
+                p++;
+        }
+    } else {
+        if (!strncmp(str, "core:", 5))
+            str += 5;
+
+        if (atoi(str) >= 0 && atoi(str) < CPU_SETSIZE)
+            CPU_SET(atoi(str), &set);
+    }
+
+    if (CPU_COUNT(&set) == 0 ||
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        ptl_warn("cannot bind the progress thread to %s\n", str);
+}
+
+#if HAVE_SYS_EPOLL_H
+/**
+ * Add a file descriptor to the set which wakes up the progress thread.
+ *
+ * @param ni the ni.
+ * @param fd the file descriptor.
+ */
+static void progress_watch(ni_t *ni, int fd)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(ni->progress.epfd, EPOLL_CTL_ADD, fd, &ev))
+        WARN();
+}
+
+/**
+ * Watch the sources which became available since the last sleep.
+ *
+ * The shared memory doorbell only exists once the map is set, for
+ * logical NIs.
+ *
+ * @param ni the ni.
+ */
+static void progress_watch_sources(ni_t *ni)
+{
+#if WITH_TRANSPORT_IB
+    if (!(ni->progress.watched & (1 << PROGRESS_SRC_RDMA)) && ni->rdma.ch) {
+        int flags = fcntl(ni->rdma.ch->fd, F_GETFL);
+
+        fcntl(ni->rdma.ch->fd, F_SETFL, flags | O_NONBLOCK);
+        progress_watch(ni, ni->rdma.ch->fd);
+        ni->progress.watched |= 1 << PROGRESS_SRC_RDMA;
+    }
+#endif
+
+#if WITH_TRANSPORT_UDP
+    if (!(ni->progress.watched & (1 << PROGRESS_SRC_UDP)) &&
+        ni->udp.s != -1) {
+        progress_watch(ni, ni->udp.s);
+        ni->progress.watched |= 1 << PROGRESS_SRC_UDP;
+    }
 #endif
 
-    while (!ni->catcher_stop
 #if WITH_TRANSPORT_SHMEM
-           //  || atomic_read(&ni->sbuf_pool.count)
+    if (!(ni->progress.watched & (1 << PROGRESS_SRC_SHMEM)) &&
+        ni->shmem.bell_fd != -1) {
+        progress_watch(ni, ni->shmem.bell_fd);
+        ni->progress.watched |= 1 << PROGRESS_SRC_SHMEM;
+    }
 #endif
-        ) {
+}
 
-        progress_thread_rdma(ni);
+/**
+ * Whether some work is pending which no file descriptor signals.
+ *
+ * Called after announcing the sleep, so that whoever brings work
+ * afterwards sees the announce and wakes the thread up.
+ *
+ * @param ni the ni.
+ *
+ * @return non-zero if the progress thread must not sleep.
+ */
+static int progress_pending(ni_t *ni)
+{
+    if (ni->catcher_stop || ni->catcher_nosleep)
+        return 1;
 
-        progress_thread_udp(ni);
+#if WITH_TRANSPORT_UDP
+    if (atomic_read(&ni->udp.self_recv) > 0)
+        return 1;
+#endif
 
 #if WITH_TRANSPORT_SHMEM
-        /* Shared memory. Physical NIs don't have a receive queue. */
-        if (ni->shmem.queue) {
-            
-            buf_t *shmem_buf;
-
-            shmem_buf = shmem_dequeue(ni);
-
-            if (shmem_buf) {
-                switch (shmem_buf->type) {
-                    case BUF_SHMEM_SEND:{
-                        buf_t *buf;
-
-                        /* Mark it for return now. The target state machine might
-                         * change its type to BUF_SHMEM_SEND. */
-                        shmem_buf->type = BUF_SHMEM_RETURN;
-
-                        err = buf_alloc(ni, &buf);
-                        if (err) {
-                            WARN();
-                        } else {
-                            buf->data = shmem_buf->internal_data;
-                            buf->length = shmem_buf->length;
-                            buf->mem_buf = shmem_buf;
-                            INIT_LIST_HEAD(&buf->list);
-                            process_recv_mem(ni, buf);
-                        }
+    if (ni->shmem.mailbox &&
+        (ni->shmem.bell_fd == -1 || shmem_busy(ni)))
+        return 1;
+#endif
 
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
-                        /* Don't send back if it's on the noknem list. */
-                        PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
-                        if (!list_empty(&buf->list)) {
-                            PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
-                            break;
-                        }
-                        PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
+    if (!list_empty(&ni->shmem.noknem_new))
+        return 1;
 #endif
+
+    return 0;
+}
+
+/**
+ * Sleep until one of the sources has work.
+ *
+ * Sleeps are bounded by PTL_PROGRESS_SLEEP (ms), for the work which
+ * is neither signalled nor announced, such as RUDP retransmissions.
+ *
+ * @param ni the ni.
+ */
+static void progress_sleep(ni_t *ni)
+{
+    struct epoll_event evs[PROGRESS_SRC_LAST + 1];
+    uint64_t val;
+#if WITH_TRANSPORT_SHMEM
+    char bell[16];
+#endif
+    int num;
+    int i;
+
+    progress_watch_sources(ni);
+
 #if WITH_TRANSPORT_IB
-                        if (buf_ref_cnt(buf) == 1 && 
-                            !(buf->event_mask & XI_RECEIVE_EXPECTED) && 
-                            (buf->type == BUF_TGT)) {
-                            ptl_warn("freeing a shared mem buf of type: %i with mask %X \n",buf->type, buf->event_mask);
-			    buf->type = BUF_FREE;
-			    buf_put(buf);
-			}
+    /* Completions which arrived before the notification was requested
+     * don't raise an event. Poll once more before sleeping. */
+    if (ni->rdma.ch && !ni->progress.cq_armed) {
+        ibv_req_notify_cq(ni->rdma.cq, 0);
+        ni->progress.cq_armed = 1;
+        return;
+    }
 #endif
-                        if (shmem_buf->type == BUF_SHMEM_SEND ||
-                            shmem_buf->shmem.index_owner != ni->mem.index) {
-                            /* Requested to send the buffer back, or not the
-                             * owner. Send the buffer back in both cases. */
-                            shmem_enqueue(ni, shmem_buf,
-                                          shmem_buf->shmem.index_owner);
-                        } else {
-                            /* It was returned to us with a message from a remote
-                             * rank. From send_message_shmem(). */
-                            buf_put(shmem_buf);
-                        }
-                    }
-                        break;
 
-                    case BUF_SHMEM_RETURN:
-                        /* Buffer returned to us by remote node. */
-                        assert(shmem_buf->shmem.index_owner == ni->mem.index);
+    ni->progress.sleeping = 1;
+#if WITH_TRANSPORT_SHMEM
+    if (ni->shmem.mailbox)
+        ni->shmem.mailbox->sleeping = 1;
+#endif
+    __sync_synchronize();
 
-                        /* From send_message_shmem(). */
-                        buf_put(shmem_buf);
-                        break;
+    if (!progress_pending(ni)) {
+        ni->progress.sleeps++;
 
-                    default:
-                        /* Should not happen. */
-                        abort();
-                }
+        num = epoll_wait(ni->progress.epfd, evs, PROGRESS_SRC_LAST + 1,
+                         get_param(PTL_PROGRESS_SLEEP));
+
+        for (i = 0; i < num; i++) {
+            int fd = evs[i].data.fd;
+
+            if (fd == ni->progress.wake_fd) {
+                if (read(fd, &val, sizeof(val)) < 0)
+                    val = 0;
+            }
+#if WITH_TRANSPORT_SHMEM
+            else if (fd == ni->shmem.bell_fd) {
+                while (recv(fd, bell, sizeof(bell), MSG_DONTWAIT) > 0) ;
+            }
+#endif
+#if WITH_TRANSPORT_IB
+            else if (ni->rdma.ch && fd == ni->rdma.ch->fd) {
+                struct ibv_cq *cq;
+                void *ctx;
+
+                while (ibv_get_cq_event(ni->rdma.ch, &cq, &ctx) == 0)
+                    ibv_ack_cq_events(cq, 1);
+                ni->progress.cq_armed = 0;
             }
+#endif
         }
+    }
+
+#if WITH_TRANSPORT_SHMEM
+    if (ni->shmem.mailbox)
+        ni->shmem.mailbox->sleeping = 0;
+#endif
+    ni->progress.sleeping = 0;
+}
+#endif
+
+/**
+ * Wake up the progress thread if it sleeps.
+ *
+ * Called after handing it work which no file descriptor signals.
+ *
+ * @param ni the ni.
+ */
+void progress_wake(ni_t *ni)
+{
+    uint64_t val = 1;
+
+    __sync_synchronize();
+
+    if (ni->progress.sleeping && ni->progress.wake_fd != -1) {
+        if (write(ni->progress.wake_fd, &val, sizeof(val)) < 0)
+            WARN();
+    }
+}
+
+/**
+ * Progress thread. Waits for ib, udp, and/or shared memory messages.
+ *
+ * Depending on PTL_PROGRESS_MODE, the thread polls the sources all
+ * the time, or sleeps until one of them has work once there is none,
+ * right away or after polling for PTL_PROGRESS_SPIN ns. A user thread
+ * waiting on an EQ or CT keeps it polling, except in blocking mode.
+ *
+ * @param arg opaque pointer to ni.
+ */
+static void *progress_thread(void *arg)
+{
+    ni_t *ni = arg;
+    uint64_t idle_since = 0;
+    uint64_t now;
+    TIMER_TYPE tp;
+    int busy;
+
+    progress_bind();
+
+    while (!ni->catcher_stop) {
+        /* Wake up the threads waiting on EQs and CTs once the
+         * messages received are fully processed. */
+        ptl_wait_defer();
+
+        busy = 0;
+
+#if WITH_TRANSPORT_IB
+        busy |= progress_count(ni, PROGRESS_SRC_RDMA,
+                               progress_thread_rdma(ni));
+#endif
+
+#if WITH_TRANSPORT_UDP
+        busy |= progress_count(ni, PROGRESS_SRC_UDP, progress_thread_udp(ni));
+#endif
+
+#if WITH_TRANSPORT_SHMEM
+        /* Shared memory. Physical NIs don't have a mailbox. */
+        if (ni->shmem.mailbox)
+            busy |= progress_count(ni, PROGRESS_SRC_SHMEM,
+                                   progress_shmem(ni));
 #endif
 
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
-        struct list_head *l, *t;
+        busy |= progress_noknem(ni);
+#endif
 
-        /* TODO: instead of having a lock, the initiator should send
-         * the buf to itself, and on receiving it, the progress thread
-         * will put it on the list. That way, only the progress thread
-         * has access to the list. */
-        PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
+        ptl_wait_flush();
 
-        list_for_each_safe(l, t, &ni->shmem.noknem_list) {
-            buf_t *buf = list_entry(l, buf_t, list);
-            struct noknem *noknem = buf->transfer.noknem.noknem;
+#if HAVE_SYS_EPOLL_H
+        if (busy || ni->progress.mode == PROGRESS_POLL ||
+            (ni->progress.mode == PROGRESS_HYBRID &&
+             atomic_read(&keep_polling) > 0)) {
+            idle_since = 0;
+            continue;
+        }
 
-            if (buf->transfer.noknem.transfer_state_expected == noknem->state) {
-                if (noknem->state == 0){
-                    err = process_init(buf);
-                    if (unlikely(err))
-                        ptl_warn("Error in non-knem shared memory initiator processing\n");
-                }
-                else if (noknem->state == 2) {
-                    if (noknem->init_done) {
-                        buf_t *shmem_buf = buf->mem_buf;
-
-                        /* The transfer is now done. Remove from
-                         * noknem_list. */
-                        list_del(&buf->list);
-
-                        err = process_tgt(buf);
-                        if (unlikely(err))
-                            ptl_warn("Error in non-knem shared memory target processing");
-
-                        if (shmem_buf->type == BUF_SHMEM_SEND ||
-                            shmem_buf->shmem.index_owner != ni->mem.index) {
-                            /* Requested to send the buffer back, or not the
-                             * owner. Send the buffer back in both cases. */
-                            shmem_enqueue(ni, shmem_buf,
-                                          shmem_buf->shmem.index_owner);
-                        } else {
-                            /* It was returned to us with a message from a remote
-                             * rank. From send_message_shmem(). */
-                            buf_put(shmem_buf);
-                        }
+        if (ni->progress.mode == PROGRESS_HYBRID) {
+            MARK_TIMER(tp);
+            now = TIMER_INTS(tp);
 
-                    } else {
-                        err = process_tgt(buf);
-                        if (unlikely(err))
-                            ptl_warn("Error in non-knem shared memory target processing");
-                    }
-                }
-            }
+            if (!idle_since)
+                idle_since = now;
+
+            if (now - idle_since < get_param(PTL_PROGRESS_SPIN))
+                continue;
         }
 
-        PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
+        progress_sleep(ni);
+        idle_since = 0;
 #endif
     }
 
@@ -1056,12 +1402,39 @@ int start_progress_thread(ni_t *ni)
     /* Keep the communication thread active at the end to terminate it */
     ni->catcher_nosleep = 0;
 
+    ni->progress.mode = get_param(PTL_PROGRESS_MODE);
+    ni->progress.epfd = -1;
+    ni->progress.wake_fd = -1;
+    ni->progress.watched = 0;
+    ni->progress.cq_armed = 0;
+    ni->progress.sleeping = 0;
+    memset(ni->progress.polls, 0, sizeof(ni->progress.polls));
+    memset(ni->progress.hits, 0, sizeof(ni->progress.hits));
+    ni->progress.sleeps = 0;
+
     str = getenv("PTL_PROGRESS_NOSLEEP");
-    if (NULL != str && ( str[0] == 'y' || str[0] == 'Y' || str[0] == '1'))
+    if (NULL != str && ( str[0] == 'y' || str[0] == 'Y' || str[0] == '1')) {
         atomic_set(&keep_polling, 1);
-    else
+        ni->progress.mode = PROGRESS_POLL;
+    } else
         atomic_set(&keep_polling, 0);
 
+#if HAVE_SYS_EPOLL_H
+    if (ni->progress.mode != PROGRESS_POLL) {
+        ni->progress.epfd = epoll_create1(EPOLL_CLOEXEC);
+        ni->progress.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (ni->progress.epfd == -1 || ni->progress.wake_fd == -1) {
+            ptl_warn("cannot create the progress thread wakeup, polling\n");
+            ni->progress.mode = PROGRESS_POLL;
+        } else {
+            progress_watch(ni, ni->progress.wake_fd);
+        }
+    }
+#else
+    ni->progress.mode = PROGRESS_POLL;
+#endif
+
     ret = pthread_create(&ni->catcher, NULL, progress_thread, ni);
     if (ret) {
         WARN();
@@ -1071,10 +1444,6 @@ int start_progress_thread(ni_t *ni)
 
         ret = PTL_OK;
     }
-    /* Give the priority to the communication thread */
-    int which = PRIO_PROCESS;
-    pid_t pid = getpid();
-    setpriority(which, pid, 2);
 
     return ret;
 }
@@ -1082,13 +1451,35 @@ int start_progress_thread(ni_t *ni)
 /* Stop the progress thread. */
 void stop_progress_thread(ni_t *ni)
 {
+    int i;
+
     if (ni->has_catcher) {
         int *status;
         ni->catcher_stop = 1;
+        progress_wake(ni);
         pthread_cancel(ni->catcher);
         ni->has_catcher = 0;
         pthread_join(ni->catcher, (void **)&status);
         assert(status == 0 || status == PTHREAD_CANCELED);
+
+        for (i = 0; i < PROGRESS_SRC_LAST; i++) {
+            if (ni->progress.polls[i])
+                ptl_info("progress source %d: %" PRIu64 " polls, %" PRIu64
+                         " found work\n", i, ni->progress.polls[i],
+                         ni->progress.hits[i]);
+        }
+        ptl_info("progress thread slept %" PRIu64 " times\n",
+                 ni->progress.sleeps);
+    }
+
+    if (ni->progress.wake_fd != -1) {
+        close(ni->progress.wake_fd);
+        ni->progress.wake_fd = -1;
+    }
+
+    if (ni->progress.epfd != -1) {
+        close(ni->progress.epfd);
+        ni->progress.epfd = -1;
     }
 }
 
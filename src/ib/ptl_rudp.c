@@ -1,228 +1,892 @@
-/* TODO LIST:
- *      --send header needs to deal with iovecs 
- *      --need to handle NACKs retransmission
- *      --timeouts need to be handled (progress thread?)
- *      --needs to work for the PPE (NACK/ACK destination pids)
- *
- * Notes:   On recv side, drop messages with seq_num below
- *          that of the current seq_num
+/*
+ * ptl_rudp.c - Reliability layer for the UDP transport
+ *
+ * Every datagram an NI sends to a remote address is given a sequence
+ * number, and a copy of it is kept in a send window until the remote
+ * NI acknowledges it. Windows are rings indexed by sequence number, so
+ * finding a datagram is a mask, not a list walk:
+ *
+ *   - the receiver acknowledges cumulatively: one ACK releases every
+ *     datagram up to its sequence number.
+ *   - a datagram arriving ahead of the next expected one is held in the
+ *     receive window, and a NACK carrying a bitmap of the missing
+ *     sequence numbers below it asks for those only.
+ *   - unacknowledged datagrams are retransmitted from a timer wheel,
+ *     with an exponential backoff.
+ *   - datagrams delivered in order are acknowledged in groups: every
+ *     RUDP_ACK_EVERY of them, or at the next tick.
+ *   - a datagram that does not fit in the send window waits in a queue
+ *     of the peer until acknowledgements make room for it.
+ *
+ * The windows belong to the NI and are looked up by the remote socket
+ * address: all the NIs of an interface share its socket, and there is
+ * at most one NI of each type on it, so the address identifies the
+ * peer NI whatever the addressing mode or connection state.
+ *
+ * Sequence numbers start at 1. Control messages are shorter than a buf,
+ * which is how the receive side tells them apart.
  */
 
-
 #include "ptl_loc.h"
 #include "ptl_rudp.h"
+#include "ptl_timer.h"
 
 #if WITH_RUDP
-int process_rudp_send_hdr(buf_t *buf, int len, ni_t *ni)
+
+#define RUDP_WHEEL_SIZE         (256)   /* ticks, must be a power of 2 */
+#define RUDP_TICKS_PER_TIMEOUT  (8)
+#define RUDP_MAX_BACKOFF        (4)     /* timeout doublings */
+#define RUDP_PEER_HASH_SIZE     (64)
+#define RUDP_MAX_WINDOW         (1 << 20)
+#define RUDP_ACK_EVERY          (16)    /* datagrams per delayed ACK */
+
+enum rudp_ctl_type {
+    RUDP_ACK = 1,
+    RUDP_NACK,
+};
+
+/* Acknowledgement sent back to a peer. */
+struct rudp_ctl {
+    struct hdr_common h1;
+    uint32_t type;
+
+    /* Every datagram up to this one was received. */
+    uint32_t ack;
+
+    /* Bit i set if ack + 1 + i is missing. */
+    uint64_t nack_mask;
+};
+
+/* A datagram waiting for its acknowledgement. */
+struct rudp_slot {
+    uint32_t seq;
+    int in_use;
+    unsigned int retries;
+    uint64_t deadline;          /* tick of the retransmission */
+    uint64_t sent;              /* tick of the last transmission */
+    void *data;
+    size_t len;
+    size_t size;                /* allocated size of data */
+};
+
+/* A datagram waiting for room in the send window. */
+struct rudp_pending {
+    struct rudp_pending *next;
+    size_t len;
+    char data[];
+};
+
+struct rudp_timer {
+    struct rudp_peer *peer;
+    uint32_t seq;
+    uint64_t deadline;
+};
+
+struct rudp_spoke {
+    struct rudp_timer *timers;
+    unsigned int num;
+    unsigned int size;
+};
+
+struct rudp_peer {
+    struct rudp_peer *next;
+    struct sockaddr_in addr;
+
+    struct {
+        struct rudp_slot *slots;
+        uint32_t size;          /* power of 2 */
+        uint32_t base;          /* oldest unacknowledged */
+        uint32_t next;          /* next to assign */
+        struct rudp_pending *pending;
+        struct rudp_pending **pending_tail;
+    } send;
+
+    struct {
+        buf_t **held;           /* arrived early */
+        uint32_t size;          /* power of 2 */
+        uint32_t next;          /* next to deliver */
+        unsigned int unacked;   /* delivered since the last ACK */
+    } recv;
+
+    struct rudp_peer *ack_next; /* on ni->udp.rudp.acks */
+    int ack_queued;
+};
+
+static inline int seq_before(uint32_t a, uint32_t b)
 {
+    return (int32_t)(a - b) < 0;
+}
 
-    int seq_num = 0;
-    if (buf->type != BUF_UDP_CONN_REP && buf->type != BUF_UDP_CONN_REQ) {
-        ptl_info("set sequence number \n");
-        seq_num = atomic_inc(&buf->conn->udp.send_seq_num);
-        buf->transfer.udp.seq_num = seq_num;
-        req_hdr_t *hdr;
+static inline uint32_t seq_next(uint32_t seq)
+{
+    seq++;
+    return seq ? seq : 1;
+}
 
-        if (buf->internal_data != NULL) {
-            hdr = (req_hdr_t *) buf->internal_data;
-        } else {
-            hdr = (req_hdr_t *) & buf->data;
+static uint64_t rudp_tick_usec(void)
+{
+    uint64_t tick = get_param(PTL_RUDP_TIMEOUT) / RUDP_TICKS_PER_TIMEOUT;
+
+    return tick ? tick : 1;
+}
+
+static uint64_t rudp_now(void)
+{
+    TIMER_TYPE tp;
+
+    MARK_TIMER(tp);
+
+    return (uint64_t)TIMER_INTS(tp) / 1000 / rudp_tick_usec();
+}
+
+static uint32_t rudp_initial_window(void)
+{
+    uint32_t size = 1;
+
+    while (size < get_param(PTL_RUDP_WINDOW))
+        size <<= 1;
+
+    return size;
+}
+
+/**
+ * @brief Initialize the reliability state of an NI.
+ *
+ * @param[in] ni the network interface.
+ *
+ * @return status
+ */
+int rudp_init(ni_t *ni)
+{
+    pthread_mutex_init(&ni->udp.rudp.lock, NULL);
+    INIT_LIST_HEAD(&ni->udp.rudp.ready);
+    ni->udp.rudp.acks = NULL;
+    ni->udp.rudp.num_pending = 0;
+
+    ni->udp.rudp.peers = calloc(RUDP_PEER_HASH_SIZE,
+                                sizeof(*ni->udp.rudp.peers));
+    ni->udp.rudp.wheel = calloc(RUDP_WHEEL_SIZE,
+                                sizeof(*ni->udp.rudp.wheel));
+    if (!ni->udp.rudp.peers || !ni->udp.rudp.wheel) {
+        rudp_fini(ni);
+        return PTL_NO_SPACE;
+    }
+
+    ni->udp.rudp.tick = rudp_now();
+
+    return PTL_OK;
+}
+
+static void rudp_drop_buf(buf_t *buf)
+{
+    if (buf->rlength > sizeof(buf_t))
+        free(buf->transfer.udp.my_iovec.iov_base);
+    buf_put(buf);
+}
+
+/**
+ * @brief Release the reliability state of an NI.
+ *
+ * Datagrams still unacknowledged are lost. Also undoes a partial
+ * rudp_init().
+ *
+ * @param[in] ni the network interface.
+ */
+void rudp_fini(ni_t *ni)
+{
+    struct rudp_peer *peer;
+    struct rudp_pending *pending;
+    struct list_head *l, *t;
+    uint32_t i, j;
+
+    if (ni->udp.rudp.peers) {
+        for (i = 0; i < RUDP_PEER_HASH_SIZE; i++) {
+            while ((peer = ni->udp.rudp.peers[i])) {
+                ni->udp.rudp.peers[i] = peer->next;
+
+                while ((pending = peer->send.pending)) {
+                    peer->send.pending = pending->next;
+                    free(pending);
+                }
+                for (j = 0; j < peer->send.size; j++)
+                    free(peer->send.slots[j].data);
+                for (j = 0; j < peer->recv.size; j++) {
+                    if (peer->recv.held[j])
+                        rudp_drop_buf(peer->recv.held[j]);
+                }
+                free(peer->send.slots);
+                free(peer->recv.held);
+                free(peer);
+            }
         }
+        free(ni->udp.rudp.peers);
+        ni->udp.rudp.peers = NULL;
+    }
+    ni->udp.rudp.acks = NULL;
+    ni->udp.rudp.num_pending = 0;
 
-        conn_t *temp_conn;
+    if (ni->udp.rudp.wheel) {
+        for (i = 0; i < RUDP_WHEEL_SIZE; i++)
+            free(ni->udp.rudp.wheel[i].timers);
+        free(ni->udp.rudp.wheel);
+        ni->udp.rudp.wheel = NULL;
+    }
 
-        temp_conn =
-            get_conn(ni, (ptl_process_t)le32_to_cpu(hdr->h1.src_rank));
-        if (temp_conn == NULL)
-            ptl_warn
-                ("RUDP couldn't fetch conn info, perhaps conn is closed?\n");
+    list_for_each_safe(l, t, &ni->udp.rudp.ready) {
+        buf_t *buf = list_entry(l, buf_t, list);
 
-        INIT_LIST_HEAD(&buf->list);
-        list_add_tail(&buf->list, &temp_conn->udp.rel_queued_bufs);
-        ptl_info("^^^added buf seq num: %i to rel_queue\n",
-                 buf->transfer.udp.seq_num);
-        buf->udp.in_progress = 1;
+        list_del(&buf->list);
+        rudp_drop_buf(buf);
     }
-    ptl_info("send header assembly complete\n");
-    return 0;
+
+    pthread_mutex_destroy(&ni->udp.rudp.lock);
 }
 
+/**
+ * @brief Find the peer behind a remote address, creating it if needed.
+ *
+ * ni->udp.rudp.lock must be held.
+ *
+ * @param[in] ni the network interface.
+ * @param[in] addr the remote address.
+ *
+ * @return the peer, or NULL if out of memory
+ */
+static struct rudp_peer *rudp_peer(ni_t *ni, const struct sockaddr_in *addr)
+{
+    unsigned int hash = (ntohl(addr->sin_addr.s_addr) ^
+                         ntohs(addr->sin_port)) % RUDP_PEER_HASH_SIZE;
+    struct rudp_peer *peer;
+    uint32_t size = rudp_initial_window();
+
+    for (peer = ni->udp.rudp.peers[hash]; peer; peer = peer->next) {
+        if (peer->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            peer->addr.sin_port == addr->sin_port)
+            return peer;
+    }
+
+    peer = calloc(1, sizeof(*peer));
+    if (!peer)
+        return NULL;
+
+    peer->send.slots = calloc(size, sizeof(*peer->send.slots));
+    peer->recv.held = calloc(size, sizeof(*peer->recv.held));
+    if (!peer->send.slots || !peer->recv.held) {
+        free(peer->send.slots);
+        free(peer->recv.held);
+        free(peer);
+        return NULL;
+    }
 
-int process_rudp_recv_hdr(buf_t *buf, int len, ni_t *ni)
+    peer->addr = *addr;
+    peer->send.size = size;
+    peer->send.base = 1;
+    peer->send.next = 1;
+    peer->send.pending_tail = &peer->send.pending;
+    peer->recv.size = size;
+    peer->recv.next = 1;
+
+    peer->next = ni->udp.rudp.peers[hash];
+    ni->udp.rudp.peers[hash] = peer;
+
+    return peer;
+}
+
+/**
+ * @brief Add a timer to the wheel.
+ *
+ * ni->udp.rudp.lock must be held.
+ */
+static void rudp_add_timer(ni_t *ni, struct rudp_peer *peer,
+                           struct rudp_slot *slot)
 {
+    struct rudp_spoke *spoke =
+        &ni->udp.rudp.wheel[slot->deadline & (RUDP_WHEEL_SIZE - 1)];
 
-    struct list_head *l, *t;
-    buf_t *temp_buf = NULL;
-    int found_one, ret = 0;
+    if (spoke->num == spoke->size) {
+        unsigned int size = spoke->size ? 2 * spoke->size : 16;
+        struct rudp_timer *timers = realloc(spoke->timers,
+                                            size * sizeof(*timers));
+
+        if (!timers) {
+            /* The next NACK will recover it. */
+            WARN();
+            return;
+        }
+        spoke->timers = timers;
+        spoke->size = size;
+    }
+
+    spoke->timers[spoke->num].peer = peer;
+    spoke->timers[spoke->num].seq = slot->seq;
+    spoke->timers[spoke->num].deadline = slot->deadline;
+    spoke->num++;
+}
+
+/**
+ * @brief Arm the retransmission timer of a datagram just sent.
+ *
+ * The timeout doubles with each retry, staying within the wheel.
+ *
+ * ni->udp.rudp.lock must be held.
+ */
+static void rudp_arm(ni_t *ni, struct rudp_peer *peer, struct rudp_slot *slot,
+                     uint64_t now)
+{
+    unsigned int backoff = slot->retries < RUDP_MAX_BACKOFF ?
+        slot->retries : RUDP_MAX_BACKOFF;
+
+    slot->sent = now;
+    slot->deadline = now + (RUDP_TICKS_PER_TIMEOUT << backoff);
+    rudp_add_timer(ni, peer, slot);
+}
+
+/**
+ * @brief Double the send window of a peer.
+ *
+ * ni->udp.rudp.lock must be held.
+ *
+ * @return status
+ */
+static int rudp_grow_send(struct rudp_peer *peer)
+{
+    uint32_t size = 2 * peer->send.size;
+    struct rudp_slot *slots;
+    uint32_t i;
+
+    if (size > RUDP_MAX_WINDOW)
+        return PTL_NO_SPACE;
+
+    slots = calloc(size, sizeof(*slots));
+    if (!slots)
+        return PTL_NO_SPACE;
+
+    for (i = 0; i < peer->send.size; i++) {
+        struct rudp_slot *slot = &peer->send.slots[i];
+
+        /* Slots in use are within the old size, so they can't
+         * collide. */
+        if (slot->in_use)
+            slots[slot->seq & (size - 1)] = *slot;
+        else
+            free(slot->data);
+    }
+
+    free(peer->send.slots);
+    peer->send.slots = slots;
+    peer->send.size = size;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Retransmit a datagram.
+ */
+static void rudp_resend(ni_t *ni, struct rudp_peer *peer,
+                        struct rudp_slot *slot, uint64_t now)
+{
+    ptl_info("RUDP retransmit seq %u to %s:%i\n", slot->seq,
+             inet_ntoa(peer->addr.sin_addr), ntohs(peer->addr.sin_port));
+
+    if (sendto(ni->iface->udp.connect_s, slot->data, slot->len, 0,
+               (struct sockaddr *)&peer->addr, sizeof(peer->addr)) == -1)
+        ptl_info("RUDP retransmit failed: %s\n", strerror(errno));
+
+    slot->retries++;
+    rudp_arm(ni, peer, slot, now);
+}
+
+/**
+ * @brief Find the next slot of the send window, with room for a
+ * datagram.
+ *
+ * ni->udp.rudp.lock must be held.
+ *
+ * @param[in] peer the peer.
+ * @param[in] len the length of the datagram.
+ *
+ * @return the slot, or NULL if the datagram can't be sent now
+ */
+static struct rudp_slot *rudp_next_slot(struct rudp_peer *peer, size_t len)
+{
+    struct rudp_slot *slot;
+
+    while (peer->send.next - peer->send.base >= peer->send.size) {
+        if (rudp_grow_send(peer))
+            return NULL;
+    }
+
+    slot = &peer->send.slots[peer->send.next & (peer->send.size - 1)];
+    if (slot->size < len) {
+        void *data = realloc(slot->data, len);
+
+        if (!data)
+            return NULL;
+        slot->data = data;
+        slot->size = len;
+    }
+
+    return slot;
+}
+
+/**
+ * @brief Number and send the datagram copied in the next slot.
+ *
+ * A failed send is retransmitted like a lost one.
+ *
+ * ni->udp.rudp.lock must be held.
+ *
+ * @return the result of sendto
+ */
+static ssize_t rudp_transmit(ni_t *ni, struct rudp_peer *peer,
+                             struct rudp_slot *slot)
+{
+    unsigned int seq = peer->send.next;
+    ssize_t ret;
 
-    //Look at the incoming header to find the connection
-    req_hdr_t *hdr;
+    /* The datagram starts with the buf. */
+    memcpy((char *)slot->data + offsetof(buf_t, transfer.udp.seq_num),
+           &seq, sizeof(seq));
+
+    slot->seq = seq;
+    slot->in_use = 1;
+    slot->retries = 0;
+    peer->send.next = seq_next(peer->send.next);
+
+    ret = sendto(ni->iface->udp.connect_s, slot->data, slot->len, 0,
+                 (struct sockaddr *)&peer->addr, sizeof(peer->addr));
+
+    rudp_arm(ni, peer, slot, rudp_now());
+
+    return ret;
+}
+
+/**
+ * @brief Send the datagrams of a peer that were waiting for room in
+ * the send window, as far as it goes.
+ *
+ * ni->udp.rudp.lock must be held.
+ */
+static void rudp_send_pending(ni_t *ni, struct rudp_peer *peer)
+{
+    struct rudp_pending *pending;
+    struct rudp_slot *slot;
 
-    if (buf->internal_data != NULL) {
-        hdr = (req_hdr_t *) buf->internal_data;
+    while ((pending = peer->send.pending)) {
+        slot = rudp_next_slot(peer, pending->len);
+        if (!slot)
+            break;
+
+        memcpy(slot->data, pending->data, pending->len);
+        slot->len = pending->len;
+        rudp_transmit(ni, peer, slot);
+
+        peer->send.pending = pending->next;
+        if (!peer->send.pending)
+            peer->send.pending_tail = &peer->send.pending;
+        ni->udp.rudp.num_pending--;
+        free(pending);
+    }
+}
+
+/**
+ * @brief Send a datagram reliably.
+ *
+ * The first I/O vector holds the buf being sent. The datagram is
+ * copied into the send window for retransmission, given its sequence
+ * number and sent. If the window has no room for it, it is queued
+ * until the peer acknowledges what is in flight.
+ *
+ * @param[in] sockfd the socket.
+ * @param[in] msg the datagram.
+ * @param[in] ni the network interface.
+ *
+ * @return the number of bytes sent or queued, or -1 on error
+ */
+static ssize_t rudp_send(int sockfd, const struct msghdr *msg, ni_t *ni)
+{
+    struct rudp_peer *peer;
+    struct rudp_slot *slot = NULL;
+    char *data;
+    size_t len = 0;
+    size_t i;
+    ssize_t ret;
+
+    for (i = 0; i < msg->msg_iovlen; i++)
+        len += msg->msg_iov[i].iov_len;
+
+    pthread_mutex_lock(&ni->udp.rudp.lock);
+
+    peer = rudp_peer(ni, msg->msg_name);
+    if (!peer)
+        goto nomem;
+
+    /* Nothing overtakes the datagrams already waiting. */
+    rudp_send_pending(ni, peer);
+    if (!peer->send.pending)
+        slot = rudp_next_slot(peer, len);
+
+    if (slot) {
+        data = slot->data;
+        slot->len = len;
     } else {
-        hdr = (req_hdr_t *) & buf->data;
+        struct rudp_pending *pending = malloc(sizeof(*pending) + len);
+
+        if (!pending)
+            goto nomem;
+
+        pending->next = NULL;
+        pending->len = len;
+        *peer->send.pending_tail = pending;
+        peer->send.pending_tail = &pending->next;
+        ni->udp.rudp.num_pending++;
+
+        data = pending->data;
     }
 
-    //get the connection for this communication
-    //this will be nid for physical addressing and rank for logical
-    __le32 src_id = le32_to_cpu(hdr->h1.src_rank);
-
-    ptl_process_t id;
-    id.rank = src_id;
-
-    conn_t *temp_conn;
-    ptl_info("get conn for rank %i at local rank: %i\n",
-             le32_to_cpu(hdr->h1.src_rank), ni->id.rank);
-    temp_conn = get_conn(ni, (ptl_process_t)le32_to_cpu(hdr->h1.src_rank));
-    if (temp_conn == NULL)
-        ptl_error("RUDP couldn't get conn info on recv\n");
-
-    ptl_info("got conn info \n");
-
-    int last_loop = -1;
-
-    //if(!list_empty(&temp_conn->udp.rel_queued_bufs))
-    if (buf->type == BUF_UDP_ACK || buf->type == BUF_UDP_NACK) {
-        list_for_each_safe(l, t, &temp_conn->udp.rel_queued_bufs) {
-            temp_buf = list_entry(l, buf_t, list);
-            assert(&temp_buf != NULL);
-            ptl_info("checking udp seq numbers %i:%i\n",
-                     temp_buf->transfer.udp.seq_num,
-                     buf->transfer.udp.seq_num);
-            if (temp_buf->transfer.udp.seq_num == buf->transfer.udp.seq_num) {
-                //if (!(list_empty(&temp_conn->udp.rel_queued_bufs))){
-                ptl_info("found one, delete it from queued bufs\n");
-                if (buf->type != BUF_UDP_NACK)
-                    list_del(l);
-                found_one = 1;
-                //if (list_empty(&temp_conn->udp.rel_queued_bufs)){
-                //   INIT_LIST_HEAD(&temp_conn->udp.rel_queued_bufs); 
-                //}
-                break;
-                //}
-            } else {
-                ptl_info("no match\n");
-                if (last_loop == temp_buf->transfer.udp.seq_num)
-                    break;
-                last_loop = temp_buf->transfer.udp.seq_num;
-                if (temp_buf->transfer.udp.seq_num == 0)
-                    break;
-            }
-        }
+    for (i = 0; i < msg->msg_iovlen; i++) {
+        memcpy(data, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+        data += msg->msg_iov[i].iov_len;
     }
 
-    ptl_info("RUDP received buf of type: %i \n", buf->type);
-
-    //Check to see if this receive is an ACK/NACK from a target
-    switch (buf->type) {
-            //For an ACK, just remove the buf from the current
-            //transfers list
-        case BUF_UDP_ACK:{
-            if (found_one == 1) {
-                ptl_info("***********ACK received seq: %i*********** \n",
-                         buf->transfer.udp.seq_num);
-                //if (!list_empty(&temp_conn->udp.rel_queued_bufs))
-                //list_del_init(l);
-                //if (list_empty(&temp_conn->udp.rel_queued_bufs))
-                //    INIT_LIST_HEAD(&temp_conn->udp.rel_queued_bufs);
-                break;
-            } else {
-                ptl_error("ACK for buf not in active transfer list\n");
-                break;
+    if (!slot) {
+        ptl_info("RUDP window to %s:%i full, queueing\n",
+                 inet_ntoa(peer->addr.sin_addr), ntohs(peer->addr.sin_port));
+        pthread_mutex_unlock(&ni->udp.rudp.lock);
+        return len;
+    }
+
+    ret = rudp_transmit(ni, peer, slot);
+
+    pthread_mutex_unlock(&ni->udp.rudp.lock);
+
+    if (ret == -1 && errno != ENOBUFS && errno != EAGAIN)
+        return -1;
+
+    return len;
+
+  nomem:
+    pthread_mutex_unlock(&ni->udp.rudp.lock);
+    ptl_warn("RUDP out of memory, cannot send\n");
+    errno = ENOMEM;
+
+    return -1;
+}
+
+/**
+ * @brief Queue a delayed ACK to a peer.
+ *
+ * ni->udp.rudp.lock must be held.
+ */
+static void rudp_delay_ack(ni_t *ni, struct rudp_peer *peer)
+{
+    if (!peer->ack_queued) {
+        peer->ack_queued = 1;
+        peer->ack_next = ni->udp.rudp.acks;
+        ni->udp.rudp.acks = peer;
+    }
+}
+
+/**
+ * @brief Send an ACK or a NACK to a peer.
+ *
+ * ni->udp.rudp.lock must be held.
+ */
+static void rudp_send_ctl(ni_t *ni, struct rudp_peer *peer,
+                          enum rudp_ctl_type type, uint64_t nack_mask)
+{
+    struct rudp_ctl ctl;
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.h1.version = PTL_HDR_VER_1;
+    ctl.h1.physical = !!(ni->options & PTL_NI_PHYSICAL);
+    ctl.h1.ni_type = ni->ni_type;
+    ctl.type = type;
+    ctl.ack = peer->recv.next - 1;
+    ctl.nack_mask = nack_mask;
+
+    sendto(ni->iface->udp.connect_s, &ctl, sizeof(ctl), 0,
+           (struct sockaddr *)&peer->addr, sizeof(peer->addr));
+
+    peer->recv.unacked = 0;
+}
+
+/**
+ * @brief Double the receive window of a peer.
+ *
+ * ni->udp.rudp.lock must be held.
+ *
+ * @return status
+ */
+static int rudp_grow_recv(struct rudp_peer *peer)
+{
+    uint32_t size = 2 * peer->recv.size;
+    buf_t **held;
+    uint32_t i;
+
+    if (size > RUDP_MAX_WINDOW)
+        return PTL_NO_SPACE;
+
+    held = calloc(size, sizeof(*held));
+    if (!held)
+        return PTL_NO_SPACE;
+
+    for (i = 0; i < peer->recv.size; i++) {
+        buf_t *buf = peer->recv.held[i];
+
+        if (buf)
+            held[buf->transfer.udp.seq_num & (size - 1)] = buf;
+    }
+
+    free(peer->recv.held);
+    peer->recv.held = held;
+    peer->recv.size = size;
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Order a received datagram.
+ *
+ * A datagram already received is dropped, one arriving early is held
+ * until the ones before it arrive. Datagrams held behind the one
+ * returned are queued on ni->udp.rudp.ready.
+ *
+ * @param[in] ni the network interface.
+ * @param[in] buf the received buf, with its source address.
+ *
+ * @return the buf to deliver now, or NULL
+ */
+buf_t *rudp_recv(ni_t *ni, buf_t *buf)
+{
+    uint32_t seq = buf->transfer.udp.seq_num;
+    struct rudp_peer *peer;
+    uint64_t nack_mask = 0;
+    int released = 0;
+    uint32_t s;
+    int i;
+
+    pthread_mutex_lock(&ni->udp.rudp.lock);
+
+    peer = rudp_peer(ni, &buf->udp.src_addr);
+    if (!peer) {
+        /* The sender will retransmit. */
+        pthread_mutex_unlock(&ni->udp.rudp.lock);
+        rudp_drop_buf(buf);
+        return NULL;
+    }
+
+    if (seq_before(seq, peer->recv.next)) {
+        /* Duplicate. Its ACK may have been lost. */
+        ptl_info("RUDP duplicate seq %u\n", seq);
+        rudp_send_ctl(ni, peer, RUDP_ACK, 0);
+        pthread_mutex_unlock(&ni->udp.rudp.lock);
+        rudp_drop_buf(buf);
+        return NULL;
+    }
+
+    if (seq != peer->recv.next) {
+        while (seq - peer->recv.next >= peer->recv.size) {
+            if (rudp_grow_recv(peer)) {
+                pthread_mutex_unlock(&ni->udp.rudp.lock);
+                rudp_drop_buf(buf);
+                return NULL;
             }
         }
 
-            //For a NACK, we need to send the buf again
-        case BUF_UDP_NACK:{
-            if (found_one == 1) {
-                //only handles the non-large message case
-                ptl_info("@@@@ RUDP NACK sendto retransmission @@@@@\n");
-                list_for_each_safe(l, t, &temp_conn->udp.rel_queued_bufs) {
-                     temp_buf = list_entry(l, buf_t, list);
-                     assert(&temp_buf != NULL);
-                     ptl_info("checking udp seq numbers %i:%i\n",
-                         temp_buf->transfer.udp.seq_num,
-                         buf->transfer.udp.seq_num);
-                     if (temp_buf->transfer.udp.seq_num <= buf->transfer.udp.seq_num) {
-                         ret =
-                            sendto(ni->iface->udp.connect_s, temp_buf,
-                               sizeof(*temp_buf), 0,
-                               (struct sockaddr *)temp_buf->udp.dest_addr,
-                               sizeof(*temp_buf->udp.dest_addr));
-                        if (ret == -1)
-                            return ret;
-                     }
-                }
-                //add the buffer back to the list
-                //INIT_LIST_HEAD(&temp_buf->list);
-                //list_add_tail(&temp_buf->list, &temp_conn->udp.rel_queued_bufs);
-            }
+        if (peer->recv.held[seq & (peer->recv.size - 1)]) {
+            rudp_drop_buf(buf);
+        } else {
+            ptl_info("RUDP holding seq %u, expecting %u\n", seq,
+                     peer->recv.next);
+            peer->recv.held[seq & (peer->recv.size - 1)] = buf;
+        }
+
+        /* Ask for what is missing below it. */
+        for (s = peer->recv.next, i = 0; s != seq && i < 64;
+             s = seq_next(s), i++) {
+            if (!peer->recv.held[s & (peer->recv.size - 1)])
+                nack_mask |= 1ULL << i;
+        }
+        rudp_send_ctl(ni, peer, RUDP_NACK, nack_mask);
+
+        pthread_mutex_unlock(&ni->udp.rudp.lock);
+        return NULL;
+    }
+
+    peer->recv.next = seq_next(seq);
+
+    /* Release what was waiting on it. */
+    for (;;) {
+        buf_t **slot = &peer->recv.held[peer->recv.next &
+                                        (peer->recv.size - 1)];
+
+        if (!*slot)
             break;
+
+        list_add_tail(&(*slot)->list, &ni->udp.rudp.ready);
+        *slot = NULL;
+        peer->recv.next = seq_next(peer->recv.next);
+        released = 1;
+    }
+
+    /* A filled gap is acknowledged at once, the sender is likely
+     * retransmitting. */
+    peer->recv.unacked++;
+    if (released || peer->recv.unacked >= RUDP_ACK_EVERY)
+        rudp_send_ctl(ni, peer, RUDP_ACK, 0);
+    else
+        rudp_delay_ack(ni, peer);
+
+    pthread_mutex_unlock(&ni->udp.rudp.lock);
+
+    return buf;
+}
+
+/**
+ * @brief Process an ACK or a NACK.
+ *
+ * @param[in] ni the network interface.
+ * @param[in] data the control message.
+ * @param[in] len its length.
+ * @param[in] src the address it came from.
+ */
+void rudp_recv_ctl(ni_t *ni, const void *data, size_t len,
+                   const struct sockaddr_in *src)
+{
+    struct rudp_ctl ctl;
+    struct rudp_peer *peer;
+    uint32_t seq;
+    uint64_t now;
+    int i;
+
+    if (len != sizeof(ctl)) {
+        ptl_warn("dropping a short datagram of %d bytes\n", (int)len);
+        return;
+    }
+    memcpy(&ctl, data, sizeof(ctl));
+
+    pthread_mutex_lock(&ni->udp.rudp.lock);
+
+    peer = rudp_peer(ni, src);
+    if (!peer) {
+        pthread_mutex_unlock(&ni->udp.rudp.lock);
+        return;
+    }
+
+    /* Cumulative acknowledgement. */
+    seq = seq_next(ctl.ack);
+    if (!seq_before(peer->send.next, seq)) {
+        while (seq_before(peer->send.base, seq)) {
+            peer->send.slots[peer->send.base &
+                             (peer->send.size - 1)].in_use = 0;
+            peer->send.base = seq_next(peer->send.base);
         }
 
-            //send an ACK or NACK depending on the data received
-        case BUF_UDP_RECEIVE || BUF_TGT || BUF_TRIGGERED_ME:{
-            ptl_info("process recv for reliability want seq num: %i\n",
-                     atomic_read(&temp_conn->udp.recv_seq_num));
-            if (atomic_read(&temp_conn->udp.recv_seq_num) ==
-                buf->transfer.udp.seq_num) {
-                //got the correct message
-                atomic_inc(&temp_conn->udp.recv_seq_num);
-                ptl_info("next seq number set to: %i\n",
-                         atomic_read(&temp_conn->udp.recv_seq_num));
-                //now we need to send an ack
-                ptl_info("@@@@@@@send back ACK for seq num: %i to %s:%i\n",
-                         buf->transfer.udp.seq_num,
-                         inet_ntoa(temp_conn->sin.sin_addr),
-                         ntohs(temp_conn->sin.sin_port));
-                /*inet_ntoa(buf->udp.src_addr.sin_addr),
-                 * ntohs(buf->udp.src_addr.sin_port)); */
-                buf->type = BUF_UDP_ACK;
-            } else if (atomic_read(&temp_conn->udp.recv_seq_num) >
-                       buf->transfer.udp.seq_num) {
-                buf->type = BUF_UDP_INVALID;     
+        rudp_send_pending(ni, peer);
+    }
 
-            } else {
-                ptl_info("@@@@@@@@@send NACK for seq num: %i \n",
-                         buf->transfer.udp.seq_num);
-                buf->type = BUF_UDP_NACK;
-            }
+    if (ctl.type == RUDP_NACK) {
+        now = rudp_now();
+
+        for (i = 0; i < 64 && ctl.nack_mask; i++, seq = seq_next(seq)) {
+            struct rudp_slot *slot;
+
+            if (!(ctl.nack_mask & (1ULL << i)))
+                continue;
+            ctl.nack_mask &= ~(1ULL << i);
+
+            slot = &peer->send.slots[seq & (peer->send.size - 1)];
+
+            /* Each datagram arriving early asks again, only resend
+             * once per tick. */
+            if (slot->in_use && slot->seq == seq && now > slot->sent)
+                rudp_resend(ni, peer, slot, now);
+        }
+    }
+
+    pthread_mutex_unlock(&ni->udp.rudp.lock);
+}
+
+/**
+ * @brief Retransmit the datagrams whose timer expired, and send the
+ * delayed ACKs.
+ *
+ * Called from the progress thread. Timers are not removed when their
+ * datagram is acknowledged, they are dropped when their spoke comes
+ * around.
+ *
+ * @param[in] ni the network interface.
+ */
+void rudp_progress(ni_t *ni)
+{
+    uint64_t now = rudp_now();
+    struct rudp_peer *peer;
+    uint64_t t;
+
+    if (now == ni->udp.rudp.tick)
+        return;
+
+    pthread_mutex_lock(&ni->udp.rudp.lock);
+
+    t = ni->udp.rudp.tick + 1;
+    if (now - t >= RUDP_WHEEL_SIZE)
+        t = now - RUDP_WHEEL_SIZE + 1;
+
+    for (; t <= now; t++) {
+        struct rudp_spoke *spoke = &ni->udp.rudp.wheel[t &
+                                                       (RUDP_WHEEL_SIZE - 1)];
+        struct rudp_timer *timers = spoke->timers;
+        unsigned int num = spoke->num;
+        unsigned int i;
+
+        /* Retransmissions rearm into the wheel, maybe this spoke. */
+        spoke->timers = NULL;
+        spoke->num = 0;
+        spoke->size = 0;
+
+        for (i = 0; i < num; i++) {
+            struct rudp_timer *timer = &timers[i];
+            struct rudp_peer *peer = timer->peer;
+            struct rudp_slot *slot =
+                &peer->send.slots[timer->seq & (peer->send.size - 1)];
+
+            if (!slot->in_use || slot->seq != timer->seq ||
+                slot->deadline != timer->deadline)
+                continue;
 
-            //now send either the ACK or NACK back
-            if (ni->options & PTL_NI_PHYSICAL) {
-                hdr->h1.src_nid = cpu_to_le32(ni->id.phys.nid);
-                hdr->h1.src_pid = cpu_to_le32(ni->id.phys.pid);
+            if (timer->deadline <= now) {
+                rudp_resend(ni, peer, slot, now);
             } else {
-                hdr->h1.src_rank = cpu_to_le32(ni->id.rank);
+                /* Not yet, put it back. */
+                rudp_add_timer(ni, peer, slot);
             }
-
-            //TODO: strip out the data so we have less network load
-            //      on the ACK/NACK
-            if (buf->type != BUF_UDP_INVALID)
-            sendto(ni->iface->udp.connect_s, buf, sizeof(*buf), 0,
-                   (struct sockaddr *)&temp_conn->sin,
-                   sizeof(*&temp_conn->sin));
-            break;
         }
 
-        default:
-            goto cleanup;
+        free(timers);
+    }
 
+    ni->udp.rudp.tick = now;
 
-    }                                  //end switch
+    while ((peer = ni->udp.rudp.acks)) {
+        ni->udp.rudp.acks = peer->ack_next;
+        peer->ack_queued = 0;
+        if (peer->recv.unacked)
+            rudp_send_ctl(ni, peer, RUDP_ACK, 0);
+    }
 
+    /* Datagrams queued when memory ran out, with nothing in flight
+     * whose acknowledgement would send them. */
+    if (ni->udp.rudp.num_pending) {
+        unsigned int i;
 
-  cleanup:
-    conn_put(temp_conn);
-    if (buf->type != BUF_UDP_RECEIVE) {
-        //horrible hacking the errno return
-        //basically indicate back to the portals lib
-        //that nothing was there.
-        errno = EAGAIN;
-        return -1;
+        for (i = 0; i < RUDP_PEER_HASH_SIZE; i++) {
+            for (peer = ni->udp.rudp.peers[i]; peer; peer = peer->next)
+                rudp_send_pending(ni, peer);
+        }
     }
-    return 0;
+
+    pthread_mutex_unlock(&ni->udp.rudp.lock);
 }
 #endif
 
@@ -237,29 +901,62 @@ int process_rudp_recv_hdr(buf_t *buf, int len, ni_t *ni)
  * @param[in] sockfd The socket to use for the send
  * @param[in] msg    The message to be sent, in strcut msghdr form
  * @param[in] flags  Appropriate flags to pass for the sendmsg operation
- * @param[in] ni     The portals network interface to use 
+ * @param[in] ni     The portals network interface to use
  *
  * @return size      Size of the message sent
  */
 ssize_t ptl_sendmsg(int sockfd, const struct msghdr *msg, int flags, ni_t *ni)
 {
-    ssize_t ret;
 #if !WITH_RUDP
-    ret = sendmsg(sockfd, msg, flags);
+    return sendmsg(sockfd, msg, flags);
 #else
-    //send this reliably
-    int hdr_status;
-    hdr_status =
-        process_rudp_send_hdr((void *)(msg->msg_iov[0].iov_base),
-                              (int)(msg->msg_iov[0].iov_len), ni);
-
-    //begin the send
-    ptl_info("@@@@@@@@@ RUDP sendmsg @@@@@@@@@\n");
-    ret = sendmsg(sockfd, msg, flags);
+    return rudp_send(sockfd, msg, ni);
 #endif
-    return ret;
 }
 
+#if HAVE_SENDMMSG
+/**
+ * @brief Intercept sendmmsg calls for reliability header processing
+ *
+ * Without reliability the whole vector is sent, retrying on partial
+ * sends. With it, each message goes through the send window.
+ *
+ * @param[in] sockfd The socket to use for the send
+ * @param[in] msgvec The messages to be sent
+ * @param[in] vlen   The number of messages
+ * @param[in] flags  Appropriate flags to pass for the sendmmsg operation
+ * @param[in] ni     The portals network interface to use
+ *
+ * @return number of messages sent, or -1 if none could be sent
+ */
+int ptl_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                 int flags, ni_t *ni)
+{
+    unsigned int sent = 0;
+
+#if WITH_RUDP
+    for (sent = 0; sent < vlen; sent++) {
+        if (rudp_send(sockfd, &msgvec[sent].msg_hdr, ni) == -1)
+            return sent ? sent : -1;
+    }
+#else
+    int ret;
+
+    while (sent < vlen) {
+        ret = sendmmsg(sockfd, msgvec + sent, vlen - sent, flags);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            return sent ? sent : -1;
+        }
+        sent += ret;
+    }
+#endif
+
+    return sent;
+}
+#endif
+
 /**
  * @brief Intercept sendto calls for reliability header processing
  *
@@ -273,7 +970,7 @@ ssize_t ptl_sendmsg(int sockfd, const struct msghdr *msg, int flags, ni_t *ni)
  * @param[in] flags      Appropriate flags to pass for the sendmsg operation
  * @param[in] dest_addr  The destination address (struct sockaddr)
  * @param[in] addrlen    The length of the dest_addr struct
- * @param[in] ni         The portals network interface to use  
+ * @param[in] ni         The portals network interface to use
  *
  * @return size          Size of the message sent
  *
@@ -281,97 +978,74 @@ ssize_t ptl_sendmsg(int sockfd, const struct msghdr *msg, int flags, ni_t *ni)
 ssize_t ptl_sendto(int sockfd, buf_t *buf, size_t len, int flags,
                    struct sockaddr * dest_addr, socklen_t addrlen, ni_t *ni)
 {
-    ssize_t ret;
 #if !WITH_RUDP
-    ret = sendto(sockfd, buf, len, flags, dest_addr, addrlen);
+    return sendto(sockfd, buf, len, flags, dest_addr, addrlen);
 #else
-    //send this reliably
-    int hdr_status;
-    hdr_status = process_rudp_send_hdr(buf, len, ni);
-
-    //begin send
-    ptl_info("@@@@@@@@@ RUDP sendto @@@@@@@@@\n");
-    ret = sendto(sockfd, buf, len, flags, dest_addr, addrlen);
-    if (ret == -1)
-        return ret;
-
+    struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = len,
+    };
+    struct msghdr msg = {
+        .msg_name = dest_addr,
+        .msg_namelen = addrlen,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
 
+    return rudp_send(sockfd, &msg, ni);
 #endif
-    return ret;
 }
 
-
 /**
- * @brief Intercept recvmsg calls for reliability header processing
+ * @brief Intercept recvmmsg calls
  *
- * This allows the non-RUDP case to simply pass through to recvmsg
- * RUDP calls have a reliabilty header processed
+ * Without recvmmsg, the messages are received one by one until none
+ * is left, so flags should hold MSG_DONTWAIT.
  *
- * @param[in] sockfd The socket to use for the recv
- * @param[in] msg    The message to be recvd, in strcut msghdr form
- * @param[in] flags  Appropriate flags to pass for the recvmsg operation
- * @param[in] ni     The portals network interface to use 
+ * In builds configured with --enable-rudp-loss, PTL_RUDP_LOSS messages
+ * out of a thousand are dropped, and come back with a length of 0.
  *
- * @return size      Size of the message received
+ * @param[in] sockfd The socket to receive from
+ * @param[in] msgvec The messages to fill
+ * @param[in] vlen   The number of messages
+ * @param[in] flags  Appropriate flags to pass for the recvmmsg operation
+ * @param[in] ni     The portals network interface to use
+ *
+ * @return number of messages received, or -1 on error
  */
-
-ssize_t ptl_recvmsg(int sockfd, struct msghdr *msg, int flags, ni_t *ni)
+int ptl_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                 int flags, ni_t *ni)
 {
-    ssize_t ret;
-#if !WITH_RUDP
-    ret = recvmsg(sockfd, msg, flags);
-#else
-    //send this reliably
-    int hdr_status;
-    ptl_info("@@@@@@@@@ RUDP recvmsg @@@@@@@@@\n");
-    ret = recvmsg(sockfd, msg, flags);
+    int ret;
+
+#if HAVE_RECVMMSG
+    ret = recvmmsg(sockfd, msgvec, vlen, flags, NULL);
     if (ret == -1)
         return ret;
-    if (flags == MSG_PEEK)
-        return ret;
+#else
+    for (ret = 0; (unsigned int)ret < vlen; ret++) {
+        ssize_t len = recvmsg(sockfd, &msgvec[ret].msg_hdr, flags);
 
-    hdr_status =
-        process_rudp_recv_hdr(msg->msg_iov[0].iov_base,
-                              msg->msg_iov[0].iov_len, ni);
+        if (len == -1)
+            break;
+        msgvec[ret].msg_len = len;
+    }
+    if (ret == 0)
+        return -1;
 #endif
-    return ret;
-}
 
-/**
- * @brief Intercept recvfrom calls for reliability header processing
- *
- * This allows the non-RUDP case to simply pass through to recvfrom
- * RUDP calls have a reliabilty header processed
- *
- * @param[in] sockfd     The socket to use for the recv
- * @param[in] buf        A buffer to put the message in
- * @param[in] len        The length of the buffer
- * @param[in] flags      Flags to pass to the recvfrom operation
- * @param[in] src_addr   The source address (struct sockaddr)
- * @param[in] addrlen    The length of the src_addr struct
- * @param[in] ni         The portals network interface to use  
- *  
- * @return size          Size of the message received
- *
- */
-ssize_t ptl_recvfrom(int sockfd, buf_t *buf, size_t len, int flags,
-                     struct sockaddr * src_addr, socklen_t *addrlen, ni_t *ni)
-{
-    ssize_t ret;
-#if !WITH_RUDP
-    ret = recvfrom(sockfd, buf, len, flags, src_addr, addrlen);
-#else
-    //recv this reliably
-    int hdr_status;
-    ret = recvfrom(sockfd, buf, len, flags, src_addr, addrlen);
-    //error processing, just hand the error back to the caller
-    if (ret == -1 || ret == 0)
-        return ret;
-    if (flags == MSG_PEEK)
-        return ret;
+#if WITH_RUDP && WITH_RUDP_LOSS
+    long loss = get_param(PTL_RUDP_LOSS);
 
-    hdr_status = process_rudp_recv_hdr(buf, len, ni);
+    if (loss) {
+        int i;
 
+        for (i = 0; i < ret; i++) {
+            if (random() % 1000 < loss)
+                msgvec[i].msg_len = 0;
+        }
+    }
 #endif
+
     return ret;
 }
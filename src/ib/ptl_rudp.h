@@ -7,14 +7,27 @@
 ssize_t ptl_sendmsg(int sockfd, const struct msghdr *msg, int flags,
                     ni_t *ni);
 
+#if HAVE_SENDMMSG
+int ptl_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                 int flags, ni_t *ni);
+#endif
+
 ssize_t ptl_sendto(int sockfd, buf_t *buf, size_t len, int flags,
                    struct sockaddr *dest_addr, socklen_t addrlen, ni_t *ni);
 
-ssize_t ptl_recvfrom(int sockfd, buf_t *buf, size_t len, int flags,
-                     struct sockaddr *src_addr, socklen_t *addrlen, ni_t *ni);
+#if !HAVE_RECVMMSG
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
 
-ssize_t ptl_recvmsg(int sockfd, struct msghdr *msg, int flags, ni_t *ni);
+int ptl_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                 int flags, ni_t *ni);
 
-int process_rudp_recv_hdr(buf_t *buf, int len, ni_t *ni);
+#if WITH_RUDP
+buf_t *rudp_recv(ni_t *ni, buf_t *buf);
 
-int process_rudp_send_hdr(buf_t *buf, int len, ni_t *ni);
+void rudp_recv_ctl(ni_t *ni, const void *data, size_t len,
+                   const struct sockaddr_in *src);
+#endif
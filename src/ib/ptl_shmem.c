@@ -4,15 +4,20 @@
 
 #include "ptl_loc.h"
 
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <mntent.h>
+#if HAVE_PROCESS_VM_READV
+#include <sys/uio.h>
+#endif
+
 /**
- * @brief Send a message using shared memory.
+ * @brief Prepare a message before enqueuing it.
  *
  * @param[in] buf
- * @param[in] signaled
- *
- * @return status
  */
-static int shmem_send_message(buf_t *buf, int from_init)
+static void shmem_prepare_send(buf_t *buf)
 {
     /* Keep a reference on the buffer so it doesn't get freed. will be
      * returned by the remote side with type=BUF_SHMEM_RETURN. */
@@ -26,12 +31,69 @@ static int shmem_send_message(buf_t *buf, int from_init)
     }
 
     buf->shmem.index_owner = buf->obj.obj_ni->mem.index;
+}
+
+/**
+ * @brief Send a message using shared memory.
+ *
+ * @param[in] buf
+ * @param[in] signaled
+ *
+ * @return status
+ */
+static int shmem_send_message(buf_t *buf, int from_init)
+{
+    shmem_prepare_send(buf);
 
     shmem_enqueue(buf->obj.obj_ni, buf, buf->dest.shmem.local_rank);
 
     return PTL_OK;
 }
 
+/**
+ * @brief Send the requests of a bundle using shared memory.
+ *
+ * The requests for the same destination are enqueued together, in
+ * order.
+ *
+ * @param[in] ni
+ * @param[in] bufs
+ * @param[in] num
+ *
+ * @return the number of requests sent
+ */
+static int shmem_send_messages(ni_t *ni, buf_t **bufs, int num)
+{
+    buf_t *group[num];
+    char done[num];
+    int i;
+    int j;
+
+    for (i = 0; i < num; i++) {
+        shmem_prepare_send(bufs[i]);
+        done[i] = 0;
+    }
+
+    for (i = 0; i < num; i++) {
+        ptl_rank_t dest = bufs[i]->dest.shmem.local_rank;
+        int n = 0;
+
+        if (done[i])
+            continue;
+
+        for (j = i; j < num; j++) {
+            if (!done[j] && bufs[j]->dest.shmem.local_rank == dest) {
+                group[n++] = bufs[j];
+                done[j] = 1;
+            }
+        }
+
+        shmem_enqueue_list(ni, group, n, dest);
+    }
+
+    return num;
+}
+
 static void shmem_set_send_flags(buf_t *buf, int can_signal)
 {
     /* The data is always in the buffer. */
@@ -60,6 +122,55 @@ static int shmem_init_connect(ni_t *ni, conn_t *conn)
     return PTL_OK;
 }
 
+/**
+ * @brief Copy the data of a put to an eager buffer, and append its
+ * data segment to the request message.
+ *
+ * The target copies the data from there as soon as it gets the
+ * request, instead of going back to the initiator's memory.
+ *
+ * @param[in] data the data segment
+ * @param[in] md the md that contains the data
+ * @param[in] offset the offset into the md
+ * @param[in] length the length of the data
+ * @param[in] buf the buf the add the data segment to
+ *
+ * @return status, PTL_NO_SPACE if all the eager buffers are in use
+ */
+static int append_init_data_eager(data_t *data, md_t *md, ptl_size_t offset,
+                                  ptl_size_t length, buf_t *buf)
+{
+    ni_t *ni = obj_to_ni(md);
+    void *eb;
+    int err;
+
+    eb = ll_dequeue_obj(&ni->shmem.eager.free_list);
+    if (!eb)
+        return PTL_NO_SPACE;
+
+    if (md->num_iov) {
+        err =
+            iov_copy_out(eb, md->start, NULL, md->num_iov, offset, length);
+        if (err) {
+            ll_enqueue_obj(&ni->shmem.eager.free_list, eb);
+            return err;
+        }
+    } else {
+        memcpy(eb, md->start + offset, length);
+    }
+
+    data->data_fmt = DATA_FMT_EAGER;
+    data->eager.data_length = length;
+    data->eager.offset = eb - ni->shmem.comm_pad;
+
+    /* Given back in buf_cleanup(). */
+    buf->transfer.eager.buf = eb;
+
+    buf->length += sizeof(*data);
+
+    return PTL_OK;
+}
+
 #if USE_KNEM
 static void append_init_data_shmem_direct(data_t *data, mr_t *mr, void *addr,
                                           ptl_size_t length, buf_t *buf)
@@ -125,6 +236,16 @@ static int shmem_init_prepare_transfer(md_t *md, data_dir_t dir,
     ptl_size_t iov_start = 0;
     ptl_size_t iov_offset = 0;
 
+    /* A mid-size put goes through an eager buffer, if one is free. */
+    if (dir == DATA_DIR_OUT && length > get_param(PTL_MAX_INLINE_DATA) &&
+        length <= get_param(PTL_EAGER_LIMIT)) {
+        err = append_init_data_eager(data, md, offset, length, buf);
+        if (err != PTL_NO_SPACE)
+            return err;
+
+        err = PTL_OK;
+    }
+
     if (length <= get_param(PTL_MAX_INLINE_DATA)) {
         err =
             append_immediate_data(md->start, NULL, md->num_iov, dir, offset,
@@ -200,43 +321,78 @@ static int knem_tgt_data_out(buf_t *buf, data_t *data)
 }
 
 #else
-static void attach_bounce_buffer(buf_t *buf, data_t *data)
+/**
+ * @brief Attach the bounce buffers of a transfer.
+ *
+ * The first buffer is waited for, while the others, up to
+ * PTL_BOUNCE_PIPELINE, are only taken if they are free. The transfer
+ * is split in chunks of at least a page, so that small transfers
+ * don't tie up buffers they can't use.
+ *
+ * @param[in] buf the initiator buf
+ * @param[in] data the data segment of the request
+ * @param[in] length the length of the transfer
+ */
+static void attach_bounce_buffers(buf_t *buf, data_t *data,
+                                  ptl_size_t length)
 {
-    void *bb;
     ni_t *ni = obj_to_ni(buf);
+    struct noknem *noknem = &data->noknem;
+    unsigned int num_bufs;
+    ptl_size_t chunk_size;
+    void *bb;
 
-    while ((bb =
-            ll_dequeue_obj_alien(&ni->shmem.bounce_buf.head->free_list,
-                                 ni->shmem.bounce_buf.head,
-                                 ni->shmem.bounce_buf.head->head_index0)) ==
-           NULL)
-        SPINLOCK_BODY();
+    num_bufs = (length + pagesize - 1) / pagesize;
+    if (num_bufs > get_param(PTL_BOUNCE_PIPELINE))
+        num_bufs = get_param(PTL_BOUNCE_PIPELINE);
+
+    noknem->num_bufs = 0;
+    while (noknem->num_bufs < num_bufs) {
+        bb = ll_dequeue_obj_alien(&ni->shmem.bounce_buf.head->free_list,
+                                  ni->shmem.bounce_buf.head,
+                                  ni->shmem.bounce_buf.head->head_index0);
+        if (bb == NULL) {
+            if (noknem->num_bufs)
+                break;
+
+            SPINLOCK_BODY();
+            continue;
+        }
 
-    buf->transfer.noknem.data = bb;
-    buf->transfer.noknem.data_length = ni->shmem.bounce_buf.buf_size;
-    buf->transfer.noknem.bounce_offset =
-        bb - (void *)ni->shmem.bounce_buf.head;
+        buf->transfer.noknem.bufs[noknem->num_bufs] = bb;
+        noknem->buf_index[noknem->num_bufs] =
+            (bb - ni->shmem.bounce_buf.bbs) / ni->shmem.bounce_buf.buf_size;
+        noknem->num_bufs++;
+    }
 
-    data->noknem.bounce_offset = buf->transfer.noknem.bounce_offset;
+    /* Spread the transfer over all the buffers. */
+    chunk_size = (length + noknem->num_bufs - 1) / noknem->num_bufs;
+    chunk_size = ROUND_UP(chunk_size, CACHELINE_WIDTH);
+    if (chunk_size > ni->shmem.bounce_buf.buf_size)
+        chunk_size = ni->shmem.bounce_buf.buf_size;
+
+    noknem->chunk_size = chunk_size;
+    noknem->produced = 0;
+    noknem->consumed = 0;
+    noknem->target_done = 0;
+    noknem->init_done = 0;
 }
 
 static void append_init_data_noknem_iovec(data_t *data, md_t *md,
                                           int iov_start, int num_iov,
+                                          ptl_size_t iov_offset,
                                           ptl_size_t length, buf_t *buf)
 {
     data->data_fmt = DATA_FMT_NOKNEM;
 
-    data->noknem.target_done = 0;
-    data->noknem.init_done = 0;
-
-    buf->transfer.noknem.transfer_state_expected = 0;   /* always the initiator here */
+    buf->transfer.noknem.target = 0;
     buf->transfer.noknem.noknem = &data->noknem;
 
-    attach_bounce_buffer(buf, data);
+    attach_bounce_buffers(buf, data, length);
 
     buf->transfer.noknem.num_iovecs = num_iov;
     buf->transfer.noknem.iovecs = &((ptl_iovec_t *)md->start)[iov_start];
-    buf->transfer.noknem.offset = 0;
+    buf->transfer.noknem.offset = iov_offset;
 
     buf->transfer.noknem.length_left = length;
 
@@ -248,13 +404,10 @@ static void append_init_data_noknem_direct(data_t *data, mr_t *mr, void *addr,
 {
     data->data_fmt = DATA_FMT_NOKNEM;
 
-    data->noknem.target_done = 0;
-    data->noknem.init_done = 0;
-
-    buf->transfer.noknem.transfer_state_expected = 0;   /* always the initiator here */
+    buf->transfer.noknem.target = 0;
     buf->transfer.noknem.noknem = &data->noknem;
 
-    attach_bounce_buffer(buf, data);
+    attach_bounce_buffers(buf, data, length);
 
     /* Describes local memory */
     buf->transfer.noknem.my_iovec.iov_base = addr;
@@ -269,6 +422,73 @@ static void append_init_data_noknem_direct(data_t *data, mr_t *mr, void *addr,
     buf->length += sizeof(*data);
 }
 
+#if HAVE_PROCESS_VM_READV
+/**
+ * @brief Build and append a cross memory attach data segment to a
+ * request message.
+ *
+ * The target copies directly from or to the MD. When the iovecs don't
+ * fit in the buf, the target reads them from the MD first.
+ *
+ * @param[in] data the data segment
+ * @param[in] md the md that contains the data
+ * @param[in] offset the offset into the md
+ * @param[in] length the length of the data
+ * @param[in] buf the buf the add the data segment to
+ *
+ * @return status
+ */
+static int append_init_data_cma(data_t *data, md_t *md, ptl_size_t offset,
+                                ptl_size_t length, buf_t *buf)
+{
+    ni_t *ni = obj_to_ni(md);
+
+    data->cma.pid = ni->shmem.pid;
+
+    if (md->options & PTL_IOVEC) {
+        ptl_iovec_t *iovecs = md->start;
+        ptl_size_t iov_start = 0;
+        ptl_size_t iov_offset = 0;
+        int num_sge;
+
+        num_sge =
+            iov_count_elem(iovecs, md->num_iov, offset, length, &iov_start,
+                           &iov_offset);
+        if (num_sge < 0) {
+            WARN();
+            return PTL_FAIL;
+        }
+
+        data->cma.num_iovecs = num_sge;
+        data->cma.offset = iov_offset;
+
+        if (num_sge > get_param(PTL_MAX_INLINE_SGE)) {
+            data->data_fmt = DATA_FMT_CMA_INDIRECT;
+            data->cma.iovec[0].iov_base = &iovecs[iov_start];
+            data->cma.iovec[0].iov_len = num_sge * sizeof(ptl_iovec_t);
+
+            buf->length += sizeof(*data) + sizeof(ptl_iovec_t);
+        } else {
+            data->data_fmt = DATA_FMT_CMA;
+            memcpy(data->cma.iovec, &iovecs[iov_start],
+                   num_sge * sizeof(ptl_iovec_t));
+
+            buf->length += sizeof(*data) + num_sge * sizeof(ptl_iovec_t);
+        }
+    } else {
+        data->data_fmt = DATA_FMT_CMA;
+        data->cma.num_iovecs = 1;
+        data->cma.offset = 0;
+        data->cma.iovec[0].iov_base = md->start + offset;
+        data->cma.iovec[0].iov_len = length;
+
+        buf->length += sizeof(*data) + sizeof(ptl_iovec_t);
+    }
+
+    return PTL_OK;
+}
+#endif
+
 /**
  * @brief Build and append a data segment to a request message.
  *
@@ -286,22 +506,32 @@ static int noknem_init_prepare_transfer(md_t *md, data_dir_t dir,
                                         buf_t *buf)
 {
     int err = PTL_OK;
-    req_hdr_t *hdr = (req_hdr_t *) buf->data;
     data_t *data = (data_t *)(buf->data + buf->length);
     int num_sge;
     ptl_size_t iov_start = 0;
     ptl_size_t iov_offset = 0;
 
+    /* A mid-size put goes through an eager buffer, if one is free. */
+    if (dir == DATA_DIR_OUT && length > get_param(PTL_MAX_INLINE_DATA) &&
+        length <= get_param(PTL_EAGER_LIMIT)) {
+        err = append_init_data_eager(data, md, offset, length, buf);
+        if (err != PTL_NO_SPACE)
+            return err;
+
+        err = PTL_OK;
+    }
+
     if (length <= get_param(PTL_MAX_INLINE_DATA)) {
         err =
             append_immediate_data(md->start, NULL, md->num_iov, dir, offset,
                                   length, buf);
-    } else {
-        if (dir == DATA_DIR_IN)
-            buf->data_in->noknem.state = 2;
-        else
-            buf->data_out->noknem.state = 0;
-
+    }
+#if HAVE_PROCESS_VM_READV
+    else if (obj_to_ni(md)->shmem.cma) {
+        err = append_init_data_cma(data, md, offset, length, buf);
+    }
+#endif
+    else {
         if (md->options & PTL_IOVEC) {
             ptl_iovec_t *iovecs = md->start;
 
@@ -316,12 +546,7 @@ static int noknem_init_prepare_transfer(md_t *md, data_dir_t dir,
             }
 
             append_init_data_noknem_iovec(data, md, iov_start, num_sge,
-                                          length, buf);
-
-            /* @todo this is completely bogus */
-            /* Adjust the header offset for iov start. */
-            hdr->roffset =
-                cpu_to_le64(le64_to_cpu(hdr->roffset) - iov_offset);
+                                          iov_offset, length, buf);
         } else {
             void *addr;
             mr_t *mr;
@@ -343,69 +568,245 @@ static int noknem_init_prepare_transfer(md_t *md, data_dir_t dir,
     return err;
 }
 
+#if HAVE_PROCESS_VM_READV
+/* Number of segments copied by a single system call. */
+#define CMA_IOV_MAX (64)
+
+/**
+ * @brief Copy between the initiator and the LE/ME with cross memory
+ * attach.
+ *
+ * The local and remote iovecs are cut into pairs of segments of the
+ * same length, and many pairs are copied at once.
+ *
+ * @param[in] buf
+ *
+ * @return status
+ */
+static int cma_do_transfer(buf_t *buf)
+{
+    me_t *me = buf->me;
+    ptl_size_t *resid =
+        buf->rdma_dir == DATA_DIR_IN ? &buf->put_resid : &buf->get_resid;
+    ptl_iovec_t my_iovec;
+    const ptl_iovec_t *loc;
+    ptl_size_t num_loc;
+    ptl_size_t loc_off = buf->moffset;
+    const ptl_iovec_t *rem = buf->transfer.cma.rem_iovecs;
+    ptl_size_t num_rem = buf->transfer.cma.num_rem_iovecs;
+    ptl_size_t rem_off = buf->transfer.cma.rem_off;
+    struct iovec local[CMA_IOV_MAX];
+    struct iovec remote[CMA_IOV_MAX];
+
+    if (me->num_iov) {
+        loc = me->start;
+        num_loc = me->num_iov;
+    } else {
+        my_iovec.iov_base = me->start;
+        my_iovec.iov_len = me->length;
+        loc = &my_iovec;
+        num_loc = 1;
+    }
+
+    /* Skip to the first byte on both sides. */
+    while (num_loc && loc_off >= loc->iov_len) {
+        loc_off -= loc->iov_len;
+        loc++;
+        num_loc--;
+    }
+
+    while (num_rem && rem_off >= rem->iov_len) {
+        rem_off -= rem->iov_len;
+        rem++;
+        num_rem--;
+    }
+
+    while (*resid) {
+        ptl_size_t total = 0;
+        ssize_t ret;
+        int n = 0;
+
+        while (n < CMA_IOV_MAX && total < *resid && num_loc && num_rem) {
+            ptl_size_t len = *resid - total;
+
+            if (len > loc->iov_len - loc_off)
+                len = loc->iov_len - loc_off;
+            if (len > rem->iov_len - rem_off)
+                len = rem->iov_len - rem_off;
+
+            local[n].iov_base = loc->iov_base + loc_off;
+            local[n].iov_len = len;
+            remote[n].iov_base = rem->iov_base + rem_off;
+            remote[n].iov_len = len;
+            n++;
+            total += len;
+
+            loc_off += len;
+            if (loc_off == loc->iov_len) {
+                loc++;
+                num_loc--;
+                loc_off = 0;
+            }
+
+            rem_off += len;
+            if (rem_off == rem->iov_len) {
+                rem++;
+                num_rem--;
+                rem_off = 0;
+            }
+        }
+
+        if (total == 0) {
+            /* One side is shorter than the transfer. */
+            WARN();
+            return PTL_FAIL;
+        }
+
+        if (buf->rdma_dir == DATA_DIR_IN)
+            ret = process_vm_readv(buf->transfer.cma.pid, local, n, remote,
+                                   n, 0);
+        else
+            ret = process_vm_writev(buf->transfer.cma.pid, local, n, remote,
+                                    n, 0);
+
+        if (ret != total) {
+            ptl_warn("cross memory attach copy failed (%d)\n", errno);
+            return PTL_FAIL;
+        }
+
+        *resid -= total;
+    }
+
+    return PTL_OK;
+}
+
+/**
+ * @brief Prepare the target of a cross memory attach transfer.
+ *
+ * @param[in] buf
+ * @param[in] data the data segment of the request
+ *
+ * @return the next state
+ */
+static int cma_tgt_data_out(buf_t *buf, data_t *data)
+{
+    buf->transfer.cma.pid = data->cma.pid;
+    buf->transfer.cma.rem_off = data->cma.offset;
+    buf->transfer.cma.num_rem_iovecs = data->cma.num_iovecs;
+
+    if (data->data_fmt == DATA_FMT_CMA) {
+        buf->transfer.cma.rem_iovecs = data->cma.iovec;
+    } else {
+        /* Read the iovecs from the initiator's MD first. */
+        struct iovec local;
+        struct iovec remote;
+
+        local.iov_len = data->cma.iovec[0].iov_len;
+        local.iov_base = malloc(local.iov_len);
+        if (!local.iov_base) {
+            WARN();
+            return STATE_TGT_ERROR;
+        }
+
+        remote.iov_base = data->cma.iovec[0].iov_base;
+        remote.iov_len = local.iov_len;
+
+        if (process_vm_readv(data->cma.pid, &local, 1, &remote, 1, 0) !=
+            local.iov_len) {
+            ptl_warn("cross memory attach copy failed (%d)\n", errno);
+            free(local.iov_base);
+            return STATE_TGT_ERROR;
+        }
+
+        /* Freed once the transfer is over. */
+        buf->indir_sge = local.iov_base;
+        buf->transfer.cma.rem_iovecs = local.iov_base;
+    }
+
+    return STATE_TGT_RDMA;
+}
+#endif
+
 static int noknem_do_transfer(buf_t *buf)
 {
     struct noknem *noknem = buf->transfer.noknem.noknem;
     ptl_size_t *resid =
         buf->rdma_dir == DATA_DIR_IN ? &buf->put_resid : &buf->get_resid;
+    unsigned int slot;
     ptl_size_t to_copy;
-    int err;
+    int err = PTL_OK;
 
-    if (noknem->state != 2)
-        return PTL_OK;
+#if HAVE_PROCESS_VM_READV
+    data_t *data =
+        buf->rdma_dir == DATA_DIR_IN ? buf->data_in : buf->data_out;
+
+    if (data->data_fmt != DATA_FMT_NOKNEM)
+        return cma_do_transfer(buf);
+#endif
 
-    if (noknem->init_done) {
-        assert(noknem->target_done);
+    /* Waiting for the initiator to be done. */
+    if (noknem->target_done)
         return PTL_OK;
-    }
 
-    noknem->state = 3;
+    if (buf->rdma_dir == DATA_DIR_IN) {
+        /* Put: drain the bounce buffers the initiator has filled. */
+        while (*resid && noknem->consumed != noknem->produced) {
+            __sync_synchronize();
 
-    if (*resid) {
-        if (buf->rdma_dir == DATA_DIR_IN) {
-            to_copy = noknem->length;
+            slot = noknem->consumed % noknem->num_bufs;
+            to_copy = noknem->chunk_size;
             if (to_copy > *resid)
                 to_copy = *resid;
 
             err =
-                iov_copy_in(buf->transfer.noknem.data,
+                iov_copy_in(buf->transfer.noknem.bufs[slot],
                             buf->transfer.noknem.iovecs, NULL,
                             buf->transfer.noknem.num_iovecs,
                             buf->transfer.noknem.offset, to_copy);
-        } else {
-            to_copy = buf->transfer.noknem.data_length;
+
+            /* That should never happen since all lengths were properly
+             * computed before entering. */
+            assert(err == PTL_OK);
+
+            buf->transfer.noknem.offset += to_copy;
+            *resid -= to_copy;
+
+            /* Give the buffer back to the initiator. */
+            __sync_synchronize();
+            noknem->consumed++;
+        }
+    } else {
+        /* Get: fill the bounce buffers the initiator has drained. */
+        while (*resid &&
+               noknem->produced - noknem->consumed < noknem->num_bufs) {
+            __sync_synchronize();
+
+            slot = noknem->produced % noknem->num_bufs;
+            to_copy = noknem->chunk_size;
             if (to_copy > *resid)
                 to_copy = *resid;
 
             err =
-                iov_copy_out(buf->transfer.noknem.data,
+                iov_copy_out(buf->transfer.noknem.bufs[slot],
                              buf->transfer.noknem.iovecs, NULL,
                              buf->transfer.noknem.num_iovecs,
                              buf->transfer.noknem.offset, to_copy);
+            assert(err == PTL_OK);
 
-            noknem->length = to_copy;
-        }
-
-        /* That should never happen since all lengths were properly
-         * computed before entering. */
-        assert(err == PTL_OK);
+            buf->transfer.noknem.offset += to_copy;
+            *resid -= to_copy;
 
-    } else {
-        /* Dropped case. Nothing to transfer, but the buffer must
-         * still be returned. */
-        to_copy = 0;
-        err = PTL_OK;
+            /* Tell the initiator the data is ready. */
+            __sync_synchronize();
+            noknem->produced++;
+        }
     }
 
-    buf->transfer.noknem.offset += to_copy;
-    *resid -= to_copy;
-
-    if (*resid == 0)
+    /* Also the dropped case, where nothing is transfered. */
+    if (*resid == 0) {
+        __sync_synchronize();
         noknem->target_done = 1;
-
-    /* Tell the initiator the buffer is his again. */
-    __sync_synchronize();
-    noknem->state = 0;
+    }
 
     return err;
 }
@@ -413,6 +814,13 @@ static int noknem_do_transfer(buf_t *buf)
 static int noknem_tgt_data_out(buf_t *buf, data_t *data)
 {
     ni_t *ni = obj_to_ni(buf);
+    unsigned int i;
+
+#if HAVE_PROCESS_VM_READV
+    if (data->data_fmt == DATA_FMT_CMA ||
+        data->data_fmt == DATA_FMT_CMA_INDIRECT)
+        return cma_tgt_data_out(buf, data);
+#endif
 
     if (data->data_fmt != DATA_FMT_NOKNEM) {
         assert(0);
@@ -420,7 +828,7 @@ static int noknem_tgt_data_out(buf_t *buf, data_t *data)
         return STATE_TGT_ERROR;
     }
 
-    buf->transfer.noknem.transfer_state_expected = 2;   /* always the target here */
+    buf->transfer.noknem.target = 1;
     buf->transfer.noknem.noknem = &data->noknem;
 
     if ((buf->rdma_dir == DATA_DIR_IN && buf->put_resid) ||
@@ -439,12 +847,36 @@ static int noknem_tgt_data_out(buf_t *buf, data_t *data)
 
     buf->transfer.noknem.offset = buf->moffset;
     buf->transfer.noknem.length_left = buf->get_resid;
-    buf->transfer.noknem.data =
-        (void *)ni->shmem.bounce_buf.head + data->noknem.bounce_offset;
-    buf->transfer.noknem.data_length = ni->shmem.bounce_buf.buf_size;
+    for (i = 0; i < data->noknem.num_bufs; i++)
+        buf->transfer.noknem.bufs[i] = ni->shmem.bounce_buf.bbs +
+            data->noknem.buf_index[i] * ni->shmem.bounce_buf.buf_size;
+
+    /* The initiator of a get doesn't know how much it will
+     * receive. */
+    if (buf->rdma_dir == DATA_DIR_OUT)
+        data->noknem.length = buf->get_resid;
 
     return STATE_TGT_START_COPY;
 }
+
+/**
+ * @brief Queue a transfer going through the bounce buffers.
+ *
+ * The progress thread takes it from there, and advances it until both
+ * sides are done.
+ *
+ * @param[in] ni the NI
+ * @param[in] buf the initiator or target buf of the transfer
+ */
+void noknem_start(ni_t *ni, buf_t *buf)
+{
+    PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
+    list_add_tail(&buf->list, &ni->shmem.noknem_new);
+    PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
+
+    /* The peer won't ring the doorbell for it. */
+    progress_wake(ni);
+}
 #endif
 
 struct transport transport_shmem = {
@@ -452,6 +884,7 @@ struct transport transport_shmem = {
     .buf_alloc = sbuf_alloc,
     .init_connect = shmem_init_connect,
     .send_message = shmem_send_message,
+    .send_messages = shmem_send_messages,
     .set_send_flags = shmem_set_send_flags,
 #if USE_KNEM
     .init_prepare_transfer = shmem_init_prepare_transfer,
@@ -464,6 +897,200 @@ struct transport transport_shmem = {
 #endif
 };
 
+/**
+ * @brief Build the address of the doorbell of a local rank.
+ *
+ * Doorbells are abstract unix sockets named after the comm pad.
+ *
+ * @param[in] ni
+ * @param[in] index the local index of the rank
+ * @param[out] addr the address
+ *
+ * @return the length of the address
+ */
+static socklen_t shmem_bell_addr(const ni_t *ni, ptl_pid_t index,
+                                 struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "%s-bell-%d",
+             ni->shmem.bell_name, index);
+
+    return offsetof(struct sockaddr_un, sun_path) + 1 +
+        strlen(addr->sun_path + 1);
+}
+
+/**
+ * @brief Create the doorbell of this rank.
+ *
+ * Without a doorbell the progress thread never sleeps while the
+ * mailbox is in use.
+ *
+ * @param[in] ni
+ */
+static void shmem_bell_init(ni_t *ni)
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+
+    ni->shmem.bell_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK |
+                               SOCK_CLOEXEC, 0);
+    if (ni->shmem.bell_fd == -1) {
+        ptl_warn("cannot create the shared memory doorbell (%d)\n", errno);
+        return;
+    }
+
+    len = shmem_bell_addr(ni, ni->mem.index, &addr);
+    if (bind(ni->shmem.bell_fd, (struct sockaddr *)&addr, len) == -1) {
+        ptl_warn("cannot bind the shared memory doorbell (%d)\n", errno);
+        close(ni->shmem.bell_fd);
+        ni->shmem.bell_fd = -1;
+    }
+}
+
+/**
+ * @brief Find the mailbox of a local rank.
+ *
+ * @param[in] ni
+ * @param[in] index the local index of the rank
+ *
+ * @return the mailbox, in the comm pad
+ */
+static inline struct shmem_mailbox *shmem_mailbox(const ni_t *ni,
+                                                  ptl_pid_t index)
+{
+    return (struct shmem_mailbox *)(ni->shmem.first_mailbox +
+                                    ni->shmem.per_proc_comm_buf_size *
+                                    index);
+}
+
+/**
+ * @brief Find the ring of a mailbox written by a given local rank.
+ *
+ * @param[in] ni
+ * @param[in] mailbox the mailbox of the receiver
+ * @param[in] index the local index of the sender
+ *
+ * @return the ring, in the comm pad
+ */
+static inline ring_t *shmem_mailbox_ring(const ni_t *ni,
+                                         struct shmem_mailbox *mailbox,
+                                         ptl_pid_t index)
+{
+    return (ring_t *)((void *)mailbox + ni->shmem.mailbox_size +
+                      ni->shmem.ring_size * index);
+}
+
+/**
+ * @brief Tell a local rank that our ring holds bufs, and wake up its
+ * progress thread.
+ *
+ * The ready bit is only written when it is clear, so that the senders
+ * of a busy receiver don't fight for the bitmap. Waking up is only
+ * needed if the receiver announced that it may sleep. A lost ring is
+ * harmless, the sleeper wakes up on its own after a while.
+ *
+ * @param[in] ni
+ * @param[in] mailbox the mailbox of the rank, just enqueued to
+ * @param[in] dest the local index of the rank
+ */
+static void shmem_notify(ni_t *ni, struct shmem_mailbox *mailbox,
+                         ptl_pid_t dest)
+{
+    unsigned long *word = &mailbox->ready[ni->mem.index / BITS_PER_LONG];
+    unsigned long bit = 1UL << (ni->mem.index % BITS_PER_LONG);
+    struct sockaddr_un addr;
+    socklen_t len;
+    char c = 0;
+
+    /* The new tail must be visible before the bit is read, and the bit
+     * before sleeping is read. See shmem_ring_pop(). */
+    __sync_synchronize();
+
+    if (!(*(volatile unsigned long *)word & bit))
+        __sync_fetch_and_or(word, bit);
+
+    if (likely(!mailbox->sleeping) || ni->shmem.bell_fd == -1)
+        return;
+
+    len = shmem_bell_addr(ni, dest, &addr);
+    (void)sendto(ni->shmem.bell_fd, &c, sizeof(c), MSG_DONTWAIT,
+                 (struct sockaddr *)&addr, len);
+}
+
+#if !USE_KNEM
+/**
+ * @brief Find whether the local ranks can use cross memory attach.
+ *
+ * Every rank tries to copy a word from each local rank, which fails if
+ * the kernel lacks it or if ptrace restrictions forbid it. It is only
+ * used if all the ranks succeeded, so that they all agree on it.
+ *
+ * @param[in] ni
+ * @param[in] pid_table the PID table, every rank being in it
+ */
+static void shmem_cma_setup(ni_t *ni, struct shmem_pid_table *pid_table)
+{
+    int usable = 0;
+#if HAVE_PROCESS_VM_READV
+    struct iovec local;
+    struct iovec remote;
+    int probe;
+    int i;
+
+    usable = get_param(PTL_SHMEM_CMA);
+
+    for (i = 0; i < ni->mem.node_size && usable; i++) {
+        local.iov_base = &probe;
+        local.iov_len = sizeof(probe);
+        remote.iov_base = pid_table[i].cma_probe;
+        remote.iov_len = sizeof(probe);
+
+        if (process_vm_readv(pid_table[i].os_pid, &local, 1, &remote, 1,
+                             0) != sizeof(probe))
+            usable = 0;
+    }
+
+    pid_table[ni->mem.index].cma = usable ? 2 : 1;
+    __sync_synchronize();
+
+    for (i = 0; i < ni->mem.node_size; i++) {
+        while (pid_table[i].cma == 0)
+            SPINLOCK_BODY();
+
+        if (pid_table[i].cma != 2)
+            usable = 0;
+    }
+
+    if (!usable && get_param(PTL_SHMEM_CMA))
+        ptl_info("cross memory attach not usable, using bounce buffers\n");
+#endif
+
+    ni->shmem.cma = usable;
+}
+#endif
+
+/**
+ * @brief Remove the comm pad file, once every rank has mapped it or
+ * on failure.
+ *
+ * @param[in] ni
+ */
+static void unlink_commpad(ni_t *ni)
+{
+    if (ni->shmem.comm_pad_path) {
+        unlink(ni->shmem.comm_pad_path);
+        free(ni->shmem.comm_pad_path);
+        ni->shmem.comm_pad_path = NULL;
+    }
+
+    if (ni->shmem.comm_pad_shm_name) {
+        shm_unlink(ni->shmem.comm_pad_shm_name);
+        free(ni->shmem.comm_pad_shm_name);
+        ni->shmem.comm_pad_shm_name = NULL;
+    }
+}
+
 /**
  * @brief Cleanup shared memory resources.
  *
@@ -471,6 +1098,8 @@ struct transport transport_shmem = {
  */
 static void release_shmem_resources(ni_t *ni)
 {
+    int i;
+
     pool_fini(&ni->sbuf_pool);
 
     if (ni->shmem.comm_pad != MAP_FAILED) {
@@ -478,13 +1107,23 @@ static void release_shmem_resources(ni_t *ni)
         ni->shmem.comm_pad = MAP_FAILED;
     }
 
-    if (ni->shmem.comm_pad_shm_name) {
-        /* Destroy the mmaped file so it doesn't pollute.
-         * All ranks try it in case rank 0 died. */
-        shm_unlink(ni->shmem.comm_pad_shm_name);
+    /* Destroy the mmaped file so it doesn't pollute.
+     * All ranks try it in case rank 0 died. */
+    unlink_commpad(ni);
 
-        free(ni->shmem.comm_pad_shm_name);
-        ni->shmem.comm_pad_shm_name = NULL;
+    if (ni->shmem.bell_fd != -1) {
+        close(ni->shmem.bell_fd);
+        ni->shmem.bell_fd = -1;
+    }
+
+    free(ni->shmem.bell_name);
+    ni->shmem.bell_name = NULL;
+
+    if (ni->shmem.ring_locks) {
+        for (i = 0; i < ni->mem.node_size; i++)
+            PTL_FASTLOCK_DESTROY(&ni->shmem.ring_locks[i]);
+        free((void *)ni->shmem.ring_locks);
+        ni->shmem.ring_locks = NULL;
     }
 
     knem_fini(ni);
@@ -494,6 +1133,112 @@ static void release_shmem_resources(ni_t *ni)
 #endif
 }
 
+/**
+ * @brief Return the size of the transparent huge pages.
+ *
+ * @return the size in bytes
+ */
+static size_t thp_size(void)
+{
+    FILE *f;
+    unsigned long size = 0;
+
+    f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    if (f) {
+        if (fscanf(f, "%lu", &size) != 1)
+            size = 0;
+        fclose(f);
+    }
+
+    if (size < pagesize)
+        size = 2 * 1024 * 1024;
+
+    return size;
+}
+
+/**
+ * @brief Find a writable hugetlbfs mount point.
+ *
+ * @param[out] dir the mount point
+ * @param[in] len the size of dir
+ *
+ * @return the page size of that file system, or 0 if none was found.
+ */
+static size_t find_hugetlbfs(char *dir, size_t len)
+{
+    FILE *mounts;
+    struct mntent *ent;
+    struct statfs sfs;
+    size_t size = 0;
+
+    mounts = setmntent("/proc/mounts", "r");
+    if (!mounts)
+        return 0;
+
+    while ((ent = getmntent(mounts))) {
+        if (strcmp(ent->mnt_type, "hugetlbfs") ||
+            access(ent->mnt_dir, W_OK) || statfs(ent->mnt_dir, &sfs))
+            continue;
+
+        snprintf(dir, len, "%s", ent->mnt_dir);
+        size = sfs.f_bsize;
+        break;
+    }
+
+    endmntent(mounts);
+
+    return size;
+}
+
+/**
+ * @brief Create and map the comm pad on hugetlbfs.
+ *
+ * The file is created under a temporary name and renamed once mapped,
+ * so the other ranks never open a file whose huge pages could not be
+ * reserved. On failure, rank 0 falls back to regular shared memory.
+ *
+ * @param[in] ni
+ * @param[in] path the file name
+ *
+ * @return status
+ */
+static int create_commpad_hugetlbfs(ni_t *ni, const char *path)
+{
+    char tmp_path[PATH_MAX];
+    void *comm_pad;
+    int fd;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, getpid());
+
+    fd = open(tmp_path, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        return PTL_FAIL;
+
+    if (ftruncate(fd, ni->shmem.comm_pad_size) == 0) {
+        /* Huge pages are reserved here, not on first access. */
+        comm_pad = mmap(NULL, ni->shmem.comm_pad_size,
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (comm_pad != MAP_FAILED) {
+            ni->shmem.comm_pad_path = strdup(path);
+
+            if (ni->shmem.comm_pad_path && rename(tmp_path, path) == 0) {
+                close(fd);
+                ni->shmem.comm_pad = comm_pad;
+                return PTL_OK;
+            }
+
+            free(ni->shmem.comm_pad_path);
+            ni->shmem.comm_pad_path = NULL;
+            munmap(comm_pad, ni->shmem.comm_pad_size);
+        }
+    }
+
+    close(fd);
+    unlink(tmp_path);
+
+    return PTL_FAIL;
+}
+
 /**
  * @brief Initialize shared memory resources.
  *
@@ -508,9 +1253,12 @@ static int setup_commpad(ni_t *ni)
 {
     int shm_fd = -1;
     char comm_pad_shm_name[200] = "";
+    char hugetlb_path[PATH_MAX] = "";
+    size_t align = pagesize;
     int err;
     int i;
     int pid_table_size;
+    struct shmem_pid_table *pid_table;
 
     /*
      * Buffers in shared memory. The buffers will be allocated later,
@@ -528,6 +1276,17 @@ static int setup_commpad(ni_t *ni)
     ni->sbuf_pool.slab_size =
         ni->shmem.per_proc_comm_buf_numbers * ni->sbuf_pool.round_size;
 
+    /* Followed by the eager buffers, unless immediate data already
+     * goes as far. */
+    if (get_param(PTL_EAGER_LIMIT) > get_param(PTL_MAX_INLINE_DATA)) {
+        ni->shmem.eager.buf_size =
+            ROUND_UP(get_param(PTL_EAGER_LIMIT), CACHELINE_WIDTH);
+        ni->shmem.eager.num_bufs = get_param(PTL_EAGER_NUM_BUFS);
+    } else {
+        ni->shmem.eager.buf_size = 0;
+        ni->shmem.eager.num_bufs = 0;
+    }
+
     /* Open KNEM device */
     if (knem_init(ni)) {
         WARN();
@@ -546,12 +1305,47 @@ static int setup_commpad(ni_t *ni)
     }
     ni->shmem.comm_pad_shm_name = strdup(comm_pad_shm_name);
 
+    /* With huge pages, every rank's part of the comm pad starts on a
+     * huge page boundary, so that its pages can be local to that
+     * rank. That costs node_size + 2 huge pages per NI at least, see
+     * PTL_SHMEM_HUGEPAGES. Prefer hugetlbfs, else ask for transparent
+     * huge pages. All the ranks on the node come up with the same
+     * choice. */
+    if (get_param(PTL_SHMEM_HUGEPAGES)) {
+        char dir[PATH_MAX];
+
+        align = thp_size();
+
+        if (find_hugetlbfs(dir, sizeof(dir)) == align)
+            snprintf(hugetlb_path, sizeof(hugetlb_path), "%s%s", dir,
+                     comm_pad_shm_name);
+    }
+
+    /* Each rank has a mailbox with one ring per local rank. A ring
+     * only carries sbufs of its sender or of its receiver, each at
+     * most once, so it never overflows. */
+    ni->shmem.ready_words =
+        (ni->mem.node_size + BITS_PER_LONG - 1) / BITS_PER_LONG;
+    ni->shmem.mailbox_size =
+        ROUND_UP(sizeof(struct shmem_mailbox) +
+                 ni->shmem.ready_words * sizeof(unsigned long),
+                 CACHELINE_WIDTH);
+
+    ni->shmem.ring_slots = 1;
+    while (ni->shmem.ring_slots < 2 * ni->shmem.per_proc_comm_buf_numbers)
+        ni->shmem.ring_slots <<= 1;
+    ni->shmem.ring_size = ring_size(ni->shmem.ring_slots);
+
     /* Allocate a pool of buffers in the mmapped region. */
     ni->shmem.per_proc_comm_buf_size =
-        sizeof(queue_t) + ni->sbuf_pool.slab_size;
+        ni->shmem.mailbox_size +
+        ni->shmem.ring_size * ni->mem.node_size + ni->sbuf_pool.slab_size +
+        ni->shmem.eager.buf_size * ni->shmem.eager.num_bufs;
+    ni->shmem.per_proc_comm_buf_size =
+        ROUND_UP(ni->shmem.per_proc_comm_buf_size, align);
 
     pid_table_size = ni->mem.node_size * sizeof(struct shmem_pid_table);
-    pid_table_size = ROUND_UP(pid_table_size, pagesize);
+    pid_table_size = ROUND_UP(pid_table_size, align);
 
     ni->shmem.comm_pad_size = pid_table_size;
 
@@ -574,6 +1368,8 @@ static int setup_commpad(ni_t *ni)
         ni->shmem.bounce_buf.buf_size * ni->shmem.bounce_buf.num_bufs;
 #endif
 
+    ni->shmem.comm_pad_size = ROUND_UP(ni->shmem.comm_pad_size, align);
+
     /* Open the communication pad. Let rank 0 create the shared memory. */
     assert(ni->shmem.comm_pad == MAP_FAILED);
 
@@ -581,6 +1377,13 @@ static int setup_commpad(ni_t *ni)
         /* Just in case, remove that file if it already exist. */
         shm_unlink(comm_pad_shm_name);
 
+        if (hugetlb_path[0]) {
+            unlink(hugetlb_path);
+            create_commpad_hugetlbfs(ni, hugetlb_path);
+        }
+    }
+
+    if (ni->mem.index == 0 && ni->shmem.comm_pad == MAP_FAILED) {
         shm_fd =
             shm_open(comm_pad_shm_name, O_RDWR | O_CREAT | O_EXCL,
                      S_IRUSR | S_IWUSR);
@@ -598,13 +1401,22 @@ static int setup_commpad(ni_t *ni)
             shm_unlink(comm_pad_shm_name);
             goto exit_fail;
         }
-    } else {
+    } else if (ni->mem.index != 0) {
         int try_count;
 
         /* Try for 10 seconds. That should leave enough time for rank
          * 0 to create the file. */
         try_count = 100;
         do {
+            /* Rank 0 may have created it on hugetlbfs. */
+            if (hugetlb_path[0]) {
+                shm_fd = open(hugetlb_path, O_RDWR);
+                if (shm_fd != -1) {
+                    ni->shmem.comm_pad_path = strdup(hugetlb_path);
+                    break;
+                }
+            }
+
             shm_fd = shm_open(comm_pad_shm_name, O_RDWR, S_IRUSR | S_IWUSR);
 
             if (shm_fd != -1)
@@ -645,28 +1457,65 @@ static int setup_commpad(ni_t *ni)
     }
 
     /* Fill our portion of the comm pad. */
-    ni->shmem.comm_pad =
-        (uint8_t *) mmap(NULL, ni->shmem.comm_pad_size,
-                         PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
     if (ni->shmem.comm_pad == MAP_FAILED) {
-        ptl_warn("mmap failed (%d)", errno);
-        perror("");
-        goto exit_fail;
+        ni->shmem.comm_pad =
+            (uint8_t *) mmap(NULL, ni->shmem.comm_pad_size,
+                             PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+        if (ni->shmem.comm_pad == MAP_FAILED) {
+            ptl_warn("mmap failed (%d)", errno);
+            perror("");
+            goto exit_fail;
+        }
+
+        /* The share memory is mmaped, so we can close the file. */
+        close(shm_fd);
+        shm_fd = -1;
     }
 
-    /* The share memory is mmaped, so we can close the file. */
-    close(shm_fd);
-    shm_fd = -1;
+#ifdef MADV_HUGEPAGE
+    /* Not an error if the kernel doesn't do transparent huge pages
+     * for shared memory. */
+    if (align != pagesize && !ni->shmem.comm_pad_path)
+        madvise(ni->shmem.comm_pad, ni->shmem.comm_pad_size, MADV_HUGEPAGE);
+#endif
 
     /* Now we can create the buffer pool */
-    ni->shmem.first_queue = ni->shmem.comm_pad + pid_table_size;
-    ni->shmem.queue =
-        (queue_t *)(ni->shmem.first_queue +
-                    (ni->shmem.per_proc_comm_buf_size * ni->mem.index));
-    queue_init(ni->shmem.queue);
+    ni->shmem.first_mailbox = ni->shmem.comm_pad + pid_table_size;
+    ni->shmem.mailbox = shmem_mailbox(ni, ni->mem.index);
+    ni->shmem.next_ring = 0;
+
+    /* Our mailbox and sbufs are only written by the others once we
+     * have announced ourselves. Touch them first, so the pages are
+     * allocated on our NUMA node. */
+    for (i = 0; i < ni->shmem.per_proc_comm_buf_size; i += pagesize)
+        ((volatile uint8_t *)ni->shmem.mailbox)[i] = 0;
+
+    ni->shmem.mailbox->sleeping = 0;
+    for (i = 0; i < ni->shmem.ready_words; i++)
+        ni->shmem.mailbox->ready[i] = 0;
+    for (i = 0; i < ni->mem.node_size; i++)
+        ring_init(shmem_mailbox_ring(ni, ni->shmem.mailbox, i),
+                  ni->shmem.ring_slots);
+
+    ni->shmem.ring_locks =
+        malloc(ni->mem.node_size * sizeof(*ni->shmem.ring_locks));
+    if (!ni->shmem.ring_locks) {
+        WARN();
+        goto exit_fail;
+    }
+    for (i = 0; i < ni->mem.node_size; i++)
+        PTL_FASTLOCK_INIT(&ni->shmem.ring_locks[i]);
+
+    /* Let the other ranks wake up our progress thread. */
+    ni->shmem.bell_name = strdup(comm_pad_shm_name);
+    if (ni->shmem.bell_name)
+        shmem_bell_init(ni);
 
-    /* The buffer is right after the nemesis queue. */
-    ni->sbuf_pool.pre_alloc_buffer = (void *)(ni->shmem.queue + 1);
+    /* The buffers are right after the rings. */
+    ni->sbuf_pool.pre_alloc_buffer =
+        shmem_mailbox_ring(ni, ni->shmem.mailbox, ni->mem.node_size);
+    ni->shmem.eager.bufs =
+        ni->sbuf_pool.pre_alloc_buffer + ni->sbuf_pool.slab_size;
 
     err =
         pool_init(ni->iface->gbl, &ni->sbuf_pool, "sbuf", real_buf_t_size(),
@@ -675,6 +1524,12 @@ static int setup_commpad(ni_t *ni)
         WARN();
         goto exit_fail;
     }
+
+    ll_init(&ni->shmem.eager.free_list);
+    for (i = 0; i < ni->shmem.eager.num_bufs; i++)
+        ll_enqueue_obj(&ni->shmem.eager.free_list,
+                       ni->shmem.eager.bufs + i * ni->shmem.eager.buf_size);
+
 #if !USE_KNEM
     /* Initialize the bounce buffers and let index 0 link them
      * together. */
@@ -694,13 +1549,17 @@ static int setup_commpad(ni_t *ni)
     }
 #endif
 
-    if (ni->options & PTL_NI_LOGICAL) {
-        /* Can now announce my presence. */
+    /* The PID table is a the beginning of the comm pad. */
+    pid_table = (struct shmem_pid_table *)ni->shmem.comm_pad;
 
-        /* The PID table is a the beginning of the comm pad. */
-        struct shmem_pid_table *pid_table =
-            (struct shmem_pid_table *)ni->shmem.comm_pad;
+#if !USE_KNEM
+    ni->shmem.pid = getpid();
+    pid_table[ni->mem.index].os_pid = ni->shmem.pid;
+    pid_table[ni->mem.index].cma_probe = &ni->shmem.cma;
+#endif
 
+    if (ni->options & PTL_NI_LOGICAL) {
+        /* Can now announce my presence. */
         pid_table[ni->mem.index].id = ni->id;
         __sync_synchronize();          /* ensure "valid" is not written before pid. */
         pid_table[ni->mem.index].valid = 1;
@@ -714,11 +1573,13 @@ static int setup_commpad(ni_t *ni)
         }
 
         /* All ranks have mmaped the memory. Get rid of the file. */
-        shm_unlink(ni->shmem.comm_pad_shm_name);
-        free(ni->shmem.comm_pad_shm_name);
-        ni->shmem.comm_pad_shm_name = NULL;
+        unlink_commpad(ni);
     }
 
+#if !USE_KNEM
+    shmem_cma_setup(ni, pid_table);
+#endif
+
     return PTL_OK;
 
   exit_fail:
@@ -739,23 +1600,132 @@ static int setup_commpad(ni_t *ni)
  */
 void shmem_enqueue(ni_t *ni, buf_t *buf, ptl_pid_t dest)
 {
-    queue_t *queue =
-        (queue_t *)(ni->shmem.first_queue +
-                    (ni->shmem.per_proc_comm_buf_size * dest));
+    shmem_enqueue_list(ni, &buf, 1, dest);
+}
+
+/**
+ * @brief enqueue several bufs to a pid using shared memory.
+ *
+ * They go to our ring in the mailbox of the destination, which no
+ * other rank writes to.
+ *
+ * @param[in] ni the network interface
+ * @param[in] bufs the bufs, in order
+ * @param[in] num the number of bufs
+ * @param[in] dest the destination pid
+ */
+void shmem_enqueue_list(ni_t *ni, buf_t **bufs, int num, ptl_pid_t dest)
+{
+    struct shmem_mailbox *mailbox = shmem_mailbox(ni, dest);
+    ring_t *ring = shmem_mailbox_ring(ni, mailbox, ni->mem.index);
+    obj_t *objs[num];
+    int i;
 
-    buf->obj.next = NULL;
+    for (i = 0; i < num; i++)
+        objs[i] = &bufs[i]->obj;
 
-    enqueue(ni->shmem.comm_pad, queue, &buf->obj);
+    PTL_FASTLOCK_LOCK(&ni->shmem.ring_locks[dest]);
+    while (!ring_push_list(ni->shmem.comm_pad, ring, objs, num))
+        SPINLOCK_BODY();
+    PTL_FASTLOCK_UNLOCK(&ni->shmem.ring_locks[dest]);
+
+    shmem_notify(ni, mailbox, dest);
+}
+
+/**
+ * @brief Take a buf off one of our rings.
+ *
+ * When the ring is empty, its ready bit is cleared and the ring is
+ * looked at once more, since the sender may have appended to it while
+ * the bit was still set.
+ *
+ * @param[in] ni the network interface.
+ * @param[in] index the local index of the sender.
+ *
+ * @return a buf, or NULL if the ring is empty.
+ */
+static buf_t *shmem_ring_pop(ni_t *ni, ptl_pid_t index)
+{
+    struct shmem_mailbox *mailbox = ni->shmem.mailbox;
+    ring_t *ring = shmem_mailbox_ring(ni, mailbox, index);
+    unsigned long *word = &mailbox->ready[index / BITS_PER_LONG];
+    unsigned long bit = 1UL << (index % BITS_PER_LONG);
+    obj_t *obj;
+
+    obj = ring_pop(ni->shmem.comm_pad, ring);
+    if (obj)
+        return (buf_t *)obj;
+
+    __sync_fetch_and_and(word, ~bit);
+
+    obj = ring_pop(ni->shmem.comm_pad, ring);
+    if (obj)
+        __sync_fetch_and_or(word, bit);
+
+    return (buf_t *)obj;
 }
 
 /**
  * @brief dequeue a buf using shared memory.
  *
+ * The rings with their ready bit set are visited round robin, so that
+ * a busy sender cannot starve the others.
+ *
  * @param[in] ni the network interface.
  */
 buf_t *shmem_dequeue(ni_t *ni)
 {
-    return (buf_t *)dequeue(ni->shmem.comm_pad, ni->shmem.queue);
+    struct shmem_mailbox *mailbox = ni->shmem.mailbox;
+    int num_words = ni->shmem.ready_words;
+    int start = ni->shmem.next_ring;
+    unsigned long first_bits = ~0UL << (start % BITS_PER_LONG);
+    int i;
+
+    /* The first word is visited twice, the rings after the start
+     * first and the ones before it last. */
+    for (i = 0; i <= num_words; i++) {
+        int w = (start / BITS_PER_LONG + i) % num_words;
+        unsigned long bits = *(volatile unsigned long *)&mailbox->ready[w];
+
+        if (i == 0)
+            bits &= first_bits;
+        else if (i == num_words)
+            bits &= ~first_bits;
+
+        while (bits) {
+            int index = w * BITS_PER_LONG + __builtin_ctzl(bits);
+            buf_t *buf;
+
+            bits &= bits - 1;
+
+            buf = shmem_ring_pop(ni, index);
+            if (buf) {
+                ni->shmem.next_ring = (index + 1) % ni->mem.node_size;
+                return buf;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Find whether some of our rings may hold bufs.
+ *
+ * @param[in] ni the network interface.
+ *
+ * @return non-zero unless all the rings are empty.
+ */
+int shmem_busy(ni_t *ni)
+{
+    int i;
+
+    for (i = 0; i < ni->shmem.ready_words; i++) {
+        if (*(volatile unsigned long *)&ni->shmem.mailbox->ready[i])
+            return 1;
+    }
+
+    return 0;
 }
 
 /**
@@ -769,6 +1739,11 @@ static int PtlNIInit_shmem(gbl_t *gbl, ni_t *ni)
 {
     ni->shmem.knem_fd = -1;
     ni->shmem.comm_pad = MAP_FAILED;
+    ni->shmem.comm_pad_path = NULL;
+    ni->shmem.bell_fd = -1;
+    ni->shmem.bell_name = NULL;
+    ni->shmem.mailbox = NULL;
+    ni->shmem.ring_locks = NULL;
 
     /* Only if IB hasn't setup the NID first. */
     if (ni->iface->id.phys.nid == PTL_NID_ANY) {
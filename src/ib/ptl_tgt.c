@@ -418,6 +418,8 @@ static int tgt_start(buf_t *buf)
 
     /* initialize fields */
     INIT_LIST_HEAD(&buf->unexpected_list);
+    INIT_LIST_HEAD(&buf->unexpected_bits_list);
+    INIT_LIST_HEAD(&buf->unexpected_src_list);
 #if WITH_TRANSPORT_IB
     INIT_LIST_HEAD(&buf->transfer.rdma.rdma_list);
 #endif
@@ -441,7 +443,10 @@ static int tgt_start(buf_t *buf)
         buf->conn = get_conn(ni, initiator);
     }
     buf->conn->state = CONN_STATE_CONNECTED;
-    buf->conn->udp.dest_addr = buf->conn->sin;
+    /* Local ranks may be reached through shared memory instead, and
+     * the UDP address would overwrite their transport info. */
+    if (buf->conn->transport.type == CONN_TYPE_UDP)
+        buf->conn->udp.dest_addr = buf->conn->sin;
 #endif
 #if !WITH_TRANSPORT_UDP
     buf->conn = get_conn(ni, initiator);
@@ -654,30 +659,30 @@ static int tgt_get_match(buf_t *buf)
         goto not_found;
     }
 #endif
-    /* Check the priority list.
+    /* Check the priority list then the overflow list.
      * If we find a match take a reference to protect
      * the list element pointer.
      * Note buf->le and buf->me are in a union */
-    list_for_each_entry(buf->le, &pt->priority_list, list) {
-        if (ni->options & PTL_NI_NO_MATCHING) {
+    if (ni->options & PTL_NI_NO_MATCHING) {
+        /* Without matching the first LE always wins. */
+        if (!list_empty(&pt->priority_list)) {
+            buf->le = list_first_entry(&pt->priority_list, le_t, list);
             le_get(buf->le);
             goto found_one;
         }
 
-        if (check_match(buf, buf->me)) {
-            me_get(buf->me);
-            goto found_one;
-        }
-    }
-
-    /* Check the overflow list */
-    list_for_each_entry(buf->le, &pt->overflow_list, list) {
-        if (ni->options & PTL_NI_NO_MATCHING) {
+        if (!list_empty(&pt->overflow_list)) {
+            buf->le = list_first_entry(&pt->overflow_list, le_t, list);
             le_get(buf->le);
             goto found_one;
         }
+    } else {
+        /* The match indexes return the same ME as a list walk. */
+        buf->me = pt_match_index_lookup(&pt->priority_index, buf);
+        if (!buf->me)
+            buf->me = pt_match_index_lookup(&pt->overflow_index, buf);
 
-        if (check_match(buf, buf->me)) {
+        if (buf->me) {
             me_get(buf->me);
             goto found_one;
         }
@@ -759,6 +764,7 @@ static int tgt_get_match(buf_t *buf)
             buf->unexpected_busy = 1;
 
             list_add_tail(&buf->unexpected_list, &pt->unexpected_list);
+            pt_unexpected_index_add(pt, buf);
 
 #if WITH_TRANSPORT_SHMEM || IS_PPE
             /* If it is a shared memory buffer, then the data is actually
@@ -999,6 +1005,150 @@ static int tgt_wait_conn(buf_t *buf)
     return STATE_TGT_DATA;
 }
 
+/**
+ * @brief Find whether an atomic operation can use the CPU atomics.
+ *
+ * That is the case for a single element in a contiguous list
+ * element, with the data in and out carried by the messages.
+ *
+ * @param[in] buf The message buf received by the target.
+ *
+ * @return non-zero if tgt_atomic_native() can handle it
+ */
+static int tgt_atomic_native_ok(buf_t *buf)
+{
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    const me_t *me = buf->me;
+
+    if (hdr->atom_type >= PTL_DATATYPE_LAST ||
+        buf->mlength != atom_type_size[hdr->atom_type] || me->num_iov)
+        return 0;
+
+    if (buf->operation == OP_SWAP) {
+        if (hdr->atom_op >= PTL_OP_LAST || !op_info[hdr->atom_op].swap_ok)
+            return 0;
+    } else {
+        if (hdr->atom_op > PTL_BXOR || !atom_op[hdr->atom_op][hdr->atom_type])
+            return 0;
+    }
+
+    if (!buf->data_in || buf->data_in->data_fmt != DATA_FMT_IMMEDIATE)
+        return 0;
+
+    if (buf->get_resid &&
+        (!buf->data_out || buf->data_out->data_fmt != DATA_FMT_IMMEDIATE))
+        return 0;
+
+    return atomic_native_ok(hdr->atom_type, me->start + buf->moffset);
+}
+
+/**
+ * @brief Perform an atomic operation with the CPU atomics.
+ *
+ * The previous value of a fetch or a swap goes straight into the
+ * reply, so the data out and data in phases are done at once.
+ *
+ * @param[in] buf The message buf received by the target.
+ *
+ * @return The next state.
+ */
+static int tgt_atomic_native(buf_t *buf)
+{
+    const req_hdr_t *hdr = (req_hdr_t *) buf->data;
+    ni_t *ni = obj_to_ni(buf);
+    me_t *me = buf->me;
+    void *start = me->start + buf->moffset;
+    data_t *reply = NULL;
+    void *fetch = NULL;
+    int err;
+#if IS_PPE
+    mr_t *mr;
+#endif
+
+    if (buf->get_resid) {
+        ack_hdr_t *send_hdr = (ack_hdr_t *) buf->send_buf->data;
+
+        reply = (data_t *)(buf->send_buf->data + buf->send_buf->length);
+        reply->data_fmt = DATA_FMT_IMMEDIATE;
+        reply->immediate.data_length = cpu_to_le32(buf->mlength);
+        fetch = reply->immediate.data;
+
+        send_hdr->h1.data_out = 1;
+    }
+
+#if IS_PPE
+    if (me->mr_start)
+        mr = me->mr_start;
+    else {
+        err = mr_lookup_app(obj_to_ni(me), start, buf->mlength, &mr);
+        if (err) {
+            WARN();
+            return STATE_TGT_ERROR;
+        }
+    }
+#endif
+
+    atomic_inc(&ni->atomic_pending);
+
+    err = atomic_native(hdr->atom_op, hdr->atom_type, start,
+                        addr_to_ppe(start, mr), buf->data_in->immediate.data,
+                        (datatype_t *)(buf->data + sizeof(req_hdr_t)), fetch);
+
+    atomic_dec(&ni->atomic_pending);
+
+#if IS_PPE
+    if (!me->mr_start)
+        mr_put(mr);
+#endif
+
+    if (err)
+        return STATE_TGT_ERROR;
+
+    if (reply)
+        buf->send_buf->length += sizeof(*reply) + buf->mlength;
+
+    return STATE_TGT_COMM_EVENT;
+}
+
+/**
+ * @brief Lock the target buffer of an atomic operation.
+ *
+ * The operations which cannot use the CPU atomics lock the stripes
+ * covering their target buffer, until they are done with it.
+ *
+ * @param[in] buf The message buf received by the target.
+ */
+static void tgt_atomic_lock(buf_t *buf)
+{
+    const me_t *me = buf->me;
+
+    atomic_inc(&obj_to_ni(buf)->atomic_pending);
+
+    if (me->num_iov)
+        buf->atomic_stripes = buf->mlength ? ATOMIC_STRIPES_ALL : 0;
+    else
+        buf->atomic_stripes =
+            atomic_stripes_find(me->start + buf->moffset, buf->mlength);
+
+    atomic_stripes_lock(buf->atomic_stripes);
+    buf->in_atomic = 1;
+}
+
+/**
+ * @brief Unlock the target buffer of an atomic operation, if locked.
+ *
+ * @param[in] buf The message buf received by the target.
+ */
+static void tgt_atomic_unlock(buf_t *buf)
+{
+    if (buf->in_atomic) {
+        atomic_stripes_unlock(buf->atomic_stripes);
+        buf->in_atomic = 0;
+
+        atomic_dec(&obj_to_ni(buf)->atomic_pending);
+    }
+}
+
 /**
  * @brief target data state.
  *
@@ -1011,25 +1161,20 @@ static int tgt_wait_conn(buf_t *buf)
  */
 static int tgt_data(buf_t *buf)
 {
-    ni_t *ni = obj_to_ni(buf);
-
     /* save the addressing information to the initiator
      * in buf */
     if (buf->conn->state >= CONN_STATE_CONNECTED)
         set_buf_dest(buf, buf->conn);
 
-    /* This implementation guarantees atomicity between
-     * the three atomic type operations by only alowing a
-     * single operation at a time to be processed. */
-
-    // TODO we could improve performance by having more locks
-    // here covering operations that do no overlap. Also
-    // we could think some more about how to protect between
-    // atomic and regular get/put operations.
+    /* Atomic operations on a single element use the CPU atomics.
+     * The others lock the part of memory they work on, until their
+     * last data phase is over. */
     if (buf->operation == OP_ATOMIC || buf->operation == OP_SWAP ||
         buf->operation == OP_FETCH) {
-        pthread_mutex_lock(&ni->atomic_mutex);
-        buf->in_atomic = 1;
+        if (tgt_atomic_native_ok(buf))
+            return tgt_atomic_native(buf);
+
+        tgt_atomic_lock(buf);
     }
 
     /* process data out, then data in */
@@ -1046,7 +1191,7 @@ static int tgt_data(buf_t *buf)
         else if (buf->data_in && buf->data_in->data_fmt == DATA_FMT_NOKNEM)
             return STATE_TGT_DATA_IN;
 #endif
-        pthread_mutex_unlock(&ni->atomic_mutex);
+        tgt_atomic_unlock(buf);
         return STATE_TGT_COMM_EVENT;
     }
 }
@@ -1174,11 +1319,7 @@ static int tgt_data_out(buf_t *buf)
 static int tgt_start_copy(buf_t *buf)
 {
     /* Add to the data queue. */
-    ni_t *ni = obj_to_ni(buf);
-
-    PTL_FASTLOCK_LOCK(&ni->shmem.noknem_lock);
-    list_add_tail(&buf->list, &ni->shmem.noknem_list);
-    PTL_FASTLOCK_UNLOCK(&ni->shmem.noknem_lock);
+    noknem_start(obj_to_ni(buf), buf);
 
     return STATE_TGT_RDMA;
 }
@@ -1211,16 +1352,18 @@ static int tgt_rdma(buf_t *buf)
     int was_done;
     was_done = 0;
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
-    /* It is possible that post_tgt_dma() sets the target_done flag,
-     * and that the initiator replies with init_done before we reach
-     * the exit test. However we must leave the state machine so the
-     * receive state machine can remove the buffer from the
-     * noknem_list; this function will be called again, and this time
-     * was_done will be 1. May be this part needs a nicer design. */
-    if (buf->conn->transport.type == CONN_TYPE_SHMEM)
-        was_done =
-            buf->transfer.noknem.noknem ? buf->transfer.noknem.
-            noknem->init_done : 0;
+    const data_t *data =
+        buf->rdma_dir == DATA_DIR_IN ? buf->data_in : buf->data_out;
+    /* Cross memory attach copies are done in one go. */
+    int noknem = buf->conn->transport.type == CONN_TYPE_SHMEM &&
+        data->data_fmt == DATA_FMT_NOKNEM;
+
+    /* The initiator may set init_done at any time, but the transfer
+     * can only complete once progress_noknem() has seen it and
+     * removed the buffer from the noknem_list, so that it also
+     * returns the shared memory buffer. */
+    if (noknem)
+        was_done = list_empty(&buf->list);
 #endif
 
     /* post one or more RDMA operations */
@@ -1240,7 +1383,7 @@ static int tgt_rdma(buf_t *buf)
         return STATE_TGT_RDMA;
 #endif
 #if WITH_TRANSPORT_SHMEM && !USE_KNEM
-    if ((was_done == 0) && (buf->conn->transport.type == CONN_TYPE_SHMEM))
+    if ((was_done == 0) && noknem)
         return STATE_TGT_RDMA;
 #endif
 
@@ -1473,17 +1616,28 @@ static int tgt_data_in(buf_t *buf)
             return STATE_TGT_ERROR;
 
         next = STATE_TGT_COMM_EVENT;
-    } else {
+    }
+#if WITH_TRANSPORT_SHMEM
+    else if (data->data_fmt == DATA_FMT_EAGER) {
+        /* The initiator gets its eager buffer back with the
+         * request. */
+        assert(buf->mlength <= data->eager.data_length);
+
+        err = tgt_copy_in(buf, me,
+                          obj_to_ni(buf)->shmem.comm_pad +
+                          data->eager.offset);
+        if (err)
+            return STATE_TGT_ERROR;
+
+        next = STATE_TGT_COMM_EVENT;
+    }
+#endif
+    else {
         next = buf->conn->transport.tgt_data_out(buf, data);
     }
 
     /* this can happen for a simple swap operation */
-    if (buf->in_atomic) {
-        ni_t *ni = obj_to_ni(buf);
-
-        pthread_mutex_unlock(&ni->atomic_mutex);
-        buf->in_atomic = 0;
-    }
+    tgt_atomic_unlock(buf);
 
     return next;
 }
@@ -1502,7 +1656,6 @@ static int tgt_atomic_data_in(buf_t *buf)
     int err;
     data_t *data = buf->data_in;
     me_t *me = buf->me;
-    ni_t *ni;
     const req_hdr_t *hdr = (req_hdr_t *) buf->data;
 
     /* assumes that max_atomic_size is <= PTL_MAX_INLINE_DATA */
@@ -1523,9 +1676,7 @@ static int tgt_atomic_data_in(buf_t *buf)
     //PTL_FASTLOCK_UNLOCK(&pt->lock);
     assert(buf->in_atomic);
 
-    ni = obj_to_ni(buf);
-    pthread_mutex_unlock(&ni->atomic_mutex);
-    buf->in_atomic = 0;
+    tgt_atomic_unlock(buf);
 
     return STATE_TGT_COMM_EVENT;
 }
@@ -1556,7 +1707,6 @@ static int tgt_swap_data_in(buf_t *buf)
     data_t *data = buf->data_in;
     uint8_t copy[sizeof(datatype_t)];
     void *dst;
-    ni_t *ni;
     const req_hdr_t *hdr = (req_hdr_t *) buf->data;
     void *operand = buf->data + sizeof(req_hdr_t);
     void *source = data->immediate.data;
@@ -1616,9 +1766,7 @@ static int tgt_swap_data_in(buf_t *buf)
 
     assert(buf->in_atomic);
 
-    ni = obj_to_ni(buf);
-    pthread_mutex_unlock(&ni->atomic_mutex);
-    buf->in_atomic = 0;
+    tgt_atomic_unlock(buf);
 
     return STATE_TGT_COMM_EVENT;
 }
@@ -1982,21 +2130,6 @@ static void tgt_cleanup_2(buf_t *buf)
         buf->matching.le = NULL;
     }
 
-#if WITH_TRANSPORT_IB && !IS_PPE
-    if(buf->conn->transport.type == CONN_TYPE_RDMA){
-        ni_t *ni = obj_to_ni(buf);
-        if(buf->mr_list[0] != NULL && ni->umn_fd == -1){
-            int i = 0;
-            while (buf->mr_list[i] != NULL){
-                mr_cleanup(buf->mr_list[i]);
-                i++;
-                if (i == 2) 
-                 abort();
-            }
-        }
-    }
-#endif
-
     if (buf->conn) {
         conn_put(buf->conn);
         buf->conn = NULL;
@@ -2191,11 +2324,7 @@ int process_tgt(buf_t *buf)
                 state = tgt_overflow_event(buf);
                 break;
             case STATE_TGT_ERROR:
-                if (buf->in_atomic) {
-                    ni_t *ni = obj_to_ni(buf);
-                    pthread_mutex_unlock(&ni->atomic_mutex);
-                    buf->in_atomic = 0;
-                }
+                tgt_atomic_unlock(buf);
                 err = PTL_FAIL;
                 state = STATE_TGT_CLEANUP;
                 break;
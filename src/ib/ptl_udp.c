@@ -37,6 +37,109 @@ static int send_message_udp(buf_t *buf, int from_init)
     return PTL_OK;
 }
 
+#if HAVE_SENDMMSG
+/**
+ * @brief Check whether a request is sent as a single datagram holding
+ * only the buf.
+ *
+ * @param[in] ni
+ * @param[in] buf
+ *
+ * @return true if it is
+ */
+static int udp_is_immediate(ni_t *ni, buf_t *buf)
+{
+    const struct sockaddr_in *dest = &buf->dest.udp.dest_addr;
+
+    /* Sends to self do not go through the socket. */
+    if ((dest->sin_port == ni->id.phys.pid) &&
+        (dest->sin_addr.s_addr == nid_to_addr(ni->id.phys.nid)))
+        return 0;
+
+    return buf->rlength <= sizeof(buf_t);
+}
+
+/**
+ * @brief Send the immediate requests collected so far with a single
+ * system call.
+ *
+ * @param[in] ni
+ * @param[in] msgs
+ * @param[in] num
+ *
+ * @return the number of requests sent
+ */
+static int udp_flush_msgs(ni_t *ni, struct mmsghdr *msgs, int num)
+{
+    int ret;
+
+    if (num == 0)
+        return 0;
+
+    ret = ptl_sendmmsg(ni->iface->udp.connect_s, msgs, num, 0, ni);
+    if (ret < num) {
+        ptl_error("error sending %d bundled messages: %s\n", num,
+                  strerror(errno));
+        return ret < 0 ? 0 : ret;
+    }
+
+    return num;
+}
+
+/**
+ * @brief Send the requests of a bundle using UDP.
+ *
+ * Immediate requests are batched with sendmmsg. The others are sent
+ * one by one, after what was batched before them.
+ *
+ * @param[in] ni
+ * @param[in] bufs
+ * @param[in] num
+ *
+ * @return the number of requests sent
+ */
+static int send_messages_udp(ni_t *ni, buf_t **bufs, int num)
+{
+    struct mmsghdr msgs[num];
+    struct iovec iov[num];
+    int sent = 0;
+    int ret;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        buf_t *buf = bufs[i];
+
+        if (!udp_is_immediate(ni, buf)) {
+            ret = udp_flush_msgs(ni, msgs, n);
+            sent += ret;
+            if (ret < n)
+                return sent;
+            n = 0;
+
+            if (send_message_udp(buf, 1))
+                return sent;
+            sent++;
+            continue;
+        }
+
+        buf->type = BUF_UDP_RECEIVE;
+
+        iov[n].iov_base = buf;
+        iov[n].iov_len = sizeof(*buf);
+
+        memset(&msgs[n], 0, sizeof(msgs[n]));
+        msgs[n].msg_hdr.msg_name = &buf->dest.udp.dest_addr;
+        msgs[n].msg_hdr.msg_namelen = sizeof(buf->dest.udp.dest_addr);
+        msgs[n].msg_hdr.msg_iov = &iov[n];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+        n++;
+    }
+
+    return sent + udp_flush_msgs(ni, msgs, n);
+}
+#endif
+
 static void udp_set_send_flags(buf_t *buf, int can_signal)
 {
     /* The data is always in the buffer. */
@@ -387,6 +490,7 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
             ni->udp.self_recv_len = sizeof(buf_t);
             ptl_info("self ref addr is: %p \n", ni->udp.self_recv_addr);
             atomic_inc(&ni->udp.self_recv);
+            progress_wake(ni);
             return;
         } else {
             ptl_warn("large message self sends not yet supported \n");
@@ -710,169 +814,250 @@ void udp_send(ni_t *ni, buf_t *buf, struct sockaddr_in *dest)
 
 }
 
+/* A datagram drained from the interface socket. The sender's buf
+ * lands in image, and the payload of a large message in data. */
+struct udp_recv_slot {
+    buf_t image;
+    void *data;
+    struct iovec iov[2];
+    struct sockaddr_in addr;
+    int ready;
+};
+
 /**
- * @brief receive a buf using a UDP socket.
+ * @brief Allocate the receive slots of an interface.
+ *
+ * Called with the interface receive lock held.
  *
  * @param[in] ni the network interface.
+ *
+ * @return status
  */
-buf_t *udp_receive(ni_t *ni)
+static int udp_recv_init(ni_t *ni)
 {
+    iface_t *iface = ni->iface;
+    unsigned int num = get_param(PTL_UDP_RECV_BATCH);
+    int max_size;
+    socklen_t len = sizeof(max_size);
 
-    int err;
-    struct sockaddr_in temp_sin;
-    socklen_t lensin = sizeof(temp_sin);
+    //a datagram can't be larger than the socket receive buffer
+    //65507 is the max IPv4 UDP message size (65536 - 8 byte UDP header - 20 byte IP header)
+    if (getsockopt(iface->udp.connect_s, SOL_SOCKET, SO_RCVBUF, &max_size,
+                   &len) || max_size > 65507)
+        max_size = 65507;
+
+    iface->udp.recv.slots = calloc(num, sizeof(struct udp_recv_slot));
+    iface->udp.recv.msgs = calloc(num, sizeof(struct mmsghdr));
+    if (!iface->udp.recv.slots || !iface->udp.recv.msgs) {
+        udp_recv_fini(iface);
+        return PTL_NO_SPACE;
+    }
+
+    iface->udp.recv.num_slots = num;
+    iface->udp.recv.pending = 0;
+    iface->udp.recv.data_size = max_size;
 
-    buf_t *thebuf = (buf_t *)calloc(1, sizeof(buf_t));
+    return PTL_OK;
+}
+
+/**
+ * @brief Free the receive slots of an interface.
+ *
+ * @param[in] iface the interface.
+ */
+void udp_recv_fini(iface_t *iface)
+{
+    unsigned int i;
 
-    if (atomic_read(&ni->udp.self_recv) >= 1) {
-        ptl_info("got a message from self %p \n", ni->udp.self_recv_addr);
-        free(thebuf);
-        thebuf = (buf_t *)ni->udp.self_recv_addr;
-        return thebuf;
+    if (iface->udp.recv.slots) {
+        for (i = 0; i < iface->udp.recv.num_slots; i++)
+            free(iface->udp.recv.slots[i].data);
     }
 
+    free(iface->udp.recv.slots);
+    free(iface->udp.recv.msgs);
 
-    int flags;
-    flags = MSG_PEEK;
-    //REG: we need to perform a quick message peek here to determine if it is a short or long message
-    // this can be tweaked performance wise to only peek on the beginning of the buf for the length
-    // this peak is also used to determine if it is a multi-segment message
-    err =
-        ptl_recvfrom(ni->iface->udp.connect_s, thebuf, sizeof(*thebuf), flags,
-                     (struct sockaddr *)&temp_sin, &lensin, ni);
+    iface->udp.recv.slots = NULL;
+    iface->udp.recv.msgs = NULL;
+    iface->udp.recv.num_slots = 0;
+    iface->udp.recv.pending = 0;
+}
 
-    if (err == -1) {
-        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
-            // OK, nothing ready to fetch
-            free(thebuf);
-            return NULL;
-        } else {
-            // Error, recvfrom returned unexpected error
-            free(thebuf);
-            WARN();
-            ptl_warn("error when peeking at message: %s \n", strerror(errno));
-            return NULL;
+/**
+ * @brief Drain the datagrams waiting on the interface socket.
+ *
+ * Called with the interface receive lock held, once every slot of
+ * the previous batch has been claimed.
+ *
+ * @param[in] ni the network interface.
+ *
+ * @return the number of datagrams received, 0 if there was none,
+ * or -1 on error
+ */
+static int udp_recv_batch(ni_t *ni)
+{
+    iface_t *iface = ni->iface;
+    unsigned int i;
+    int ret;
+
+    if (!iface->udp.recv.slots && udp_recv_init(ni))
+        return -1;
+
+    for (i = 0; i < iface->udp.recv.num_slots; i++) {
+        struct udp_recv_slot *slot = &iface->udp.recv.slots[i];
+        struct msghdr *msg_hdr = &iface->udp.recv.msgs[i].msg_hdr;
+
+        //the previous payload area went away with a large message
+        if (!slot->data) {
+            slot->data = malloc(iface->udp.recv.data_size);
+            if (!slot->data)
+                break;
         }
+
+        //first I/O vector will be the traditional portals buf
+        //second will be the data for the buf, if any
+        slot->iov[0].iov_base = &slot->image;
+        slot->iov[0].iov_len = sizeof(buf_t);
+        slot->iov[1].iov_base = slot->data;
+        slot->iov[1].iov_len = iface->udp.recv.data_size;
+
+        memset(msg_hdr, 0, sizeof(*msg_hdr));
+        msg_hdr->msg_name = &slot->addr;
+        msg_hdr->msg_namelen = sizeof(slot->addr);
+        msg_hdr->msg_iov = slot->iov;
+        msg_hdr->msg_iovlen = 2;
     }
 
-    req_hdr_t *hdr;
+    if (i == 0)
+        return -1;
 
-    //first check to see if this is meant for this ni
-    if (thebuf->internal_data != NULL) {
-        hdr = (req_hdr_t *) thebuf->internal_data;
-    } else {
-        hdr = (req_hdr_t *) & thebuf->data;
+    ret = ptl_recvmmsg(iface->udp.connect_s, iface->udp.recv.msgs, i,
+                       MSG_DONTWAIT, ni);
+    if (ret == -1) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            // OK, nothing ready to fetch
+            return 0;
+        }
+
+        WARN();
+        ptl_warn("error receiving from socket: %d %s\n",
+                 iface->udp.connect_s, strerror(errno));
+        return -1;
     }
 
-    ptl_info("QQQQQQQQQQQQQQ: ni_type of incoming message: %x and ni_type of %x\n",hdr->h1.ni_type,ni->ni_type);
-
-    if (((hdr->h1.physical == 0) && (!!(ni->options & PTL_NI_PHYSICAL))) ||
-        ((hdr->h1.physical == 1) && (!!(ni->options & PTL_NI_LOGICAL))) ||
-        (hdr->h1.ni_type != ni->ni_type)) {
-            //this datagram is not meant for us
-            ptl_info("packet not meant for this NI, dropping \n");
-            free(thebuf);
-            //this time interval is just to back off, it is completely arbitrary
-            //although 20us is a reasonable approximation of the time to 
-            //fetch a recv through the kernel UDP networking stack
-            usleep(20);
-            return NULL;
-        
+    //messages dropped on the way come back empty
+    iface->udp.recv.pending = 0;
+    for (i = 0; i < (unsigned int)ret; i++) {
+        if (iface->udp.recv.msgs[i].msg_len) {
+            iface->udp.recv.slots[i].ready = 1;
+            iface->udp.recv.pending++;
+        }
     }
-    //we are going to be handling multiple messages, implemented through a recvmsg call
-    if (thebuf->rlength > sizeof(buf_t)) {
-        ptl_info("peek indicates large message of size: %i\n",
-                 (int)thebuf->rlength);
 
-        //first I/O vector will be the traditional portals buf
-        //second will be the data for the buf, so we need to set the data pointer appropriately once
-        //the data has arrived
-        struct msghdr buf_msg_hdr;
-        char *buf_data;
-        int buf_data_len;
-        struct iovec iov[thebuf->transfer.udp.num_iovecs + 1];
-
-        //this is the size of the largest UDP message that can be sent
-        //without fragmenting into multiple datagrams
-        int MAX_UDP_MSG_SIZE;
-        uint32_t max_len_size;
-        max_len_size = sizeof(int);
-        int current_message_size;
-
-        getsockopt(ni->iface->udp.connect_s, SOL_SOCKET, SO_RCVBUF,
-                   (int *)&MAX_UDP_MSG_SIZE, &max_len_size);
-        //65507 is the max IPv4 UDP message size (65536 - 8 byte UDP header - 20 byte IP header)
-        if (MAX_UDP_MSG_SIZE > 65507)
-            MAX_UDP_MSG_SIZE = 65507;
-        buf_data = calloc(1, (size_t) MAX_UDP_MSG_SIZE);
-
-        iov[0].iov_base = thebuf;
-        iov[0].iov_len = sizeof(buf_t);
-        iov[1].iov_base = buf_data;
-        //just combine all data into one big iov
-        iov[1].iov_len = thebuf->rlength;
+    return iface->udp.recv.pending;
+}
 
-        buf_msg_hdr.msg_name = &temp_sin;
-        buf_msg_hdr.msg_namelen = sizeof(temp_sin);
-        buf_msg_hdr.msg_iov = (struct iovec *)&iov;
+/**
+ * @brief Find the portals header of a received datagram.
+ *
+ * A datagram shorter than a buf is a reliability layer control
+ * message, which starts with the header.
+ *
+ * @param[in] slot the receive slot holding the datagram.
+ * @param[in] len the length of the datagram.
+ *
+ * @return the header
+ */
+static struct hdr_common *udp_recv_hdr(struct udp_recv_slot *slot,
+                                       size_t len)
+{
+    if (len < sizeof(buf_t))
+        return (struct hdr_common *)&slot->image;
 
-        //we only ever have two iovecs, the header and the data
-        buf_msg_hdr.msg_iovlen = 2;
+    return (struct hdr_common *)slot->image.internal_data;
+}
 
-        err = recvmsg(ni->iface->udp.connect_s, &buf_msg_hdr, 0);
-        if (err == -1) {
-            free(thebuf);
-            free(buf_data);
-            WARN();
-            ptl_warn("error receiving main buffer from socket: %d %s\n",
-                     ni->iface->udp.connect_s, strerror(errno));
-            abort();
-            return NULL;
+/**
+ * @brief Check whether a received datagram is meant for a network
+ * interface.
+ *
+ * @param[in] ni the network interface.
+ * @param[in] hdr the header of the datagram.
+ *
+ * @return true if it is
+ */
+static int udp_recv_for_ni(ni_t *ni, struct hdr_common *hdr)
+{
 
-        }
+    ptl_info("QQQQQQQQQQQQQQ: ni_type of incoming message: %x and ni_type of %x\n",hdr->ni_type,ni->ni_type);
 
-        current_message_size = err - sizeof(buf_t);
-        ptl_info("received message of size: %i %i %i\n", err,
-                 (int)iov[0].iov_len, (int)iov[1].iov_len);
-
-        //process received IO vectors
-        thebuf = (buf_t *)buf_msg_hdr.msg_iov[0].iov_base;
-        thebuf->transfer.udp.num_iovecs = buf_msg_hdr.msg_iovlen;
-
-        struct md *recv_md = NULL;
-
-        //check if this is an iovec
-        //if it is, copy all of the iovecs over
-        if (thebuf->transfer.udp.num_iovecs > 2) {
-            int cur_iov_copy_loc = 0;
-            int i;
-            for (i = 1; i < thebuf->transfer.udp.num_iovecs; i++) { //msg_num_iovecs
-                ptl_info("copy iovec #%i of %i\n", i,
-                         (int)thebuf->transfer.udp.num_iovecs);
-                memcpy((buf_data + cur_iov_copy_loc),
-                       buf_msg_hdr.msg_iov[i].iov_base,
-                       buf_msg_hdr.msg_iov[i].iov_len);
-                cur_iov_copy_loc =
-                    cur_iov_copy_loc + buf_msg_hdr.msg_iov[i].iov_len;
-            }
-            thebuf->transfer.udp.my_iovec.iov_base = buf_data;
-            thebuf->transfer.udp.my_iovec.iov_len = thebuf->rlength;
-        } else {
-            //if not, copy just the data in the 2 element iovec
-            ptl_info("not an iovec \n");
-            memcpy(buf_data, buf_msg_hdr.msg_iov[1].iov_base,
-                   (size_t) buf_msg_hdr.msg_iovlen);
-            buf_data_len = buf_msg_hdr.msg_iovlen;
-            thebuf->transfer.udp.my_iovec.iov_base =
-                buf_msg_hdr.msg_iov[1].iov_base;
-            thebuf->transfer.udp.my_iovec.iov_len =
-                buf_msg_hdr.msg_iov[1].iov_len;
-        }
+    if (((hdr->physical == 0) && (!!(ni->options & PTL_NI_PHYSICAL))) ||
+        ((hdr->physical == 1) && (!!(ni->options & PTL_NI_LOGICAL))) ||
+        (hdr->ni_type != ni->ni_type))
+        return 0;
 
-        thebuf->transfer.udp.data = (unsigned char *)buf_data;
+    return 1;
+}
 
-        temp_sin = *(struct sockaddr_in *)buf_msg_hdr.msg_name;
-        lensin = buf_msg_hdr.msg_namelen;
+/**
+ * @brief Fill a buf from the pool with a received image.
+ *
+ * The object header, lock and list linkage stay those of the local
+ * buf, as do the target fields that must survive buffer reuse.
+ *
+ * @param[in] buf the buf to fill.
+ * @param[in] image the buf as sent.
+ */
+static void udp_copy_image(buf_t *buf, const buf_t *image)
+{
+    const size_t start = offsetof(buf_t, event_mask);
+    const size_t hole = offsetof(buf_t, unexpected_list);
+    const size_t end = offsetof(buf_t, cond) + sizeof(buf->cond);
+
+    memcpy((char *)buf + start, (const char *)image + start, hole - start);
+    memcpy((char *)buf + end, (const char *)image + end,
+           sizeof(buf_t) - end);
+
+    //the sender's memory regions mean nothing here
+    buf->num_mr = 0;
+    buf->data = buf->internal_data;
+
+    //neither do the sender's bookkeeping pointers; the receive path
+    //releases recv_buf once completed, and initiators expect a free
+    //buf to hold no MD
+    buf->completed = 0;
+    buf->recv_buf = NULL;
+    buf->put_md = NULL;
+    buf->get_md = NULL;
+}
+
+/**
+ * @brief Finish the reception of a datagram.
+ *
+ * Fragments of a large message are gathered until the message is
+ * complete, then the type of the buf is set from the message.
+ *
+ * @param[in] ni the network interface.
+ * @param[in] thebuf the buf holding the datagram, with the payload of
+ * a large message in its I/O vector.
+ *
+ * @return the received buf, or NULL
+ */
+static buf_t *udp_recv_finish(ni_t *ni, buf_t *thebuf)
+{
+    req_hdr_t *hdr = (req_hdr_t *)thebuf->internal_data;
+
+    if (thebuf->rlength > sizeof(buf_t)) {
+        char *buf_data = thebuf->transfer.udp.my_iovec.iov_base;
+        int current_message_size = thebuf->transfer.udp.my_iovec.iov_len;
+
+        ptl_info("large message of size: %i received %i\n",
+                 (int)thebuf->rlength, current_message_size);
+
+        //the data is in the second I/O vector
+        thebuf->transfer.udp.num_iovecs = 2;
+        thebuf->transfer.udp.data = (unsigned char *)buf_data;
+        thebuf->transfer.udp.my_iovec.iov_len = thebuf->rlength;
 
         int MAX_UDP_RECV_SIZE = 1488;
         uint32_t max_recv_size;
@@ -896,7 +1081,7 @@ buf_t *udp_receive(ni_t *ni)
 
             buf_t *big_buf;
 
-            //create or fetch a large message buffer from a linked list
+            //fetch a large message buffer from a linked list
             int found_one = 0;
             struct list_head *l, *t;
 
@@ -928,16 +1113,13 @@ buf_t *udp_receive(ni_t *ni)
 
             }
             //if a buffer didn't already exist, this is a new incoming
-            //large message, so allocate one
+            //large message, so this buf will collect it
             if (found_one != 1) {
                 //size is 16MB because we have 8 bits available for number of 64K packets
                 //this is completely arbitrary, and could be adjusted up or down
                 ptl_info
-                    ("not an oustanding transfer, allocate a new buffer \n");
-                //copy the buf over to the first iovec
-                big_buf = calloc(1, sizeof(buf_t));
-                memcpy(big_buf, buf_msg_hdr.msg_iov[0].iov_base,
-                       sizeof(buf_t));
+                    ("not an oustanding transfer, start a new one \n");
+                big_buf = thebuf;
                 //set the 16MB buffer
                 big_buf->transfer.udp.data = calloc(1, 65536 << 8);
                 ptl_info
@@ -949,7 +1131,6 @@ buf_t *udp_receive(ni_t *ni)
                 big_buf->transfer.udp.my_iovec.iov_len = 0;
                 ptl_info("adding buffer @%p to the list \n", big_buf);
                 //add the buffer to the udp outstanding transfer list
-                INIT_LIST_HEAD(&big_buf->list);
                 list_add_tail(&big_buf->list, &ni->udp_list);
                 big_buf->transfer.udp.fragment_count = 0;
                 big_buf->transfer.udp.cur_iov_copy_loc = 0;
@@ -965,35 +1146,11 @@ buf_t *udp_receive(ni_t *ni)
                      ((MAX_UDP_RECV_SIZE -
                        sizeof(buf_t)) * hdr->fragment_seq));
 
-            if (big_buf->transfer.udp.is_iovec) {
-                if ((big_buf->put_md != NULL) || big_buf->get_md != NULL) {
-                    if (big_buf->put_md != NULL) {
-                        if (big_buf->put_md->options) {
-                            if (big_buf->put_md->options & PTL_IOVEC) {
-                                ptl_warn("IO vec put transfer %i \n",
-                                         (int)big_buf->rlength);
-                                recv_md = big_buf->put_md;
-                            }
-                        }
-                    }
-                } else {
-                    if (big_buf->get_md->options) {
-                        if (big_buf->get_md->options & PTL_IOVEC) {
-                            ptl_info("IO vec get transfer %i \n",
-                                     (int)big_buf->rlength);
-                            recv_md = big_buf->get_md;
-                        }
-                    }
-                }
-            } else {
-                ptl_info("Not a iovec recv \n");
-                recv_md = NULL;
-            }
-
             memcpy((big_buf->transfer.udp.data +
                     (((MAX_UDP_RECV_SIZE -
                        sizeof(buf_t)) * hdr->fragment_seq))),
-                   buf_msg_hdr.msg_iov[1].iov_base, current_message_size);
+                   buf_data, current_message_size);
+            free(buf_data);
 
             ptl_info("segment size was data:%i max data size:%lu \n",
                      current_message_size, MAX_UDP_RECV_SIZE - sizeof(buf_t));
@@ -1021,41 +1178,26 @@ buf_t *udp_receive(ni_t *ni)
                                                      udp.data +
                                                      (current_message_size)));
 
-                if (!(list_empty(&ni->udp_list))) {
-                    list_del(l);
-                }
+                list_del(&big_buf->list);
                 big_buf->transfer.udp.my_iovec.iov_base =
                     big_buf->transfer.udp.data;
                 big_buf->transfer.udp.my_iovec.iov_len = thebuf->rlength;
+                if (thebuf != big_buf)
+                    buf_put(thebuf);
                 thebuf = big_buf;
-                thebuf->recv_buf = big_buf;
+                hdr = (req_hdr_t *)thebuf->internal_data;
             }
             //if it does not, return nothing as we are still in progress
             else {
                 ptl_info
                     ("transfer not complete, wait for more incoming datagrams \n");
+                if (thebuf != big_buf)
+                    buf_put(thebuf);
                 return NULL;
             }
         }
     } else {
-        //this is a small transfer with immediate data, fetch it.
-        err =
-            ptl_recvfrom(ni->iface->udp.connect_s, thebuf, sizeof(*thebuf), 0,
-                         (struct sockaddr *)&temp_sin, &lensin, ni);
-        if (err == -1) {
-            if (errno != EAGAIN) {
-                free(thebuf);
-                WARN();
-                ptl_warn("error receiving main buffer from socket: %d %s\n",
-                         ni->iface->udp.connect_s, strerror(errno));
-                return NULL;
-
-            } else {
-                //Nothing to fetch
-                free(thebuf);
-                return NULL;
-            }
-        }
+        //this is a small transfer with immediate data
         thebuf->transfer.udp.data = (unsigned char*)&thebuf->internal_data;
         thebuf->transfer.udp.my_iovec.iov_len = thebuf->length;
     }
@@ -1078,19 +1220,135 @@ buf_t *udp_receive(ni_t *ni)
     }
 
     if (thebuf->type == BUF_UDP_RECEIVE) {
-        thebuf->obj.obj_ni = ni;
         thebuf->conn =
             get_conn(ni, (ptl_process_t)le32_to_cpu(hdr->h1.src_rank));
         //atomic_inc(&thebuf->conn->udp.recv_seq);
     }
 
     ptl_info
-        ("received data from %s:%i type:%i data size: %lu message size:%u %i \n",
-         inet_ntoa(temp_sin.sin_addr), ntohs(temp_sin.sin_port), thebuf->type,
-         sizeof(*(thebuf->data)), (int)thebuf->rlength, err);
+        ("received data from %s:%i type:%i data size: %lu message size:%u \n",
+         inet_ntoa(thebuf->udp.src_addr.sin_addr),
+         ntohs(thebuf->udp.src_addr.sin_port), thebuf->type,
+         sizeof(*(thebuf->data)), (int)thebuf->rlength);
+
+    return thebuf;
+}
+
+/**
+ * @brief receive a buf using a UDP socket.
+ *
+ * Datagrams are drained from the socket, which all the NIs of the
+ * interface share, in batches of PTL_UDP_RECV_BATCH. The first one
+ * meant for ni is returned in a buf from its pool, the others are
+ * left for the NIs they are meant for.
+ *
+ * @param[in] ni the network interface.
+ *
+ * @return the received buf, or NULL
+ */
+buf_t *udp_receive(ni_t *ni)
+{
+    iface_t *iface = ni->iface;
+    struct udp_recv_slot *slot = NULL;
+    struct sockaddr_in temp_sin;
+    buf_t *thebuf;
+    size_t msg_len;
+    unsigned int i;
+    int err;
 
+#if WITH_RUDP
+    //datagrams that arrived early and are now in order go first
+    pthread_mutex_lock(&ni->udp.rudp.lock);
+    if (!list_empty(&ni->udp.rudp.ready)) {
+        thebuf = list_first_entry(&ni->udp.rudp.ready, buf_t, list);
+        list_del_init(&thebuf->list);
+        pthread_mutex_unlock(&ni->udp.rudp.lock);
+        return udp_recv_finish(ni, thebuf);
+    }
+    pthread_mutex_unlock(&ni->udp.rudp.lock);
+#endif
+
+    pthread_mutex_lock(&iface->udp.recv.lock);
+
+    if (iface->udp.recv.pending == 0 && udp_recv_batch(ni) <= 0) {
+        pthread_mutex_unlock(&iface->udp.recv.lock);
+        return NULL;
+    }
+
+    //first check to see if one is meant for this ni
+    for (i = 0; i < iface->udp.recv.num_slots; i++) {
+        if (iface->udp.recv.slots[i].ready &&
+            udp_recv_for_ni(ni, udp_recv_hdr(&iface->udp.recv.slots[i],
+                                             iface->udp.recv.msgs[i].
+                                             msg_len))) {
+            slot = &iface->udp.recv.slots[i];
+            break;
+        }
+    }
+
+    if (!slot) {
+        pthread_mutex_unlock(&iface->udp.recv.lock);
+        //these datagrams are not meant for us
+        ptl_info("packets not meant for this NI, leaving them \n");
+        //this time interval is just to back off, it is completely arbitrary
+        //although 20us is a reasonable approximation of the time to 
+        //fetch a recv through the kernel UDP networking stack
+        usleep(20);
+        return NULL;
+    }
+
+    msg_len = iface->udp.recv.msgs[i].msg_len;
+    temp_sin = slot->addr;
+
+    if (msg_len < sizeof(buf_t)) {
+#if WITH_RUDP
+        //an acknowledgement
+        char ctl[sizeof(buf_t)];
+
+        memcpy(ctl, &slot->image, msg_len);
+#endif
+        slot->ready = 0;
+        iface->udp.recv.pending--;
+        pthread_mutex_unlock(&iface->udp.recv.lock);
+
+#if WITH_RUDP
+        rudp_recv_ctl(ni, ctl, msg_len, &temp_sin);
+#else
+        ptl_warn("dropping a short datagram of %d bytes\n", (int)msg_len);
+#endif
+        return NULL;
+    }
+
+    err = buf_alloc(ni, &thebuf);
+    if (err) {
+        pthread_mutex_unlock(&iface->udp.recv.lock);
+        WARN();
+        return NULL;
+    }
+
+    udp_copy_image(thebuf, &slot->image);
     thebuf->udp.src_addr = temp_sin;
-    return (buf_t *)thebuf;
+
+    //the payload area goes with a large message, the slot gets a
+    //new one at the next batch
+    if (thebuf->rlength > sizeof(buf_t)) {
+        thebuf->transfer.udp.my_iovec.iov_base = slot->data;
+        thebuf->transfer.udp.my_iovec.iov_len = msg_len - sizeof(buf_t);
+        slot->data = NULL;
+    }
+
+    slot->ready = 0;
+    iface->udp.recv.pending--;
+
+    pthread_mutex_unlock(&iface->udp.recv.lock);
+
+#if WITH_RUDP
+    thebuf = rudp_recv(ni, thebuf);
+    if (!thebuf)
+        return NULL;
+#endif
+
+    return udp_recv_finish(ni, thebuf);
 }
 
 /* change the state of conn; we are now connected (UO & REB) */
@@ -1202,6 +1460,7 @@ static int init_connect_udp(ni_t *ni, conn_t *conn)
             ni->udp.map_done = 1;
             //now let the progress thread know that we've sent something to ourselves
             atomic_set(&ni->udp.self_recv, 1);
+            progress_wake(ni);
             return PTL_OK;
         }
     }
@@ -1234,6 +1493,9 @@ struct transport transport_udp = {
     .buf_alloc = buf_alloc,
     .init_connect = init_connect_udp,
     .send_message = send_message_udp,
+#if HAVE_SENDMMSG
+    .send_messages = send_messages_udp,
+#endif
     .set_send_flags = udp_set_send_flags,
     .init_prepare_transfer = init_prepare_transfer_udp,
     .post_tgt_dma = do_udp_transfer,
@@ -0,0 +1,249 @@
+/**
+ * @file ptl_wait.c
+ *
+ * @brief Adaptive waiting for event queues and counting events.
+ */
+
+#ifdef IS_LIGHT_LIB
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "portals4.h"
+
+#include "ptl_locks.h"
+#include "ptl_sync.h"
+#include "ptl_param.h"
+#include "ptl_wait.h"
+#include "ptl_timer.h"
+
+#else
+#include "ptl_loc.h"
+#include "ptl_timer.h"
+#endif
+
+#if HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/* Weight of the last wait in the average, as a shift. */
+#define WAIT_GAP_SHIFT		(3)
+
+/* A sleeper wakes up at least that often (ns) to check for
+ * PtlAbort() and its timeout. */
+#define WAIT_SLEEP_MAX		(1000000)
+
+/* Number of wakeups a thread may hold back. */
+#define WAIT_DEFER_MAX		(16)
+
+/* Wakeups held back by the current thread, see ptl_wait_defer(). */
+static __thread int wait_deferring;
+static __thread int wait_num_deferred;
+static __thread uint32_t *wait_deferred[WAIT_DEFER_MAX];
+
+static inline uint64_t wait_now(void)
+{
+    TIMER_TYPE tp;
+
+    MARK_TIMER(tp);
+
+    return TIMER_INTS(tp);
+}
+
+/*
+ * The futex is not private, as the wait object may live in memory
+ * shared with the light library clients.
+ */
+static void wait_sleep(uint32_t *addr, uint32_t val, uint64_t ns)
+{
+#if HAVE_LINUX_FUTEX_H
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+#else
+    sched_yield();
+#endif
+}
+
+/*
+ * Waking up never writes to addr, so it is harmless even if the
+ * wait object has been freed meanwhile.
+ */
+static void wait_wake(uint32_t *addr)
+{
+#if HAVE_LINUX_FUTEX_H
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/**
+ * @brief Initialize a wait object.
+ *
+ * Waits start out polling for as long as they may.
+ *
+ * @param[in] wait the wait object
+ */
+void ptl_wait_init(struct ptl_wait *wait)
+{
+    wait->seq = 0;
+    atomic_set(&wait->waiters, 0);
+    wait->gap = get_param(PTL_WAIT_SPIN_MAX) / 2;
+}
+
+/**
+ * @brief Wake all the threads sleeping on a wait object.
+ *
+ * @see ptl_wait_wake()
+ *
+ * @param[in] wait the wait object
+ */
+void ptl_wait_wake_all(struct ptl_wait *wait)
+{
+    int i;
+
+    __sync_fetch_and_add(&wait->seq, 1);
+
+    if (wait_deferring) {
+        for (i = 0; i < wait_num_deferred; i++) {
+            if (wait_deferred[i] == &wait->seq)
+                return;
+        }
+
+        if (wait_num_deferred < WAIT_DEFER_MAX) {
+            wait_deferred[wait_num_deferred++] = &wait->seq;
+            return;
+        }
+    }
+
+    wait_wake(&wait->seq);
+}
+
+/**
+ * @brief Hold back the wakeups issued by the current thread.
+ *
+ * The progress thread posts events and counts in the middle of
+ * processing a message, before it releases the list entry involved.
+ * A woken up thread would preempt it on a busy core, and find the
+ * entry still in use. The wakeups are issued by ptl_wait_flush()
+ * once the message is done with.
+ */
+void ptl_wait_defer(void)
+{
+    wait_deferring = 1;
+}
+
+/**
+ * @brief Issue the wakeups held back since ptl_wait_defer().
+ */
+void ptl_wait_flush(void)
+{
+    int i;
+
+    for (i = 0; i < wait_num_deferred; i++)
+        wait_wake(wait_deferred[i]);
+
+    wait_num_deferred = 0;
+    wait_deferring = 0;
+}
+
+/**
+ * @brief Find how long to poll before sleeping.
+ *
+ * A wait which usually ends while polling may take up to twice as
+ * long as usual before sleeping. Otherwise polling is not worth it.
+ *
+ * @param[in] wait the wait object
+ *
+ * @return the polling period, in ns
+ */
+static uint64_t wait_spin(const struct ptl_wait *wait)
+{
+    const uint64_t min = get_param(PTL_WAIT_SPIN_MIN);
+    const uint64_t max = get_param(PTL_WAIT_SPIN_MAX);
+    const uint64_t gap = wait->gap;
+
+    if (2 * gap > max)
+        return min;
+
+    return 2 * gap > min ? 2 * gap : min;
+}
+
+/**
+ * @brief Wait until something happens.
+ *
+ * The thread polls, then sleeps until a producer calls
+ * ptl_wait_wake(). The time the wait took is accounted for in the
+ * polling period of the next ones.
+ *
+ * @param[in] wait the wait object
+ * @param[in] ready tells whether the wait is over
+ * @param[in] arg the argument of ready
+ * @param[in] timeout_ns how long to wait, or PTL_WAIT_FOREVER
+ * @param[in] timeout_err the value to return on timeout
+ *
+ * @return PTL_OK once ready returned non-zero
+ * @return PTL_ABORTED if PtlAbort() was called
+ * @return timeout_err if the timeout expired first
+ */
+int ptl_wait_until(struct ptl_wait *wait, ptl_wait_ready_t ready,
+                   void *arg, uint64_t timeout_ns, int timeout_err)
+{
+    const uint64_t start = wait_now();
+    const uint64_t spin = wait_spin(wait);
+    uint64_t elapsed;
+    uint64_t left;
+    uint32_t seq;
+    int err;
+
+    while (1) {
+        if (ready(arg)) {
+            err = PTL_OK;
+            break;
+        }
+
+        err = check_abort_state();
+        if (err == PTL_ABORTED)
+            break;
+
+        elapsed = wait_now() - start;
+        if (elapsed >= timeout_ns) {
+            err = timeout_err;
+            break;
+        }
+
+        if (elapsed < spin) {
+            sched_yield();
+            continue;
+        }
+
+        /* Announce the sleep before the last check, so that a producer
+         * either sees the waiter or is seen by the check. */
+        seq = wait->seq;
+        atomic_inc(&wait->waiters);
+        __sync_synchronize();
+
+        if (ready(arg)) {
+            atomic_dec(&wait->waiters);
+            err = PTL_OK;
+            break;
+        }
+
+        left = timeout_ns - elapsed;
+        wait_sleep(&wait->seq, seq,
+                   left < WAIT_SLEEP_MAX ? left : WAIT_SLEEP_MAX);
+
+        atomic_dec(&wait->waiters);
+    }
+
+    if (err == PTL_OK) {
+        elapsed = wait_now() - start;
+        wait->gap += (elapsed >> WAIT_GAP_SHIFT) -
+            (wait->gap >> WAIT_GAP_SHIFT);
+    }
+
+    return err;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file ptl_wait.h
+ *
+ * Adaptive waiting interface declarations.
+ * @see ptl_wait.c
+ */
+
+#ifndef PTL_WAIT_H
+#define PTL_WAIT_H
+
+#include "ptl_sync.h"
+
+/** Wait without a timeout. */
+#define PTL_WAIT_FOREVER	UINT64_MAX
+
+/**
+ * Where the threads waiting on an EQ or a CT park.
+ *
+ * A waiter polls for a while, then sleeps on a futex on seq until a
+ * producer bumps it. The polling period follows how long the recent
+ * waits took, so that waits which usually end quickly never sleep,
+ * while waits which usually take long do not burn a core.
+ *
+ * It is shared with the light library clients, so it holds no
+ * pointers.
+ */
+struct ptl_wait {
+    uint32_t seq;                               /**< futex word, bumped
+						   by each wakeup */
+    atomic_t waiters;                           /**< threads sleeping,
+						   or about to */
+    uint64_t gap;                               /**< average length of
+						   the recent waits, in ns */
+};
+
+/**
+ * Whether what a thread waits for has happened.
+ *
+ * @param[in] arg the argument given to ptl_wait_until()
+ *
+ * @return non-zero when the wait is over
+ */
+typedef int (*ptl_wait_ready_t)(void *arg);
+
+void ptl_wait_init(struct ptl_wait *wait);
+
+int ptl_wait_until(struct ptl_wait *wait, ptl_wait_ready_t ready,
+                   void *arg, uint64_t timeout_ns, int timeout_err);
+
+void ptl_wait_wake_all(struct ptl_wait *wait);
+
+void ptl_wait_defer(void);
+
+void ptl_wait_flush(void);
+
+/**
+ * @brief Wake the threads sleeping on a wait object.
+ *
+ * Called by producers once the change waited for is visible. There is
+ * no system call unless a thread sleeps.
+ *
+ * @param[in] wait the wait object
+ */
+static inline void ptl_wait_wake(struct ptl_wait *wait)
+{
+    __sync_synchronize();
+
+    if (unlikely(atomic_read(&wait->waiters) > 0))
+        ptl_wait_wake_all(wait);
+}
+
+#endif /* PTL_WAIT_H */
@@ -0,0 +1,107 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "testing.h"
+
+/*
+ * Every rank of a physical NI puts its rank, twice, into its own slot
+ * of every other rank. With enough processes, this grows the table of
+ * connections of the NI while it is being used.
+ */
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_pt_index_t  pt_index;
+    uint64_t       *value;
+    uint64_t        src;
+    ptl_le_t        value_e;
+    ptl_handle_le_t value_e_handle;
+    ptl_md_t        md;
+    ptl_handle_md_t md_handle;
+    ptl_ct_event_t  ctc;
+    ptl_process_t  *procs;
+    int             num_procs;
+    int             rank;
+    int             i, n;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    rank = libtest_get_rank();
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_PHYSICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    procs = libtest_get_mapping(ni_h);
+    assert(procs);
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &pt_index));
+    assert(pt_index == 0);
+
+    value = calloc(num_procs, sizeof(uint64_t));
+    assert(value);
+
+    value_e.start     = value;
+    value_e.length    = num_procs * sizeof(uint64_t);
+    value_e.uid       = PTL_UID_ANY;
+    value_e.options   = PTL_LE_OP_PUT;
+    value_e.ct_handle = PTL_CT_NONE;
+    CHECK_RETURNVAL(PtlLEAppend(ni_h, 0, &value_e, PTL_PRIORITY_LIST, NULL,
+                                &value_e_handle));
+
+    src = rank;
+
+    md.start     = &src;
+    md.length    = sizeof(src);
+    md.options   = PTL_MD_EVENT_CT_ACK;
+    md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &md_handle));
+
+    libtest_barrier();
+
+    /* The second round finds the connections already there. */
+    for (n = 0; n < 2; n++) {
+        for (i = 1; i < num_procs; i++) {
+            ptl_process_t peer = procs[(rank + i) % num_procs];
+
+            CHECK_RETURNVAL(PtlPut(md_handle, 0, sizeof(src),
+                                   PTL_CT_ACK_REQ, peer, pt_index, 0,
+                                   rank * sizeof(uint64_t), NULL, 0));
+        }
+    }
+    CHECK_RETURNVAL(PtlCTWait(md.ct_handle, 2 * (num_procs - 1), &ctc));
+    assert(ctc.failure == 0);
+
+    libtest_barrier();
+
+    for (i = 0; i < num_procs; i++) {
+        if (i != rank)
+            assert(value[i] == i);
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(md_handle));
+    CHECK_RETURNVAL(PtlCTFree(md.ct_handle));
+    CHECK_RETURNVAL(PtlLEUnlink(value_e_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    free(value);
+
+    return 0;
+}
+
+/* vim:set expandtab: */
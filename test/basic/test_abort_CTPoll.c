@@ -173,7 +173,7 @@ int main(int   argc, char *argv[])
         printf("worker1 ret = %d\n", ret);
         printf("PTL_OK == %d\n", PTL_OK);
   
-        ret = PtlCTAlloc(ni_h, &ct_h);
+        ret = PtlCTAlloc(ni_h, &tdata0.ct_h);
         printf("eqAlloc: worker0 ret = %d\n", ret);
         ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
                          &pt_index);
@@ -226,7 +226,7 @@ int main(int   argc, char *argv[])
         printf("worker1 ret = %d\n", ret);
         printf("PTL_OK == %d\n", PTL_OK);
   
-        ret = PtlCTAlloc(ni_h, &ct_h);
+        ret = PtlCTAlloc(ni_h, &tdata0.ct_h);
         printf("eqAlloc: worker0 ret = %d\n", ret);
         ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
                          &pt_index);
@@ -282,7 +282,7 @@ int main(int   argc, char *argv[])
         printf("worker1 ret = %d\n", ret);
         printf("PTL_OK == %d\n", PTL_OK);
   
-        ret = PtlCTAlloc(ni_h, &ct_h);
+        ret = PtlCTAlloc(ni_h, &tdata0.ct_h);
         printf("eqAlloc: worker0 ret = %d\n", ret);
         ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
                          &pt_index);
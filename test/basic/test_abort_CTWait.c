@@ -204,7 +204,7 @@ int main(int   argc, char *argv[])
         printf("PTL_OK == %d\n", PTL_OK);
         printf("\n");    
   
-        ret = PtlCTAlloc(ni_h, &ct_h);
+        ret = PtlCTAlloc(ni_h, &tdata0.ct_h);
         printf("CTAlloc: worker0 ret = %d\n", ret);
         ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
                          &pt_index);
@@ -266,7 +266,7 @@ int main(int   argc, char *argv[])
         printf("PTL_OK == %d\n", PTL_OK);
         printf("\n");    
   
-        ret = PtlCTAlloc(ni_h, &ct_h);
+        ret = PtlCTAlloc(ni_h, &tdata0.ct_h);
         printf("CTAlloc: worker0 ret = %d\n", ret);
         ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
                          &pt_index);
@@ -327,7 +327,7 @@ int main(int   argc, char *argv[])
         printf("PTL_OK == %d\n", PTL_OK);
         printf("\n");
   
-        ret = PtlCTAlloc(ni_h, &ct_h);
+        ret = PtlCTAlloc(ni_h, &tdata0.ct_h);
         printf("CTAlloc: worker0 ret = %d\n", ret);
         ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
                          &pt_index);
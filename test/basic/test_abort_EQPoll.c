@@ -144,9 +144,9 @@ int main(int   argc, char *argv[])
         printf("worker1 ret = %d\n", ret);
         printf("PTL_OK == %d\n", PTL_OK);
   
-        ret = PtlEQAlloc(ni_h, 8192, &eq_h);
+        ret = PtlEQAlloc(ni_h, 8192, &tdata0.eq_h);
         printf("eqAlloc: worker0 ret = %d\n", ret);
-        ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
+        ret = PtlPTAlloc(ni_h, 0, tdata0.eq_h, PTL_PT_ANY,
                          &pt_index);
         printf("ptAlloc: worker0 ret = %d\n", ret);
     
@@ -200,9 +200,9 @@ int main(int   argc, char *argv[])
         printf("worker1 ret = %d\n", ret);
         printf("PTL_OK == %d\n", PTL_OK);
   
-        ret = PtlEQAlloc(ni_h, 8192, &eq_h);
+        ret = PtlEQAlloc(ni_h, 8192, &tdata0.eq_h);
         printf("eqAlloc: worker0 ret = %d\n", ret);
-        ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
+        ret = PtlPTAlloc(ni_h, 0, tdata0.eq_h, PTL_PT_ANY,
                          &pt_index);
         printf("ptAlloc: worker0 ret = %d\n", ret);
     
@@ -257,9 +257,9 @@ int main(int   argc, char *argv[])
         printf("worker1 ret = %d\n", ret);
         printf("PTL_OK == %d\n", PTL_OK);
   
-        ret = PtlEQAlloc(ni_h, 8192, &eq_h);
+        ret = PtlEQAlloc(ni_h, 8192, &tdata0.eq_h);
         printf("eqAlloc: worker0 ret = %d\n", ret);
-        ret = PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY,
+        ret = PtlPTAlloc(ni_h, 0, tdata0.eq_h, PTL_PT_ANY,
                          &pt_index);
         printf("ptAlloc: worker0 ret = %d\n", ret);
     
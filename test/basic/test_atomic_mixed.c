@@ -0,0 +1,163 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "testing.h"
+
+#define NUM_ELEMS 16
+#define NUM_ITERS 64
+
+/*
+ * Single element atomics and vector atomics hit the same elements of
+ * rank 0, along with long doubles, which the CPU cannot update
+ * natively.
+ */
+struct target {
+    uint64_t    counters[NUM_ELEMS];
+    double      min;
+    long double sum;
+};
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_logical;
+    ptl_process_t   myself;
+    ptl_process_t   r0 = { .rank = 0 };
+    ptl_pt_index_t  logical_pt_index;
+    struct target   target;
+    struct target   source;
+    uint64_t        fetched;
+    ptl_le_t        value_e;
+    ptl_handle_le_t value_e_handle;
+    ptl_md_t        md;
+    ptl_handle_md_t md_handle;
+    ptl_md_t        fetch_md;
+    ptl_handle_md_t fetch_md_handle;
+    ptl_ct_event_t  ctc;
+    int             num_procs;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_logical));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_logical, num_procs,
+                              libtest_get_mapping(ni_logical)));
+
+    CHECK_RETURNVAL(PtlGetId(ni_logical, &myself));
+    CHECK_RETURNVAL(PtlPTAlloc(ni_logical, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &logical_pt_index));
+    assert(logical_pt_index == 0);
+
+    for (i = 0; i < NUM_ELEMS; i++)
+        target.counters[i] = 0;
+    target.min = 1e9;
+    target.sum = 0;
+
+    if (myself.rank == 0) {
+        value_e.start     = &target;
+        value_e.length    = sizeof(target);
+        value_e.uid       = PTL_UID_ANY;
+        value_e.options   = PTL_LE_OP_PUT | PTL_LE_OP_GET;
+        value_e.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlLEAppend(ni_logical, 0, &value_e,
+                                    PTL_PRIORITY_LIST, NULL,
+                                    &value_e_handle));
+    }
+
+    for (i = 0; i < NUM_ELEMS; i++)
+        source.counters[i] = 1;
+    source.min = myself.rank;
+    source.sum = 0.5;
+
+    md.start     = &source;
+    md.length    = sizeof(source);
+    md.options   = PTL_MD_EVENT_CT_ACK;
+    md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_logical, &md, &md_handle));
+
+    fetch_md.start     = &fetched;
+    fetch_md.length    = sizeof(fetched);
+    fetch_md.options   = PTL_MD_EVENT_CT_REPLY;
+    fetch_md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &fetch_md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_logical, &fetch_md, &fetch_md_handle));
+
+    libtest_barrier();
+
+    for (i = 0; i < NUM_ITERS; i++) {
+        /* One element at a time. */
+        CHECK_RETURNVAL(PtlFetchAtomic(fetch_md_handle, 0, md_handle, 0,
+                                       sizeof(uint64_t), r0,
+                                       logical_pt_index, 0,
+                                       (i % NUM_ELEMS) * sizeof(uint64_t),
+                                       NULL, 0, PTL_SUM, PTL_UINT64_T));
+
+        /* All of them. */
+        CHECK_RETURNVAL(PtlAtomic(md_handle, 0,
+                                  NUM_ELEMS * sizeof(uint64_t),
+                                  PTL_CT_ACK_REQ, r0, logical_pt_index, 0, 0,
+                                  NULL, 0, PTL_SUM, PTL_UINT64_T));
+
+        CHECK_RETURNVAL(PtlAtomic(md_handle, offsetof(struct target, min),
+                                  sizeof(double), PTL_CT_ACK_REQ, r0,
+                                  logical_pt_index, 0,
+                                  offsetof(struct target, min), NULL, 0,
+                                  PTL_MIN, PTL_DOUBLE));
+
+        CHECK_RETURNVAL(PtlAtomic(md_handle, offsetof(struct target, sum),
+                                  sizeof(long double), PTL_CT_ACK_REQ, r0,
+                                  logical_pt_index, 0,
+                                  offsetof(struct target, sum), NULL, 0,
+                                  PTL_SUM, PTL_LONG_DOUBLE));
+
+        CHECK_RETURNVAL(PtlCTWait(fetch_md.ct_handle, i + 1, &ctc));
+        assert(ctc.failure == 0);
+        assert(fetched < (uint64_t)(2 * NUM_ITERS * num_procs));
+    }
+
+    CHECK_RETURNVAL(PtlCTWait(md.ct_handle, 3 * NUM_ITERS, &ctc));
+    assert(ctc.failure == 0);
+
+    libtest_barrier();
+
+    if (myself.rank == 0) {
+        CHECK_RETURNVAL(PtlAtomicSync());
+
+        for (i = 0; i < NUM_ELEMS; i++) {
+            assert(target.counters[i] ==
+                   (uint64_t)(num_procs * (NUM_ITERS + NUM_ITERS / NUM_ELEMS)));
+        }
+        assert(target.min == 0);
+        assert(target.sum == 0.5L * NUM_ITERS * num_procs);
+
+        CHECK_RETURNVAL(PtlLEUnlink(value_e_handle));
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(fetch_md_handle));
+    CHECK_RETURNVAL(PtlCTFree(fetch_md.ct_handle));
+    CHECK_RETURNVAL(PtlMDRelease(md_handle));
+    CHECK_RETURNVAL(PtlCTFree(md.ct_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_logical, logical_pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_logical));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,147 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "testing.h"
+
+#define MAXLEN (1024 * 1024 + 64)
+
+/*
+ * Every rank puts buffers of various sizes into its own region of
+ * rank 0, and gets them back. Cross memory attach is turned off, so
+ * the shared memory transport splits the larger ones over several
+ * bounce buffers.
+ */
+static const ptl_size_t sizes[] = { 5000, 40000, 123457, 1024 * 1024 + 7 };
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_logical;
+    ptl_process_t   myself;
+    ptl_process_t   r0 = { .rank = 0 };
+    ptl_pt_index_t  logical_pt_index;
+    unsigned char  *value = NULL;
+    unsigned char  *src, *dst;
+    ptl_le_t        value_e;
+    ptl_handle_le_t value_e_handle;
+    ptl_md_t        md;
+    ptl_handle_md_t md_handle;
+    ptl_md_t        read_md;
+    ptl_handle_md_t read_md_handle;
+    ptl_ct_event_t  ctc;
+    ptl_size_t      offset;
+    ptl_size_t      i;
+    int             num_procs;
+    int             n;
+
+    setenv("PTL_SHMEM_CMA", "0", 1);
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_logical));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_logical, num_procs,
+                              libtest_get_mapping(ni_logical)));
+
+    CHECK_RETURNVAL(PtlGetId(ni_logical, &myself));
+    CHECK_RETURNVAL(PtlPTAlloc(ni_logical, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &logical_pt_index));
+    assert(logical_pt_index == 0);
+
+    if (myself.rank == 0) {
+        value = malloc(num_procs * MAXLEN);
+        assert(value);
+
+        value_e.start     = value;
+        value_e.length    = num_procs * MAXLEN;
+        value_e.uid       = PTL_UID_ANY;
+        value_e.options   = PTL_LE_OP_PUT | PTL_LE_OP_GET;
+        value_e.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlLEAppend(ni_logical, 0, &value_e,
+                                    PTL_PRIORITY_LIST, NULL,
+                                    &value_e_handle));
+    }
+
+    src = malloc(MAXLEN);
+    dst = malloc(MAXLEN);
+    assert(src && dst);
+
+    md.start     = src;
+    md.length    = MAXLEN;
+    md.options   = PTL_MD_EVENT_CT_ACK;
+    md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_logical, &md, &md_handle));
+
+    read_md.start     = dst;
+    read_md.length    = MAXLEN;
+    read_md.options   = PTL_MD_EVENT_CT_REPLY;
+    read_md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &read_md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_logical, &read_md, &read_md_handle));
+
+    libtest_barrier();
+
+    offset = myself.rank * MAXLEN;
+
+    for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+        for (i = 0; i < sizes[n]; i++)
+            src[i] = (unsigned char)(i * 7 + n + myself.rank);
+        memset(dst, 0, MAXLEN);
+
+        CHECK_RETURNVAL(PtlPut(md_handle, 0, sizes[n], PTL_CT_ACK_REQ, r0,
+                               logical_pt_index, 0, offset, NULL, 0));
+        CHECK_RETURNVAL(PtlCTWait(md.ct_handle, n + 1, &ctc));
+        assert(ctc.failure == 0);
+
+        CHECK_RETURNVAL(PtlGet(read_md_handle, 0, sizes[n], r0,
+                               logical_pt_index, 0, offset, NULL));
+        CHECK_RETURNVAL(PtlCTWait(read_md.ct_handle, n + 1, &ctc));
+        assert(ctc.failure == 0);
+
+        for (i = 0; i < sizes[n]; i++) {
+            if (dst[i] != src[i]) {
+                fprintf(stderr, "bad value at idx %lu of %lu\n",
+                        (unsigned long)i, (unsigned long)sizes[n]);
+                abort();
+            }
+        }
+        assert(dst[sizes[n]] == 0);
+    }
+
+    libtest_barrier();
+
+    if (myself.rank == 0) {
+        CHECK_RETURNVAL(PtlLEUnlink(value_e_handle));
+        free(value);
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(read_md_handle));
+    CHECK_RETURNVAL(PtlCTFree(read_md.ct_handle));
+    CHECK_RETURNVAL(PtlMDRelease(md_handle));
+    CHECK_RETURNVAL(PtlCTFree(md.ct_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_logical, logical_pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_logical));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    free(src);
+    free(dst);
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,120 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "testing.h"
+
+#define NUM_PUTS 16
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_pt_index_t  pt_index;
+    uint64_t        slots[NUM_PUTS];
+    uint64_t        writevals[NUM_PUTS];
+    ptl_le_t        value_e;
+    ptl_handle_le_t value_e_handle;
+    ptl_md_t        write_md;
+    ptl_handle_md_t write_md_handle;
+    ptl_process_t   peer;
+    ptl_ct_event_t  ctc;
+    int             num_procs;
+    int             rank;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    rank = libtest_get_rank();
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_h, num_procs,
+                              libtest_get_mapping(ni_h)));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &pt_index));
+    assert(pt_index == 0);
+
+    for (i = 0; i < NUM_PUTS; i++) {
+        slots[i]     = 0;
+        writevals[i] = ((uint64_t)rank << 32) | (i + 1);
+    }
+
+    value_e.start   = slots;
+    value_e.length  = sizeof(slots);
+    value_e.uid     = PTL_UID_ANY;
+    value_e.options = PTL_LE_OP_PUT | PTL_LE_EVENT_CT_COMM;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &value_e.ct_handle));
+    CHECK_RETURNVAL(PtlLEAppend(ni_h, 0, &value_e, PTL_PRIORITY_LIST, NULL,
+                                &value_e_handle));
+
+    write_md.start     = writevals;
+    write_md.length    = sizeof(writevals);
+    write_md.options   = PTL_MD_EVENT_CT_ACK;
+    write_md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &write_md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &write_md, &write_md_handle));
+
+    libtest_barrier();
+
+    peer.rank = (rank + 1) % num_procs;
+
+    /* Nested bundles only start their operations at the outermost end. */
+    CHECK_RETURNVAL(PtlStartBundle(ni_h));
+    CHECK_RETURNVAL(PtlStartBundle(ni_h));
+    for (i = 0; i < NUM_PUTS; i++) {
+        CHECK_RETURNVAL(PtlPut(write_md_handle, i * sizeof(uint64_t),
+                               sizeof(uint64_t), PTL_CT_ACK_REQ, peer,
+                               pt_index, 0, i * sizeof(uint64_t), NULL, 0));
+    }
+    CHECK_RETURNVAL(PtlEndBundle(ni_h));
+
+    CHECK_RETURNVAL(PtlCTGet(write_md.ct_handle, &ctc));
+    assert(ctc.success == 0 && ctc.failure == 0);
+
+    CHECK_RETURNVAL(PtlEndBundle(ni_h));
+
+    CHECK_RETURNVAL(PtlCTWait(write_md.ct_handle, NUM_PUTS, &ctc));
+    assert(ctc.failure == 0);
+
+    NO_FAILURES(value_e.ct_handle, NUM_PUTS);
+
+    libtest_barrier();
+
+    for (i = 0; i < NUM_PUTS; i++) {
+        uint64_t expected = ((uint64_t)((rank + num_procs - 1) % num_procs)
+                             << 32) | (i + 1);
+
+        if (slots[i] != expected) {
+            fprintf(stderr, "slot %d received %llx instead of %llx\n", i,
+                    (unsigned long long)slots[i],
+                    (unsigned long long)expected);
+            abort();
+        }
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(write_md_handle));
+    CHECK_RETURNVAL(PtlCTFree(write_md.ct_handle));
+    CHECK_RETURNVAL(PtlLEUnlink(value_e_handle));
+    CHECK_RETURNVAL(PtlCTFree(value_e.ct_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
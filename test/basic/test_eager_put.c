@@ -0,0 +1,184 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "testing.h"
+
+#define BURST     200
+#define BURST_LEN 4000
+#define AREA      (1024 * 1024)
+
+static unsigned char pattern(ptl_size_t offset)
+{
+    return (offset * 7 + offset / 251) & 0xff;
+}
+
+/*
+ * Rank 0 puts messages of sizes around the immediate and eager limits
+ * into rank 1, from a contiguous MD and from an iovec MD, then a
+ * burst of mid-size puts that needs more eager buffers than there
+ * are. Rank 1 checks that everything landed where it should. Cross
+ * memory attach is turned off, so the puts above the eager limit go
+ * through the bounce buffers.
+ */
+int main(int   argc,
+         char *argv[])
+{
+    static const ptl_size_t sizes[] = {
+        100, 1000, 2000, 8000, 16 * 1024, 20000, 40000
+    };
+    const int       num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    ptl_handle_ni_t ni_h;
+    ptl_pt_index_t  pt_index;
+    unsigned char  *src;
+    unsigned char  *dst;
+    ptl_iovec_t     iov[3];
+    ptl_le_t        dst_e;
+    ptl_handle_le_t dst_e_handle;
+    ptl_md_t        md;
+    ptl_handle_md_t md_handle;
+    ptl_md_t        iov_md;
+    ptl_handle_md_t iov_md_handle;
+    ptl_ct_event_t  ctc;
+    ptl_process_t  *procs;
+    ptl_process_t   peer;
+    ptl_size_t      offset;
+    ptl_size_t      i;
+    int             rank;
+    int             num_puts;
+    int             n;
+
+    setenv("PTL_SHMEM_CMA", "0", 1);
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    rank = libtest_get_rank();
+
+    if (libtest_get_size() != 2) {
+        fprintf(stderr, "test_eager_put needs exactly 2 processes\n");
+        return 77;
+    }
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    procs = libtest_get_mapping(ni_h);
+    CHECK_RETURNVAL(PtlSetMap(ni_h, 2, procs));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &pt_index));
+    assert(pt_index == 0);
+
+    src = malloc(AREA);
+    dst = calloc(1, AREA);
+    assert(src && dst);
+
+    for (i = 0; i < AREA; i++)
+        src[i] = pattern(i);
+
+    dst_e.start     = dst;
+    dst_e.length    = AREA;
+    dst_e.uid       = PTL_UID_ANY;
+    dst_e.options   = PTL_LE_OP_PUT;
+    dst_e.ct_handle = PTL_CT_NONE;
+    CHECK_RETURNVAL(PtlLEAppend(ni_h, 0, &dst_e, PTL_PRIORITY_LIST, NULL,
+                                &dst_e_handle));
+
+    md.start     = src;
+    md.length    = AREA;
+    md.options   = PTL_MD_EVENT_CT_ACK;
+    md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &md_handle));
+
+    /* The same memory, cut in uneven pieces. */
+    iov[0].iov_base = src;
+    iov[0].iov_len  = 3000;
+    iov[1].iov_base = src + 3000;
+    iov[1].iov_len  = 17;
+    iov[2].iov_base = src + 3017;
+    iov[2].iov_len  = AREA - 3017;
+
+    iov_md.start     = iov;
+    iov_md.length    = 3;
+    iov_md.options   = PTL_IOVEC | PTL_MD_EVENT_CT_ACK;
+    iov_md.eq_handle = PTL_EQ_NONE;
+    iov_md.ct_handle = md.ct_handle;
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &iov_md, &iov_md_handle));
+
+    libtest_barrier();
+
+    if (rank == 0) {
+        peer.rank = 1;
+        num_puts = 0;
+
+        /* Each put lands at its own offset, from the same offset. */
+        offset = 0;
+        for (n = 0; n < num_sizes; n++) {
+            CHECK_RETURNVAL(PtlPut(md_handle, offset, sizes[n],
+                                   PTL_CT_ACK_REQ, peer, pt_index, 0,
+                                   offset, NULL, 0));
+            offset += sizes[n];
+
+            CHECK_RETURNVAL(PtlPut(iov_md_handle, offset, sizes[n],
+                                   PTL_CT_ACK_REQ, peer, pt_index, 0,
+                                   offset, NULL, 0));
+            offset += sizes[n];
+
+            num_puts += 2;
+        }
+
+        /* Don't wait for the acks, so the eager buffers run out. */
+        for (n = 0; n < BURST; n++) {
+            CHECK_RETURNVAL(PtlPut(md_handle, offset, BURST_LEN,
+                                   PTL_CT_ACK_REQ, peer, pt_index, 0,
+                                   offset, NULL, 0));
+            offset += BURST_LEN;
+            num_puts++;
+        }
+
+        CHECK_RETURNVAL(PtlCTWait(md.ct_handle, num_puts, &ctc));
+        assert(ctc.failure == 0);
+    }
+
+    libtest_barrier();
+
+    if (rank == 1) {
+        offset = 0;
+        for (n = 0; n < num_sizes; n++)
+            offset += 2 * sizes[n];
+        offset += BURST * BURST_LEN;
+        assert(offset <= AREA);
+
+        for (i = 0; i < AREA; i++) {
+            if (i < offset)
+                assert(dst[i] == pattern(i));
+            else
+                assert(dst[i] == 0);
+        }
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(iov_md_handle));
+    CHECK_RETURNVAL(PtlMDRelease(md_handle));
+    CHECK_RETURNVAL(PtlCTFree(md.ct_handle));
+    CHECK_RETURNVAL(PtlLEUnlink(dst_e_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    free(src);
+    free(dst);
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,144 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "testing.h"
+
+#define NUM_PUTS 8
+#define BATCH    5
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_pt_index_t  pt_index;
+    uint64_t        slots[NUM_PUTS];
+    uint64_t        writevals[NUM_PUTS];
+    ptl_le_t        value_e;
+    ptl_handle_le_t value_e_handle;
+    ptl_md_t        write_md;
+    ptl_handle_md_t write_md_handle;
+    ptl_handle_eq_t eq_h;
+    ptl_process_t   peer;
+    ptl_event_t     evs[BATCH];
+    unsigned int    num;
+    unsigned int    which;
+    int             seen[PTL_EVENT_SEARCH + 1] = { 0 };
+    int             num_procs;
+    int             rank;
+    int             total;
+    int             ret;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    rank = libtest_get_rank();
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_h, num_procs,
+                              libtest_get_mapping(ni_h)));
+
+    CHECK_RETURNVAL(PtlEQAlloc(ni_h, 1024, &eq_h));
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, eq_h, PTL_PT_ANY, &pt_index));
+    assert(pt_index == 0);
+
+    for (i = 0; i < NUM_PUTS; i++) {
+        slots[i]     = 0;
+        writevals[i] = i + 1;
+    }
+
+    value_e.start     = slots;
+    value_e.length    = sizeof(slots);
+    value_e.uid       = PTL_UID_ANY;
+    value_e.options   = PTL_LE_OP_PUT | PTL_LE_EVENT_LINK_DISABLE |
+                        PTL_LE_EVENT_UNLINK_DISABLE;
+    value_e.ct_handle = PTL_CT_NONE;
+    CHECK_RETURNVAL(PtlLEAppend(ni_h, 0, &value_e, PTL_PRIORITY_LIST, NULL,
+                                &value_e_handle));
+
+    write_md.start     = writevals;
+    write_md.length    = sizeof(writevals);
+    write_md.options   = 0;
+    write_md.eq_handle = eq_h;
+    write_md.ct_handle = PTL_CT_NONE;
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &write_md, &write_md_handle));
+
+    /* An empty queue and a zero sized array. */
+    ret = PtlEQGetMany(eq_h, BATCH, evs, &num);
+    assert(ret == PTL_EQ_EMPTY);
+    ret = PtlEQGetMany(eq_h, 0, evs, &num);
+    assert(ret == PTL_ARG_INVALID);
+
+    libtest_barrier();
+
+    peer.rank = (rank + 1) % num_procs;
+
+    for (i = 0; i < NUM_PUTS; i++) {
+        CHECK_RETURNVAL(PtlPut(write_md_handle, i * sizeof(uint64_t),
+                               sizeof(uint64_t), PTL_ACK_REQ, peer,
+                               pt_index, 0, i * sizeof(uint64_t), NULL, 0));
+    }
+
+    /* Each put yields a send and an ack here, and a put on the peer. */
+    total = 0;
+    while (total < 3 * NUM_PUTS) {
+        if (total & 1)
+            ret = PtlEQGetMany(eq_h, BATCH, evs, &num);
+        else
+            ret = PtlEQPollMany(&eq_h, 1, PTL_TIME_FOREVER, BATCH, evs,
+                                &num, &which);
+
+        if (ret == PTL_EQ_EMPTY)
+            continue;
+
+        assert(ret == PTL_OK);
+        assert(num >= 1 && num <= BATCH);
+
+        for (i = 0; i < num; i++) {
+            assert(evs[i].ni_fail_type == PTL_NI_OK);
+            assert(evs[i].type == PTL_EVENT_SEND ||
+                   evs[i].type == PTL_EVENT_ACK ||
+                   evs[i].type == PTL_EVENT_PUT);
+            seen[evs[i].type]++;
+        }
+        total += num;
+    }
+
+    assert(total == 3 * NUM_PUTS);
+    assert(seen[PTL_EVENT_SEND] == NUM_PUTS);
+    assert(seen[PTL_EVENT_ACK] == NUM_PUTS);
+    assert(seen[PTL_EVENT_PUT] == NUM_PUTS);
+
+    ret = PtlEQPollMany(&eq_h, 1, 0, BATCH, evs, &num, &which);
+    assert(ret == PTL_EQ_EMPTY);
+
+    libtest_barrier();
+
+    for (i = 0; i < NUM_PUTS; i++) {
+        assert(slots[i] == i + 1);
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(write_md_handle));
+    CHECK_RETURNVAL(PtlLEUnlink(value_e_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlEQFree(eq_h));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
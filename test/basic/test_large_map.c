@@ -0,0 +1,127 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "testing.h"
+
+#define MAP_SIZE (100 * 1000)
+
+/*
+ * A logical NI with a large map, where only a few ranks are real. The
+ * other ones are never talked to, so no connection must be needed for
+ * them. The real ranks are at the end of the map.
+ */
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_logical;
+    ptl_process_t  *real_map;
+    ptl_process_t  *map;
+    ptl_process_t   myself;
+    ptl_process_t   target;
+    ptl_pt_index_t  logical_pt_index;
+    uint64_t       *value = NULL;
+    uint64_t        src;
+    ptl_le_t        value_e;
+    ptl_handle_le_t value_e_handle;
+    ptl_md_t        md;
+    ptl_handle_md_t md_handle;
+    ptl_ct_event_t  ctc;
+    ptl_rank_t      first;
+    int             num_procs;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+    first = MAP_SIZE - num_procs;
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_logical));
+
+    real_map = libtest_get_mapping(ni_logical);
+
+    map = malloc(MAP_SIZE * sizeof(ptl_process_t));
+    assert(map);
+
+    /* Nobody listens on the first ranks. */
+    for (i = 0; i < first; i++) {
+        map[i].phys.nid = real_map[0].phys.nid + 1 + i / 10000;
+        map[i].phys.pid = i % 10000;
+    }
+    for (i = 0; i < num_procs; i++)
+        map[first + i] = real_map[i];
+
+    CHECK_RETURNVAL(PtlSetMap(ni_logical, MAP_SIZE, map));
+
+    CHECK_RETURNVAL(PtlGetId(ni_logical, &myself));
+    assert(myself.rank >= first);
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_logical, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &logical_pt_index));
+    assert(logical_pt_index == 0);
+
+    if (myself.rank == first) {
+        value = calloc(num_procs, sizeof(uint64_t));
+        assert(value);
+
+        value_e.start     = value;
+        value_e.length    = num_procs * sizeof(uint64_t);
+        value_e.uid       = PTL_UID_ANY;
+        value_e.options   = PTL_LE_OP_PUT;
+        value_e.ct_handle = PTL_CT_NONE;
+        CHECK_RETURNVAL(PtlLEAppend(ni_logical, 0, &value_e,
+                                    PTL_PRIORITY_LIST, NULL,
+                                    &value_e_handle));
+    }
+
+    src = myself.rank;
+
+    md.start     = &src;
+    md.length    = sizeof(src);
+    md.options   = PTL_MD_EVENT_CT_ACK;
+    md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_logical, &md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_logical, &md, &md_handle));
+
+    libtest_barrier();
+
+    target.rank = first;
+    CHECK_RETURNVAL(PtlPut(md_handle, 0, sizeof(src), PTL_CT_ACK_REQ, target,
+                           logical_pt_index, 0,
+                           (myself.rank - first) * sizeof(uint64_t), NULL,
+                           0));
+    CHECK_RETURNVAL(PtlCTWait(md.ct_handle, 1, &ctc));
+    assert(ctc.failure == 0);
+
+    libtest_barrier();
+
+    if (myself.rank == first) {
+        for (i = 0; i < num_procs; i++)
+            assert(value[i] == first + i);
+
+        CHECK_RETURNVAL(PtlLEUnlink(value_e_handle));
+        free(value);
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(md_handle));
+    CHECK_RETURNVAL(PtlCTFree(md.ct_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_logical, logical_pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_logical));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    free(map);
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,164 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "testing.h"
+
+#define NUM_ORDERED 5
+#define NUM_EXACT   100
+#define EXACT_BITS  0x1000
+
+/* Entries appended in this order. A put must land in the first entry
+ * that matches, whether it is a wildcard or an exact entry. */
+static const struct {
+    ptl_match_bits_t match_bits;
+    ptl_match_bits_t ignore_bits;
+    unsigned int     options;
+} ordered[NUM_ORDERED] = {
+    { 0x10, 0xf, PTL_ME_USE_ONCE },
+    { 0x11, 0x0, PTL_ME_USE_ONCE },
+    { 0x11, 0x0, 0 },
+    { 0x21, 0x0, PTL_ME_USE_ONCE },
+    { 0x20, 0xf, 0 },
+};
+
+/* Bits of each put, and the entry it is expected to land in. */
+static const ptl_match_bits_t put_bits[NUM_ORDERED] = {
+    0x11, 0x11, 0x11, 0x21, 0x21
+};
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_process_t   myself;
+    ptl_pt_index_t  pt_index;
+    uint64_t        slots[NUM_ORDERED + NUM_EXACT];
+    uint64_t        writevals[NUM_ORDERED + NUM_EXACT];
+    ptl_me_t        value_e;
+    ptl_handle_me_t handles[NUM_ORDERED + NUM_EXACT];
+    ptl_handle_ct_t value_ct;
+    ptl_md_t        write_md;
+    ptl_handle_md_t write_md_handle;
+    ptl_ct_event_t  ctc;
+    int             num_procs;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_h, num_procs,
+                              libtest_get_mapping(ni_h)));
+
+    CHECK_RETURNVAL(PtlGetId(ni_h, &myself));
+
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &pt_index));
+    assert(pt_index == 0);
+
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &value_ct));
+
+    for (i = 0; i < NUM_ORDERED + NUM_EXACT; i++) {
+        slots[i]     = 0;
+        writevals[i] = i + 1;
+    }
+
+    value_e.length   = sizeof(uint64_t);
+    value_e.uid      = PTL_UID_ANY;
+    value_e.match_id = myself;
+    value_e.ct_handle = value_ct;
+
+    for (i = 0; i < NUM_ORDERED; i++) {
+        value_e.start       = &slots[i];
+        value_e.match_bits  = ordered[i].match_bits;
+        value_e.ignore_bits = ordered[i].ignore_bits;
+        value_e.options     = PTL_ME_OP_PUT | PTL_ME_EVENT_CT_COMM |
+                              ordered[i].options;
+        CHECK_RETURNVAL(PtlMEAppend(ni_h, 0, &value_e, PTL_PRIORITY_LIST,
+                                    NULL, &handles[i]));
+    }
+
+    /* Enough exact entries to populate many hash buckets. */
+    for (i = 0; i < NUM_EXACT; i++) {
+        value_e.start       = &slots[NUM_ORDERED + i];
+        value_e.match_bits  = EXACT_BITS + i;
+        value_e.ignore_bits = 0;
+        value_e.options     = PTL_ME_OP_PUT | PTL_ME_EVENT_CT_COMM;
+        CHECK_RETURNVAL(PtlMEAppend(ni_h, 0, &value_e, PTL_PRIORITY_LIST,
+                                    NULL, &handles[NUM_ORDERED + i]));
+    }
+
+    libtest_barrier();
+
+    write_md.start     = writevals;
+    write_md.length    = sizeof(writevals);
+    write_md.options   = PTL_MD_EVENT_CT_ACK;
+    write_md.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &write_md.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &write_md, &write_md_handle));
+
+    /* One put at a time so that each one sees the list as left by
+     * the previous one. */
+    for (i = 0; i < NUM_ORDERED; i++) {
+        CHECK_RETURNVAL(PtlPut(write_md_handle, i * sizeof(uint64_t),
+                               sizeof(uint64_t), PTL_CT_ACK_REQ, myself,
+                               pt_index, put_bits[i], 0, NULL, 0));
+        CHECK_RETURNVAL(PtlCTWait(write_md.ct_handle, i + 1, &ctc));
+        assert(ctc.failure == 0);
+    }
+
+    /* Hit the exact entries in the reverse order of their append. */
+    for (i = NUM_EXACT - 1; i >= 0; i--) {
+        CHECK_RETURNVAL(PtlPut(write_md_handle,
+                               (NUM_ORDERED + i) * sizeof(uint64_t),
+                               sizeof(uint64_t), PTL_CT_ACK_REQ, myself,
+                               pt_index, EXACT_BITS + i, 0, NULL, 0));
+        CHECK_RETURNVAL(PtlCTWait(write_md.ct_handle,
+                                  NUM_ORDERED + NUM_EXACT - i, &ctc));
+        assert(ctc.failure == 0);
+    }
+
+    NO_FAILURES(value_ct, NUM_ORDERED + NUM_EXACT);
+
+    for (i = 0; i < NUM_ORDERED + NUM_EXACT; i++) {
+        if (slots[i] != writevals[i]) {
+            fprintf(stderr, "entry %d received %llu instead of %llu\n", i,
+                    (unsigned long long)slots[i],
+                    (unsigned long long)writevals[i]);
+            abort();
+        }
+    }
+
+    CHECK_RETURNVAL(PtlMDRelease(write_md_handle));
+    CHECK_RETURNVAL(PtlCTFree(write_md.ct_handle));
+
+    /* The use once entries are already gone. */
+    for (i = 0; i < NUM_ORDERED + NUM_EXACT; i++) {
+        if (i < NUM_ORDERED && (ordered[i].options & PTL_ME_USE_ONCE))
+            continue;
+        CHECK_RETURNVAL(PtlMEUnlink(handles[i]));
+    }
+    CHECK_RETURNVAL(PtlCTFree(value_ct));
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
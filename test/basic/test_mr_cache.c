@@ -0,0 +1,114 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "testing.h"
+
+#define NUM_BUFS    16
+#define MAX_ENTRIES 4
+
+static ptl_sr_value_t status(ptl_handle_ni_t ni_h, ptl_sr_index_t index)
+{
+    ptl_sr_value_t value;
+
+    CHECK_RETURNVAL(PtlNIStatus(ni_h, index, &value));
+
+    return value;
+}
+
+/* Bind and release an MD, which registers its memory. */
+static void bind_release(ptl_handle_ni_t ni_h, void *addr, ptl_size_t length)
+{
+    ptl_iovec_t     iov = { .iov_base = addr, .iov_len = length };
+    ptl_md_t        md;
+    ptl_handle_md_t md_h;
+
+    md.start     = &iov;
+    md.length    = 1;
+    md.options   = PTL_IOVEC;
+    md.eq_handle = PTL_EQ_NONE;
+    md.ct_handle = PTL_CT_NONE;
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &md_h));
+    CHECK_RETURNVAL(PtlMDRelease(md_h));
+}
+
+/*
+ * The registration cache keeps the regions once their MD is released,
+ * evicts the oldest ones beyond its limit, and forgets the memory
+ * unmapped by the application. The memory hooks stand in for
+ * ummunotify where it is missing.
+ */
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    long            pagesize = sysconf(_SC_PAGESIZE);
+    size_t          size = 2 * NUM_BUFS * pagesize;
+    unsigned char  *bufs;
+    ptl_sr_value_t  hits, misses, evictions;
+    int             i;
+
+    setenv("PTL_MR_CACHE_ENTRIES", "4", 1);
+    setenv("PTL_MR_HOOKS", "1", 1);
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_MATCHING | PTL_NI_PHYSICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    /* One page out of two, so the regions are never merged. */
+    bufs = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(bufs != MAP_FAILED);
+
+    hits = status(ni_h, PTL_SR_MR_CACHE_HITS);
+    misses = status(ni_h, PTL_SR_MR_CACHE_MISSES);
+    evictions = status(ni_h, PTL_SR_MR_CACHE_EVICTIONS);
+
+    bind_release(ni_h, bufs, 100);
+    bind_release(ni_h, bufs + 10, 50);
+    assert(status(ni_h, PTL_SR_MR_CACHE_MISSES) == misses + 1);
+    assert(status(ni_h, PTL_SR_MR_CACHE_HITS) == hits + 1);
+
+    for (i = 0; i < NUM_BUFS; i++)
+        bind_release(ni_h, bufs + 2 * i * pagesize, pagesize);
+    assert(status(ni_h, PTL_SR_MR_CACHE_MISSES) == misses + NUM_BUFS);
+    assert(status(ni_h, PTL_SR_MR_CACHE_HITS) == hits + 2);
+    assert(status(ni_h, PTL_SR_MR_CACHE_EVICTIONS) ==
+           evictions + NUM_BUFS - MAX_ENTRIES);
+
+    /* The last ones are still cached, until the memory goes away. */
+    bind_release(ni_h, bufs + 2 * (NUM_BUFS - 1) * pagesize, pagesize);
+    assert(status(ni_h, PTL_SR_MR_CACHE_HITS) == hits + 3);
+
+    evictions = status(ni_h, PTL_SR_MR_CACHE_EVICTIONS);
+    assert(munmap(bufs, size) == 0);
+
+    /* ummunotify reports the unmapping from the progress thread. */
+    for (i = 0; i < 1000; i++) {
+        if (status(ni_h, PTL_SR_MR_CACHE_EVICTIONS) ==
+            evictions + MAX_ENTRIES)
+            break;
+        usleep(1000);
+    }
+    assert(status(ni_h, PTL_SR_MR_CACHE_EVICTIONS) ==
+           evictions + MAX_ENTRIES);
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,106 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "testing.h"
+
+#define NUM_THREADS 4
+#define NUM_OBJS    128
+#define NUM_ROUNDS  64
+
+/*
+ * Threads allocate MDs and CTs, and each frees those of another
+ * thread, so that objects move between the thread caches of the pools
+ * and the pools grow and shrink.
+ */
+static ptl_handle_ni_t   ni_h;
+static ptl_handle_md_t   mds[NUM_THREADS][NUM_OBJS];
+static ptl_handle_ct_t   cts[NUM_THREADS][NUM_OBJS];
+static char              buffer[NUM_THREADS][NUM_OBJS];
+static pthread_barrier_t barrier;
+
+static void *worker(void *arg)
+{
+    int            me = (intptr_t)arg;
+    int            other = (me + 1) % NUM_THREADS;
+    ptl_md_t       md;
+    ptl_ct_event_t ctc;
+    int            round;
+    int            i;
+
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        for (i = 0; i < NUM_OBJS; i++) {
+            CHECK_RETURNVAL(PtlCTAlloc(ni_h, &cts[me][i]));
+
+            md.start     = &buffer[me][i];
+            md.length    = 1;
+            md.options   = PTL_MD_EVENT_CT_SEND;
+            md.eq_handle = PTL_EQ_NONE;
+            md.ct_handle = cts[me][i];
+            CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &mds[me][i]));
+        }
+
+        for (i = 0; i < NUM_OBJS; i++) {
+            ctc.success = me * NUM_OBJS + i;
+            ctc.failure = round;
+            CHECK_RETURNVAL(PtlCTSet(cts[me][i], ctc));
+        }
+
+        pthread_barrier_wait(&barrier);
+
+        /* Check and free the objects of another thread. */
+        for (i = 0; i < NUM_OBJS; i++) {
+            CHECK_RETURNVAL(PtlCTGet(cts[other][i], &ctc));
+            assert(ctc.success == other * NUM_OBJS + i);
+            assert(ctc.failure == round);
+
+            CHECK_RETURNVAL(PtlMDRelease(mds[other][i]));
+            CHECK_RETURNVAL(PtlCTFree(cts[other][i]));
+        }
+
+        pthread_barrier_wait(&barrier);
+    }
+
+    return NULL;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    pthread_t threads[NUM_THREADS];
+    int       i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_MATCHING | PTL_NI_PHYSICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+
+    for (i = 0; i < NUM_THREADS; i++)
+        assert(pthread_create(&threads[i], NULL, worker,
+                              (void *)(intptr_t)i) == 0);
+
+    for (i = 0; i < NUM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_barrier_destroy(&barrier);
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,86 @@
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "testing.h"
+
+#define NUM_ITERS 1000
+
+/*
+ * Handles of freed objects must be rejected, even once their objects
+ * are allocated again.
+ */
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_handle_ct_t ct_h;
+    ptl_handle_ct_t stale_h;
+    ptl_handle_md_t md_h;
+    ptl_handle_md_t stale_md_h;
+    ptl_ct_event_t  ctc;
+    ptl_md_t        md;
+    char            buffer[8];
+    int             ret;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_MATCHING | PTL_NI_PHYSICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &stale_h));
+    CHECK_RETURNVAL(PtlCTFree(stale_h));
+
+    ret = PtlCTGet(stale_h, &ctc);
+    assert(ret == PTL_ARG_INVALID);
+
+    md.start     = buffer;
+    md.length    = sizeof(buffer);
+    md.options   = 0;
+    md.eq_handle = PTL_EQ_NONE;
+    md.ct_handle = PTL_CT_NONE;
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &stale_md_h));
+    CHECK_RETURNVAL(PtlMDRelease(stale_md_h));
+
+    for (i = 0; i < NUM_ITERS; i++) {
+        /* Most likely the same objects again. */
+        CHECK_RETURNVAL(PtlCTAlloc(ni_h, &ct_h));
+        CHECK_RETURNVAL(PtlMDBind(ni_h, &md, &md_h));
+
+        CHECK_RETURNVAL(PtlCTGet(ct_h, &ctc));
+
+        if (ct_h != stale_h) {
+            ret = PtlCTGet(stale_h, &ctc);
+            assert(ret == PTL_ARG_INVALID);
+        }
+
+        if (md_h != stale_md_h) {
+            ret = PtlMDRelease(stale_md_h);
+            assert(ret == PTL_ARG_INVALID);
+        }
+
+        CHECK_RETURNVAL(PtlMDRelease(md_h));
+        CHECK_RETURNVAL(PtlCTFree(ct_h));
+
+        /* These handles are stale from now on. */
+        stale_h = ct_h;
+        stale_md_h = md_h;
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -277,7 +277,12 @@ int main(int   argc,
     recv_e.length = sizeof(recvval);
     recv_e.uid    = PTL_UID_ANY;
 #if INTERFACE == 1
+# if MATCH_SRC == 1
+    /* only accept the put from the rank that targets us */
+    recv_e.match_id.rank = (rank + num_procs - 1) % num_procs;
+# else
     recv_e.match_id.rank = PTL_RANK_ANY;
+# endif
     recv_e.match_bits    = 1;
     recv_e.ignore_bits   = 0;
     recv_e.options       = OPTIONS | PTL_ME_USE_ONCE;
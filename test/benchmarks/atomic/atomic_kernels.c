@@ -0,0 +1,185 @@
+/*
+ * Atomic kernels: reports the rate in GB/s at which the target side
+ * kernels of the library combine incoming atomic data into memory,
+ * for each op and type, with each instruction set the CPU supports.
+ *
+ * Usage: atomic_kernels [size in bytes]
+ *
+ * The size defaults to the default PTL_LIM_MAX_ATOMIC_SIZE. Larger
+ * sizes show the rate the kernels reach once the call overhead is
+ * amortized.
+ */
+
+#include "ptl_loc.h"
+
+#include <time.h>
+
+#define DEFAULT_SIZE 512
+#define MIN_TIME_NS  (50 * 1000 * 1000ULL)
+
+static const char *op_name[PTL_OP_LAST] = {
+    [PTL_MIN] = "MIN",
+    [PTL_MAX] = "MAX",
+    [PTL_SUM] = "SUM",
+    [PTL_PROD] = "PROD",
+    [PTL_LOR] = "LOR",
+    [PTL_LAND] = "LAND",
+    [PTL_BOR] = "BOR",
+    [PTL_BAND] = "BAND",
+    [PTL_LXOR] = "LXOR",
+    [PTL_BXOR] = "BXOR",
+};
+
+static const char *type_name[PTL_DATATYPE_LAST] = {
+    [PTL_INT8_T] = "INT8",
+    [PTL_UINT8_T] = "UINT8",
+    [PTL_INT16_T] = "INT16",
+    [PTL_UINT16_T] = "UINT16",
+    [PTL_INT32_T] = "INT32",
+    [PTL_UINT32_T] = "UINT32",
+    [PTL_FLOAT] = "FLOAT",
+    [PTL_INT64_T] = "INT64",
+    [PTL_UINT64_T] = "UINT64",
+    [PTL_DOUBLE] = "DOUBLE",
+    [PTL_FLOAT_COMPLEX] = "FLOAT_COMPLEX",
+    [PTL_DOUBLE_COMPLEX] = "DOUBLE_COMPLEX",
+    [PTL_LONG_DOUBLE] = "LONG_DOUBLE",
+    [PTL_LONG_DOUBLE_COMPLEX] = "LONG_DOUBLE_COMPLEX",
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Fill the buffers with small values, so that sums and products do
+ * not overflow into infinities, whose handling may be slow.
+ */
+static void fill(ptl_datatype_t type, void *dst, void *src, size_t size)
+{
+    size_t i;
+
+    switch (type) {
+        case PTL_FLOAT:
+        case PTL_FLOAT_COMPLEX:
+            for (i = 0; i < size / sizeof(float); i++) {
+                ((float *)dst)[i] = 1.0f;
+                ((float *)src)[i] = 1.0f;
+            }
+            break;
+        case PTL_DOUBLE:
+        case PTL_DOUBLE_COMPLEX:
+            for (i = 0; i < size / sizeof(double); i++) {
+                ((double *)dst)[i] = 1.0;
+                ((double *)src)[i] = 1.0;
+            }
+            break;
+        case PTL_LONG_DOUBLE:
+        case PTL_LONG_DOUBLE_COMPLEX:
+            for (i = 0; i < size / sizeof(long double); i++) {
+                ((long double *)dst)[i] = 1.0L;
+                ((long double *)src)[i] = 1.0L;
+            }
+            break;
+        default:
+            memset(dst, 1, size);
+            memset(src, 1, size);
+            break;
+    }
+}
+
+/* Return the rate of a kernel in GB/s. */
+static double measure(atom_op_t kernel, ptl_datatype_t type, void *dst,
+                      void *src, size_t size)
+{
+    unsigned long long start;
+    unsigned long long elapsed;
+    unsigned long long bytes = 0;
+    int i;
+
+    fill(type, dst, src, size);
+
+    /* Warm up. */
+    kernel(dst, src, size);
+
+    start = now_ns();
+    do {
+        for (i = 0; i < 1000; i++)
+            kernel(dst, src, size);
+        bytes += 1000ULL * size;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_TIME_NS);
+
+    return (double)bytes / elapsed;
+}
+
+int main(int   argc,
+         char *argv[])
+{
+    static atom_op_t kernels[ATOMIC_ISA_LAST][PTL_OP_LAST][PTL_DATATYPE_LAST];
+    size_t size = DEFAULT_SIZE;
+    void *dst;
+    void *src;
+    int isa;
+    int op;
+    int type;
+
+    if (argc > 1)
+        size = strtoul(argv[1], NULL, 0);
+    if (size == 0) {
+        fprintf(stderr, "usage: %s [size in bytes]\n", argv[0]);
+        return 1;
+    }
+
+    init_param();
+
+    for (isa = 0; isa < ATOMIC_ISA_LAST; isa++) {
+        if (atomic_isa_ok(isa)) {
+            atomic_isa_use(isa);
+            memcpy(kernels[isa], atom_op, sizeof(atom_op));
+        }
+    }
+
+    if (posix_memalign(&dst, 64, size) || posix_memalign(&src, 64, size)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("# %zu bytes, GB/s\n", size);
+    printf("%-6s %-20s", "op", "type");
+    for (isa = 0; isa < ATOMIC_ISA_LAST; isa++)
+        printf(" %8s", atomic_isa_name(isa));
+    printf("\n");
+
+    for (op = 0; op < PTL_OP_LAST; op++) {
+        if (!op_name[op])
+            continue;
+
+        for (type = 0; type < PTL_DATATYPE_LAST; type++) {
+            if (!atom_op[op][type])
+                continue;
+
+            printf("%-6s %-20s", op_name[op], type_name[type]);
+            for (isa = 0; isa < ATOMIC_ISA_LAST; isa++) {
+                if (kernels[isa][op][type])
+                    printf(" %8.2f", measure(kernels[isa][op][type], type,
+                                             dst, src, size));
+                else
+                    printf(" %8s", "-");
+            }
+            printf("\n");
+        }
+    }
+
+    free(dst);
+    free(src);
+
+    return 0;
+}
+
+/* vim:set expandtab: */
@@ -0,0 +1,144 @@
+/*
+ * Put goodput: rank 0 streams puts of increasing sizes to rank 1,
+ * keeping WINDOW of them in flight, and reports the rate at which
+ * acknowledged payload got through.
+ *
+ * Meant to exercise the reliability layer of the UDP transport, e.g.
+ * with PTL_RUDP_LOSS=50 to drop 5% of the datagrams in a build
+ * configured with --enable-rudp-loss.
+ */
+
+#include <portals4.h>
+#include <support.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#define ITERS    1000
+#define WINDOW   64
+#define MIN_SIZE 8
+#define MAX_SIZE (64 * 1024)
+
+#define CHECK_RETURNVAL(x) do { int ret;                                                                                                                              \
+                                switch (ret = x) {                                                                                                                    \
+                                    case PTL_IGNORED: case PTL_OK: break;                                                                                             \
+                                    case PTL_FAIL: fprintf(stderr, "=> %s returned PTL_FAIL (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;               \
+                                    case PTL_NO_SPACE: fprintf(stderr, "=> %s returned PTL_NO_SPACE (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;       \
+                                    case PTL_ARG_INVALID: fprintf(stderr, "=> %s returned PTL_ARG_INVALID (line %u)\n", # x, (unsigned int)__LINE__); abort(); break; \
+                                    case PTL_NO_INIT: fprintf(stderr, "=> %s returned PTL_NO_INIT (line %u)\n", # x, (unsigned int)__LINE__); abort(); break;         \
+                                    default: fprintf(stderr, "=> %s returned failcode %i (line %u)\n", # x, ret, (unsigned int)__LINE__); abort(); break;             \
+                                } } while (0)
+
+int main(int   argc,
+         char *argv[])
+{
+    ptl_handle_ni_t ni_h;
+    ptl_pt_index_t  pt_index;
+    ptl_process_t   myself;
+    ptl_process_t   peer;
+    ptl_le_t        sink;
+    ptl_handle_le_t sink_h;
+    ptl_md_t        source;
+    ptl_handle_md_t source_h;
+    ptl_ct_event_t  ctc;
+    struct timeval  start, stop;
+    char           *buffer;
+    ptl_size_t      acked = 0;
+    size_t          size;
+    int             num_procs;
+    int             i;
+
+    CHECK_RETURNVAL(PtlInit());
+
+    CHECK_RETURNVAL(libtest_init());
+
+    num_procs = libtest_get_size();
+    if (num_procs != 2) {
+        fprintf(stderr, "put_goodput needs exactly 2 processes\n");
+        return 77;
+    }
+
+    CHECK_RETURNVAL(PtlNIInit(PTL_IFACE_DEFAULT,
+                              PTL_NI_NO_MATCHING | PTL_NI_LOGICAL,
+                              PTL_PID_ANY, NULL, NULL, &ni_h));
+
+    CHECK_RETURNVAL(PtlSetMap(ni_h, num_procs, libtest_get_mapping(ni_h)));
+
+    CHECK_RETURNVAL(PtlGetId(ni_h, &myself));
+    CHECK_RETURNVAL(PtlPTAlloc(ni_h, 0, PTL_EQ_NONE, PTL_PT_ANY,
+                               &pt_index));
+    assert(pt_index == 0);
+
+    buffer = calloc(1, MAX_SIZE);
+    assert(buffer);
+
+    /* Every put lands on the same buffer, only the bytes count. */
+    sink.start   = buffer;
+    sink.length  = MAX_SIZE;
+    sink.uid     = PTL_UID_ANY;
+    sink.options = PTL_LE_OP_PUT | PTL_LE_EVENT_CT_COMM |
+                   PTL_LE_EVENT_COMM_DISABLE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &sink.ct_handle));
+    CHECK_RETURNVAL(PtlLEAppend(ni_h, pt_index, &sink, PTL_PRIORITY_LIST,
+                                NULL, &sink_h));
+
+    source.start     = buffer;
+    source.length    = MAX_SIZE;
+    source.options   = PTL_MD_EVENT_CT_ACK;
+    source.eq_handle = PTL_EQ_NONE;
+    CHECK_RETURNVAL(PtlCTAlloc(ni_h, &source.ct_handle));
+    CHECK_RETURNVAL(PtlMDBind(ni_h, &source, &source_h));
+
+    libtest_barrier();
+
+    peer.rank = 1 - myself.rank;
+
+    if (myself.rank == 0) {
+        printf("%10s %12s %12s\n", "bytes", "usec", "MB/s");
+    }
+
+    for (size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+        if (myself.rank == 0) {
+            double elapsed;
+
+            gettimeofday(&start, NULL);
+            for (i = 0; i < ITERS; i++) {
+                if (i >= WINDOW) {
+                    CHECK_RETURNVAL(PtlCTWait(source.ct_handle,
+                                              acked + i - WINDOW + 1, &ctc));
+                }
+                CHECK_RETURNVAL(PtlPut(source_h, 0, size, PTL_CT_ACK_REQ,
+                                       peer, pt_index, 0, 0, NULL, 0));
+            }
+            acked += ITERS;
+            CHECK_RETURNVAL(PtlCTWait(source.ct_handle, acked, &ctc));
+            assert(ctc.failure == 0);
+            gettimeofday(&stop, NULL);
+
+            elapsed = (stop.tv_sec - start.tv_sec) * 1e6 +
+                      (stop.tv_usec - start.tv_usec);
+            printf("%10lu %12.0f %12.2f\n", (unsigned long)size, elapsed,
+                   (double)size * ITERS / elapsed);
+        }
+
+        libtest_barrier();
+    }
+
+    /* cleanup */
+    CHECK_RETURNVAL(PtlMDRelease(source_h));
+    CHECK_RETURNVAL(PtlCTFree(source.ct_handle));
+    CHECK_RETURNVAL(PtlLEUnlink(sink_h));
+    CHECK_RETURNVAL(PtlCTFree(sink.ct_handle));
+    CHECK_RETURNVAL(PtlPTFree(ni_h, pt_index));
+    CHECK_RETURNVAL(PtlNIFini(ni_h));
+    CHECK_RETURNVAL(libtest_fini());
+    free(buffer);
+    PtlFini();
+
+    return 0;
+}
+
+/* vim:set expandtab: */
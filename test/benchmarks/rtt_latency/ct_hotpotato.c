@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 
 #define LOOPS 1000000
 
@@ -42,6 +43,7 @@ int main(int   argc,
     ptl_pt_index_t  logical_pt_index;
     ptl_process_t   myself;
     struct timeval  start, stop;
+    struct rusage   ustart, ustop;
     int             potato = 0;
     ENTRY_T         potato_catcher;
     HANDLE_T        potato_catcher_handle;
@@ -107,6 +109,7 @@ int main(int   argc,
         nextrank.rank  = myself.rank + 1;
         nextrank.rank *= (nextrank.rank <= num_procs - 1);
         gettimeofday(&start, NULL);
+        getrusage(RUSAGE_SELF, &ustart);
         CHECK_RETURNVAL(PtlPut(potato_launcher_handle, 0, potato_launcher.length,
                                (LOOPS == 1) ? PTL_OC_ACK_REQ : PTL_NO_ACK_REQ,
                                nextrank, logical_pt_index, 1, 0,
@@ -147,11 +150,18 @@ int main(int   argc,
     if (myself.rank == 0) {
         double accumulate = 0.0;
         gettimeofday(&stop, NULL);
+        getrusage(RUSAGE_SELF, &ustop);
         accumulate =
             (stop.tv_sec + stop.tv_usec * 1e-6) - (start.tv_sec +
                                                    start.tv_usec * 1e-6);
         /* calculate the average time waiting */
         printf("Total time: %g secs\n", accumulate);
+        /* how much CPU the waits burnt meanwhile */
+        printf("CPU time: %g secs user, %g secs system\n",
+               (ustop.ru_utime.tv_sec - ustart.ru_utime.tv_sec) +
+               (ustop.ru_utime.tv_usec - ustart.ru_utime.tv_usec) * 1e-6,
+               (ustop.ru_stime.tv_sec - ustart.ru_stime.tv_sec) +
+               (ustop.ru_stime.tv_usec - ustart.ru_stime.tv_usec) * 1e-6);
         accumulate /= LOOPS;
         printf("Average time around the loop: %g microseconds\n",
                accumulate * 1e6);
@@ -135,6 +135,7 @@ ptl_process_t*
 libtest_get_mapping(ptl_handle_ni_t ni_h)
 {
     int i, ret, max_name_len, max_key_len, max_val_len;
+    int block, count;
     char *name, *key, *val;
     ptl_process_t my_id;
     struct map_t *map = NULL;
@@ -181,21 +182,25 @@ libtest_get_mapping(ptl_handle_ni_t ni_h)
         return NULL;
     }
 
-    /* put my information */
-    snprintf(key, max_key_len, "libsupport-%lu-%lu-nid", 
-             (long unsigned) ni_h, (long unsigned) rank);
-    if (0 != encode(&my_id.phys.nid, sizeof(my_id.phys.nid), val, 
-                    max_val_len)) {
-        return NULL;
-    }
-    if (PMI_SUCCESS != PMI_KVS_Put(name, key, val)) {
-        return NULL;
-    }
+    map->mapping = malloc(sizeof(ptl_process_t) * size);
+    if (NULL == map->mapping) return NULL;
 
-    snprintf(key, max_key_len, "libsupport-%lu-%lu-pid",
+    /*
+     * The ranks are split in blocks of consecutive ranks, as many as
+     * fit in a single value. The first rank of each block gathers the
+     * ids of its block and publishes them together, so everyone only
+     * needs one get per block instead of one per rank. Only half of
+     * the value length is used, as the simple PMI wire protocol also
+     * limits the whole command line, key and name included, to about
+     * that size.
+     */
+    block = (max_val_len / 2 - 1) / (2 * sizeof(ptl_process_t));
+    if (block < 1) return NULL;
+
+    /* put my information */
+    snprintf(key, max_key_len, "libsupport-%lu-%lu",
              (long unsigned) ni_h, (long unsigned) rank);
-    if (0 != encode(&my_id.phys.pid, sizeof(my_id.phys.pid), val, 
-                    max_val_len)) {
+    if (0 != encode(&my_id, sizeof(my_id), val, max_val_len)) {
         return NULL;
     }
     if (PMI_SUCCESS != PMI_KVS_Put(name, key, val)) {
@@ -210,32 +215,63 @@ libtest_get_mapping(ptl_handle_ni_t ni_h)
         return NULL;
     }
 
-    /* get everyone's information */
-    map->mapping = malloc(sizeof(ptl_process_t) * size);
-    if (NULL == map->mapping) return NULL;
+    /* gather and put my block's information */
+    if (0 == rank % block) {
+        count = size - rank < block ? size - rank : block;
+
+        map->mapping[rank] = my_id;
+        for (i = rank + 1 ; i < rank + count ; ++i) {
+            snprintf(key, max_key_len, "libsupport-%lu-%lu",
+                     (long unsigned) ni_h, (long unsigned) i);
+            if (PMI_SUCCESS != PMI_KVS_Get(name, key, val, max_val_len)) {
+                return NULL;
+            }
+            if (0 != decode(val, &(map->mapping)[i],
+                            sizeof((map->mapping)[i]))) {
+                return NULL;
+            }
+        }
 
-    for (i = 0 ; i < size ; ++i) {
-        snprintf(key, max_key_len, "libsupport-%lu-%lu-nid",
-                 (long unsigned) ni_h, (long unsigned) i);
-        if (PMI_SUCCESS != PMI_KVS_Get(name, key, val, max_val_len)) {
+        snprintf(key, max_key_len, "libsupport-%lu-block-%lu",
+                 (long unsigned) ni_h, (long unsigned) (rank / block));
+        if (0 != encode(&(map->mapping)[rank],
+                        count * sizeof(ptl_process_t), val, max_val_len)) {
             return NULL;
         }
-        if (0 != decode(val, &(map->mapping)[i].phys.nid, 
-                        sizeof((map->mapping)[i].phys.nid))) {
+        if (PMI_SUCCESS != PMI_KVS_Put(name, key, val)) {
             return NULL;
         }
 
-        snprintf(key, max_key_len, "libsupport-%lu-%lu-pid",
-                 (long unsigned) ni_h, (long unsigned) i);
+        if (PMI_SUCCESS != PMI_KVS_Commit(name)) {
+            return NULL;
+        }
+    }
+
+    if (PMI_SUCCESS != PMI_Barrier()) {
+        return NULL;
+    }
+
+    /* get everyone's information */
+    for (i = 0 ; i < size ; i += block) {
+        if (i == rank) continue;
+
+        count = size - i < block ? size - i : block;
+
+        snprintf(key, max_key_len, "libsupport-%lu-block-%lu",
+                 (long unsigned) ni_h, (long unsigned) (i / block));
         if (PMI_SUCCESS != PMI_KVS_Get(name, key, val, max_val_len)) {
             return NULL;
         }
-        if (0 != decode(val, &(map->mapping)[i].phys.pid,
-                        sizeof((map->mapping)[i].phys.pid))) {
+        if (0 != decode(val, &(map->mapping)[i],
+                        count * sizeof(ptl_process_t))) {
             return NULL;
         }
     }
 
+    free(name);
+    free(key);
+    free(val);
+
     return map->mapping;
 }
 